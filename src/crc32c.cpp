@@ -0,0 +1,79 @@
+#include "crc32c.h"
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_HAVE_SSE42_PATH 1
+#include <nmmintrin.h>
+#endif
+
+// Slicing-by-8 tables, built on first use.
+static uint32_t crc_table[8][256];
+
+static bool BuildTables() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c >> 1) ^ ((c & 1) ? 0x82F63B78u : 0);
+    crc_table[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = crc_table[0][i];
+    for (int t = 1; t < 8; t++) {
+      c = crc_table[0][c & 0xFF] ^ (c >> 8);
+      crc_table[t][i] = c;
+    }
+  }
+  return true;
+}
+
+static uint32_t Crc32cSoftware(uint32_t crc, const uint8_t *p, size_t len) {
+  static const bool tables_ready = BuildTables();
+  (void)tables_ready;
+
+  while (len >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;
+    crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+          crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+          crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+          crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len--)
+    crc = crc_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42_PATH
+__attribute__((target("sse4.2"))) static uint32_t
+Crc32cSse42(uint32_t crc, const uint8_t *p, size_t len) {
+#ifdef __x86_64__
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    crc64 = _mm_crc32_u64(crc64, v);
+    p += 8;
+    len -= 8;
+  }
+  crc = (uint32_t)crc64;
+#endif
+  while (len--)
+    crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+#endif
+
+uint32_t Crc32cUpdate(uint32_t crc, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+#ifdef CRC32C_HAVE_SSE42_PATH
+  static const bool have_sse42 = __builtin_cpu_supports("sse4.2");
+  if (have_sse42)
+    return Crc32cSse42(crc, p, len);
+#endif
+  return Crc32cSoftware(crc, p, len);
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli) as used by PostgreSQL for WAL records and control
+// files. Usage mirrors pg_crc32c.h:
+//
+//   uint32_t crc = CRC32C_INIT;
+//   crc = Crc32cUpdate(crc, data, len);
+//   ...
+//   crc = Crc32cFinish(crc);
+//
+// Uses the SSE4.2 crc32 instruction when the CPU has it.
+#define CRC32C_INIT 0xFFFFFFFFu
+
+uint32_t Crc32cUpdate(uint32_t crc, const void *data, size_t len);
+inline uint32_t Crc32cFinish(uint32_t crc) { return crc ^ 0xFFFFFFFFu; }
@@ -1,4 +1,5 @@
 #include "imgui_hex.h"
+#include "wal_perf.h"
 #include <imgui.h>
 #include <imgui_internal.h>
 #include <ctype.h>
@@ -306,6 +307,8 @@ static void RenderByteDecorations(ImDrawList* draw_list, const ImRect& bb, ImCol
 
 bool ImGui::BeginHexEditor(const char* str_id, ImGuiHexEditorState* state, const ImVec2& size, ImGuiChildFlags child_flags, ImGuiWindowFlags window_flags)
 {
+	WalPerfScope perf(WalPerfSection::HexRender);
+
 	if (!ImGui::BeginChild(str_id, size, child_flags, window_flags))
 		return false;
 
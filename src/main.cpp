@@ -2,10 +2,16 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <stdio.h>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #define GL_SILENCE_DEPRECATION
 #include <GLFW/glfw3.h> // Will drag system OpenGL headers
@@ -13,10 +19,29 @@
 namespace fs = std::filesystem;
 
 #include "imgui_hex.h"  // Include the hex editor header
+#include "wal_archive.h"  // Compressed archive segments
+#include "wal_attr_fetch.h" // Column layouts, one relation at a time
+#include "wal_catalog.h"  // Names from the data directory
+#include "wal_catalog_fetch.h" // Catalogs of every database at once
+#include "wal_catalog_snapshot.h" // Names saved between runs
+#include "wal_control.h"  // Offline pg_control
+#include "wal_prefetch.h" // Background loading of neighbouring segments
+#include "wal_dir_scan.h" // Directory overview
+#include "wal_filter.h" // Record filter expressions
+#include "wal_fpi_bloat.h" // Full-page image sizes per wal_compression
+#include "wal_hotspot.h" // Most modified pages
 #include "wal_parser.h" // Include WAL parser
+#include "wal_perf.h"   // Timings for the performance overlay
+#include "wal_record_table.h" // Record list
+#include "wal_tail.h"   // Latest records, read backwards
+#include "wal_time_index.h" // Jump to a wall-clock time
+#include "wal_trace.h"  // Chrome trace export
+#include "wal_tuple.h"  // Column values of heap tuples
+#include "wal_xact.h"   // Transaction outcomes
 #include <libpq-fe.h>   // PostgreSQL LibPQ
 #include <map>
 #include <nlohmann/json.hpp>
+#include <set>
 #include <sstream> // Added for string building
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -24,6 +49,19 @@ namespace fs = std::filesystem;
 
 using json = nlohmann::json;
 
+// Every allocation is counted for the performance overlay's allocations per
+// frame. A relaxed increment is cheap enough to leave on.
+static std::atomic<uint64_t> alloc_count{0};
+
+void *operator new(size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
 static void glfw_error_callback(int error, const char *description) {
   fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
@@ -88,8 +126,11 @@ static std::map<std::string, std::string> LoadJsonConfig() {
 // Hex Editor State
 static ImGuiHexEditorState hex_state;
 
-// File loading state
-static std::vector<uint8_t> file_data;
+// File loading state. Zero pages are not held; the hex editor reads through
+// HexReadCallback.
+static WalSparseSegment file_data;
+// What the bodies of the records in view say, decoded as rows are drawn
+static WalRecordDescCache record_details;
 static char file_path[256] = "";
 static char error_msg[256] = "";
 static std::vector<std::string> files;
@@ -108,105 +149,283 @@ static std::string wal_dir_path = "/home/rajesh/proj/wal_viewer/build/pg_wal";
 static bool should_scroll_to_bottom = false;
 static uint64_t current_file_base_lsn =
     0; // The starting LSN of the current file
-static const uint64_t WAL_SEGMENT_SIZE = 16 * 1024 * 1024;
 
 // WAL State
 static WalParser wal_parser;
+static WalSegmentCache segment_cache; // Recently viewed, parsed segments
+static WalPrefetcher prefetcher(&segment_cache); // Neighbouring segments
+static uint64_t wal_end_lsn = 0; // Where the parser stopped, and why
+// The latest segment opens with only its last tail_records records, read
+// backwards along xl_prev (TAIL_RECORDS in .env, 0 parses it whole).
+static int tail_records = 1000;
+static std::string tail_status; // Set while only a tail is loaded
+static WalEndReason wal_end_reason = WalEndReason::None;
 static std::vector<WalRecordInfo> wal_records;
 
 // DB State
 static char db_conn_str[512] = "host=localhost dbname=postgres";
-static std::map<uint32_t, std::string> rel_names;
-static std::map<uint32_t, std::string> rel_names_oid;
+// Relation and namespace names of every database, by (database OID,
+// relfilenode) as block references name them.
+static WalRelNameMap rel_names;
 static std::map<uint32_t, std::string> db_names;
 
 static char db_status[128] = "Disconnected";
+// Where fetched catalogs are saved between runs (CATALOG_CACHE_DIR in .env,
+// empty to always fetch them whole).
+static std::string catalog_cache_dir = WalDefaultCacheDir();
+// Databases whose catalogs are fetched at the same time
+// (CATALOG_CONNECTIONS in .env).
+static int catalog_connections = 4;
 
 // Table Filter Globals
 struct RelItem {
+  uint32_t db;
   uint32_t id;
   std::string name;
 };
 static std::vector<RelItem> table_filter_items;
 static int selected_table_idx = -1; // -1 for All
 
-// Namespace Filter Globals
-static std::map<uint32_t, std::string> namespace_names; // OID -> Name
-static std::map<uint32_t, uint32_t>
-    rel_namespace; // RelNode -> Namespace OID (via OID map logic? No,
-                   // OID->NamespaceOID)
-// Actually we need RelOID -> NamespaceOID.
-// But WAL record has RelNode. We map RelNode -> RelOID in ConnectToDB if
-// needed? In ConnectToDB: rel_names maps RelNode -> Name. rel_names_oid maps
-// OID -> Name. We should map RelNode -> NamespaceOID
-static std::map<uint32_t, uint32_t> relnode_to_namespace_oid;
-
+// Namespace Filter Globals. Namespace OIDs differ between databases, so
+// the combo lists each name once and filters by name.
 struct NamespaceItem {
-  uint32_t id;
   std::string name;
 };
 static std::vector<NamespaceItem> namespace_filter_items;
 static int selected_namespace_idx = -1; // -1 for All
 
+// Memory budget (MEMORY_BUDGET_MB in .env). The segment on screen, the
+// prefetched neighbours and the name maps are counted first; the segment
+// cache gets what is left and evicts least recently viewed segments.
+static int memory_budget_mb = 512;
+static size_t memory_view_bytes = 0;
+static size_t memory_prefetch_bytes = 0;
+static size_t memory_names_bytes = 0;
+
+// Record filter. The RMID/namespace/table combos are turned into clauses and
+// and-ed with the expression typed into the filter bar, then compiled once.
+// filtered_indices is rebuilt only when the records or the filter change.
+static char filter_expr[512] = "";
+static WalFilter record_filter;
+static std::string filter_error;
+static std::vector<uint32_t> filtered_indices;
+static bool filter_dirty = true;
+
 // Active DB State
+// Directory overview
+static bool show_overview = false;
+static bool overview_dirty = true;
+static std::vector<WalSegmentSummary> overview_segments;
+static double overview_scan_ms = 0.0;
+
+// Block hotspots of the listed records, recounted when the list changes
+static bool show_hotspots = false;
+static bool hotspots_dirty = true;
+static WalHotspotSketch hotspot_sketch;
+static double hotspot_ms = 0.0;
+static int hotspot_count = 25;
+
+// Full-page image bytes per wal_compression setting, over the listed
+// records. Recompressing takes a while, so it only runs on request.
+static bool show_fpi_bloat = false;
+static bool fpi_bloat_stale = true;
+static WalFpiAnalyzer fpi_analyzer;
+static std::vector<WalFpiRelStats> fpi_relations; // Sorted once per analysis
+static size_t fpi_not_held = 0; // Tail records from earlier segments
+static double fpi_bloat_ms = 0.0;
+
+// Performance overlay
+static bool show_perf = false;
+static uint64_t perf_frame_allocs = 0; // Allocations during the last frame
+static size_t perf_rss_bytes = 0;
+static double perf_rss_time = 0.0;
+static char trace_path[256] = "wal_viewer_trace.json";
+static std::string trace_status;
+
 static std::string active_wal_filename;
 static uint64_t active_wal_lsn = 0;
-static uint32_t highlighted_xid = 0; // 0 means no specific XID selected
-
-static uint64_t ParseWalFilename(const std::string &filename) {
-  if (filename.length() != 24)
-    return 0;
-  // Format: TLI(8) Log(8) Seg(8)
-  std::string logStr = filename.substr(8, 8);
-  std::string segStr = filename.substr(16, 8);
 
-  uint32_t logId = 0;
-  uint32_t segId = 0;
+// Data directory, from PGDATA in the config or the parent of wal_dir_path.
+// Its pg_control gives the last checkpoint, so without a live server the
+// viewer opens at the redo pointer, where crash recovery would start.
+static std::string data_dir_path;
+static WalControlFile control_file;
+static bool control_loaded = false;
+static std::string control_error;
+static uint32_t highlighted_xid = 0; // 0 means no specific XID selected
 
-  try {
-    logId = std::stoul(logStr, nullptr, 16);
-    segId = std::stoul(segStr, nullptr, 16);
-    return ((uint64_t)logId << 32) | ((uint64_t)segId * WAL_SEGMENT_SIZE);
-  } catch (...) {
-    return 0;
-  }
-}
+// Fate of every transaction in the loaded records, for row tints and the
+// list of those still open at the end
+static WalXactIndex xact_index;
+static bool show_xacts = false;
+
+// Wall-clock time -> LSN over the whole folder, saved in the cache dir.
+// Brought up to date in the background before each jump; the timeline
+// charts the WAL written per second from the same samples.
+static WalTimeIndex time_index;
+static WalTimeIndex time_index_next; // Built by time_index_thread
+static std::thread time_index_thread;
+static std::atomic<bool> time_index_busy{false};
+static std::atomic<size_t> time_index_done{0};
+static size_t time_index_total = 0;
+static std::string time_index_error;
+static bool show_timeline = false;
+static char jump_time[64] = "";
+static bool jump_pending = false; // Jump once the index is up to date
+static std::string jump_status;
+
+// Column values of the last Heap record clicked, decoded with the layout of
+// its relation, which is fetched from the server the first time it's needed
+static WalAttributeFetcher attr_fetcher;
+static bool show_columns = false;
+static uint64_t selected_lsn = 0;
+static uint64_t columns_lsn = 0; // Record the tuples were taken from
+static std::vector<WalHeapTuple> columns_tuples;
+static std::string columns_why; // Why there are none
+static std::shared_ptr<const WalTupleLayout> columns_layout;
+static std::vector<std::vector<WalColumnValue>> columns_values;
 
 // Global UI State for Offset
 static uint64_t search_lsn = 0;
 
 // --- Helper Functions ---
 
-static void LoadCurrentFile() {
+static void EnforceMemoryBudget();
+
+// One pass over the loaded records. Commit and abort bodies are read from
+// the held segment; records a tail took from earlier segments aren't in
+// it, so their transactions only count as seen.
+static void BuildXactIndex() {
+  xact_index.Clear();
+  std::vector<uint8_t> bytes;
+  for (const WalRecordInfo &rec : wal_records) {
+    bool held = rec.RMID == RM_XACT_ID && rec.LSN >= current_file_base_lsn &&
+                WalReadRecordBytes(file_data, rec.Offset, rec.Length, bytes);
+    xact_index.Add(rec, held ? bytes.data() : nullptr, rec.Length);
+  }
+}
+
+// Loads files[current_file_idx]. With start_lsn, only the records from
+// there on are parsed, e.g. from the checkpoint's redo pointer.
+static void LoadCurrentFile(uint64_t start_lsn = 0) {
   if (current_file_idx >= 0 && current_file_idx < files.size()) {
     // fs::path handles separators correctly
     fs::path full_path = fs::path(wal_dir_path) / files[current_file_idx];
     std::string full_path_str = full_path.string();
     strncpy(file_path, full_path_str.c_str(), sizeof(file_path) - 1);
     printf("DEBUG: Loading file: %s\n", file_path);
+    tail_status.clear();
+
+    // Neighbours are usually loaded already by the prefetcher. Otherwise
+    // load here; archived segments (.gz/.lz4/.zst) are parsed as they are
+    // decompressed and cached so coming back to one is free. The parser
+    // stops at the end of valid WAL, so stale records of recycled segments
+    // never make it into wal_records.
+    WalPerfScope perf(WalPerfSection::Load);
+    WalLoadedSegment seg;
+    if (start_lsn)
+      LoadWalSegmentAt(full_path_str, wal_parser, start_lsn, seg);
+    else if (!prefetcher.Take(full_path_str, seg))
+      LoadWalSegment(full_path_str, wal_parser, &segment_cache, seg);
+    perf.SetWork(seg.Data.Size(), seg.Records.size());
+    file_data = std::move(seg.Data);
+    wal_records = std::move(seg.Records);
+    wal_end_lsn = seg.EndLSN;
+    wal_end_reason = seg.EndReason;
+
+    if (seg.Error.empty()) {
+      hex_state.MaxBytes = (int)file_data.Size();
+      error_msg[0] = 0;
+
+      // Update Base LSN
+      std::string fname = WalStripCompressionSuffix(files[current_file_idx]);
+      uint64_t segment_size = seg.SegmentSize;
+      if (segment_size == 0)
+        segment_size = WalSegmentSizeFromFileSize(file_data.Size());
+      current_file_base_lsn = WalFileNameToLSN(fname, segment_size);
+      record_details.SetSource(&file_data, current_file_base_lsn);
+
+      // Auto-update search LSN to file base; a partial load stays at the
+      // top, where it starts.
+      search_lsn = start_lsn ? start_lsn : current_file_base_lsn;
+      should_scroll_to_bottom = start_lsn == 0;
+      filter_dirty = true;
+      BuildXactIndex();
+    } else {
+      snprintf(error_msg, sizeof(error_msg), "%s: %s",
+               files[current_file_idx].c_str(), seg.Error.c_str());
+      fprintf(stderr, "Error: %s\n", error_msg);
+      hex_state.MaxBytes = 0;
+      record_details.SetSource(nullptr, 0);
+    }
 
-    std::ifstream file(full_path_str, std::ios::binary | std::ios::ate);
-    if (file) {
-      std::streamsize size = file.tellg();
-      file.seekg(0, std::ios::beg);
-      file_data.resize(size);
-      if (file.read((char *)file_data.data(), size)) {
-        hex_state.Bytes = file_data.data();
-        hex_state.MaxBytes = size;
-        error_msg[0] = 0;
-        wal_records.clear();
-        wal_parser.Parse(file_data.data(), size, wal_records);
-        should_scroll_to_bottom = true;
-
-        // Auto-update search LSN to file base
-        search_lsn = current_file_base_lsn;
+    std::vector<std::string> paths;
+    for (const auto &f : files)
+      paths.push_back((fs::path(wal_dir_path) / f).string());
+    prefetcher.Navigate(paths, current_file_idx);
+    EnforceMemoryBudget();
+  }
+}
 
-        // Update Base LSN
-        std::string fname = files[current_file_idx];
-        current_file_base_lsn = ParseWalFilename(fname);
-      }
-    }
+// Loads the last tail_records records of files[current_file_idx], walking
+// xl_prev back from the end of valid WAL (or from the server's current
+// position in the active segment) into earlier files as needed. Only the
+// pages holding those records are read.
+static void LoadCurrentFileTail() {
+  if (current_file_idx < 0 || current_file_idx >= (int)files.size())
+    return;
+  std::vector<std::string> paths;
+  for (const auto &f : files)
+    paths.push_back((fs::path(wal_dir_path) / f).string());
+  strncpy(file_path, paths[current_file_idx].c_str(), sizeof(file_path) - 1);
+
+  WalPerfScope perf(WalPerfSection::Load);
+  uint64_t end_lsn =
+      files[current_file_idx] == active_wal_filename ? active_wal_lsn : 0;
+  WalTailResult tail;
+  bool ok = ReadWalTail(paths, current_file_idx, end_lsn, tail_records,
+                        wal_parser, tail);
+  perf.SetWork(tail.PagesRead * WAL_PAGE_SIZE, tail.Records.size());
+  file_data = std::move(tail.Data);
+  wal_records = std::move(tail.Records);
+  wal_end_lsn = tail.EndLSN;
+  wal_end_reason = tail.EndReason;
+
+  if (ok) {
+    hex_state.MaxBytes = (int)file_data.Size();
+    error_msg[0] = 0;
+    current_file_base_lsn = tail.BaseLSN;
+    record_details.SetSource(&file_data, current_file_base_lsn);
+    search_lsn =
+        wal_records.empty() ? current_file_base_lsn : wal_records[0].LSN;
+    should_scroll_to_bottom = true;
+    filter_dirty = true;
+    BuildXactIndex();
+    char buf[256];
+    snprintf(buf, sizeof(buf), "latest %zu records, %llu pages of %u files",
+             wal_records.size(), (unsigned long long)tail.PagesRead,
+             tail.SegmentsRead);
+    tail_status = buf;
+    if (!tail.Stop.empty())
+      tail_status += " (" + tail.Stop + ")";
+  } else {
+    snprintf(error_msg, sizeof(error_msg), "%s: %s",
+             files[current_file_idx].c_str(), tail.Error.c_str());
+    fprintf(stderr, "Error: %s\n", error_msg);
+    hex_state.MaxBytes = 0;
+    record_details.SetSource(nullptr, 0);
+    tail_status.clear();
   }
+  prefetcher.Navigate(paths, current_file_idx);
+  EnforceMemoryBudget();
+}
+
+// The segment being written to: only its tail unless that's turned off.
+static void LoadLatestFile() {
+  if (tail_records > 0)
+    LoadCurrentFileTail();
+  else
+    LoadCurrentFile();
 }
 
 static uint64_t ParseLSN(const char *lsnStr) {
@@ -217,86 +436,1176 @@ static uint64_t ParseLSN(const char *lsnStr) {
   return 0;
 }
 
+// Rereads pg_control and opens the segment holding its redo pointer,
+// parsed from there. False if there is no control file or no such segment.
+static bool LoadRedoSegment() {
+  if (data_dir_path.empty())
+    return false;
+  control_error.clear();
+  control_loaded =
+      ReadWalControlFile(data_dir_path, control_file, control_error);
+  if (!control_loaded)
+    return false;
+  std::string path = FindWalSegmentForLSN(wal_dir_path, control_file.Timeline,
+                                          control_file.RedoLSN);
+  std::string name = fs::path(path).filename().string();
+  for (size_t i = 0; i < files.size(); ++i) {
+    if (files[i] == name) {
+      current_file_idx = (int)i;
+      LoadCurrentFile(control_file.RedoLSN);
+      return true;
+    }
+  }
+  control_error = "no segment for the redo pointer in " + wal_dir_path;
+  return false;
+}
+
 static bool HexAddressCallback(ImGuiHexEditorState *state, int offset,
                                char *buf, int size) {
   snprintf(buf, size, "%lX", current_file_base_lsn + offset);
   return true;
 }
 
-// function moved
+static int HexReadCallback(ImGuiHexEditorState *, int offset, void *buf,
+                           int size) {
+  return (int)file_data.Read(offset, buf, size);
+}
 
-static void ConnectToDB() {
-  PGconn *conn = PQconnectdb(db_conn_str);
-  if (PQstatus(conn) == CONNECTION_OK) {
-    snprintf(db_status, sizeof(db_status), "Connected!");
+static int HexWriteCallback(ImGuiHexEditorState *, int offset, void *buf,
+                            int size) {
+  file_data.Write(offset, buf, size);
+  record_details.SetSource(&file_data, current_file_base_lsn); // Stale now
+  return size;
+}
+
+// Maps relation / namespace / database names used in filter expressions to
+// ids using the catalog fetched by ConnectToDB(). Relations are matched in
+// every database that has one by that name. Numbers are accepted for
+// namespaces as their OID.
+static bool ResolveFilterName(const std::string &field, const std::string &name,
+                              std::vector<uint64_t> &out_ids) {
+  if (field == "rel") {
+    for (const WalRelName &rel : rel_names.Relations()) {
+      if (rel.Name == name)
+        out_ids.push_back(WalRelKey(rel.Database, rel.RelFileNode));
+    }
+    return !out_ids.empty();
+  }
+  if (field == "nsp") {
+    std::unordered_set<uint64_t> namespaces; // (database, OID)
+    for (const auto &kv : rel_names.Namespaces()) {
+      if (kv.second == name || std::to_string((uint32_t)kv.first) == name)
+        namespaces.insert(kv.first);
+    }
+    for (const WalRelName &rel : rel_names.Relations()) {
+      if (namespaces.count(WalRelKey(rel.Database, rel.Namespace)))
+        out_ids.push_back(WalRelKey(rel.Database, rel.RelFileNode));
+    }
+    return !namespaces.empty();
+  }
+  if (field == "db") {
+    for (const auto &kv : db_names) {
+      if (kv.second == name)
+        out_ids.push_back(kv.first);
+    }
+    return !out_ids.empty();
+  }
+  return false;
+}
+
+static void RebuildFilteredRecords(const bool *rmid_filter_states,
+                                   int rmid_count) {
+  WalPerfScope perf(WalPerfSection::Filter);
+  WalTraceScope trace("index", "filter");
+  std::string expr;
+  auto add_clause = [&](const std::string &clause) {
+    if (!expr.empty())
+      expr += " and ";
+    expr += clause;
+  };
+
+  std::string rmids;
+  bool all_rmids = true;
+  for (int i = 0; i < rmid_count; i++) {
+    if (rmid_filter_states[i]) {
+      if (!rmids.empty())
+        rmids += ",";
+      rmids += std::to_string(i);
+    } else {
+      all_rmids = false;
+    }
+  }
+  if (!all_rmids)
+    add_clause("rmid in (" + rmids + ")");
+  if (selected_namespace_idx >= 0 &&
+      (size_t)selected_namespace_idx < namespace_filter_items.size()) {
+    const std::string &name =
+        namespace_filter_items[selected_namespace_idx].name;
+    char quote = name.find('\'') == std::string::npos ? '\'' : '"';
+    add_clause("nsp = " + std::string(1, quote) + name + quote);
+  }
+  if (selected_table_idx >= 0 &&
+      (size_t)selected_table_idx < table_filter_items.size()) {
+    const RelItem &item = table_filter_items[selected_table_idx];
+    add_clause("(db = " + std::to_string(item.db) +
+               " and rel = " + std::to_string(item.id) + ")");
+  }
+  std::string combo_expr = expr;
+  if (filter_expr[0] != 0)
+    add_clause(std::string("(") + filter_expr + ")");
+
+  if (!record_filter.Compile(expr, filter_error, ResolveFilterName)) {
+    // Bad expression in the filter bar: keep the error for display and fall
+    // back to the combo filters alone.
+    std::string combo_error;
+    record_filter.Compile(combo_expr, combo_error, ResolveFilterName);
+  }
+
+  filtered_indices.clear();
+  record_filter.Evaluate(wal_records.data(), wal_records.size(),
+                         filtered_indices);
+  perf.SetWork(0, wal_records.size());
+  trace.SetItems(wal_records.size());
+  filter_dirty = false;
+  hotspots_dirty = true;
+  fpi_bloat_stale = true;
+}
+
+static size_t NameMapMemoryUsage(const std::map<uint32_t, std::string> &m) {
+  // Rough: a red-black tree node plus the string's heap buffer
+  size_t bytes = m.size() * (4 * sizeof(void *) + sizeof(std::string) + 8);
+  for (const auto &kv : m) {
+    if (kv.second.capacity() > 15)
+      bytes += kv.second.capacity() + 1;
+  }
+  return bytes;
+}
+
+// Recomputes what is held outside the segment cache and hands the rest of
+// the budget to the cache. Called when a segment is loaded, names are
+// fetched or the budget changes.
+static void EnforceMemoryBudget() {
+  memory_view_bytes = file_data.ResidentBytes() +
+                      WalRecordsMemoryUsage(wal_records) +
+                      filtered_indices.capacity() * sizeof(uint32_t) +
+                      xact_index.MemoryUsage() +
+                      record_details.MemoryUsage();
+  memory_prefetch_bytes = prefetcher.GetMemoryUsage();
+  memory_names_bytes = rel_names.MemoryUsage() +
+                       NameMapMemoryUsage(db_names) +
+                       time_index.MemoryUsage() + attr_fetcher.MemoryUsage();
+  size_t budget = (size_t)memory_budget_mb << 20;
+  size_t fixed = memory_view_bytes + memory_prefetch_bytes + memory_names_bytes;
+  segment_cache.SetBudget(budget > fixed ? budget - fixed : 0);
+}
+
+static void DrawMemoryStatus() {
+  const double mb = 1024.0 * 1024.0;
+  size_t used = memory_view_bytes + memory_prefetch_bytes +
+                memory_names_bytes + segment_cache.GetUsage();
+  ImGui::TextDisabled("| Memory: %.0f / %d MB", used / mb, memory_budget_mb);
+  if (ImGui::IsItemHovered())
+    ImGui::SetTooltip("Click to change the memory budget");
+  if (ImGui::IsItemClicked())
+    ImGui::OpenPopup("MemoryBudget");
+  if (ImGui::BeginPopup("MemoryBudget")) {
+    ImGui::Text("Current segment:    %8.1f MB", memory_view_bytes / mb);
+    if (file_data.ZeroPages() > 0)
+      ImGui::TextDisabled("  %zu zero pages not held (%.1f MB)",
+                          file_data.ZeroPages(),
+                          file_data.ZeroPages() * WAL_PAGE_SIZE / mb);
+    ImGui::Text("Prefetched:         %8.1f MB", memory_prefetch_bytes / mb);
+    ImGui::Text("Segment cache:      %8.1f MB (%zu segments)",
+                segment_cache.GetUsage() / mb, segment_cache.GetCount());
+    ImGui::Text("Names, time index:  %8.1f MB", memory_names_bytes / mb);
+    ImGui::Separator();
+    ImGui::SetNextItemWidth(150);
+    if (ImGui::InputInt("Budget (MB)", &memory_budget_mb, 64, 256)) {
+      memory_budget_mb = std::max(memory_budget_mb, 64);
+      EnforceMemoryBudget();
+    }
+    ImGui::EndPopup();
+  }
+}
+
+// Frame graph, rolling timings of the hot paths and process counters.
+// Recording is only on while the window is open.
+static void DrawPerfWindow() {
+  if (!show_perf)
+    return;
+  ImGui::SetNextWindowSize(ImVec2(560, 420), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Performance", &show_perf)) {
+    ImGui::End();
+    return;
+  }
 
-    // Fetch relations
-    // Fetch namespaces
-    PGresult *res_nsp = PQexec(conn, "SELECT oid, nspname FROM pg_namespace");
-    if (PQresultStatus(res_nsp) == PGRES_TUPLES_OK) {
-      namespace_names.clear();
-      namespace_filter_items.clear();
-      int rows = PQntuples(res_nsp);
-      for (int i = 0; i < rows; i++) {
-        uint32_t oid =
-            (uint32_t)strtoul(PQgetvalue(res_nsp, i, 0), nullptr, 10);
-        std::string name = PQgetvalue(res_nsp, i, 1);
-        namespace_names[oid] = name;
-        namespace_filter_items.push_back({oid, name});
+  WalPerfStats stats;
+  WalPerfGetStats(WalPerfSection::Frame, stats);
+  ImGui::Text("%.1f FPS, frame %.2f ms (p95 %.2f, max %.2f)",
+              ImGui::GetIO().Framerate, stats.Last, stats.P95, stats.Max);
+  ImGui::PlotLines("##frames", stats.Samples, stats.Count, 0,
+                   "CPU ms per frame", 0.0f, std::max(stats.Max, 16.7f),
+                   ImVec2(-FLT_MIN, 60));
+
+  if (ImGui::GetTime() - perf_rss_time > 0.5) {
+    perf_rss_bytes = WalPerfResidentBytes();
+    perf_rss_time = ImGui::GetTime();
+  }
+  ImGui::Text("Allocations last frame: %llu",
+              (unsigned long long)perf_frame_allocs);
+  ImGui::Text("Resident memory: %.1f MB", perf_rss_bytes / (1024.0 * 1024.0));
+  WalPerfGetStats(WalPerfSection::Parse, stats);
+  ImGui::Text("Last parse: %.1f MB/s, %.0f records/s",
+              stats.BytesPerSec / (1024.0 * 1024.0), stats.ItemsPerSec);
+  ImGui::Separator();
+
+  if (ImGui::BeginTable("perf", 7,
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV |
+                            ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupColumn("Section");
+    ImGui::TableSetupColumn("Last ms");
+    ImGui::TableSetupColumn("Mean");
+    ImGui::TableSetupColumn("p50");
+    ImGui::TableSetupColumn("p95");
+    ImGui::TableSetupColumn("Max");
+    ImGui::TableSetupColumn("History", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableHeadersRow();
+    for (int i = 0; i < (int)WalPerfSection::Count; i++) {
+      WalPerfGetStats((WalPerfSection)i, stats);
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", WalPerfSectionName((WalPerfSection)i));
+      float values[] = {stats.Last, stats.Mean, stats.P50, stats.P95,
+                        stats.Max};
+      for (float v : values) {
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f", v);
       }
-      std::sort(namespace_filter_items.begin(), namespace_filter_items.end(),
-                [](const NamespaceItem &a, const NamespaceItem &b) {
-                  return a.name < b.name;
-                });
-    }
-    PQclear(res_nsp);
-
-    // Fetch relations with namespace info
-    PGresult *res = PQexec(
-        conn, "SELECT relfilenode, oid, relname, relnamespace FROM pg_class");
-    if (PQresultStatus(res) == PGRES_TUPLES_OK) {
-      rel_names.clear();
-      rel_names_oid.clear();
-      relnode_to_namespace_oid.clear();
-
-      int rows = PQntuples(res);
-      for (int i = 0; i < rows; i++) {
-        uint32_t rnode = (uint32_t)strtoul(PQgetvalue(res, i, 0), nullptr, 10);
-        uint32_t oid = (uint32_t)strtoul(PQgetvalue(res, i, 1), nullptr, 10);
-        std::string name = PQgetvalue(res, i, 2);
-        uint32_t nsp = (uint32_t)strtoul(PQgetvalue(res, i, 3), nullptr, 10);
-
-        rel_names[rnode] = name;
-        rel_names_oid[oid] = name;
-        relnode_to_namespace_oid[rnode] = nsp;
+      ImGui::TableNextColumn();
+      ImGui::PushID(i);
+      ImGui::PlotHistogram("##history", stats.Samples, stats.Count, 0, nullptr,
+                           0.0f, stats.Max, ImVec2(-FLT_MIN, 18));
+      ImGui::PopID();
+    }
+    ImGui::EndTable();
+  }
+  if (ImGui::Button("Reset"))
+    WalPerfReset();
+
+  // Loading, parsing and UI frames of every thread, for a closer look in
+  // chrome://tracing or ui.perfetto.dev
+  ImGui::SeparatorText("Trace");
+  if (!WalTraceEnabled()) {
+    if (ImGui::Button("Start trace")) {
+      WalTraceStart();
+      trace_status.clear();
+    }
+  } else {
+    if (ImGui::Button("Stop and save")) {
+      WalTraceStop();
+      std::string error;
+      if (WalTraceWrite(trace_path, error))
+        trace_status = std::to_string(WalTraceEventCount()) +
+                       " events written to " + trace_path;
+      else
+        trace_status = error;
+    }
+    ImGui::SameLine();
+    ImGui::Text("Recording, %llu events",
+                (unsigned long long)WalTraceEventCount());
+  }
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(-FLT_MIN);
+  ImGui::InputText("##trace_path", trace_path, sizeof(trace_path));
+  if (!trace_status.empty())
+    ImGui::TextDisabled("%s", trace_status.c_str());
+  ImGui::End();
+}
+
+// "db:relation" when the names are known, else the numbers.
+static void DrawRelationName(uint32_t spc, uint32_t db, uint32_t rel) {
+  const WalRelName *name = rel_names.Find(db, rel);
+  auto db_name = db_names.find(db);
+  if (name && db_name != db_names.end())
+    ImGui::Text("%s:%s", db_name->second.c_str(), name->Name.c_str());
+  else if (name)
+    ImGui::Text("%s", name->Name.c_str());
+  else
+    ImGui::Text("%u/%u/%u", spc, db, rel);
+}
+
+// Counts the pages referenced by the listed records, in chunks on all
+// cores whose sketches are then merged.
+static void CountHotspots() {
+  auto start = std::chrono::steady_clock::now();
+  size_t n = filtered_indices.size();
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, n / 50000 + 1);
+  std::vector<WalHotspotSketch> sketches(threads);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+        sketches[t].Add(wal_records[filtered_indices[i]]);
+    });
+  }
+  for (std::thread &w : workers)
+    w.join();
+  for (size_t t = 1; t < threads; t++)
+    sketches[0].Merge(sketches[t]);
+  hotspot_sketch = std::move(sketches[0]);
+  hotspot_ms = std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  hotspots_dirty = false;
+}
+
+static void DrawHotspotTable(const char *id, bool by_fpi) {
+  std::vector<WalHotspot> top = hotspot_sketch.Top(hotspot_count, by_fpi);
+  bool exact = hotspot_sketch.Exact();
+  if (!ImGui::BeginTable(id, exact ? 5 : 6,
+                         ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders |
+                             ImGuiTableFlags_ScrollY |
+                             ImGuiTableFlags_SizingFixedFit))
+    return;
+  ImGui::TableSetupScrollFreeze(0, 1);
+  ImGui::TableSetupColumn("Relation", ImGuiTableColumnFlags_WidthStretch);
+  ImGui::TableSetupColumn("Fork");
+  ImGui::TableSetupColumn("Block");
+  ImGui::TableSetupColumn("Refs");
+  ImGui::TableSetupColumn("FPIs");
+  if (!exact)
+    ImGui::TableSetupColumn("Error");
+  ImGui::TableHeadersRow();
+  for (const WalHotspot &h : top) {
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    DrawRelationName(h.Key.Spc, h.Key.Db, h.Key.Rel);
+    ImGui::TableNextColumn();
+    ImGui::Text("%s", WalForkName(h.Key.Fork));
+    ImGui::TableNextColumn();
+    ImGui::Text("%u", h.Key.Block);
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", (unsigned long long)h.Refs);
+    ImGui::TableNextColumn();
+    ImGui::Text("%llu", (unsigned long long)h.Fpis);
+    if (!exact) {
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)h.Error);
+    }
+  }
+  ImGui::EndTable();
+}
+
+// The pages the listed records modify most and get the most full-page
+// images for. Narrow the list with the filter to look at a range.
+static void DrawHotspotWindow() {
+  if (!show_hotspots)
+    return;
+  ImGui::SetNextWindowSize(ImVec2(620, 480), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Block Hotspots", &show_hotspots)) {
+    ImGui::End();
+    return;
+  }
+  if (hotspots_dirty)
+    CountHotspots();
+
+  ImGui::Text("%llu block references, %llu FPIs in %zu records (%.0f ms)",
+              (unsigned long long)hotspot_sketch.TotalRefs(),
+              (unsigned long long)hotspot_sketch.TotalFpis(),
+              filtered_indices.size(), hotspot_ms);
+  if (hotspot_sketch.Exact())
+    ImGui::Text("Exact, %zu distinct pages", hotspot_sketch.Tracked());
+  else
+    ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.3f, 1.0f),
+                       "Approximate: over %zu distinct pages, counts are at "
+                       "most Error too high",
+                       hotspot_sketch.Capacity());
+  ImGui::SameLine();
+  ImGui::SetNextItemWidth(100);
+  ImGui::InputInt("Top", &hotspot_count);
+  hotspot_count = std::max(1, std::min(hotspot_count, 10000));
+
+  if (ImGui::BeginTabBar("hotspot_tabs")) {
+    if (ImGui::BeginTabItem("By references")) {
+      DrawHotspotTable("hot_refs", false);
+      ImGui::EndTabItem();
+    }
+    if (ImGui::BeginTabItem("By full-page images")) {
+      DrawHotspotTable("hot_fpis", true);
+      ImGui::EndTabItem();
+    }
+    ImGui::EndTabBar();
+  }
+  ImGui::End();
+}
+
+// Recompresses the images of the listed records, spread over all cores.
+// Records a tail took from earlier segments aren't in the held segment and
+// are left out.
+static void AnalyzeFpiBloat() {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<uint32_t> with_fpi;
+  fpi_not_held = 0;
+  for (uint32_t i : filtered_indices) {
+    if (!wal_records[i].HasFPI)
+      continue;
+    if (wal_records[i].LSN < current_file_base_lsn)
+      fpi_not_held++;
+    else
+      with_fpi.push_back(i);
+  }
+  size_t n = with_fpi.size();
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, n / 256 + 1);
+  std::vector<WalFpiAnalyzer> analyzers(threads);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      std::vector<uint8_t> bytes;
+      for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+        const WalRecordInfo &rec = wal_records[with_fpi[i]];
+        if (WalReadRecordBytes(file_data, rec.Offset, rec.Length, bytes))
+          analyzers[t].AddRecord(bytes.data(), rec.Length);
       }
+    });
+  }
+  for (std::thread &w : workers)
+    w.join();
+  for (size_t t = 1; t < threads; t++)
+    analyzers[0].Merge(analyzers[t]);
+  fpi_analyzer = std::move(analyzers[0]);
+  fpi_relations = fpi_analyzer.Relations();
+  fpi_bloat_ms = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  fpi_bloat_stale = false;
+}
 
-      // Populate dropdown items
-      table_filter_items.clear();
-      for (const auto &kv : rel_names) {
-        table_filter_items.push_back({kv.first, kv.second});
+// How much of the WAL is full-page images, per relation, and what each
+// wal_compression setting would make of them.
+static void DrawFpiBloatWindow() {
+  if (!show_fpi_bloat)
+    return;
+  static const WalFpiCompression methods[] = {
+      WalFpiCompression::None, WalFpiCompression::Pglz,
+      WalFpiCompression::Lz4, WalFpiCompression::Zstd};
+  ImGui::SetNextWindowSize(ImVec2(760, 480), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Full-Page Images", &show_fpi_bloat)) {
+    ImGui::End();
+    return;
+  }
+  if (ImGui::Button("Analyze"))
+    AnalyzeFpiBloat();
+  ImGui::SameLine();
+  if (fpi_bloat_stale)
+    ImGui::TextDisabled("Recompresses the images of the %zu listed records",
+                        filtered_indices.size());
+  else
+    ImGui::Text("%llu images in %llu records (%.0f ms)",
+                (unsigned long long)fpi_analyzer.Total().Images,
+                (unsigned long long)fpi_analyzer.Records(), fpi_bloat_ms);
+  if (!fpi_bloat_stale && fpi_not_held)
+    ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.3f, 1.0f),
+                       "%zu records with images are from earlier segments "
+                       "the tail read and are not counted",
+                       fpi_not_held);
+
+  WalFpiRelStats total = fpi_analyzer.Total();
+  const double kb = 1024.0;
+  ImGui::Text("Pages %.1f KB, holes %.1f KB, stored %.1f KB",
+              total.Images * WAL_PAGE_SIZE / kb, total.HoleBytes / kb,
+              total.StoredBytes / kb);
+  if (total.Unreadable)
+    ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.3f, 1.0f),
+                       "%llu images use a compression not built in and "
+                       "count at their stored size",
+                       (unsigned long long)total.Unreadable);
+
+  if (ImGui::BeginTable("fpi_settings", 4,
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders |
+                            ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupColumn("wal_compression");
+    ImGui::TableSetupColumn("Written with");
+    ImGui::TableSetupColumn("Would take");
+    ImGui::TableSetupColumn("Saved");
+    ImGui::TableHeadersRow();
+    for (WalFpiCompression m : methods) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", WalFpiCompressionName(m));
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)total.Compressed[(int)m]);
+      ImGui::TableNextColumn();
+      if (!WalFpiCompressionAvailable(m)) {
+        ImGui::TextDisabled("not built in");
+        continue;
+      }
+      uint64_t bytes = total.WhatIf[(int)m];
+      ImGui::Text("%.1f KB", bytes / kb);
+      ImGui::TableNextColumn();
+      double saved = (double)total.StoredBytes - (double)bytes;
+      ImGui::Text("%.1f KB (%.1f%%)", saved / kb,
+                  total.StoredBytes ? 100.0 * saved / total.StoredBytes
+                                    : 0.0);
+    }
+    ImGui::EndTable();
+  }
+
+  const std::vector<WalFpiRelStats> &rels = fpi_relations;
+  if (ImGui::BeginTable("fpi_rels", 8,
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders |
+                            ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Relation", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("Images");
+    ImGui::TableSetupColumn("Hole KB");
+    ImGui::TableSetupColumn("Stored KB");
+    for (WalFpiCompression m : methods)
+      ImGui::TableSetupColumn(WalFpiCompressionName(m));
+    ImGui::TableHeadersRow();
+    ImGuiListClipper clipper;
+    clipper.Begin((int)rels.size());
+    while (clipper.Step()) {
+      for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+        const WalFpiRelStats &r = rels[i];
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        DrawRelationName(r.Spc, r.Db, r.Rel);
+        ImGui::TableNextColumn();
+        ImGui::Text("%llu", (unsigned long long)r.Images);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.1f", r.HoleBytes / kb);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.1f", r.StoredBytes / kb);
+        for (WalFpiCompression m : methods) {
+          ImGui::TableNextColumn();
+          if (WalFpiCompressionAvailable(m))
+            ImGui::Text("%.1f", r.WhatIf[(int)m] / kb);
+          else
+            ImGui::TextDisabled("-");
+        }
+      }
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+// How the loaded transactions ended, and the ones still open at the end of
+// the records: long-running or prepared transactions holding back vacuum.
+static void DrawXactWindow() {
+  if (!show_xacts)
+    return;
+  ImGui::SetNextWindowSize(ImVec2(560, 420), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Transactions", &show_xacts)) {
+    ImGui::End();
+    return;
+  }
+  ImGui::Text("%zu committed, %zu aborted, %zu prepared",
+              xact_index.Count(WalXactOutcome::Committed),
+              xact_index.Count(WalXactOutcome::Aborted),
+              xact_index.Count(WalXactOutcome::Prepared));
+  std::vector<std::pair<uint32_t, WalXactStatus>> open =
+      xact_index.InFlight();
+  ImGui::Text("%zu in flight at %lX (click to highlight)", open.size(),
+              (unsigned long)wal_end_lsn);
+  if (ImGui::BeginTable("xacts_open", 5,
+                        ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders |
+                            ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_SizingFixedFit)) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("XID");
+    ImGui::TableSetupColumn("State");
+    ImGui::TableSetupColumn("First LSN");
+    ImGui::TableSetupColumn("Records");
+    ImGui::TableSetupColumn("Prepared at",
+                            ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableHeadersRow();
+    ImGuiListClipper clipper;
+    clipper.Begin((int)open.size());
+    while (clipper.Step()) {
+      for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+        uint32_t xid = open[i].first;
+        const WalXactStatus &s = open[i].second;
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        char label[16];
+        snprintf(label, sizeof(label), "%u", xid);
+        if (ImGui::Selectable(label, xid == highlighted_xid,
+                              ImGuiSelectableFlags_SpanAllColumns))
+          highlighted_xid = xid;
+        ImGui::TableNextColumn();
+        ImGui::Text("%s", WalXactOutcomeName(s.Outcome));
+        ImGui::TableNextColumn();
+        ImGui::Text("%lX", (unsigned long)s.FirstLSN);
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", s.Records);
+        ImGui::TableNextColumn();
+        if (s.Outcome == WalXactOutcome::Prepared)
+          ImGui::Text("%s", WalFormatTimestamp(s.Time).c_str());
+      }
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+// The record at lsn among the loaded ones, nullptr if it isn't.
+static const WalRecordInfo *FindLoadedRecord(uint64_t lsn) {
+  auto it = std::lower_bound(
+      wal_records.begin(), wal_records.end(), lsn,
+      [](const WalRecordInfo &r, uint64_t lsn) { return r.LSN < lsn; });
+  return it != wal_records.end() && it->LSN == lsn ? &*it : nullptr;
+}
+
+// The tuples of the selected Heap record, column by column. The record is
+// decoded when it is selected; the values once the layout of its relation
+// is in.
+static void DrawColumnsWindow() {
+  if (!show_columns)
+    return;
+  ImGui::SetNextWindowSize(ImVec2(560, 420), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("Columns", &show_columns)) {
+    ImGui::End();
+    return;
+  }
+  const WalRecordInfo *rec = FindLoadedRecord(selected_lsn);
+  if (!rec || rec->RMID != RM_HEAP_ID) {
+    ImGui::TextDisabled("Select a Heap insert, update or delete record.");
+    ImGui::End();
+    return;
+  }
+
+  if (rec->LSN != columns_lsn) {
+    columns_lsn = rec->LSN;
+    columns_tuples.clear();
+    columns_why.clear();
+    columns_layout.reset();
+    columns_values.clear();
+    std::vector<uint8_t> bytes;
+    WalDecodedRecord decoded;
+    if (rec->LSN < current_file_base_lsn)
+      columns_why = "the record is in an earlier segment; open that one";
+    else if (rec->RelFileNodes.empty() ||
+             !WalReadRecordBytes(file_data, rec->Offset, rec->Length,
+                                 bytes) ||
+             !WalDecodeRecord(bytes.data(), rec->Length, decoded))
+      columns_why = "the record can't be read back";
+    else
+      WalExtractHeapTuples(decoded, columns_tuples, columns_why);
+  }
+
+  WalRelFileNode node;
+  if (!rec->RelFileNodes.empty())
+    node = rec->RelFileNodes[0];
+  ImGui::Text("%lX %s", (unsigned long)rec->LSN, rec->Description.c_str());
+  ImGui::SameLine();
+  DrawRelationName(node.spcNode, node.dbNode, node.relNode);
+  if (columns_tuples.empty()) {
+    ImGui::TextWrapped("No tuple: %s.", columns_why.c_str());
+    ImGui::End();
+    return;
+  }
+
+  std::string error;
+  std::shared_ptr<const WalTupleLayout> layout =
+      attr_fetcher.Find(node, error);
+  if (layout != columns_layout) {
+    columns_layout = layout;
+    columns_values.assign(columns_tuples.size(), {});
+    for (size_t i = 0; layout && i < columns_tuples.size(); i++)
+      WalDecodeTuple(*layout, columns_tuples[i], columns_values[i]);
+  }
+  if (!layout && error.empty())
+    ImGui::TextDisabled("Fetching the columns of the relation...");
+  else if (!layout)
+    ImGui::TextWrapped("Columns: %s", error.c_str());
+
+  for (size_t t = 0; t < columns_tuples.size(); t++) {
+    const WalHeapTuple &tuple = columns_tuples[t];
+    ImGui::Separator();
+    ImGui::Text("%s tuple: %u attributes, %zu bytes%s", tuple.Role,
+                tuple.Infomask2 & 0x07FF, tuple.Bytes.size(),
+                tuple.FromImage ? ", from the full-page image" : "");
+    if (!layout)
+      continue;
+    ImGui::PushID((int)t);
+    if (ImGui::BeginTable("columns", 4,
+                          ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders |
+                              ImGuiTableFlags_SizingFixedFit)) {
+      ImGui::TableSetupColumn("#");
+      ImGui::TableSetupColumn("Column");
+      ImGui::TableSetupColumn("Type");
+      ImGui::TableSetupColumn("Value", ImGuiTableColumnFlags_WidthStretch);
+      ImGui::TableHeadersRow();
+      for (const WalColumnValue &v : columns_values[t]) {
+        const WalAttribute &a = layout->Attributes[v.Attnum - 1];
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", v.Attnum);
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(layout->Name(v.Attnum - 1));
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(WalTypeName(a.TypeOid).c_str());
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(v.Value.c_str());
       }
-      std::sort(
-          table_filter_items.begin(), table_filter_items.end(),
-          [](const RelItem &a, const RelItem &b) { return a.name < b.name; });
-
-      snprintf(db_status, sizeof(db_status), "Fetched %zu relations",
-               rel_names.size());
-
-      // Fetch database names
-      PGresult *res_db = PQexec(conn, "SELECT oid, datname FROM pg_database");
-      if (PQresultStatus(res_db) == PGRES_TUPLES_OK) {
-        db_names.clear();
-        int rows_db = PQntuples(res_db);
-        for (int i = 0; i < rows_db; i++) {
-          uint32_t oid =
-              (uint32_t)strtoul(PQgetvalue(res_db, i, 0), nullptr, 10);
-          std::string name = PQgetvalue(res_db, i, 1);
-          db_names[oid] = name;
+      ImGui::EndTable();
+    }
+    ImGui::PopID();
+  }
+  ImGui::End();
+}
+
+// Summarizes every file of the folder from its page headers and lists them
+// with their status and how much of each holds valid WAL.
+static void DrawOverviewWindow() {
+  if (!show_overview)
+    return;
+  if (overview_dirty) {
+    std::vector<std::string> paths;
+    for (const auto &f : files)
+      paths.push_back((fs::path(wal_dir_path) / f).string());
+    auto start = std::chrono::steady_clock::now();
+    ScanWalFiles(paths, overview_segments);
+    overview_scan_ms = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    overview_dirty = false;
+  }
+
+  ImGui::SetNextWindowSize(ImVec2(900, 500), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("WAL Directory Overview", &show_overview)) {
+    ImGui::End();
+    return;
+  }
+  ImGui::Text("%zu files scanned in %.1f ms", overview_segments.size(),
+              overview_scan_ms);
+  ImGui::SameLine();
+  if (ImGui::Button("Rescan"))
+    overview_dirty = true;
+
+  if (ImGui::BeginTable("OverviewTable", 8,
+                        ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                            ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_Resizable)) {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("File", ImGuiTableColumnFlags_WidthFixed, 200.0f);
+    ImGui::TableSetupColumn("Status", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+    ImGui::TableSetupColumn("Start LSN", ImGuiTableColumnFlags_WidthFixed,
+                            100.0f);
+    ImGui::TableSetupColumn("TLI", ImGuiTableColumnFlags_WidthFixed, 40.0f);
+    ImGui::TableSetupColumn("System ID", ImGuiTableColumnFlags_WidthFixed,
+                            160.0f);
+    ImGui::TableSetupColumn("Seg Size", ImGuiTableColumnFlags_WidthFixed,
+                            70.0f);
+    ImGui::TableSetupColumn("First Time", ImGuiTableColumnFlags_WidthFixed,
+                            140.0f);
+    ImGui::TableSetupColumn("Fill", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableHeadersRow();
+
+    ImGuiListClipper clipper;
+    clipper.Begin((int)overview_segments.size());
+    while (clipper.Step()) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+        const WalSegmentSummary &seg = overview_segments[row];
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        // Selecting a row opens the file in the main view
+        bool is_current = current_file_idx >= 0 &&
+                          current_file_idx < (int)files.size() &&
+                          files[current_file_idx] == seg.FileName;
+        if (ImGui::Selectable(seg.FileName.c_str(), is_current,
+                              ImGuiSelectableFlags_SpanAllColumns)) {
+          auto it = std::find(files.begin(), files.end(), seg.FileName);
+          if (it != files.end()) {
+            current_file_idx = (int)(it - files.begin());
+            LoadCurrentFile();
+          }
         }
+        ImGui::TableNextColumn();
+        ImVec4 color = seg.Status == WalSegmentStatus::Valid
+                           ? ImVec4(0.4f, 1.0f, 0.4f, 1.0f)
+                           : ImVec4(0.7f, 0.7f, 0.7f, 1.0f);
+        ImGui::TextColored(color, "%s", WalSegmentStatusName(seg.Status));
+        ImGui::TableNextColumn();
+        if (seg.Status == WalSegmentStatus::Valid ||
+            seg.Status == WalSegmentStatus::Recycled)
+          ImGui::Text("%X/%X", (uint32_t)(seg.StartLSN >> 32),
+                      (uint32_t)seg.StartLSN);
+        ImGui::TableNextColumn();
+        if (seg.Timeline)
+          ImGui::Text("%u", seg.Timeline);
+        ImGui::TableNextColumn();
+        if (seg.SystemId)
+          ImGui::Text("%llu", (unsigned long long)seg.SystemId);
+        ImGui::TableNextColumn();
+        if (seg.SegmentSize)
+          ImGui::Text("%u MB", seg.SegmentSize >> 20);
+        ImGui::TableNextColumn();
+        // Once the timeline or a jump has indexed the folder
+        const WalSegmentTimes *times = time_index.FindSegment(seg.FileName);
+        if (times && times->FirstTime)
+          ImGui::Text("%.19s", WalFormatTimestamp(times->FirstTime).c_str());
+        ImGui::TableNextColumn();
+        char fill_label[32];
+        snprintf(fill_label, sizeof(fill_label), "%u / %u pages",
+                 seg.ValidPages, seg.TotalPages);
+        ImGui::ProgressBar(seg.Fill, ImVec2(-FLT_MIN, 0), fill_label);
       }
-      PQclear(res_db);
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+// Indexes the folder's new and changed segments on a background thread.
+static void StartTimeIndex() {
+  if (time_index_busy)
+    return;
+  if (time_index_thread.joinable())
+    time_index_thread.join();
+  std::vector<std::string> paths;
+  for (const auto &f : files)
+    paths.push_back((fs::path(wal_dir_path) / f).string());
+  time_index_total = paths.size();
+  time_index_done = 0;
+  time_index_next = time_index;
+  time_index_busy = true;
+  time_index_thread = std::thread([paths, dir = catalog_cache_dir]() {
+    WalTraceSetThreadName("time index");
+    std::string error;
+    WalRefreshTimeIndex(paths, dir, time_index_next, error);
+    time_index_error = error;
+    time_index_busy = false;
+  });
+}
+
+// Opens the segment holding time and lists the WAL from the last record
+// stamped before it, so what was written from then on is at the top.
+static void JumpToTime(int64_t time) {
+  WalTimePoint point;
+  size_t seg;
+  if (!time_index.Find(time, point, &seg)) {
+    jump_status = WalFormatTimestamp(time) + " is outside the indexed WAL";
+    return;
+  }
+  auto it = std::find(files.begin(), files.end(),
+                      time_index.Segments()[seg].FileName);
+  if (it == files.end()) {
+    jump_status = time_index.Segments()[seg].FileName + " is gone";
+    return;
+  }
+  current_file_idx = (int)(it - files.begin());
+  LoadCurrentFile(point.LSN);
+
+  // Samples are WAL_TIME_SAMPLE_BYTES apart; the records in between narrow
+  // it down
+  uint64_t from = point.LSN;
+  std::vector<uint8_t> bytes;
+  WalDecodedRecord decoded;
+  for (const WalRecordInfo &rec : wal_records) {
+    int64_t t;
+    if ((rec.RMID == RM_XACT_ID || rec.RMID == RM_XLOG_ID) &&
+        WalReadRecordBytes(file_data, rec.Offset, rec.Length, bytes) &&
+        WalDecodeRecord(bytes.data(), rec.Length, decoded) &&
+        WalRecordTime(decoded, t)) {
+      if (t >= time)
+        break;
+      from = rec.LSN;
+    }
+  }
+  if (from != point.LSN) {
+    wal_records.erase(std::remove_if(wal_records.begin(), wal_records.end(),
+                                     [&](const WalRecordInfo &r) {
+                                       return r.LSN < from;
+                                     }),
+                      wal_records.end());
+    BuildXactIndex();
+  }
+  search_lsn = from;
+  jump_status.clear();
+}
+
+// Segments the prefetcher finishes after Navigate() count against the
+// budget from the frame they are ready.
+static void PollPrefetchMemory() {
+  if (prefetcher.GetMemoryUsage() != memory_prefetch_bytes)
+    EnforceMemoryBudget();
+}
+
+// Takes over the index once the thread is done, and makes the jump that
+// was waiting for it.
+static void PollTimeIndex() {
+  if (time_index_busy || !time_index_thread.joinable())
+    return;
+  time_index_thread.join();
+  time_index = std::move(time_index_next);
+  time_index_next = WalTimeIndex();
+  EnforceMemoryBudget();
+  if (jump_pending) {
+    jump_pending = false;
+    int64_t time;
+    if (WalParseTime(jump_time, time_index.LastTime(), time))
+      JumpToTime(time);
+    else
+      jump_status = std::string("can't read '") + jump_time + "' as a time";
+  }
+}
 
+// WAL written per second over the indexed time range; a click on the
+// chart jumps to that time.
+static void DrawTimelineWindow() {
+  if (!show_timeline)
+    return;
+  ImGui::SetNextWindowSize(ImVec2(760, 300), ImGuiCond_FirstUseEver);
+  if (!ImGui::Begin("WAL Timeline", &show_timeline)) {
+    ImGui::End();
+    return;
+  }
+  if (time_index_busy) {
+    ImGui::Text("Indexing %zu / %zu files...", time_index_done.load(),
+                time_index_total);
+  } else {
+    ImGui::Text("%zu files, %zu samples", time_index.Segments().size(),
+                time_index.PointCount());
+    ImGui::SameLine();
+    if (ImGui::Button("Update"))
+      StartTimeIndex();
+    // Written by the thread, so only read while it isn't running
+    if (!time_index_error.empty())
+      ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%s",
+                         time_index_error.c_str());
+  }
+
+  int64_t from = time_index.FirstTime(), to = time_index.LastTime() + 1;
+  if (time_index.PointCount() < 2) {
+    ImGui::TextDisabled("No timestamps indexed yet");
+    ImGui::End();
+    return;
+  }
+  ImGui::Text("%s to %s", WalFormatTimestamp(from).c_str(),
+              WalFormatTimestamp(to - 1).c_str());
+
+  static std::vector<float> rate;
+  size_t buckets = (size_t)std::max(16.0f, ImGui::GetContentRegionAvail().x);
+  time_index.Rate(from, to, buckets, rate);
+  float peak = *std::max_element(rate.begin(), rate.end());
+  char overlay[64];
+  snprintf(overlay, sizeof(overlay), "peak %.1f MB/s", peak / (1 << 20));
+  float height = std::max(80.0f, ImGui::GetContentRegionAvail().y);
+  ImGui::PlotHistogram("##wal_rate", rate.data(), (int)rate.size(), 0,
+                       overlay, 0.0f, peak * 1.1f, ImVec2(-FLT_MIN, height));
+  if (ImGui::IsItemHovered()) {
+    ImVec2 p0 = ImGui::GetItemRectMin(), p1 = ImGui::GetItemRectMax();
+    double x = (ImGui::GetIO().MousePos.x - p0.x) / (p1.x - p0.x);
+    int64_t t = from + (int64_t)(std::clamp(x, 0.0, 1.0) * (to - from));
+    ImGui::SetTooltip("%s\nClick to jump there",
+                      WalFormatTimestamp(t).c_str());
+    if (ImGui::IsItemClicked())
+      JumpToTime(t);
+  }
+  ImGui::End();
+}
+
+#define GLOBALTABLESPACE_OID 1664
+
+// Adds the names of one database's catalog. Shared catalogs go under
+// database 0, as WAL names them, with their namespace (pg_catalog).
+static void AddCatalogNames(uint32_t db,
+                            const std::map<uint32_t, std::string> &namespaces,
+                            const std::vector<WalCatalogRelation> &relations) {
+  for (const auto &[oid, name] : namespaces)
+    rel_names.AddNamespace(db, oid, name);
+  // Live rows first: deleted versions only name old relfilenodes
+  for (bool live : {true, false}) {
+    for (const WalCatalogRelation &rel : relations) {
+      if (rel.Live != live)
+        continue;
+      uint32_t rel_db = rel.Tablespace == GLOBALTABLESPACE_OID ? 0 : db;
+      if (rel_db == 0) {
+        auto nsp = namespaces.find(rel.Namespace);
+        if (nsp != namespaces.end())
+          rel_names.AddNamespace(0, nsp->first, nsp->second);
+      }
+      rel_names.Add(rel_db, rel.RelFileNode, rel.Oid, rel.Namespace,
+                    rel.Name);
+    }
+  }
+}
+
+// Rebuilds the namespace and table combos from rel_names. With more than
+// one database, tables are labelled with theirs.
+static void RebuildNameFilterItems() {
+  std::set<std::string> namespaces;
+  for (const auto &kv : rel_names.Namespaces())
+    namespaces.insert(kv.second);
+  namespace_filter_items.clear();
+  for (const std::string &name : namespaces)
+    namespace_filter_items.push_back({name});
+
+  bool label_db = db_names.size() > 1;
+  table_filter_items.clear();
+  for (const WalRelName &rel : rel_names.Relations()) {
+    if (rel.RelFileNode == 0)
+      continue; // No storage, so never in WAL
+    std::string name = rel.Name;
+    if (label_db) {
+      auto db = db_names.find(rel.Database);
+      if (rel.Database == 0)
+        name += " (shared)";
+      else if (db != db_names.end())
+        name += " (" + db->second + ")";
+      else
+        name += " (" + std::to_string(rel.Database) + ")";
+    }
+    table_filter_items.push_back({rel.Database, rel.RelFileNode, name});
+  }
+  std::sort(
+      table_filter_items.begin(), table_filter_items.end(),
+      [](const RelItem &a, const RelItem &b) { return a.name < b.name; });
+  selected_namespace_idx = -1;
+  selected_table_idx = -1;
+  filter_dirty = true;
+}
+
+// Without a server, fills the same name maps from the catalog files of the
+// data directory, every database at once.
+static void LoadOfflineCatalog() {
+  WalOfflineCatalog catalog;
+  std::string error;
+  auto start = std::chrono::steady_clock::now();
+  if (!ReadOfflineCatalog(data_dir_path, catalog, error)) {
+    snprintf(db_status, sizeof(db_status), "Offline catalog failed: %s",
+             error.c_str());
+    return;
+  }
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  for (const std::string &warning : catalog.Warnings)
+    fprintf(stderr, "Offline catalog: %s\n", warning.c_str());
+
+  db_names.clear();
+  rel_names.Clear();
+  for (const WalCatalogDatabase &db : catalog.Databases) {
+    db_names[db.Oid] = db.Name;
+    AddCatalogNames(db.Oid, db.Namespaces, db.Relations);
+  }
+  RebuildNameFilterItems();
+
+  snprintf(db_status, sizeof(db_status),
+           "Offline catalog: %zu relations of %zu databases (%.0f ms)",
+           rel_names.Size(), catalog.Databases.size(), ms);
+}
+
+// Runs a query and returns its rows, or nullptr (with the error in
+// db_status) if it failed.
+static PGresult *QueryRows(PGconn *conn, const char *sql) {
+  PGresult *res = PQexec(conn, sql);
+  if (PQresultStatus(res) == PGRES_TUPLES_OK)
+    return res;
+  snprintf(db_status, sizeof(db_status), "Query Failed: %s",
+           PQerrorMessage(conn));
+  PQclear(res);
+  return nullptr;
+}
+
+// Fetches the names of every database that accepts connections, up to
+// catalog_connections of them at once. Each starts from its snapshot in
+// catalog_cache_dir, if there is one, so only what changed since is
+// fetched, and is saved again afterwards. A database that can't be
+// fetched is reported on stderr and left without names.
+static bool FetchCatalog(PGconn *conn) {
+  auto start = std::chrono::steady_clock::now();
+  PGresult *res =
+      QueryRows(conn, "SELECT system_identifier FROM pg_control_system()");
+  if (!res)
+    return false;
+  uint64_t system_id = strtoull(PQgetvalue(res, 0, 0), nullptr, 10);
+  PQclear(res);
+
+  if (!(res = QueryRows(conn,
+                        "SELECT oid, datname, datallowconn FROM pg_database")))
+    return false;
+  std::map<uint32_t, std::string> databases;
+  std::vector<uint32_t> fetch_oids;
+  std::vector<WalCatalogFetch> fetches;
+  for (int i = 0; i < PQntuples(res); i++) {
+    uint32_t oid = (uint32_t)strtoul(PQgetvalue(res, i, 0), nullptr, 10);
+    databases[oid] = PQgetvalue(res, i, 1);
+    if (PQgetvalue(res, i, 2)[0] != 't')
+      continue; // template0
+    WalCatalogFetch fetch;
+    fetch.Snapshot.SystemId = system_id;
+    fetch.Snapshot.Database = databases[oid];
+    if (!catalog_cache_dir.empty()) {
+      WalCatalogSnapshot saved;
+      std::string error;
+      fetch.Incremental =
+          LoadWalCatalogSnapshot(WalCatalogSnapshotPath(catalog_cache_dir,
+                                                        system_id,
+                                                        databases[oid]),
+                                 saved, error) &&
+          saved.SystemId == system_id &&
+          saved.Database == fetch.Snapshot.Database;
+      if (fetch.Incremental)
+        fetch.Snapshot = std::move(saved);
+    }
+    fetch_oids.push_back(oid);
+    fetches.push_back(std::move(fetch));
+  }
+  PQclear(res);
+
+  FetchCatalogs(db_conn_str, fetches, catalog_connections);
+
+  db_names = databases;
+  rel_names.Clear();
+  int fetched = 0, failed = 0;
+  for (size_t i = 0; i < fetches.size(); i++) {
+    WalCatalogFetch &fetch = fetches[i];
+    if (fetch.Fetched < 0) {
+      fprintf(stderr, "Catalog of %s: %s\n", fetch.Snapshot.Database.c_str(),
+              fetch.Error.c_str());
+      failed++;
+      continue;
+    }
+    fetched += fetch.Fetched;
+    AddCatalogNames(fetch_oids[i], fetch.Snapshot.Namespaces,
+                    fetch.Snapshot.Relations);
+    std::string error;
+    fetch.Snapshot.Databases = databases;
+    if (!catalog_cache_dir.empty() &&
+        !SaveWalCatalogSnapshot(
+            WalCatalogSnapshotPath(catalog_cache_dir, system_id,
+                                   fetch.Snapshot.Database),
+            fetch.Snapshot, error))
+      fprintf(stderr, "Catalog snapshot: %s\n", error.c_str());
+  }
+  RebuildNameFilterItems();
+
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  int len = snprintf(db_status, sizeof(db_status),
+                     "Fetched %zu relations of %zu databases (%d rows, "
+                     "%.0f ms)",
+                     rel_names.Size(), fetches.size() - failed, fetched, ms);
+  if (failed && len > 0 && (size_t)len < sizeof(db_status))
+    snprintf(db_status + len, sizeof(db_status) - len, ", %d failed",
+             failed);
+  return true;
+}
+
+static void ConnectToDB() {
+  PGconn *conn = PQconnectdb(db_conn_str);
+  if (PQstatus(conn) == CONNECTION_OK) {
+    snprintf(db_status, sizeof(db_status), "Connected!");
+
+    if (FetchCatalog(conn)) {
+      attr_fetcher.Reset(db_conn_str, db_names);
       // Fetch current WAL state
       PGresult *res_wal = PQexec(
           conn,
@@ -311,7 +1620,7 @@ static void ConnectToDB() {
           for (size_t i = 0; i < files.size(); ++i) {
             if (files[i] == active_wal_filename) {
               current_file_idx = (int)i;
-              LoadCurrentFile();
+              LoadLatestFile();
               found = true;
               break;
             }
@@ -320,17 +1629,16 @@ static void ConnectToDB() {
         }
       }
       PQclear(res_wal);
-
-    } else {
-      snprintf(db_status, sizeof(db_status), "Query Failed: %s",
-               PQerrorMessage(conn));
     }
-    PQclear(res);
   } else {
     snprintf(db_status, sizeof(db_status), "Conn Failed: %s",
              PQerrorMessage(conn));
+    attr_fetcher.Reset("", {});
+    if (!data_dir_path.empty())
+      LoadOfflineCatalog();
   }
   PQfinish(conn);
+  EnforceMemoryBudget();
 }
 
 int main(int, char **) {
@@ -459,6 +1767,25 @@ int main(int, char **) {
       strncpy(ui_db, env_config["DB_NAME"].c_str(), sizeof(ui_db) - 1);
     if (env_config.count("DB_PASSWORD"))
       strncpy(ui_pass, env_config["DB_PASSWORD"].c_str(), sizeof(ui_pass) - 1);
+    if (env_config.count("MEMORY_BUDGET_MB"))
+      memory_budget_mb =
+          std::max(64, atoi(env_config["MEMORY_BUDGET_MB"].c_str()));
+    if (env_config.count("CATALOG_CACHE_DIR"))
+      catalog_cache_dir = env_config["CATALOG_CACHE_DIR"];
+    if (env_config.count("CATALOG_CONNECTIONS"))
+      catalog_connections =
+          std::max(1, atoi(env_config["CATALOG_CONNECTIONS"].c_str()));
+    if (env_config.count("TAIL_RECORDS"))
+      tail_records = std::max(0, atoi(env_config["TAIL_RECORDS"].c_str()));
+    if (env_config.count("PGDATA")) {
+      data_dir_path = env_config["PGDATA"];
+      wal_dir_path = (fs::path(data_dir_path) / "pg_wal").string();
+    } else {
+      fs::path parent = fs::path(wal_dir_path).parent_path();
+      std::error_code ec;
+      if (fs::exists(parent / "global" / "pg_control", ec))
+        data_dir_path = parent.string();
+    }
 
     // Initial Connect
     // Initial Connect
@@ -474,12 +1801,18 @@ int main(int, char **) {
   }
 
   // Configure Hex State Callback
+  WalTraceSetThreadName("ui");
   hex_state.GetAddressNameCallback = HexAddressCallback;
+  hex_state.ReadCallback = HexReadCallback;
+  hex_state.WriteCallback = HexWriteCallback;
 
   // Main loop
   while (!glfwWindowShouldClose(window)) {
     // Poll and handle events (inputs, window resize, etc.)
     glfwPollEvents();
+    WalPerfSetEnabled(show_perf);
+    auto frame_start = std::chrono::steady_clock::now();
+    WalTraceScope frame_trace("ui", "frame");
 
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -520,23 +1853,25 @@ int main(int, char **) {
         // Initial load logic
         if (!files.empty()) {
           if (active_wal_filename.empty()) {
-            current_file_idx =
-                files.size() - 1; // Default to last if no active WAL known
-            LoadCurrentFile();    // Simple default
+            // No server: start where recovery would, else at the last file
+            if (!LoadRedoSegment()) {
+              current_file_idx = files.size() - 1;
+              LoadLatestFile(); // Simple default
+            }
           } else {
             // Try to find the active WAL
             bool found = false;
             for (size_t i = 0; i < files.size(); ++i) {
               if (files[i] == active_wal_filename) {
                 current_file_idx = (int)i;
-                LoadCurrentFile();
+                LoadLatestFile();
                 found = true;
                 break;
               }
             }
             if (!found) {
               current_file_idx = files.size() - 1; // Fallback
-              LoadCurrentFile();
+              LoadLatestFile();
             }
           }
         }
@@ -549,13 +1884,22 @@ int main(int, char **) {
     ImGui::SameLine();
 
     // Calculate available width for the input text
-    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x - 120);
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x -
+                            (data_dir_path.empty() ? 120 : 190));
     ImGui::InputText("##db_conn_str", db_conn_str, sizeof(db_conn_str));
 
     ImGui::SameLine();
     if (ImGui::Button("Connect")) {
       ConnectToDB();
     }
+    if (!data_dir_path.empty()) {
+      ImGui::SameLine();
+      if (ImGui::Button("Offline"))
+        LoadOfflineCatalog();
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Read names from the catalog files in %s",
+                          data_dir_path.c_str());
+    }
     ImGui::SameLine();
     ImGui::Text("%s", db_status);
 
@@ -597,11 +1941,57 @@ int main(int, char **) {
     ImGui::SameLine();
     if (ImGui::Button("Refresh Folder")) {
       files_loaded = false;
+      prefetcher.Clear();
+      overview_dirty = true;
     }
     ImGui::SameLine();
+    if (ImGui::Button("Overview")) {
+      show_overview = true;
+      overview_dirty = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Hotspots"))
+      show_hotspots = !show_hotspots;
+    ImGui::SameLine();
+    if (ImGui::Button("FPIs"))
+      show_fpi_bloat = !show_fpi_bloat;
+    ImGui::SameLine();
+    if (ImGui::Button("Xacts"))
+      show_xacts = !show_xacts;
+    ImGui::SameLine();
+    if (ImGui::Button("Columns"))
+      show_columns = !show_columns;
+    ImGui::SameLine();
+    if (ImGui::Button("Timeline")) {
+      show_timeline = !show_timeline;
+      if (show_timeline)
+        StartTimeIndex();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Perf"))
+      show_perf = !show_perf;
+    ImGui::SameLine();
     if (ImGui::Button("Refresh File")) {
       LoadCurrentFile();
     }
+    ImGui::SameLine();
+    if (ImGui::Button("Latest"))
+      LoadCurrentFileTail();
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Only the last N records of this segment, read "
+                        "backwards from its end");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(80);
+    if (ImGui::InputInt("##tail_records", &tail_records, 0))
+      tail_records = std::max(1, tail_records);
+    if (!data_dir_path.empty()) {
+      ImGui::SameLine();
+      if (ImGui::Button("Redo"))
+        LoadRedoSegment();
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Reread pg_control and show the WAL from the last "
+                          "checkpoint's redo pointer");
+    }
 
     // Moved controls: Show Raw Ids, Start LSN, Go
     ImGui::SameLine();
@@ -621,7 +2011,10 @@ int main(int, char **) {
 
     ImGui::SameLine();
     if (ImGui::Button("Go")) {
-      if (!file_data.empty()) {
+      if (!tail_status.empty()) {
+        // Only some pages of the segment are held: read it from the LSN on
+        LoadCurrentFile(search_lsn);
+      } else if (!file_data.Empty()) {
         wal_records.clear();
 
         // Calculate offset from LSN
@@ -629,22 +2022,56 @@ int main(int, char **) {
         size_t start_offset_calc = 0;
         if (search_lsn > current_file_base_lsn) {
           uint64_t diff = search_lsn - current_file_base_lsn;
-          if (diff < file_data.size()) {
+          if (diff < file_data.Size()) {
             start_offset_calc = (size_t)diff;
           }
         }
 
-        if (start_offset_calc < file_data.size()) {
-          wal_parser.Parse(file_data.data() + start_offset_calc,
-                           file_data.size() - start_offset_calc, wal_records);
-          // Fixup global offsets
-          for (auto &r : wal_records) {
-            r.Offset += start_offset_calc;
-          }
+        // Parse from the top of the page holding the LSN so we start on a
+        // record boundary, then drop the records before it.
+        if (start_offset_calc < file_data.Size()) {
+          size_t page_start =
+              start_offset_calc - start_offset_calc % WAL_PAGE_SIZE;
+          wal_parser.ParseFrom(file_data, page_start, wal_records);
+          wal_end_lsn = wal_parser.GetEndLSN();
+          wal_end_reason = wal_parser.GetEndReason();
+          wal_records.erase(
+              std::remove_if(wal_records.begin(), wal_records.end(),
+                             [](const WalRecordInfo &r) {
+                               return r.LSN < search_lsn;
+                             }),
+              wal_records.end());
         }
+        filter_dirty = true;
+        BuildXactIndex();
       }
     }
 
+    ImGui::SameLine();
+    ImGui::Text("Time:");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(160);
+    bool jump = ImGui::InputTextWithHint("##jump_time", "14:03:27", jump_time,
+                                         sizeof(jump_time),
+                                         ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::SameLine();
+    if (time_index_busy && jump_pending) {
+      ImGui::Text("Indexing %zu / %zu...", time_index_done.load(),
+                  time_index_total);
+    } else if (ImGui::Button("Jump") || jump) {
+      // Segments written since the last jump are indexed first
+      jump_pending = true;
+      StartTimeIndex();
+    }
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Show the WAL written from a local time on, e.g. "
+                        "14:03:27 or 2024-01-31 14:03:27, found by commit "
+                        "and checkpoint times across the folder");
+    if (!jump_status.empty()) {
+      ImGui::SameLine();
+      ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%s", jump_status.c_str());
+    }
+
     // Filter Variables
     static bool rmid_filter_states[24];
     static bool rmid_filters_initialized = false;
@@ -665,12 +2092,14 @@ int main(int, char **) {
     if (ImGui::BeginCombo("##nsp_filter", current_nsp_name)) {
       if (ImGui::Selectable("All", selected_namespace_idx == -1)) {
         selected_namespace_idx = -1;
+        filter_dirty = true;
       }
       for (int i = 0; i < namespace_filter_items.size(); i++) {
         bool is_selected = (selected_namespace_idx == i);
         if (ImGui::Selectable(namespace_filter_items[i].name.c_str(),
                               is_selected)) {
           selected_namespace_idx = i;
+          filter_dirty = true;
         }
         if (is_selected)
           ImGui::SetItemDefaultFocus();
@@ -691,12 +2120,14 @@ int main(int, char **) {
     if (ImGui::BeginCombo("##table_filter", current_table_name)) {
       if (ImGui::Selectable("All Tables", selected_table_idx == -1)) {
         selected_table_idx = -1;
+        filter_dirty = true;
       }
       for (int i = 0; i < table_filter_items.size(); i++) {
         bool is_selected = (selected_table_idx == i);
         if (ImGui::Selectable(table_filter_items[i].name.c_str(),
                               is_selected)) {
           selected_table_idx = i;
+          filter_dirty = true;
         }
         if (is_selected)
           ImGui::SetItemDefaultFocus();
@@ -742,26 +2173,82 @@ int main(int, char **) {
       if (ImGui::Button("All")) {
         for (int i = 0; i < rmid_count; ++i)
           rmid_filter_states[i] = true;
+        filter_dirty = true;
       }
       ImGui::SameLine();
       if (ImGui::Button("None")) {
         for (int i = 0; i < rmid_count; ++i)
           rmid_filter_states[i] = false;
+        filter_dirty = true;
       }
       ImGui::Separator();
 
       for (int i = 0; i < rmid_count; i++) {
-        ImGui::Checkbox(rmid_names[i], &rmid_filter_states[i]);
+        if (ImGui::Checkbox(rmid_names[i], &rmid_filter_states[i]))
+          filter_dirty = true;
       }
       ImGui::EndCombo();
     }
 
     ImGui::SameLine();
-    ImGui::Text(" | Records: %zu", wal_records.size());
+    ImGui::Text(" | Records: %zu / %zu", filtered_indices.size(),
+                wal_records.size());
+    if (!file_data.Empty()) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("| WAL ends at %X/%X: %s",
+                          (uint32_t)(wal_end_lsn >> 32), (uint32_t)wal_end_lsn,
+                          WalEndReasonName(wal_end_reason));
+    }
+    if (!tail_status.empty()) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("| %s", tail_status.c_str());
+    }
+    ImGui::SameLine();
+    DrawMemoryStatus();
+    if (control_loaded) {
+      ImGui::TextDisabled(
+          "pg_control: %s, checkpoint %X/%X, redo %X/%X, timeline %u",
+          WalClusterStateName(control_file.State),
+          (uint32_t)(control_file.CheckpointLSN >> 32),
+          (uint32_t)control_file.CheckpointLSN,
+          (uint32_t)(control_file.RedoLSN >> 32),
+          (uint32_t)control_file.RedoLSN, control_file.Timeline);
+    }
+    if (!control_error.empty()) {
+      if (control_loaded)
+        ImGui::SameLine();
+      ImGui::TextColored(ImVec4(1, 0.6f, 0, 1), "%s", control_error.c_str());
+    }
+
+    // Filter bar (expression language, see wal_filter.h)
+    ImGui::AlignTextToFramePadding();
+    ImGui::Text("Filter:");
+    ImGui::SameLine();
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x - 200);
+    if (ImGui::InputTextWithHint(
+            "##filter_expr",
+            "e.g. rmid in (Heap,Btree) and rel = orders and len > 4096",
+            filter_expr, sizeof(filter_expr),
+            ImGuiInputTextFlags_EnterReturnsTrue))
+      filter_dirty = true;
+    ImGui::SameLine();
+    if (ImGui::Button("Apply"))
+      filter_dirty = true;
+    ImGui::SameLine();
+    if (ImGui::Button("Clear")) {
+      filter_expr[0] = 0;
+      filter_dirty = true;
+    }
+    if (!filter_error.empty())
+      ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "Filter error: %s",
+                         filter_error.c_str());
+
+    if (filter_dirty)
+      RebuildFilteredRecords(rmid_filter_states, rmid_count);
 
     ImGui::Separator();
 
-    if (hex_state.Bytes) {
+    if (!file_data.Empty()) {
       if (!wal_records.empty()) {
 
         // Dynamic resizing: Hex Editor gets ~30%, Table gets rest
@@ -782,194 +2269,27 @@ int main(int, char **) {
         if (table_h < 100.0f)
           table_h = 100.0f;
 
-        if (ImGui::BeginTable("WalRecords", 6,
-                              ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
-                                  ImGuiTableFlags_ScrollY |
-                                  ImGuiTableFlags_Resizable,
-                              ImVec2(0, table_h))) {
-          ImGui::TableSetupScrollFreeze(0, 1); // Make top row always visible
-          // Increased widths by ~50-80%
-          ImGui::TableSetupColumn("LSN", ImGuiTableColumnFlags_WidthFixed,
-                                  150.0f);
-          ImGui::TableSetupColumn("RMID", ImGuiTableColumnFlags_WidthFixed,
-                                  160.0f);
-          ImGui::TableSetupColumn("Info", ImGuiTableColumnFlags_WidthFixed,
-                                  80.0f);
-          ImGui::TableSetupColumn("Length", ImGuiTableColumnFlags_WidthFixed,
-                                  80.0f);
-          ImGui::TableSetupColumn("RelNode", ImGuiTableColumnFlags_WidthFixed,
-                                  350.0f);
-          ImGui::TableSetupColumn("Description",
-                                  ImGuiTableColumnFlags_WidthStretch);
-          ImGui::TableHeadersRow();
-
-          for (const auto &rec : wal_records) {
-            // Apply Filters
-            // Search Text removed as per user request
-            // if (filter_text[0] != 0) { ... }
-
-            // RMID Filter
-            // Check usage of rmid_filter_states
-            // Handle Out Of Bounds just in case
-            if (rec.RMID >= 0 && rec.RMID < 24) {
-              if (!rmid_filter_states[rec.RMID])
-                continue;
-            } else {
-              // Unknown RMID, maybe show it? or hide?
-              // Let's hide if not explicitly enabled (but we don't have a
-              // checkbox for > 23 usually) Actually our names array goes up
-              // to 23.
-            }
-
-            // Filter out future records (invalid tail)
-            // User requirement: "display records upto the current WAL LSN
-            // only. anything beyond that is invalid."
-            if (active_wal_lsn > 0 && rec.LSN > active_wal_lsn) {
-              continue;
-            }
-
-            // Filter out garbage from recycled files (LSN mismatch)
-            // If the record's LSN is not within the file's segment range,
-            // hide it.
-            if (current_file_base_lsn > 0) {
-              if (rec.LSN < current_file_base_lsn ||
-                  rec.LSN >= current_file_base_lsn + WAL_SEGMENT_SIZE) {
-                continue;
-              }
-            }
-
-            // Table Filter
-            if (selected_table_idx != -1) {
-              uint32_t target_node = table_filter_items[selected_table_idx].id;
-              bool match = false;
-              for (const auto &node : rec.RelFileNodes) {
-                if (node.relNode == target_node) {
-                  match = true;
-                  break;
-                }
-              }
-              if (!match)
-                continue;
-            }
-
-            ImGui::TableNextRow();
-
-            // Highlight XID logic
-            if (highlighted_xid != 0 && rec.XID == highlighted_xid) {
-              ImGui::TableSetBgColor(
-                  ImGuiTableBgTarget_RowBg0,
-                  ImGui::GetColorU32(
-                      ImVec4(0.3f, 0.3f, 0.2f, 0.6f))); // Yellow-ish tint
-            }
-
-            // Make row selectable
-            ImGui::TableNextColumn();
-            char lsnBuf[32];
-            snprintf(lsnBuf, 32, "%lX", rec.LSN);
-
-            // We use a unique ID for selectable to allow multiple items with
-            // same XID to be handled separately if needed, but here we just
-            // need to detect click. Note: Selectable returns true on click.
-            bool is_selected = (rec.XID != 0 && rec.XID == highlighted_xid);
-            if (ImGui::Selectable(lsnBuf, is_selected,
-                                  ImGuiSelectableFlags_SpanAllColumns)) {
-              // Highlight in hex editor
-              hex_state.SelectStartByte = rec.Offset;
-              hex_state.SelectEndByte = rec.Offset + rec.Length - 1;
-
-              // Update highlighted XID
-              highlighted_xid = rec.XID;
-            }
-
-            // Context Menu
-            if (ImGui::BeginPopupContextItem()) {
-              if (ImGui::MenuItem("Show Hexdump")) {
-                show_hexdump = true;
-                hex_state.SelectStartByte = rec.Offset;
-                hex_state.SelectEndByte = rec.Offset + rec.Length - 1;
-                highlighted_xid = rec.XID;
-                // Note: CollapsingHeader state is managed by show_hexdump
-                // variable if we use it with &
-              }
-              ImGui::EndPopup();
-            }
-
-            // Offset column removed
-
-            ImGui::TableNextColumn();
-            // Show Name only
-            ImGui::Text("%s", wal_parser.GetRmidName(rec.RMID).c_str());
-
-            ImGui::TableNextColumn();
-            ImGui::Text("%02X", rec.Info);
-
-            ImGui::TableNextColumn();
-            ImGui::Text("%u", rec.Length);
-
-            ImGui::TableNextColumn();
-            if (rec.RelFileNodes.empty()) {
-              ImGui::Text("-");
-            } else {
-              std::string s;
-              for (size_t i = 0; i < rec.RelFileNodes.size(); ++i) {
-                if (i > 0)
-                  s += "\n"; // Use newlines for multiple relations
-
-                if (show_raw_ids) {
-                  // spc
-                  s += std::to_string(rec.RelFileNodes[i].spcNode) + "/";
-
-                  // db (Name)
-                  s += std::to_string(rec.RelFileNodes[i].dbNode);
-                  if (db_names.count(rec.RelFileNodes[i].dbNode)) {
-                    s += "(" + db_names[rec.RelFileNodes[i].dbNode] + ")";
-                  }
-                  s += "/";
-
-                  // rel (Name)
-                  s += std::to_string(rec.RelFileNodes[i].relNode);
-                  if (rel_names.count(rec.RelFileNodes[i].relNode)) {
-                    s += "(" + rel_names[rec.RelFileNodes[i].relNode] + ")";
-                  } else if (rel_names_oid.count(rec.RelFileNodes[i].relNode)) {
-                    s += "(" + rel_names_oid[rec.RelFileNodes[i].relNode] +
-                         "*)"; // * indicates OID match
-                  }
-                } else {
-                  // Simplified view: db_name:rel_name
-                  // DB Name
-                  std::string db = std::to_string(rec.RelFileNodes[i].dbNode);
-                  if (db_names.count(rec.RelFileNodes[i].dbNode)) {
-                    db = db_names[rec.RelFileNodes[i].dbNode];
-                  }
-
-                  // Rel Name
-                  std::string rel = std::to_string(rec.RelFileNodes[i].relNode);
-                  if (rel_names.count(rec.RelFileNodes[i].relNode)) {
-                    rel = rel_names[rec.RelFileNodes[i].relNode];
-                  } else if (rel_names_oid.count(rec.RelFileNodes[i].relNode)) {
-                    rel = rel_names_oid[rec.RelFileNodes[i].relNode] + "*";
-                  }
-
-                  s += db + ":" + rel;
-                }
-              }
-              ImGui::Text("%s", s.c_str());
-            }
-
-            ImGui::TableNextColumn();
-            ImGui::Text("%s", rec.Description.c_str());
-            // Maybe append XID here?
-            if (rec.XID != 0)
-              ImGui::SameLine();
-            ImGui::TextColored(ImVec4(0.7f, 0.7f, 1, 1), "XID: %u", rec.XID);
+        WalRecordTableNames names = {&db_names, &rel_names, show_raw_ids};
+        WalRecordTableAction action;
+        DrawWalRecordTable(wal_records, filtered_indices, names, &xact_index,
+                           highlighted_xid, &record_details,
+                           should_scroll_to_bottom,
+                           ImVec2(0, table_h), action);
+        if (action.Selected) {
+          // Highlight in hex editor and the records of its transaction
+          const WalRecordInfo &rec = *action.Selected;
+          // A tail may reach back into earlier segments, which aren't in
+          // the hex view.
+          if (rec.LSN >= current_file_base_lsn) {
+            hex_state.SelectStartByte = rec.Offset;
+            hex_state.SelectEndByte = rec.Offset + rec.Length - 1;
           }
-
-          if (should_scroll_to_bottom) {
-            ImGui::SetScrollHereY(1.0f);
-            should_scroll_to_bottom = false;
-          }
-
-          ImGui::EndTable();
+          highlighted_xid = rec.XID;
+          selected_lsn = rec.LSN;
+          if (action.ShowHexdump)
+            show_hexdump = true;
+          if (action.ShowColumns)
+            show_columns = true;
         }
       }
 
@@ -980,6 +2300,8 @@ int main(int, char **) {
         ImGui::BeginHexEditor("##HexEditor", &hex_state, avail);
         ImGui::EndHexEditor();
       }
+    } else if (error_msg[0]) {
+      ImGui::TextColored(ImVec4(1, 0, 0, 1), "%s", error_msg);
     } else {
       ImGui::Text("No file loaded.");
     }
@@ -987,6 +2309,16 @@ int main(int, char **) {
     ImGui::End();
     // Removed brace here to keep Block 389 open
 
+    DrawOverviewWindow();
+    DrawHotspotWindow();
+    DrawFpiBloatWindow();
+    DrawXactWindow();
+    DrawColumnsWindow();
+    PollTimeIndex();
+    PollPrefetchMemory();
+    DrawTimelineWindow();
+    DrawPerfWindow();
+
     // Rendering
     ImGui::Render();
     int display_w, display_h;
@@ -998,10 +2330,19 @@ int main(int, char **) {
     glClear(GL_COLOR_BUFFER_BIT);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+    if (WalPerfEnabled())
+      WalPerfRecord(WalPerfSection::Frame,
+                    std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - frame_start)
+                        .count());
+    WalPerfEndFrame();
+    perf_frame_allocs = alloc_count.exchange(0, std::memory_order_relaxed);
     glfwSwapBuffers(window);
   }
 
   // Cleanup
+  if (time_index_thread.joinable())
+    time_index_thread.join();
   ImGui_ImplOpenGL3_Shutdown();
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
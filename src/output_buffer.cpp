@@ -0,0 +1,107 @@
+#include "output_buffer.h"
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// Writes the decimal digits of v right-aligned into the end of tmp and
+// returns the number of digits.
+static size_t FormatDec(uint64_t v, char *tmp_end) {
+  size_t n = 0;
+  do {
+    *--tmp_end = (char)('0' + v % 10);
+    v /= 10;
+    n++;
+  } while (v);
+  return n;
+}
+
+static size_t FormatHex(uint64_t v, char *tmp_end) {
+  size_t n = 0;
+  do {
+    *--tmp_end = hex_digits[v & 0xF];
+    v >>= 4;
+    n++;
+  } while (v);
+  return n;
+}
+
+void OutputBuffer::Flush() {
+  if (pos_ > 0) {
+    fwrite(buf_.get(), 1, pos_, out_);
+    pos_ = 0;
+  }
+}
+
+void OutputBuffer::AppendDec(uint64_t v) {
+  char tmp[24];
+  size_t n = FormatDec(v, tmp + sizeof(tmp));
+  Append(tmp + sizeof(tmp) - n, n);
+}
+
+void OutputBuffer::AppendHex(uint64_t v) {
+  char tmp[24];
+  size_t n = FormatHex(v, tmp + sizeof(tmp));
+  Append(tmp + sizeof(tmp) - n, n);
+}
+
+void OutputBuffer::AppendLSN(uint64_t lsn) {
+  AppendHex(lsn >> 32);
+  Append('/');
+  AppendHex(lsn & 0xFFFFFFFF);
+}
+
+void OutputBuffer::AppendPadded(const char *s, size_t n, size_t width) {
+  Append(s, n);
+  while (n++ < width)
+    Append(' ');
+}
+
+void OutputBuffer::AppendDecPadded(uint64_t v, size_t width) {
+  char tmp[24];
+  size_t n = FormatDec(v, tmp + sizeof(tmp));
+  AppendPadded(tmp + sizeof(tmp) - n, n, width);
+}
+
+void OutputBuffer::AppendHexPadded(uint64_t v, size_t width) {
+  char tmp[24];
+  size_t n = FormatHex(v, tmp + sizeof(tmp));
+  AppendPadded(tmp + sizeof(tmp) - n, n, width);
+}
+
+void OutputBuffer::AppendJsonString(const char *s, size_t n) {
+  Append('"');
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = (unsigned char)s[i];
+    if (c == '"' || c == '\\') {
+      Append('\\');
+      Append((char)c);
+    } else if (c < 0x20) {
+      Append("\\u00", 4);
+      Append(hex_digits[c >> 4]);
+      Append(hex_digits[c & 0xF]);
+    } else {
+      Append((char)c);
+    }
+  }
+  Append('"');
+}
+
+void OutputBuffer::AppendCsvField(const char *s, size_t n) {
+  bool needs_quotes = false;
+  for (size_t i = 0; i < n; i++) {
+    if (s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r') {
+      needs_quotes = true;
+      break;
+    }
+  }
+  if (!needs_quotes) {
+    Append(s, n);
+    return;
+  }
+  Append('"');
+  for (size_t i = 0; i < n; i++) {
+    if (s[i] == '"')
+      Append('"');
+    Append(s[i]);
+  }
+  Append('"');
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+// Fixed-size output buffer used by the CLI to format millions of records
+// without going through iostream manipulators. The buffer is allocated once,
+// on the heap (it is too big for a thread's stack), and nothing else here
+// allocates: all numbers are converted by hand into the buffer and the
+// buffer is flushed with a single fwrite when it fills up.
+class OutputBuffer {
+public:
+  explicit OutputBuffer(FILE *out) : out_(out), buf_(new char[kSize]) {}
+  ~OutputBuffer() { Flush(); }
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+  void Flush();
+
+  void Append(const char *s, size_t n) {
+    if (pos_ + n > kSize) {
+      Flush();
+      if (n > kSize) {
+        fwrite(s, 1, n, out_);
+        return;
+      }
+    }
+    memcpy(buf_.get() + pos_, s, n);
+    pos_ += n;
+  }
+  void Append(const char *s) { Append(s, strlen(s)); }
+  void Append(char c) {
+    if (pos_ == kSize)
+      Flush();
+    buf_[pos_++] = c;
+  }
+
+  void AppendDec(uint64_t v);
+  void AppendHex(uint64_t v);
+  // PostgreSQL style "%X/%X" LSN.
+  void AppendLSN(uint64_t lsn);
+  // Left-aligned field padded with spaces to `width` columns.
+  void AppendPadded(const char *s, size_t n, size_t width);
+  void AppendDecPadded(uint64_t v, size_t width);
+  void AppendHexPadded(uint64_t v, size_t width);
+  // Quoted and escaped for JSON / CSV respectively.
+  void AppendJsonString(const char *s, size_t n);
+  void AppendCsvField(const char *s, size_t n);
+
+private:
+  static constexpr size_t kSize = 1 << 20;
+  FILE *out_;
+  size_t pos_ = 0;
+  std::unique_ptr<char[]> buf_;
+};
@@ -0,0 +1,625 @@
+#include "wal_archive.h"
+#include "wal_trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#ifdef WAL_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WAL_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef WAL_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define WAL_ARCHIVE_IN_CHUNK (64 * 1024)
+// Decompressed bytes handed to the parser per step: a few pages.
+#define WAL_ARCHIVE_OUT_CHUNK (8 * WAL_PAGE_SIZE)
+
+static bool EndsWith(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+const char *WalCompressionName(WalCompression compression) {
+  switch (compression) {
+  case WalCompression::None:
+    return "none";
+  case WalCompression::Gzip:
+    return "gzip";
+  case WalCompression::Lz4:
+    return "lz4";
+  case WalCompression::Zstd:
+    return "zstd";
+  }
+  return "?";
+}
+
+bool WalCompressionAvailable(WalCompression compression) {
+  switch (compression) {
+  case WalCompression::None:
+    return true;
+  case WalCompression::Gzip:
+#ifdef WAL_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  case WalCompression::Lz4:
+#ifdef WAL_HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+  case WalCompression::Zstd:
+#ifdef WAL_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+WalCompression WalCompressionFromName(const std::string &name) {
+  if (EndsWith(name, ".gz"))
+    return WalCompression::Gzip;
+  if (EndsWith(name, ".lz4"))
+    return WalCompression::Lz4;
+  if (EndsWith(name, ".zst") || EndsWith(name, ".zstd"))
+    return WalCompression::Zstd;
+  return WalCompression::None;
+}
+
+std::string WalStripCompressionSuffix(const std::string &name) {
+  if (WalCompressionFromName(name) == WalCompression::None)
+    return name;
+  return name.substr(0, name.rfind('.'));
+}
+
+// --- WalDecompressor ---
+
+WalDecompressor::~WalDecompressor() { Close(); }
+
+void WalDecompressor::Close() {
+  if (ctx_) {
+    switch (compression_) {
+#ifdef WAL_HAVE_ZLIB
+    case WalCompression::Gzip:
+      inflateEnd((z_stream *)ctx_);
+      delete (z_stream *)ctx_;
+      break;
+#endif
+#ifdef WAL_HAVE_LZ4
+    case WalCompression::Lz4:
+      LZ4F_freeDecompressionContext((LZ4F_dctx *)ctx_);
+      break;
+#endif
+#ifdef WAL_HAVE_ZSTD
+    case WalCompression::Zstd:
+      ZSTD_freeDStream((ZSTD_DStream *)ctx_);
+      break;
+#endif
+    default:
+      break;
+    }
+    ctx_ = nullptr;
+  }
+  if (file_) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+bool WalDecompressor::OpenFile(const std::string &path,
+                               WalCompression compression,
+                               std::string &error) {
+  Close();
+  compression_ = compression;
+  file_ = fopen(path.c_str(), "rb");
+  if (!file_) {
+    error = "failed to open file";
+    return false;
+  }
+  in_buf_.resize(WAL_ARCHIVE_IN_CHUNK);
+  in_ = nullptr;
+  in_len_ = 0;
+  input_done_ = false;
+  return Init(error);
+}
+
+bool WalDecompressor::OpenBuffer(const uint8_t *data, size_t size,
+                                 WalCompression compression,
+                                 std::string &error) {
+  Close();
+  compression_ = compression;
+  in_ = data;
+  in_len_ = size;
+  input_done_ = true;
+  return Init(error);
+}
+
+bool WalDecompressor::Init(std::string &error) {
+  stream_done_ = false;
+  frame_complete_ = false;
+  if (!WalCompressionAvailable(compression_) ||
+      compression_ == WalCompression::None) {
+    error = std::string(WalCompressionName(compression_)) +
+            " support not compiled in";
+    return false;
+  }
+  switch (compression_) {
+#ifdef WAL_HAVE_ZLIB
+  case WalCompression::Gzip: {
+    z_stream *zs = new z_stream();
+    // 15 + 32: largest window, detect gzip or zlib header
+    if (inflateInit2(zs, 15 + 32) != Z_OK) {
+      delete zs;
+      error = "inflateInit2 failed";
+      return false;
+    }
+    ctx_ = zs;
+    break;
+  }
+#endif
+#ifdef WAL_HAVE_LZ4
+  case WalCompression::Lz4: {
+    LZ4F_dctx *dctx;
+    if (LZ4F_isError(
+            LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+      error = "LZ4F_createDecompressionContext failed";
+      return false;
+    }
+    ctx_ = dctx;
+    break;
+  }
+#endif
+#ifdef WAL_HAVE_ZSTD
+  case WalCompression::Zstd: {
+    ZSTD_DStream *ds = ZSTD_createDStream();
+    if (!ds || ZSTD_isError(ZSTD_initDStream(ds))) {
+      ZSTD_freeDStream(ds);
+      error = "ZSTD_createDStream failed";
+      return false;
+    }
+    ctx_ = ds;
+    break;
+  }
+#endif
+  default:
+    break;
+  }
+  return true;
+}
+
+bool WalDecompressor::FillInput() {
+  if (in_len_ > 0)
+    return true;
+  if (input_done_ || !file_)
+    return false;
+  size_t n = fread(in_buf_.data(), 1, in_buf_.size(), file_);
+  if (n == 0) {
+    input_done_ = true;
+    return false;
+  }
+  in_ = in_buf_.data();
+  in_len_ = n;
+  return true;
+}
+
+size_t WalDecompressor::Read(uint8_t *out, size_t len, std::string &error) {
+  WalTraceScope trace("decompress", WalCompressionName(compression_));
+  size_t produced = 0;
+  while (produced < len && !stream_done_) {
+    bool have_input = FillInput();
+    size_t consumed = 0, written = 0;
+
+    switch (compression_) {
+#ifdef WAL_HAVE_ZLIB
+    case WalCompression::Gzip: {
+      z_stream *zs = (z_stream *)ctx_;
+      zs->next_in = (Bytef *)in_;
+      zs->avail_in = (uInt)in_len_;
+      zs->next_out = out + produced;
+      zs->avail_out = (uInt)(len - produced);
+      int ret = inflate(zs, Z_NO_FLUSH);
+      consumed = in_len_ - zs->avail_in;
+      written = (len - produced) - zs->avail_out;
+      if (ret == Z_STREAM_END) {
+        // gzip allows several members back to back
+        in_ += consumed;
+        in_len_ -= consumed;
+        produced += written;
+        if (FillInput())
+          inflateReset(zs);
+        else
+          stream_done_ = true;
+        continue;
+      }
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        error = std::string("gzip: ") + (zs->msg ? zs->msg : "corrupt data");
+        return 0;
+      }
+      break;
+    }
+#endif
+#ifdef WAL_HAVE_LZ4
+    case WalCompression::Lz4: {
+      size_t dst_size = len - produced;
+      size_t src_size = in_len_;
+      size_t ret = LZ4F_decompress((LZ4F_dctx *)ctx_, out + produced,
+                                   &dst_size, in_, &src_size, nullptr);
+      if (LZ4F_isError(ret)) {
+        error = std::string("lz4: ") + LZ4F_getErrorName(ret);
+        return 0;
+      }
+      consumed = src_size;
+      written = dst_size;
+      if (consumed || written)
+        frame_complete_ = ret == 0;
+      break;
+    }
+#endif
+#ifdef WAL_HAVE_ZSTD
+    case WalCompression::Zstd: {
+      ZSTD_inBuffer zin = {in_, in_len_, 0};
+      ZSTD_outBuffer zout = {out + produced, len - produced, 0};
+      size_t ret = ZSTD_decompressStream((ZSTD_DStream *)ctx_, &zout, &zin);
+      if (ZSTD_isError(ret)) {
+        error = std::string("zstd: ") + ZSTD_getErrorName(ret);
+        return 0;
+      }
+      consumed = zin.pos;
+      written = zout.pos;
+      if (consumed || written)
+        frame_complete_ = ret == 0;
+      break;
+    }
+#endif
+    default:
+      stream_done_ = true;
+      break;
+    }
+
+    in_ += consumed;
+    in_len_ -= consumed;
+    produced += written;
+    if (!have_input && written == 0) {
+      // Out of input and the decoder has nothing buffered: fine if that
+      // was the end of a frame.
+      if (!stream_done_ && !frame_complete_)
+        error = std::string(WalCompressionName(compression_)) +
+                ": truncated stream";
+      stream_done_ = true;
+      break;
+    }
+  }
+  trace.SetBytes(produced);
+  return produced;
+}
+
+// --- Loading ---
+
+// Start LSN implied by the segment's file name. The segment size comes from
+// the long page header if the data has one, else from the file size.
+static uint64_t NameBaseLSN(const std::string &path, const uint8_t *data,
+                            size_t size, uint64_t file_size) {
+  std::string name = WalStripCompressionSuffix(
+      std::filesystem::path(path).filename().string());
+  WalPageHeaderInfo header;
+  uint64_t segment_size = WalSegmentSizeFromFileSize(file_size);
+  if (ReadWalPageHeader(data, size, header) && header.SegmentSize)
+    segment_size = header.SegmentSize;
+  return WalFileNameToLSN(name, segment_size);
+}
+
+static bool ReadRawSegment(const std::string &path,
+                           std::vector<uint8_t> &data, std::string &error) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    error = "failed to open file";
+    return false;
+  }
+  WalTraceScope trace("io", "read");
+  trace.SetSegment(path);
+  std::error_code ec;
+  uint64_t size = std::filesystem::file_size(path, ec);
+  data.resize(ec ? 0 : (size_t)size);
+  bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  trace.SetBytes(data.size());
+  if (!ok) {
+    error = "failed to read file data";
+    return false;
+  }
+  return true;
+}
+
+// Decompresses into data while feeding the parser.
+static bool StreamSegment(const std::string &path, WalDecompressor &dec,
+                          WalParser &parser, std::vector<uint8_t> &data,
+                          std::vector<WalRecordInfo> &records,
+                          std::string &error, bool stop_at_end) {
+  data.clear();
+  records.clear();
+  parser.BeginIncremental();
+  size_t size = 0;
+  bool parsing = true;
+  for (;;) {
+    if (data.size() < size + WAL_ARCHIVE_OUT_CHUNK)
+      data.resize(std::max(data.size() * 2,
+                           (size_t)(16u << 20))); // One default segment
+    size_t n = dec.Read(data.data() + size, WAL_ARCHIVE_OUT_CHUNK, error);
+    if (!error.empty()) {
+      data.resize(size);
+      return false;
+    }
+    if (size == 0)
+      parser.SetExpectedBaseLSN(NameBaseLSN(path, data.data(), n, 0));
+    size += n;
+    if (parsing)
+      parsing = parser.ParseMore(data.data(), size, n == 0, records);
+    if (n == 0 || (!parsing && stop_at_end))
+      break;
+  }
+  data.resize(size);
+  return true;
+}
+
+bool LoadWalSegment(const std::string &path, WalParser &parser,
+                    std::vector<uint8_t> &data,
+                    std::vector<WalRecordInfo> &records, std::string &error,
+                    bool stop_at_end) {
+  WalCompression compression = WalCompressionFromName(path);
+  if (compression == WalCompression::None) {
+    if (!ReadRawSegment(path, data, error))
+      return false;
+    return ParseWalSegment(path, parser, data, records);
+  }
+
+  WalDecompressor dec;
+  if (!dec.OpenFile(path, compression, error))
+    return false;
+  return StreamSegment(path, dec, parser, data, records, error, stop_at_end);
+}
+
+bool ParseWalSegment(const std::string &path, WalParser &parser,
+                     const std::vector<uint8_t> &data,
+                     std::vector<WalRecordInfo> &records) {
+  parser.SetExpectedBaseLSN(
+      NameBaseLSN(path, data.data(), data.size(), data.size()));
+  parser.Parse(data.data(), data.size(), records);
+  return true;
+}
+
+bool LoadWalSegmentFromBuffer(const std::string &path,
+                              const uint8_t *compressed, size_t size,
+                              WalParser &parser, std::vector<uint8_t> &data,
+                              std::vector<WalRecordInfo> &records,
+                              std::string &error, bool stop_at_end) {
+  WalTraceScope trace("load", "load");
+  trace.SetSegment(path);
+  trace.SetBytes(size);
+  WalDecompressor dec;
+  if (!dec.OpenBuffer(compressed, size, WalCompressionFromName(path), error))
+    return false;
+  return StreamSegment(path, dec, parser, data, records, error, stop_at_end);
+}
+
+size_t WalRecordsMemoryUsage(const std::vector<WalRecordInfo> &records) {
+  size_t bytes = records.capacity() * sizeof(WalRecordInfo);
+  for (const WalRecordInfo &rec : records) {
+    if (rec.Description.capacity() > 15) // Beyond the small-string buffer
+      bytes += rec.Description.capacity() + 1;
+    bytes += rec.RelFileNodes.capacity() * sizeof(WalRelFileNode);
+  }
+  return bytes;
+}
+
+size_t WalSegmentMemoryUsage(const WalLoadedSegment &seg) {
+  return seg.Data.ResidentBytes() + WalRecordsMemoryUsage(seg.Records);
+}
+
+bool LoadWalSegment(const std::string &path, WalParser &parser,
+                    WalSegmentCache *cache, WalLoadedSegment &out,
+                    bool speculative) {
+  WalTraceScope trace("load", "load");
+  trace.SetSegment(path);
+  if (cache && cache->Lookup(path, out, !speculative)) {
+    trace.SetItems(out.Records.size());
+    return true;
+  }
+
+  out.Path = path;
+  out.Error.clear();
+  std::vector<uint8_t> data;
+  bool loaded = LoadWalSegment(path, parser, data, out.Records, out.Error);
+  out.EndLSN = parser.GetEndLSN();
+  out.EndReason = parser.GetEndReason();
+  out.SegmentSize = parser.GetSegmentSize();
+  if (!loaded) {
+    out.Data.Clear();
+    out.Records.clear();
+    return false;
+  }
+  out.Data.Assign(std::move(data));
+  trace.SetBytes(out.Data.Size());
+  trace.SetItems(out.Records.size());
+  if (cache)
+    cache->Insert(out, !speculative);
+  return true;
+}
+
+bool ReadWalSegmentFile(const std::string &path, std::vector<uint8_t> &data,
+                        std::string &error) {
+  WalCompression compression = WalCompressionFromName(path);
+  if (compression == WalCompression::None)
+    return ReadRawSegment(path, data, error);
+
+  WalDecompressor dec;
+  if (!dec.OpenFile(path, compression, error))
+    return false;
+  size_t size = 0;
+  for (;;) {
+    if (data.size() < size + WAL_ARCHIVE_OUT_CHUNK)
+      data.resize(std::max(data.size() * 2, (size_t)(16u << 20)));
+    size_t n = dec.Read(data.data() + size, WAL_ARCHIVE_OUT_CHUNK, error);
+    size += n;
+    if (!error.empty())
+      return false;
+    if (n == 0)
+      break;
+  }
+  data.resize(size);
+  return true;
+}
+
+bool LoadWalSegmentAt(const std::string &path, WalParser &parser,
+                      uint64_t start_lsn, WalLoadedSegment &out) {
+  WalTraceScope trace("load", "load");
+  trace.SetSegment(path);
+  out.Path = path;
+  out.Error.clear();
+  out.Records.clear();
+  out.EndLSN = 0;
+  out.EndReason = WalEndReason::None;
+  out.SegmentSize = 0;
+
+  std::vector<uint8_t> data;
+  if (!ReadWalSegmentFile(path, data, out.Error)) {
+    out.Data.Clear();
+    return false;
+  }
+
+  // Only the long header on the first page knows the segment size; parsing
+  // from the middle never sees it.
+  WalPageHeaderInfo header;
+  if (ReadWalPageHeader(data.data(), data.size(), header))
+    out.SegmentSize = header.SegmentSize;
+  uint64_t base_lsn = NameBaseLSN(path, data.data(), data.size(), data.size());
+  out.Data.Assign(std::move(data));
+  parser.SetExpectedBaseLSN(base_lsn);
+
+  size_t start = 0;
+  if (base_lsn && start_lsn > base_lsn &&
+      start_lsn - base_lsn < out.Data.Size())
+    start = (size_t)(start_lsn - base_lsn);
+  parser.ParseFrom(out.Data, start - start % WAL_PAGE_SIZE, out.Records);
+  out.Records.erase(std::remove_if(out.Records.begin(), out.Records.end(),
+                                   [&](const WalRecordInfo &r) {
+                                     return r.LSN < start_lsn;
+                                   }),
+                    out.Records.end());
+  out.EndLSN = parser.GetEndLSN();
+  out.EndReason = parser.GetEndReason();
+  trace.SetBytes(out.Data.Size());
+  trace.SetItems(out.Records.size());
+  return true;
+}
+
+// --- WalSegmentCache ---
+
+static bool FileStamp(const std::string &path, uint64_t &size,
+                      int64_t &mtime) {
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  mtime = std::filesystem::last_write_time(path, ec)
+              .time_since_epoch()
+              .count();
+  return !ec;
+}
+
+bool WalSegmentCache::Lookup(const std::string &path, WalLoadedSegment &out,
+                             bool recent) {
+  uint64_t size;
+  int64_t mtime;
+  if (!FileStamp(path, size, mtime))
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it == index_.end())
+      return false;
+    if (it->second->file_size != size || it->second->mtime != mtime) {
+      usage_ -= it->second->bytes;
+      lru_.erase(it->second);
+      index_.erase(it);
+      return false;
+    }
+    if (recent)
+      lru_.splice(lru_.begin(), lru_, it->second);
+    out = it->second->seg;
+  }
+  if (WalCompressionFromName(path) != WalCompression::None)
+    return true;
+
+  // Raw segment: the bytes come back from the file
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  std::vector<uint8_t> data((size_t)size);
+  bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  out.Data.Assign(std::move(data));
+  return ok;
+}
+
+void WalSegmentCache::Insert(const WalLoadedSegment &seg, bool recent) {
+  Entry entry;
+  if (!FileStamp(seg.Path, entry.file_size, entry.mtime))
+    return;
+  entry.seg.Path = seg.Path;
+  if (WalCompressionFromName(seg.Path) != WalCompression::None)
+    entry.seg.Data = seg.Data;
+  entry.seg.Records = seg.Records;
+  entry.seg.EndLSN = seg.EndLSN;
+  entry.seg.EndReason = seg.EndReason;
+  entry.seg.SegmentSize = seg.SegmentSize;
+  entry.bytes = WalSegmentMemoryUsage(entry.seg);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entry.bytes > budget_)
+    return;
+  auto it = index_.find(seg.Path);
+  if (it != index_.end()) {
+    usage_ -= it->second->bytes;
+    lru_.erase(it->second);
+  }
+  usage_ += entry.bytes;
+  if (recent) {
+    lru_.push_front(std::move(entry));
+    index_[seg.Path] = lru_.begin();
+  } else {
+    lru_.push_back(std::move(entry));
+    index_[seg.Path] = std::prev(lru_.end());
+  }
+  EvictLocked();
+}
+
+bool WalSegmentCache::Touch(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(path);
+  if (it == index_.end())
+    return false;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return true;
+}
+
+void WalSegmentCache::SetBudget(size_t budget_bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  budget_ = budget_bytes;
+  EvictLocked();
+}
+
+void WalSegmentCache::EvictLocked() {
+  while (usage_ > budget_ && !lru_.empty()) {
+    usage_ -= lru_.back().bytes;
+    index_.erase(lru_.back().seg.Path);
+    lru_.pop_back();
+  }
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "wal_parser.h"
+#include "wal_sparse.h"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compressed segments as left behind by archive_command (gzip, lz4 or zstd
+// on the segment file). Which formats are available depends on the
+// libraries found at build time.
+enum class WalCompression : uint8_t { None, Gzip, Lz4, Zstd };
+const char *WalCompressionName(WalCompression compression);
+bool WalCompressionAvailable(WalCompression compression);
+// By file name suffix: .gz, .lz4, .zst/.zstd.
+WalCompression WalCompressionFromName(const std::string &name);
+// "000000010000000000000003.gz" -> "000000010000000000000003"
+std::string WalStripCompressionSuffix(const std::string &name);
+
+// Streams the decompressed contents of a compressed file or buffer.
+class WalDecompressor {
+public:
+  WalDecompressor() = default;
+  ~WalDecompressor();
+  WalDecompressor(const WalDecompressor &) = delete;
+  WalDecompressor &operator=(const WalDecompressor &) = delete;
+
+  bool OpenFile(const std::string &path, WalCompression compression,
+                std::string &error);
+  // The buffer must outlive the decompressor.
+  bool OpenBuffer(const uint8_t *data, size_t size,
+                  WalCompression compression, std::string &error);
+
+  // Decompresses up to len bytes into out. Returns the number of bytes
+  // produced, 0 at the end of the stream or on error (error is set).
+  size_t Read(uint8_t *out, size_t len, std::string &error);
+
+private:
+  bool Init(std::string &error);
+  bool FillInput(); // Refills in_ from the file; false at end of input
+  void Close();
+
+  WalCompression compression_ = WalCompression::None;
+  FILE *file_ = nullptr;
+  std::vector<uint8_t> in_buf_;
+  const uint8_t *in_ = nullptr; // Unconsumed input
+  size_t in_len_ = 0;
+  bool input_done_ = false;
+  bool stream_done_ = false;
+  bool frame_complete_ = false; // lz4/zstd: last call ended a frame
+  void *ctx_ = nullptr; // z_stream, LZ4F_dctx or ZSTD_DStream
+};
+
+// Reads a segment, raw or compressed, into data and parses it, checking
+// page addresses against the LSN its file name implies. Compressed segments
+// are parsed page by page as they are decompressed. With stop_at_end,
+// decompression stops once the parser reaches the end of valid WAL, which
+// leaves data short but saves inflating the zeroed tail.
+bool LoadWalSegment(const std::string &path, WalParser &parser,
+                    std::vector<uint8_t> &data,
+                    std::vector<WalRecordInfo> &records, std::string &error,
+                    bool stop_at_end = false);
+// Same for a file already read into memory; compressed according to the
+// suffix of path.
+bool LoadWalSegmentFromBuffer(const std::string &path,
+                              const uint8_t *compressed, size_t size,
+                              WalParser &parser, std::vector<uint8_t> &data,
+                              std::vector<WalRecordInfo> &records,
+                              std::string &error, bool stop_at_end = false);
+// Reads a segment whole, decompressing it if needed, without parsing it.
+bool ReadWalSegmentFile(const std::string &path, std::vector<uint8_t> &data,
+                        std::string &error);
+// Parses an uncompressed segment held in data (e.g. from the cache) the
+// same way.
+bool ParseWalSegment(const std::string &path, WalParser &parser,
+                     const std::vector<uint8_t> &data,
+                     std::vector<WalRecordInfo> &records);
+
+class WalSegmentCache;
+
+// A segment read and parsed, with the parser's verdict on it.
+struct WalLoadedSegment {
+  std::string Path;
+  WalSparseSegment Data; // Zero pages not held
+  std::vector<WalRecordInfo> Records;
+  uint64_t EndLSN = 0;
+  WalEndReason EndReason = WalEndReason::None;
+  uint32_t SegmentSize = 0; /* xlp_seg_size, 0 if not seen */
+  std::string Error;        /* Non-empty if the file couldn't be read */
+};
+// Heap bytes held, for memory budgets.
+size_t WalRecordsMemoryUsage(const std::vector<WalRecordInfo> &records);
+size_t WalSegmentMemoryUsage(const WalLoadedSegment &seg);
+
+// LoadWalSegment() into out. With a cache, a segment seen recently is not
+// parsed again, and a parsed one is added to it. A speculative load
+// (prefetching) leaves the cache's order alone and adds at the cold end,
+// so it never evicts segments that were viewed.
+bool LoadWalSegment(const std::string &path, WalParser &parser,
+                    WalSegmentCache *cache, WalLoadedSegment &out,
+                    bool speculative = false);
+// Reads a segment whole but parses it only from start_lsn on (from the top
+// of its page, dropping the records before it), e.g. from a checkpoint's
+// redo pointer. Not cached, since the records are a partial set.
+bool LoadWalSegmentAt(const std::string &path, WalParser &parser,
+                      uint64_t start_lsn, WalLoadedSegment &out);
+
+// Recently viewed segments, parsed, so going back to one is free. The least
+// recently used are evicted once the bytes held exceed the budget. Records
+// are always kept; the bytes only for compressed segments, since a raw
+// segment's bytes are cheaper to read again from the file (usually from the
+// page cache) than to hold. Entries are keyed by path and remember the
+// file's size and mtime, so a rewritten file is loaded again.
+class WalSegmentCache {
+public:
+  explicit WalSegmentCache(size_t budget_bytes = (size_t)256 << 20)
+      : budget_(budget_bytes) {}
+
+  // Copies the cached segment into out, reading a raw segment's bytes back
+  // from its file, and makes it the most recently used unless not recent.
+  // False on a miss.
+  bool Lookup(const std::string &path, WalLoadedSegment &out,
+              bool recent = true);
+  // Adds seg as the most recently used, or not recent as the least (the
+  // first evicted).
+  void Insert(const WalLoadedSegment &seg, bool recent = true);
+  // Makes path the most recently used. False if it isn't cached.
+  bool Touch(const std::string &path);
+
+  void SetBudget(size_t budget_bytes);
+  size_t GetBudget() const { return budget_; }
+  size_t GetUsage() const { return usage_; }
+  size_t GetCount() const { return lru_.size(); }
+
+private:
+  struct Entry {
+    WalLoadedSegment seg; // Data empty for raw segments
+    uint64_t file_size;
+    int64_t mtime;
+    size_t bytes; // WalSegmentMemoryUsage(seg)
+  };
+  void EvictLocked();
+
+  std::mutex mutex_;
+  size_t budget_;
+  size_t usage_ = 0;
+  std::list<Entry> lru_; // Most recently used first
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
@@ -0,0 +1,157 @@
+#include "wal_attr_fetch.h"
+#include <cstdlib>
+#include <libpq-fe.h>
+
+// Dropped columns keep their place, length and alignment in the rows
+// written before the drop, so they are part of the layout.
+static const char *const attribute_query =
+    "SELECT attname, atttypid, attlen, attalign, attbyval, attisdropped "
+    "FROM pg_attribute WHERE attrelid = pg_filenode_relation($1, $2) "
+    "AND attnum > 0 ORDER BY attnum";
+
+WalAttributeFetcher::WalAttributeFetcher() {
+  thread_ = std::thread(&WalAttributeFetcher::Worker, this);
+}
+
+WalAttributeFetcher::~WalAttributeFetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+void WalAttributeFetcher::Reset(
+    const std::string &conninfo,
+    const std::map<uint32_t, std::string> &databases) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  conninfo_ = conninfo;
+  databases_ = databases;
+  entries_.clear();
+  queue_.clear();
+  generation_++;
+}
+
+std::shared_ptr<const WalTupleLayout>
+WalAttributeFetcher::Find(const WalRelFileNode &node, std::string &error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (conninfo_.empty()) {
+    error = "column layouts come from the server: connect first";
+    return nullptr;
+  }
+  Key key(node.dbNode, node.spcNode, node.relNode);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    entries_[key] = Entry();
+    queue_.push_back(key);
+    cv_.notify_all();
+    error.clear();
+    return nullptr;
+  }
+  error = it->second.Error;
+  return it->second.Layout;
+}
+
+size_t WalAttributeFetcher::MemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (const auto &entry : entries_) {
+    bytes += sizeof(entry) + 4 * sizeof(void *) + entry.second.Error.size();
+    if (entry.second.Layout)
+      bytes += entry.second.Layout->MemoryUsage();
+  }
+  return bytes;
+}
+
+void WalAttributeFetcher::Worker() {
+  // Connections by database OID, 0 for shared catalogs (any database will
+  // do), of the generation they were opened in
+  std::map<uint32_t, PGconn *> conns;
+  uint64_t conns_generation = 0;
+  auto close_all = [&] {
+    for (auto &c : conns)
+      PQfinish(c.second);
+    conns.clear();
+  };
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+    if (stop_)
+      break;
+    Key key = queue_.front();
+    queue_.pop_front();
+    uint64_t generation = generation_;
+    std::string conninfo = conninfo_;
+    uint32_t db = std::get<0>(key);
+    auto name = databases_.find(db);
+    bool known_db = db == 0 || name != databases_.end();
+    std::string database = name != databases_.end() ? name->second : "";
+    lock.unlock();
+
+    if (generation != conns_generation) {
+      close_all();
+      conns_generation = generation;
+    }
+    Entry result;
+    PGconn *conn = nullptr;
+    if (!known_db) {
+      result.Error =
+          "database " + std::to_string(db) + " isn't on the server";
+    } else if (!(conn = conns[db])) {
+      // The first dbname is expanded as a connection string, the second
+      // overrides the database in it.
+      const char *keywords[] = {"dbname", "dbname", nullptr};
+      const char *values[] = {conninfo.c_str(), database.c_str(), nullptr};
+      if (db == 0)
+        keywords[1] = nullptr;
+      conn = PQconnectdbParams(keywords, values, 1);
+      if (PQstatus(conn) != CONNECTION_OK) {
+        result.Error = PQerrorMessage(conn);
+        PQfinish(conn);
+        conn = nullptr;
+      }
+      conns[db] = conn;
+    }
+
+    if (conn) {
+      std::string spc = std::to_string(std::get<1>(key));
+      std::string rel = std::to_string(std::get<2>(key));
+      const char *params[] = {spc.c_str(), rel.c_str()};
+      PGresult *res = PQexecParams(conn, attribute_query, 2, nullptr, params,
+                                   nullptr, nullptr, 0);
+      if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        result.Error = PQresultErrorMessage(res);
+        if (PQstatus(conn) != CONNECTION_OK) {
+          PQfinish(conn); // Reconnect for the next relation
+          conns[db] = nullptr;
+        }
+      } else if (PQntuples(res) == 0) {
+        result.Error = "no relation has this file now (dropped or "
+                       "rewritten since?)";
+      } else {
+        auto layout = std::make_shared<WalTupleLayout>();
+        for (int i = 0; i < PQntuples(res); i++)
+          layout->Add(PQgetvalue(res, i, 0),
+                      (uint32_t)strtoul(PQgetvalue(res, i, 1), nullptr, 10),
+                      (int16_t)atoi(PQgetvalue(res, i, 2)),
+                      PQgetvalue(res, i, 3)[0],
+                      PQgetvalue(res, i, 4)[0] == 't',
+                      PQgetvalue(res, i, 5)[0] == 't');
+        result.Layout = std::move(layout);
+      }
+      PQclear(res);
+    }
+    while (!result.Error.empty() && result.Error.back() == '\n')
+      result.Error.pop_back();
+    if (!result.Layout && result.Error.empty())
+      result.Error = "couldn't be fetched";
+
+    lock.lock();
+    if (generation == generation_)
+      entries_[key] = std::move(result);
+  }
+  lock.unlock();
+  close_all();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "wal_parser.h"
+#include "wal_tuple.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+
+// Column layouts of relations, asked of the server one relation at a time
+// the first time a record of it is opened, on a background thread: a
+// catalog has thousands of relations and a record list usually touches a
+// few. The relation is looked up by its file with pg_filenode_relation(),
+// so a layout is found whether or not names were fetched. A connection per
+// database is kept open for the next relation.
+//
+//   std::string error;
+//   auto layout = fetcher.Find(node, error);
+//   if (!layout && error.empty())
+//     ; // Asked for, look again next frame
+class WalAttributeFetcher {
+public:
+  WalAttributeFetcher();
+  ~WalAttributeFetcher();
+
+  WalAttributeFetcher(const WalAttributeFetcher &) = delete;
+  WalAttributeFetcher &operator=(const WalAttributeFetcher &) = delete;
+
+  // conninfo gives everything but the database, databases their names by
+  // OID. Forgets every layout fetched before; an empty conninfo stops
+  // fetching.
+  void Reset(const std::string &conninfo,
+             const std::map<uint32_t, std::string> &databases);
+  // The layout of node's relation, nullptr while it is being fetched (the
+  // first call asks for it) or, with error set, if it can't be.
+  std::shared_ptr<const WalTupleLayout> Find(const WalRelFileNode &node,
+                                             std::string &error);
+  size_t MemoryUsage();
+
+private:
+  using Key = std::tuple<uint32_t, uint32_t, uint32_t>; // db, spc, rel
+  struct Entry {
+    std::shared_ptr<const WalTupleLayout> Layout;
+    std::string Error;
+  };
+
+  void Worker();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::string conninfo_;
+  std::map<uint32_t, std::string> databases_;
+  std::map<Key, Entry> entries_; // Asked for; done once Layout or Error
+  std::deque<Key> queue_;
+  uint64_t generation_ = 0; // Bumped by Reset(), so late results are dropped
+  bool stop_ = false;
+  std::thread thread_;
+};
@@ -0,0 +1,345 @@
+#include "wal_filter.h"
+#include "wal_parser.h"
+#include "wal_synth.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Throughput of the hot paths over synthetic WAL. The input depends only on
+// the options, so two builds run with the same options parse the same bytes
+// and their numbers (and checksums) can be compared directly.
+
+static void PrintUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "\n"
+          "Options:\n"
+          "      --seed N           Generator seed (default 42)\n"
+          "      --segments N       Segments to generate (default 8)\n"
+          "      --segment-size MB  Segment size (default 16)\n"
+          "      --fpi RATIO        Share of block references with a page "
+          "image\n"
+          "                         (default 0.05)\n"
+          "      --compression C    Page images: off (default), pglz, lz4, "
+          "zstd\n"
+          "      --mix LIST         Resource manager weights, e.g.\n"
+          "                         Heap=60,Btree=30,Transaction=10\n"
+          "      --median N         Median block/main data length (default "
+          "48)\n"
+          "      --fill F           Switch segments when F of them is used "
+          "(default 1)\n"
+          "      --repeat N         Runs per benchmark, best and median are "
+          "shown\n"
+          "                         (default 5)\n"
+          "      --write DIR        Also write the segments to DIR\n"
+          "  -h, --help             Show this help\n",
+          prog);
+}
+
+static std::string Lower(std::string s) {
+  for (char &c : s)
+    c = (char)tolower((unsigned char)c);
+  return s;
+}
+
+// "Heap=60,Btree=30" into weights. Names as in the record list, or ids.
+static bool ParseMix(const char *s, std::vector<WalSynthRmidWeight> &out) {
+  WalParser parser;
+  std::string list = s;
+  size_t start = 0;
+  while (start < list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string item = list.substr(start, end - start);
+    start = end + 1;
+    size_t eq = item.find('=');
+    if (eq == std::string::npos)
+      return false;
+    std::string name = Lower(item.substr(0, eq));
+    int rmid = -1;
+    for (int i = 0; i <= RM_LOGICALMSG_ID && rmid < 0; i++)
+      if (Lower(parser.GetRmidName((uint8_t)i)) == name)
+        rmid = i;
+    if (rmid < 0) {
+      char *endp;
+      long id = strtol(name.c_str(), &endp, 10);
+      if (*endp || id < 0 || id > 255)
+        return false;
+      rmid = (int)id;
+    }
+    out.push_back({(uint8_t)rmid, atof(item.c_str() + eq + 1)});
+  }
+  return !out.empty();
+}
+
+// Runs fn repeat times and prints the best and median run, with throughput
+// of the best one.
+template <typename Fn>
+static void Bench(const char *name, int repeat, uint64_t bytes,
+                  uint64_t items, Fn fn) {
+  std::vector<double> times;
+  for (int i = 0; i < repeat; i++) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    times.push_back(std::chrono::duration<double>(t1 - t0).count());
+  }
+  std::sort(times.begin(), times.end());
+  double best = times[0], median = times[times.size() / 2];
+  // Benchmarks over parsed records read no WAL bytes: no MB/s for them
+  char mb_per_sec[16] = "-";
+  if (bytes)
+    snprintf(mb_per_sec, sizeof(mb_per_sec), "%.1f",
+             bytes / best / (1024 * 1024));
+  printf("%-16s %10.2f %10.2f %10s %12.0f\n", name, best * 1e3,
+         median * 1e3, mb_per_sec, items / best);
+}
+
+// FNV-1a over what the benchmarks produced, to tell two runs (or builds)
+// saw the same data and computed the same results.
+static uint64_t Mix(uint64_t h, uint64_t v) {
+  for (int i = 0; i < 8; i++, v >>= 8)
+    h = (h ^ (v & 0xFF)) * 0x100000001B3ULL;
+  return h;
+}
+
+struct RmidStats {
+  uint64_t Count = 0;
+  uint64_t Bytes = 0;
+  uint64_t Fpis = 0;
+};
+
+int main(int argc, char **argv) {
+  WalSynthOptions options;
+  options.Seed = 42;
+  int segments = 8;
+  int repeat = 5;
+  double fill = 1.0;
+  const char *write_dir = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    auto next = [&](const char *opt) -> const char * {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Error: %s requires an argument\n", opt);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+      PrintUsage(argv[0]);
+      return 0;
+    } else if (!strcmp(arg, "--seed")) {
+      options.Seed = strtoull(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--segments")) {
+      segments = atoi(next(arg));
+    } else if (!strcmp(arg, "--segment-size")) {
+      options.SegmentSize = (uint32_t)atoi(next(arg)) * 1024 * 1024;
+    } else if (!strcmp(arg, "--fpi")) {
+      options.FpiRatio = atof(next(arg));
+    } else if (!strcmp(arg, "--compression")) {
+      const char *v = next(arg);
+      bool found = false;
+      for (WalFpiCompression c :
+           {WalFpiCompression::None, WalFpiCompression::Pglz,
+            WalFpiCompression::Lz4, WalFpiCompression::Zstd}) {
+        if (!strcmp(v, WalFpiCompressionName(c)) ||
+            (c == WalFpiCompression::None && !strcmp(v, "none"))) {
+          options.FpiCompression = c;
+          found = true;
+        }
+      }
+      if (!found) {
+        fprintf(stderr, "Error: unknown compression '%s'\n", v);
+        return 1;
+      }
+      if (!WalFpiCompressionAvailable(options.FpiCompression)) {
+        fprintf(stderr, "Error: built without %s\n", v);
+        return 1;
+      }
+    } else if (!strcmp(arg, "--mix")) {
+      const char *v = next(arg);
+      if (!ParseMix(v, options.RmidMix)) {
+        fprintf(stderr, "Error: bad resource manager mix '%s'\n", v);
+        return 1;
+      }
+    } else if (!strcmp(arg, "--median")) {
+      options.DataLenMedian = (uint32_t)atoi(next(arg));
+    } else if (!strcmp(arg, "--fill")) {
+      fill = atof(next(arg));
+    } else if (!strcmp(arg, "--repeat")) {
+      repeat = atoi(next(arg));
+    } else if (!strcmp(arg, "--write")) {
+      write_dir = next(arg);
+    } else {
+      fprintf(stderr, "Error: unknown option '%s'\n", arg);
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  uint32_t seg_size = options.SegmentSize;
+  if (segments < 1 || repeat < 1 || seg_size < WAL_PAGE_SIZE ||
+      (seg_size & (seg_size - 1)) || fill <= 0) {
+    fprintf(stderr, "Error: invalid options\n");
+    return 1;
+  }
+
+  // --- Input ---
+  std::vector<std::vector<uint8_t>> segs(segments);
+  std::vector<std::string> names(segments);
+  uint64_t gen_records = 0, gen_fpis = 0, gen_fpis_compressed = 0;
+  uint64_t total_bytes = (uint64_t)segments * seg_size;
+  uint64_t checksum = 0xCBF29CE484222325ULL;
+  printf("seed %llu, %d x %u MB segments, fpi %.3f (%s), fill %.2f\n\n",
+         (unsigned long long)options.Seed, segments, seg_size >> 20,
+         options.FpiRatio, WalFpiCompressionName(options.FpiCompression),
+         fill);
+  printf("%-16s %10s %10s %10s %12s\n", "benchmark", "best ms", "median ms",
+         "MB/s", "items/s");
+  {
+    WalSynthGenerator gen(options);
+    for (int i = 0; i < segments; i++) {
+      names[i] = gen.NextSegmentName();
+      gen.NextSegment(segs[i], fill);
+    }
+    gen_records = gen.GetRecordCount();
+    gen_fpis = gen.GetFpiCount();
+    gen_fpis_compressed = gen.GetFpiCompressedCount();
+    // Timed into a scratch buffer, the same bytes each run
+    std::vector<uint8_t> out;
+    Bench("generate", repeat, total_bytes, gen_records, [&]() {
+      WalSynthGenerator timed(options);
+      for (int i = 0; i < segments; i++)
+        timed.NextSegment(out, fill);
+    });
+  }
+
+  if (write_dir) {
+    std::error_code ec;
+    fs::create_directories(write_dir, ec);
+    for (int i = 0; i < segments; i++) {
+      std::string path = (fs::path(write_dir) / names[i]).string();
+      FILE *f = fopen(path.c_str(), "wb");
+      if (!f || fwrite(segs[i].data(), 1, seg_size, f) != seg_size) {
+        fprintf(stderr, "Error: cannot write %s\n", path.c_str());
+        if (f)
+          fclose(f);
+        return 1;
+      }
+      fclose(f);
+    }
+  }
+
+  // --- Parsing ---
+  std::vector<std::vector<WalRecordInfo>> parsed(segments);
+  auto parse_all = [&](bool verify_crc) {
+    WalParser parser;
+    parser.SetVerifyCRC(verify_crc);
+    for (int i = 0; i < segments; i++) {
+      parsed[i].clear();
+      parser.SetExpectedBaseLSN(WalFileNameToLSN(names[i], seg_size));
+      parser.Parse(segs[i].data(), segs[i].size(), parsed[i]);
+    }
+  };
+  Bench("parse", repeat, total_bytes, gen_records, [&]() { parse_all(true); });
+  Bench("parse (no crc)", repeat, total_bytes, gen_records,
+        [&]() { parse_all(false); });
+
+  std::vector<WalRecordInfo> records;
+  for (std::vector<WalRecordInfo> &p : parsed)
+    for (WalRecordInfo &r : p)
+      records.push_back(std::move(r));
+  for (const WalRecordInfo &r : records)
+    checksum = Mix(Mix(checksum, r.LSN), r.Length);
+
+  // --- Filtering ---
+  static const char *exprs[] = {
+      "rmid in (Heap,Btree) and len > 128",
+      "has_fpi or rmid = Transaction",
+      "rel in (16384,16400,16500) and not (info = 0)",
+      "db = 5 and xid > 2000 and len < 100",
+  };
+  std::vector<WalFilter> filters(sizeof(exprs) / sizeof(exprs[0]));
+  for (size_t i = 0; i < filters.size(); i++) {
+    std::string error;
+    if (!filters[i].Compile(exprs[i], error)) {
+      fprintf(stderr, "Error: %s: %s\n", exprs[i], error.c_str());
+      return 1;
+    }
+  }
+  std::vector<uint32_t> matches;
+  uint64_t match_total = 0;
+  Bench("filter", repeat, 0, records.size() * filters.size(), [&]() {
+    match_total = 0;
+    for (const WalFilter &f : filters) {
+      matches.clear();
+      f.Evaluate(records.data(), records.size(), matches);
+      match_total += matches.size();
+    }
+  });
+  checksum = Mix(checksum, match_total);
+
+  // --- Stats aggregation: per resource manager and per relation ---
+  RmidStats rmid_stats[256];
+  std::unordered_map<uint64_t, uint64_t> rel_counts;
+  Bench("stats", repeat, 0, records.size(), [&]() {
+    for (RmidStats &s : rmid_stats)
+      s = RmidStats();
+    rel_counts.clear();
+    for (const WalRecordInfo &r : records) {
+      RmidStats &s = rmid_stats[r.RMID];
+      s.Count++;
+      s.Bytes += r.Length;
+      s.Fpis += r.HasFPI;
+      for (const WalRelFileNode &n : r.RelFileNodes)
+        rel_counts[(uint64_t)n.dbNode << 32 | n.relNode]++;
+    }
+  });
+  for (const RmidStats &s : rmid_stats)
+    checksum = Mix(Mix(checksum, s.Count), s.Bytes);
+  checksum = Mix(checksum, rel_counts.size());
+
+  // --- Indexing: relation posting lists and LSN lookups ---
+  std::unordered_map<uint64_t, std::vector<uint32_t>> postings;
+  uint64_t lookups = std::min<uint64_t>(records.size(), 100000);
+  uint64_t found = 0;
+  Bench("index", repeat, 0, records.size() + lookups, [&]() {
+    postings.clear();
+    for (uint32_t i = 0; i < records.size(); i++)
+      for (const WalRelFileNode &n : records[i].RelFileNodes)
+        postings[(uint64_t)n.dbNode << 32 | n.relNode].push_back(i);
+    // Jump to LSN: binary search for records spread over the input
+    found = 0;
+    for (uint64_t k = 0; k < lookups; k++) {
+      uint64_t lsn = records[k * records.size() / lookups].LSN;
+      auto it = std::lower_bound(
+          records.begin(), records.end(), lsn,
+          [](const WalRecordInfo &r, uint64_t v) { return r.LSN < v; });
+      found += it != records.end() && it->LSN == lsn;
+    }
+  });
+  checksum = Mix(Mix(checksum, postings.size()), found);
+
+  printf("\n%llu records (%llu generated), %llu page images (%llu "
+         "compressed), %zu relations\n",
+         (unsigned long long)records.size(), (unsigned long long)gen_records,
+         (unsigned long long)gen_fpis,
+         (unsigned long long)gen_fpis_compressed, rel_counts.size());
+  printf("checksum %016llx\n", (unsigned long long)checksum);
+  if (records.size() != gen_records) {
+    fprintf(stderr, "Error: parsed %zu of %llu generated records\n",
+            records.size(), (unsigned long long)gen_records);
+    return 1;
+  }
+  return 0;
+}
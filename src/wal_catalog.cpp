@@ -0,0 +1,343 @@
+#include "wal_catalog.h"
+#include "crc32c.h"
+#include "wal_io.h"
+#include "wal_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+// BLCKSZ and RELSEG_SIZE of a default build
+#define CATALOG_PAGE_SIZE 8192
+#define CATALOG_SEGMENT_PAGES 131072
+// Pages per work item, so even a single huge pg_class segment is split
+// over all workers.
+#define CATALOG_CHUNK_PAGES 256
+
+// Catalog OIDs (pg_class.h, pg_namespace.h, pg_database.h)
+#define DatabaseRelationId 1262
+#define RelationRelationId 1259
+#define NamespaceRelationId 2615
+#define GLOBALTABLESPACE_OID 1664
+
+// relmapper.c: RelMapFile is magic, count, mappings[MAX_MAPPINGS], crc.
+// MAX_MAPPINGS is 62 in PostgreSQL 15 (512 byte file), 64 since 16.
+#define RELMAPPER_FILEMAGIC 0x592717
+
+// bufpage.h / itemid.h / htup_details.h
+#define SizeOfPageHeaderData 24
+#define LP_NORMAL 1
+#define HEAP_XMIN_INVALID 0x0200
+#define HEAP_XMAX_COMMITTED 0x0400
+#define HEAP_XMAX_INVALID 0x0800
+#define HEAP_XMAX_LOCK_ONLY 0x0080
+#define HEAP_TUPLE_T_HOFF 22
+#define HEAP_TUPLE_INFOMASK 20
+#define NAMEDATALEN 64
+
+// Offsets of the leading columns from t_hoff. All are NOT NULL and fixed
+// width, so they sit at the same place in every row.
+#define PG_CLASS_OID 0
+#define PG_CLASS_RELNAME 4
+#define PG_CLASS_RELNAMESPACE 68
+#define PG_CLASS_RELFILENODE 88
+#define PG_CLASS_RELTABLESPACE 92
+#define PG_CLASS_MIN_LEN 96
+#define PG_NAMESPACE_MIN_LEN 68 /* oid, nspname */
+#define PG_DATABASE_MIN_LEN 68  /* oid, datname */
+
+namespace {
+
+template <typename T> T Get(const uint8_t *data, size_t off) {
+  T v;
+  memcpy(&v, data + off, sizeof(v));
+  return v;
+}
+
+std::string GetName(const uint8_t *data, size_t off) {
+  const char *s = (const char *)data + off;
+  return std::string(s, strnlen(s, NAMEDATALEN));
+}
+
+// OID -> relfilenode from a pg_filenode.map.
+bool ReadRelMap(const fs::path &path, std::map<uint32_t, uint32_t> &out) {
+  FILE *f = fopen(path.string().c_str(), "rb");
+  if (!f)
+    return false;
+  uint8_t data[1024];
+  size_t size = fread(data, 1, sizeof(data), f);
+  fclose(f);
+  size_t max_mappings = size == 512 ? 62 : 64;
+  size_t crc_off = 8 + max_mappings * 8;
+  if (size < crc_off + 4 || Get<int32_t>(data, 0) != RELMAPPER_FILEMAGIC)
+    return false;
+  uint32_t crc = Crc32cFinish(Crc32cUpdate(CRC32C_INIT, data, crc_off));
+  int32_t count = Get<int32_t>(data, 4);
+  if (crc != Get<uint32_t>(data, crc_off) || count < 0 ||
+      (size_t)count > max_mappings)
+    return false;
+  for (int32_t i = 0; i < count; i++)
+    out[Get<uint32_t>(data, 8 + i * 8)] = Get<uint32_t>(data, 12 + i * 8);
+  return true;
+}
+
+// One normal line pointer's tuple, past its header.
+struct HeapTuple {
+  const uint8_t *Data;
+  size_t Len;
+  bool Live;
+};
+
+// Calls fn for every tuple on a heap page that was ever committed, as far
+// as the hint bits tell. Pages that don't look like heap pages are skipped.
+template <typename Fn> void ForEachTuple(const uint8_t *page, Fn &&fn) {
+  uint16_t lower = Get<uint16_t>(page, 12);
+  uint16_t upper = Get<uint16_t>(page, 14);
+  uint16_t special = Get<uint16_t>(page, 16);
+  if (lower < SizeOfPageHeaderData || lower > upper || upper > special ||
+      special > CATALOG_PAGE_SIZE)
+    return;
+  size_t items = (lower - SizeOfPageHeaderData) / 4;
+  for (size_t i = 0; i < items; i++) {
+    uint32_t lp = Get<uint32_t>(page, SizeOfPageHeaderData + i * 4);
+    uint32_t off = lp & 0x7FFF;
+    uint32_t flags = (lp >> 15) & 3;
+    uint32_t len = lp >> 17;
+    if (flags != LP_NORMAL || off < upper || off + len > special ||
+        len <= HEAP_TUPLE_T_HOFF)
+      continue;
+    const uint8_t *tup = page + off;
+    uint16_t infomask = Get<uint16_t>(tup, HEAP_TUPLE_INFOMASK);
+    uint8_t hoff = tup[HEAP_TUPLE_T_HOFF];
+    if ((infomask & HEAP_XMIN_INVALID) || hoff > len)
+      continue;
+    bool deleted = (infomask & HEAP_XMAX_COMMITTED) &&
+                   !(infomask & HEAP_XMAX_INVALID) &&
+                   !(infomask & HEAP_XMAX_LOCK_ONLY);
+    fn(HeapTuple{tup + hoff, len - hoff, !deleted});
+  }
+}
+
+// A run of pages of one segment file of a catalog.
+struct HeapChunk {
+  std::string Path;
+  uint32_t FirstPage;
+  uint32_t PageCount;
+  size_t Owner; // Index of the database it belongs to
+};
+
+// Splits every segment file (relfilenode, relfilenode.1, ...) of a heap
+// into chunks.
+void AddHeapChunks(const fs::path &dir, uint32_t relfilenode, size_t owner,
+                   std::vector<HeapChunk> &out) {
+  for (uint32_t segno = 0;; segno++) {
+    std::string name = std::to_string(relfilenode);
+    if (segno)
+      name += "." + std::to_string(segno);
+    std::error_code ec;
+    fs::path path = dir / name;
+    uint64_t size = fs::file_size(path, ec);
+    if (ec)
+      break;
+    uint32_t pages = (uint32_t)(size / CATALOG_PAGE_SIZE);
+    for (uint32_t first = 0; first < pages; first += CATALOG_CHUNK_PAGES)
+      out.push_back({path.string(), first,
+                     std::min<uint32_t>(CATALOG_CHUNK_PAGES, pages - first),
+                     owner});
+    if (pages < CATALOG_SEGMENT_PAGES)
+      break;
+  }
+}
+
+// Decodes the chunks on `threads` workers. decode(tuple, rows) appends to
+// the rows of the chunk's owner; each chunk has its own output, so workers
+// never share one, and the rows come out in file order.
+template <typename Row, typename Decode>
+uint64_t ScanHeapChunks(const std::vector<HeapChunk> &chunks,
+                        unsigned threads, Decode decode,
+                        std::vector<std::vector<Row>> &out) {
+  out.assign(chunks.size(), {});
+  threads = (unsigned)std::min<size_t>(threads, chunks.size());
+  std::atomic<size_t> next{0};
+  std::atomic<uint64_t> pages_read{0};
+  auto worker = [&]() {
+    WalTraceSetThreadName("catalog");
+    std::vector<uint8_t> buf;
+    for (size_t i = next++; i < chunks.size(); i = next++) {
+      const HeapChunk &chunk = chunks[i];
+      WalTraceScope trace("catalog", "scan");
+      trace.SetSegment(chunk.Path);
+      WalPositionalFile file;
+      uint64_t size;
+      buf.resize((size_t)chunk.PageCount * CATALOG_PAGE_SIZE);
+      if (!file.Open(chunk.Path, size) ||
+          !file.ReadAt((uint64_t)chunk.FirstPage * CATALOG_PAGE_SIZE,
+                       buf.data(), buf.size()))
+        continue;
+      pages_read += chunk.PageCount;
+      for (uint32_t p = 0; p < chunk.PageCount; p++)
+        ForEachTuple(buf.data() + (size_t)p * CATALOG_PAGE_SIZE,
+                     [&](const HeapTuple &tup) { decode(tup, out[i]); });
+      trace.SetBytes(buf.size());
+      trace.SetItems(out[i].size());
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++)
+    pool.emplace_back(worker);
+  if (threads)
+    worker();
+  for (auto &t : pool)
+    t.join();
+  return pages_read;
+}
+
+// Database directories: base/<oid> and pg_tblspc/<spc>/<version>/<oid>,
+// wherever there is a pg_filenode.map.
+void FindDatabaseDirs(const fs::path &data_dir,
+                      std::map<uint32_t, fs::path> &out) {
+  std::error_code ec;
+  auto scan = [&](const fs::path &dir) {
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+      std::string name = entry.path().filename().string();
+      if (name.empty() ||
+          name.find_first_not_of("0123456789") != std::string::npos)
+        continue;
+      if (fs::exists(entry.path() / "pg_filenode.map", ec))
+        out[(uint32_t)strtoul(name.c_str(), nullptr, 10)] = entry.path();
+    }
+  };
+  scan(data_dir / "base");
+  for (const auto &spc : fs::directory_iterator(data_dir / "pg_tblspc", ec))
+    for (const auto &version : fs::directory_iterator(spc.path(), ec))
+      scan(version.path());
+}
+
+} // namespace
+
+bool ReadOfflineCatalog(const std::string &data_dir, WalOfflineCatalog &out,
+                        std::string &error, unsigned threads) {
+  WalTraceScope trace("catalog", "read");
+  out = WalOfflineCatalog();
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  fs::path root(data_dir);
+
+  std::map<uint32_t, fs::path> dirs;
+  FindDatabaseDirs(root, dirs);
+  if (dirs.empty()) {
+    error = "no databases found in " + data_dir;
+    return false;
+  }
+  for (const auto &[oid, path] : dirs) {
+    WalCatalogDatabase db;
+    db.Oid = oid;
+    db.Name = std::to_string(oid);
+    db.Path = path.string();
+    out.Databases.push_back(std::move(db));
+  }
+
+  // --- Database names from the shared pg_database ---
+  std::map<uint32_t, uint32_t> shared_map;
+  if (!ReadRelMap(root / "global" / "pg_filenode.map", shared_map) ||
+      !shared_map.count(DatabaseRelationId)) {
+    out.Warnings.push_back("cannot read global/pg_filenode.map");
+  } else {
+    std::vector<HeapChunk> chunks;
+    AddHeapChunks(root / "global", shared_map[DatabaseRelationId], 0, chunks);
+    std::vector<std::vector<std::pair<uint32_t, std::string>>> rows;
+    out.PagesRead += ScanHeapChunks(
+        chunks, threads,
+        [](const HeapTuple &tup,
+           std::vector<std::pair<uint32_t, std::string>> &rows) {
+          if (tup.Live && tup.Len >= PG_DATABASE_MIN_LEN)
+            rows.emplace_back(Get<uint32_t>(tup.Data, 0),
+                              GetName(tup.Data, 4));
+        },
+        rows);
+    for (const auto &chunk : rows) {
+      for (const auto &[oid, name] : chunk) {
+        out.Tuples++;
+        for (WalCatalogDatabase &db : out.Databases)
+          if (db.Oid == oid)
+            db.Name = name;
+      }
+    }
+  }
+
+  // --- pg_class of every database at once ---
+  std::vector<std::map<uint32_t, uint32_t>> maps(out.Databases.size());
+  std::vector<HeapChunk> chunks;
+  for (size_t i = 0; i < out.Databases.size(); i++) {
+    WalCatalogDatabase &db = out.Databases[i];
+    if (!ReadRelMap(fs::path(db.Path) / "pg_filenode.map", maps[i]) ||
+        !maps[i].count(RelationRelationId)) {
+      out.Warnings.push_back(db.Name + ": cannot read pg_filenode.map");
+      continue;
+    }
+    AddHeapChunks(db.Path, maps[i][RelationRelationId], i, chunks);
+  }
+  std::vector<std::vector<WalCatalogRelation>> rel_rows;
+  out.PagesRead += ScanHeapChunks(
+      chunks, threads,
+      [](const HeapTuple &tup, std::vector<WalCatalogRelation> &rows) {
+        if (tup.Len < PG_CLASS_MIN_LEN)
+          return;
+        rows.push_back({Get<uint32_t>(tup.Data, PG_CLASS_OID),
+                        Get<uint32_t>(tup.Data, PG_CLASS_RELFILENODE),
+                        Get<uint32_t>(tup.Data, PG_CLASS_RELNAMESPACE),
+                        Get<uint32_t>(tup.Data, PG_CLASS_RELTABLESPACE),
+                        GetName(tup.Data, PG_CLASS_RELNAME), tup.Live});
+      },
+      rel_rows);
+  for (size_t c = 0; c < chunks.size(); c++) {
+    WalCatalogDatabase &db = out.Databases[chunks[c].Owner];
+    const std::map<uint32_t, uint32_t> &map = maps[chunks[c].Owner];
+    for (WalCatalogRelation &rel : rel_rows[c]) {
+      // Mapped catalogs have relfilenode 0; their file is in the map
+      if (rel.RelFileNode == 0) {
+        const auto &m =
+            rel.Tablespace == GLOBALTABLESPACE_OID ? shared_map : map;
+        auto it = m.find(rel.Oid);
+        if (it != m.end())
+          rel.RelFileNode = it->second;
+      }
+      out.Tuples++;
+      db.Relations.push_back(std::move(rel));
+    }
+  }
+
+  // --- pg_namespace, wherever pg_class says it is ---
+  chunks.clear();
+  for (size_t i = 0; i < out.Databases.size(); i++) {
+    for (const WalCatalogRelation &rel : out.Databases[i].Relations) {
+      if (rel.Oid == NamespaceRelationId && rel.Live && rel.RelFileNode) {
+        AddHeapChunks(out.Databases[i].Path, rel.RelFileNode, i, chunks);
+        break;
+      }
+    }
+  }
+  std::vector<std::vector<std::pair<uint32_t, std::string>>> nsp_rows;
+  out.PagesRead += ScanHeapChunks(
+      chunks, threads,
+      [](const HeapTuple &tup,
+         std::vector<std::pair<uint32_t, std::string>> &rows) {
+        if (tup.Live && tup.Len >= PG_NAMESPACE_MIN_LEN)
+          rows.emplace_back(Get<uint32_t>(tup.Data, 0), GetName(tup.Data, 4));
+      },
+      nsp_rows);
+  for (size_t c = 0; c < chunks.size(); c++) {
+    for (auto &[oid, name] : nsp_rows[c]) {
+      out.Tuples++;
+      out.Databases[chunks[c].Owner].Namespaces[oid] = std::move(name);
+    }
+  }
+
+  trace.SetBytes(out.PagesRead * CATALOG_PAGE_SIZE);
+  trace.SetItems(out.Tuples);
+  return true;
+}
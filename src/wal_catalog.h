@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Relation, namespace and database names read straight from the catalog
+// heap files of a data directory, for a stopped or crashed cluster that
+// can't be queried. pg_filenode.map gives the files of the mapped catalogs
+// (pg_class, pg_database), pg_class the rest. Only the fixed-width columns
+// at the start of each row are decoded; their layout is the same in
+// PostgreSQL 15 to 17.
+//
+// Without the commit log, tuple visibility is judged by hint bits only:
+// rows whose insert aborted are skipped, and deleted versions are kept
+// (marked not Live), since WAL may still name a relation by the
+// relfilenode it had before a rewrite.
+
+struct WalCatalogRelation {
+  uint32_t Oid;
+  uint32_t RelFileNode; /* From pg_filenode.map for mapped catalogs */
+  uint32_t Namespace;
+  uint32_t Tablespace; /* 0: the database's default */
+  std::string Name;
+  bool Live; /* Not known to be deleted */
+};
+
+struct WalCatalogDatabase {
+  uint32_t Oid;
+  std::string Name;
+  std::string Path; /* Its directory, base/<oid> or under pg_tblspc */
+  std::map<uint32_t, std::string> Namespaces; /* OID -> nspname */
+  std::vector<WalCatalogRelation> Relations;
+};
+
+struct WalOfflineCatalog {
+  std::vector<WalCatalogDatabase> Databases; /* By OID */
+  uint64_t PagesRead = 0;
+  uint64_t Tuples = 0;
+  std::vector<std::string> Warnings; /* Databases that couldn't be read */
+};
+
+// Reads the catalogs of every database in data_dir, spreading the pages of
+// all pg_class (then pg_namespace) segment files over `threads` workers
+// (0 = all cores). False with error set if not even the database list can
+// be found.
+bool ReadOfflineCatalog(const std::string &data_dir, WalOfflineCatalog &out,
+                        std::string &error, unsigned threads = 0);
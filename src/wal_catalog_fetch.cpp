@@ -0,0 +1,259 @@
+#include "wal_catalog_fetch.h"
+#include <algorithm>
+#include <cstdlib>
+#include <libpq-fe.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+namespace {
+
+// One connection of the pool and the database it is fetching.
+struct CatalogConnection {
+  enum class Stage { Connecting, Catalog, Prune };
+
+  PGconn *Conn = nullptr;
+  WalCatalogFetch *Job = nullptr;
+  Stage State = Stage::Connecting;
+  PostgresPollingStatusType Poll = PGRES_POLLING_WRITING;
+  bool Flushing = false; /* Query not fully sent yet */
+  int Results = 0;       /* Of the current query, so far */
+  uint32_t Xmin = 0;
+  size_t Count = 0; /* Rows of pg_class now */
+  std::unordered_map<uint32_t, size_t> ByOid;
+};
+
+uint32_t RowOid(PGresult *res, int row, int col) {
+  return (uint32_t)strtoul(PQgetvalue(res, row, col), nullptr, 10);
+}
+
+void Fail(CatalogConnection &c, const char *message) {
+  if (c.Job->Error.empty()) {
+    c.Job->Error = message;
+    while (!c.Job->Error.empty() && c.Job->Error.back() == '\n')
+      c.Job->Error.pop_back();
+  }
+}
+
+bool Send(CatalogConnection &c, const std::string &sql) {
+  c.Results = 0;
+  if (!PQsendQuery(c.Conn, sql.c_str())) {
+    Fail(c, PQerrorMessage(c.Conn));
+    return false;
+  }
+  int flushed = PQflush(c.Conn);
+  c.Flushing = flushed == 1;
+  if (flushed < 0)
+    Fail(c, PQerrorMessage(c.Conn));
+  return flushed >= 0;
+}
+
+// Rows of transactions still running now count as changed next time, so
+// the snapshot's Xmin is the oldest of them. The rest of the snapshot is
+// replaced, except pg_class rows, which are merged by OID when
+// incremental. Mapped catalogs have relfilenode 0 in pg_class; the file
+// they are in comes from the relation mapper, and VACUUM FULL or CLUSTER
+// changes it without touching their row, so they are always fetched.
+bool SendCatalogQuery(CatalogConnection &c) {
+  const WalCatalogSnapshot &snapshot = c.Job->Snapshot;
+  std::string sql =
+      "SELECT txid_snapshot_xmin(txid_current_snapshot()) % 4294967296;"
+      "SELECT oid, nspname FROM pg_namespace;"
+      "SELECT CASE relfilenode WHEN 0 THEN pg_relation_filenode(oid) "
+      "ELSE relfilenode END, oid, relname, relnamespace, reltablespace "
+      "FROM pg_class";
+  if (c.Job->Incremental)
+    sql += " WHERE age(xmin) <= age('" + std::to_string(snapshot.Xmin) +
+           "'::xid) OR relfilenode = 0";
+  sql += ";SELECT count(*) FROM pg_class";
+  c.State = CatalogConnection::Stage::Catalog;
+  return Send(c, sql);
+}
+
+void OnCatalogResult(CatalogConnection &c, int index, PGresult *res) {
+  WalCatalogSnapshot &snapshot = c.Job->Snapshot;
+  switch (index) {
+  case 0:
+    c.Xmin = RowOid(res, 0, 0);
+    break;
+  case 1:
+    snapshot.Namespaces.clear();
+    for (int i = 0; i < PQntuples(res); i++)
+      snapshot.Namespaces[RowOid(res, i, 0)] = PQgetvalue(res, i, 1);
+    break;
+  case 2: {
+    if (!c.Job->Incremental)
+      snapshot.Relations.clear();
+    c.ByOid.clear();
+    for (size_t i = 0; i < snapshot.Relations.size(); i++)
+      c.ByOid[snapshot.Relations[i].Oid] = i;
+    int rows = PQntuples(res);
+    for (int i = 0; i < rows; i++) {
+      WalCatalogRelation rel = {RowOid(res, i, 1), RowOid(res, i, 0),
+                                RowOid(res, i, 3), RowOid(res, i, 4),
+                                PQgetvalue(res, i, 2), true};
+      auto it = c.ByOid.find(rel.Oid);
+      if (it != c.ByOid.end()) {
+        snapshot.Relations[it->second] = rel;
+      } else {
+        c.ByOid[rel.Oid] = snapshot.Relations.size();
+        snapshot.Relations.push_back(rel);
+      }
+    }
+    c.Job->Fetched = rows;
+    break;
+  }
+  case 3:
+    c.Count = strtoull(PQgetvalue(res, 0, 0), nullptr, 10);
+    break;
+  }
+}
+
+// Dropped relations leave no newer row; the count gives them away.
+void OnPruneResult(CatalogConnection &c, PGresult *res) {
+  std::unordered_set<uint32_t> present;
+  for (int i = 0; i < PQntuples(res); i++)
+    present.insert(RowOid(res, i, 0));
+  std::vector<WalCatalogRelation> &rels = c.Job->Snapshot.Relations;
+  rels.erase(std::remove_if(rels.begin(), rels.end(),
+                            [&](const WalCatalogRelation &rel) {
+                              return !present.count(rel.Oid);
+                            }),
+             rels.end());
+}
+
+// Called once every result of the current query is in. Returns true if
+// the connection is done with its database.
+bool OnQueryDone(CatalogConnection &c) {
+  if (!c.Job->Error.empty())
+    return true;
+  if (c.State == CatalogConnection::Stage::Catalog && c.Job->Incremental &&
+      c.Count != c.Job->Snapshot.Relations.size()) {
+    c.State = CatalogConnection::Stage::Prune;
+    return !Send(c, "SELECT oid FROM pg_class");
+  }
+  WalCatalogSnapshot &snapshot = c.Job->Snapshot;
+  std::sort(snapshot.Relations.begin(), snapshot.Relations.end(),
+            [](const WalCatalogRelation &a, const WalCatalogRelation &b) {
+              return a.Oid < b.Oid;
+            });
+  snapshot.Xmin = c.Xmin;
+  return true;
+}
+
+// Advances c after its socket became ready. Returns true when done.
+bool Step(CatalogConnection &c) {
+  if (c.State == CatalogConnection::Stage::Connecting) {
+    c.Poll = PQconnectPoll(c.Conn);
+    if (c.Poll == PGRES_POLLING_FAILED) {
+      Fail(c, PQerrorMessage(c.Conn));
+      return true;
+    }
+    if (c.Poll != PGRES_POLLING_OK)
+      return false;
+    PQsetnonblocking(c.Conn, 1);
+    return !SendCatalogQuery(c);
+  }
+
+  if (c.Flushing) {
+    int flushed = PQflush(c.Conn);
+    c.Flushing = flushed == 1;
+    if (flushed < 0) {
+      Fail(c, PQerrorMessage(c.Conn));
+      return true;
+    }
+    return false;
+  }
+  if (!PQconsumeInput(c.Conn)) {
+    Fail(c, PQerrorMessage(c.Conn));
+    return true;
+  }
+  while (!PQisBusy(c.Conn)) {
+    PGresult *res = PQgetResult(c.Conn);
+    if (!res)
+      return OnQueryDone(c);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK)
+      Fail(c, PQresultErrorMessage(res));
+    else if (c.Job->Error.empty() &&
+             c.State == CatalogConnection::Stage::Catalog)
+      OnCatalogResult(c, c.Results, res);
+    else if (c.Job->Error.empty())
+      OnPruneResult(c, res);
+    c.Results++;
+    PQclear(res);
+  }
+  return false;
+}
+
+} // namespace
+
+void FetchCatalogs(const std::string &conninfo,
+                   std::vector<WalCatalogFetch> &fetches, int connections) {
+  size_t next = 0;
+  auto start_next = [&](CatalogConnection &c) {
+    c = CatalogConnection();
+    while (next < fetches.size()) {
+      WalCatalogFetch &job = fetches[next++];
+      // The first dbname is expanded as a connection string, the second
+      // overrides the database in it.
+      const char *keywords[] = {"dbname", "dbname", nullptr};
+      const char *values[] = {conninfo.c_str(),
+                              job.Snapshot.Database.c_str(), nullptr};
+      PGconn *conn = PQconnectStartParams(keywords, values, 1);
+      if (conn && PQstatus(conn) != CONNECTION_BAD) {
+        c.Conn = conn;
+        c.Job = &job;
+        return;
+      }
+      job.Error = conn ? PQerrorMessage(conn) : "out of memory";
+      job.Fetched = -1;
+      PQfinish(conn);
+    }
+  };
+
+  std::vector<CatalogConnection> pool(
+      std::max<size_t>(1, std::min<size_t>(connections, fetches.size())));
+  for (CatalogConnection &c : pool)
+    start_next(c);
+
+  for (;;) {
+    fd_set readable, writable;
+    FD_ZERO(&readable);
+    FD_ZERO(&writable);
+    int max_fd = -1;
+    for (CatalogConnection &c : pool) {
+      if (!c.Conn)
+        continue;
+      int fd = PQsocket(c.Conn);
+      bool write = c.State == CatalogConnection::Stage::Connecting
+                       ? c.Poll == PGRES_POLLING_WRITING
+                       : c.Flushing;
+      FD_SET(fd, write ? &writable : &readable);
+      max_fd = std::max(max_fd, fd);
+    }
+    if (max_fd < 0)
+      break;
+    timeval timeout = {1, 0};
+    if (select(max_fd + 1, &readable, &writable, nullptr, &timeout) < 0)
+      continue;
+
+    for (CatalogConnection &c : pool) {
+      if (!c.Conn)
+        continue;
+      int fd = PQsocket(c.Conn);
+      if (!FD_ISSET(fd, &readable) && !FD_ISSET(fd, &writable))
+        continue;
+      if (!Step(c))
+        continue;
+      if (!c.Job->Error.empty())
+        c.Job->Fetched = -1;
+      PQfinish(c.Conn);
+      start_next(c);
+    }
+  }
+}
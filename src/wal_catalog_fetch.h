@@ -0,0 +1,27 @@
+#pragma once
+#include "wal_catalog_snapshot.h"
+#include <string>
+#include <vector>
+
+// Fetches the catalogs of many databases of one server at once. Each
+// database needs its own connection, since pg_class and pg_namespace are
+// per database; a few non-blocking libpq connections are polled together
+// from the calling thread, each taking the next database when done.
+
+struct WalCatalogFetch {
+  // In: Snapshot.Database names the database. If Incremental, Snapshot
+  // holds a saved snapshot of it, and only pg_class rows inserted or
+  // updated since (xmin not older than its Xmin) are fetched, which
+  // includes every relation given a new relfilenode; rows that are gone
+  // are dropped by OID. Otherwise it is filled whole. Databases and
+  // SystemId are left to the caller.
+  WalCatalogSnapshot Snapshot;
+  bool Incremental = false;
+  int Fetched = -1; /* pg_class rows fetched, -1 on failure */
+  std::string Error;
+};
+
+// conninfo gives everything but the database. At most `connections`
+// databases are fetched at the same time.
+void FetchCatalogs(const std::string &conninfo,
+                   std::vector<WalCatalogFetch> &fetches, int connections);
@@ -0,0 +1,264 @@
+#include "wal_catalog_snapshot.h"
+#include "crc32c.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#define SNAPSHOT_MAGIC "WALCATS"
+#define SNAPSHOT_VERSION 1
+
+// File layout: header, database and namespace entries, relation entries,
+// then the names, each NUL-terminated. All little-endian, as written.
+struct SnapshotHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t HeaderSize;
+  uint64_t SystemId;
+  uint32_t Xmin;
+  uint32_t DatabaseName; /* Offset into the names */
+  uint32_t DatabaseCount;
+  uint32_t NamespaceCount;
+  uint32_t RelationCount;
+  uint32_t NameBytes;
+  uint32_t BodyCrc; /* CRC-32C of everything after the header */
+  uint32_t Padding;
+};
+
+struct SnapshotName {
+  uint32_t Oid;
+  uint32_t Name;
+};
+
+struct SnapshotRelation {
+  uint32_t Oid;
+  uint32_t RelFileNode;
+  uint32_t Namespace;
+  uint32_t Tablespace;
+  uint32_t Name;
+  uint32_t Live;
+};
+
+std::string WalDefaultCacheDir() {
+#ifdef _WIN32
+  if (const char *dir = getenv("LOCALAPPDATA"))
+    return (fs::path(dir) / "wal_viewer").string();
+#else
+  if (const char *dir = getenv("XDG_CACHE_HOME"))
+    return (fs::path(dir) / "wal_viewer").string();
+  if (const char *home = getenv("HOME"))
+    return (fs::path(home) / ".cache" / "wal_viewer").string();
+#endif
+  return "wal_viewer_cache";
+}
+
+std::string WalCatalogSnapshotPath(const std::string &dir, uint64_t system_id,
+                                   const std::string &database) {
+  // Database names may hold anything; keep the file name portable
+  std::string safe;
+  for (char c : database)
+    safe += isalnum((unsigned char)c) || c == '_' || c == '-' ? c : '_';
+  return (fs::path(dir) / ("catalog-" + std::to_string(system_id) + "-" +
+                           safe + ".bin"))
+      .string();
+}
+
+bool SaveWalCatalogSnapshot(const std::string &path,
+                            const WalCatalogSnapshot &snapshot,
+                            std::string &error) {
+  std::vector<char> names;
+  auto add_name = [&](const std::string &s) {
+    uint32_t off = (uint32_t)names.size();
+    names.insert(names.end(), s.begin(), s.end());
+    names.push_back(0);
+    return off;
+  };
+
+  SnapshotHeader header = {};
+  memcpy(header.Magic, SNAPSHOT_MAGIC, sizeof(header.Magic));
+  header.Version = SNAPSHOT_VERSION;
+  header.HeaderSize = sizeof(header);
+  header.SystemId = snapshot.SystemId;
+  header.Xmin = snapshot.Xmin;
+  header.DatabaseName = add_name(snapshot.Database);
+  header.DatabaseCount = (uint32_t)snapshot.Databases.size();
+  header.NamespaceCount = (uint32_t)snapshot.Namespaces.size();
+  header.RelationCount = (uint32_t)snapshot.Relations.size();
+
+  std::vector<uint8_t> body;
+  auto append = [&](const void *p, size_t len) {
+    body.insert(body.end(), (const uint8_t *)p, (const uint8_t *)p + len);
+  };
+  for (const auto *map : {&snapshot.Databases, &snapshot.Namespaces}) {
+    for (const auto &[oid, name] : *map) {
+      SnapshotName entry = {oid, add_name(name)};
+      append(&entry, sizeof(entry));
+    }
+  }
+  for (const WalCatalogRelation &rel : snapshot.Relations) {
+    SnapshotRelation entry = {rel.Oid,        rel.RelFileNode,
+                              rel.Namespace,  rel.Tablespace,
+                              add_name(rel.Name), rel.Live ? 1u : 0u};
+    append(&entry, sizeof(entry));
+  }
+  header.NameBytes = (uint32_t)names.size();
+  append(names.data(), names.size());
+  header.BodyCrc =
+      Crc32cFinish(Crc32cUpdate(CRC32C_INIT, body.data(), body.size()));
+
+  std::error_code ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f) {
+    error = "cannot create " + tmp;
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(body.data(), 1, body.size(), f) == body.size();
+  ok = fclose(f) == 0 && ok;
+  if (ok) {
+    fs::rename(tmp, path, ec);
+    ok = !ec;
+  }
+  if (!ok) {
+    fs::remove(tmp, ec);
+    error = "cannot write " + path;
+  }
+  return ok;
+}
+
+namespace {
+
+// The whole file, mapped read-only (read into memory on Windows).
+class MappedFile {
+public:
+  ~MappedFile() {
+#ifndef _WIN32
+    if (data_)
+      munmap((void *)data_, size_);
+#endif
+  }
+
+  bool Open(const std::string &path) {
+#ifdef _WIN32
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+      return false;
+    _fseeki64(f, 0, SEEK_END);
+    buf_.resize((size_t)_ftelli64(f));
+    _fseeki64(f, 0, SEEK_SET);
+    bool ok = fread(buf_.data(), 1, buf_.size(), f) == buf_.size();
+    fclose(f);
+    data_ = buf_.data();
+    size_ = buf_.size();
+    return ok;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (ok) {
+      void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+                     0);
+      ok = p != MAP_FAILED;
+      if (ok) {
+        data_ = (const uint8_t *)p;
+        size_ = (size_t)st.st_size;
+      }
+    }
+    close(fd);
+    return ok;
+#endif
+  }
+
+  const uint8_t *Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<uint8_t> buf_;
+#endif
+};
+
+} // namespace
+
+bool LoadWalCatalogSnapshot(const std::string &path, WalCatalogSnapshot &out,
+                            std::string &error) {
+  MappedFile file;
+  if (!file.Open(path)) {
+    error = "cannot read " + path;
+    return false;
+  }
+  SnapshotHeader header;
+  if (file.Size() < sizeof(header)) {
+    error = path + " is too short";
+    return false;
+  }
+  memcpy(&header, file.Data(), sizeof(header));
+  if (memcmp(header.Magic, SNAPSHOT_MAGIC, sizeof(header.Magic)) != 0 ||
+      header.Version != SNAPSHOT_VERSION ||
+      header.HeaderSize != sizeof(header)) {
+    error = path + " is not a catalog snapshot of this version";
+    return false;
+  }
+  uint64_t names_count =
+      (uint64_t)header.DatabaseCount + header.NamespaceCount;
+  uint64_t body_size = names_count * sizeof(SnapshotName) +
+                       (uint64_t)header.RelationCount *
+                           sizeof(SnapshotRelation) +
+                       header.NameBytes;
+  const uint8_t *body = file.Data() + sizeof(header);
+  if (body_size != file.Size() - sizeof(header) ||
+      Crc32cFinish(Crc32cUpdate(CRC32C_INIT, body, body_size)) !=
+          header.BodyCrc) {
+    error = path + " is corrupt";
+    return false;
+  }
+
+  // The names end with a NUL, so every offset below NameBytes reads back
+  // a terminated string.
+  const char *names = (const char *)body + (body_size - header.NameBytes);
+  if (header.NameBytes == 0 || names[header.NameBytes - 1] != 0) {
+    error = path + " is corrupt";
+    return false;
+  }
+  auto name = [&](uint32_t off) {
+    return std::string(off < header.NameBytes ? names + off : "");
+  };
+
+  out = WalCatalogSnapshot();
+  out.SystemId = header.SystemId;
+  out.Xmin = header.Xmin;
+  out.Database = name(header.DatabaseName);
+  const uint8_t *p = body;
+  for (uint64_t i = 0; i < names_count; i++, p += sizeof(SnapshotName)) {
+    SnapshotName entry;
+    memcpy(&entry, p, sizeof(entry));
+    auto &map = i < header.DatabaseCount ? out.Databases : out.Namespaces;
+    map.emplace_hint(map.end(), entry.Oid, name(entry.Name));
+  }
+  out.Relations.reserve(header.RelationCount);
+  for (uint32_t i = 0; i < header.RelationCount;
+       i++, p += sizeof(SnapshotRelation)) {
+    SnapshotRelation entry;
+    memcpy(&entry, p, sizeof(entry));
+    out.Relations.push_back({entry.Oid, entry.RelFileNode, entry.Namespace,
+                             entry.Tablespace, name(entry.Name),
+                             entry.Live != 0});
+  }
+  return true;
+}
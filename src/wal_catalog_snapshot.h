@@ -0,0 +1,38 @@
+#pragma once
+#include "wal_catalog.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// The names fetched from a server, kept on disk between runs so the next
+// start only has to fetch what changed. One file per cluster (system
+// identifier) and database, in a versioned binary format that is mapped
+// into memory to load.
+struct WalCatalogSnapshot {
+  uint64_t SystemId = 0;
+  // Oldest transaction running when the rows were fetched; rows with a
+  // newer xmin may have changed since.
+  uint32_t Xmin = 0;
+  std::string Database;
+  std::map<uint32_t, std::string> Databases;  /* OID -> datname */
+  std::map<uint32_t, std::string> Namespaces; /* OID -> nspname */
+  std::vector<WalCatalogRelation> Relations;  /* By OID */
+};
+
+// $XDG_CACHE_HOME/wal_viewer, ~/.cache/wal_viewer or
+// %LOCALAPPDATA%\wal_viewer.
+std::string WalDefaultCacheDir();
+// dir/catalog-<system id>-<database>.bin
+std::string WalCatalogSnapshotPath(const std::string &dir, uint64_t system_id,
+                                   const std::string &database);
+
+// Written to a temporary file and renamed over path, so a reader never sees
+// half a snapshot. Creates the directory.
+bool SaveWalCatalogSnapshot(const std::string &path,
+                            const WalCatalogSnapshot &snapshot,
+                            std::string &error);
+// False with error set if the file is missing, of another version or
+// corrupt.
+bool LoadWalCatalogSnapshot(const std::string &path, WalCatalogSnapshot &out,
+                            std::string &error);
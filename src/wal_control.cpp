@@ -0,0 +1,133 @@
+#include "wal_control.h"
+#include "crc32c.h"
+#include "wal_parser.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+// PG_CONTROL_FILE_SIZE; ControlFileData itself stays under
+// PG_CONTROL_MAX_SAFE_SIZE, so its CRC is somewhere in the first 512 bytes.
+#define PG_CONTROL_FILE_SIZE 8192
+#define PG_CONTROL_MAX_SAFE_SIZE 512
+
+// ControlFileData offsets (CheckPoint checkPointCopy starts at 40)
+#define CTL_SYSTEM_IDENTIFIER 0
+#define CTL_CONTROL_VERSION 8
+#define CTL_CATALOG_VERSION 12
+#define CTL_STATE 16
+#define CTL_TIME 24
+#define CTL_CHECKPOINT 32
+#define CTL_CKPT_REDO 40
+#define CTL_CKPT_TLI 48
+#define CTL_CKPT_PREV_TLI 52
+#define CTL_CKPT_FULL_PAGE_WRITES 56
+#define CTL_CKPT_NEXT_XID 64
+#define CTL_CKPT_NEXT_OID 72
+#define CTL_CKPT_TIME 104
+#define CTL_MIN_RECOVERY_POINT 136
+#define CTL_MIN_RECOVERY_TLI 144
+#define CTL_MIN_SIZE 148
+
+const char *WalClusterStateName(WalClusterState state) {
+  switch (state) {
+  case WalClusterState::Startup:
+    return "starting up";
+  case WalClusterState::Shutdowned:
+    return "shut down";
+  case WalClusterState::ShutdownedInRecovery:
+    return "shut down in recovery";
+  case WalClusterState::Shutdowning:
+    return "shutting down";
+  case WalClusterState::InCrashRecovery:
+    return "in crash recovery";
+  case WalClusterState::InArchiveRecovery:
+    return "in archive recovery";
+  case WalClusterState::InProduction:
+    return "in production";
+  }
+  return "unrecognized status code";
+}
+
+template <typename T> static T Get(const uint8_t *data, size_t off) {
+  T v;
+  memcpy(&v, data + off, sizeof(v));
+  return v;
+}
+
+bool ReadWalControlFile(const std::string &data_dir, WalControlFile &out,
+                        std::string &error) {
+  std::string path =
+      (std::filesystem::path(data_dir) / "global" / "pg_control").string();
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    error = "cannot open " + path;
+    return false;
+  }
+  uint8_t data[PG_CONTROL_MAX_SAFE_SIZE];
+  size_t size = fread(data, 1, sizeof(data), f);
+  fclose(f);
+  if (size < CTL_MIN_SIZE + 4) {
+    error = path + " is too short";
+    return false;
+  }
+
+  // The CRC covers everything before it, and where it sits depends on the
+  // version; it is the first 4-aligned word that matches the data before.
+  bool crc_ok = false;
+  uint32_t crc = Crc32cUpdate(CRC32C_INIT, data, CTL_MIN_SIZE);
+  for (size_t off = CTL_MIN_SIZE; off + 4 <= size; off += 4) {
+    if (Crc32cFinish(crc) == Get<uint32_t>(data, off)) {
+      crc_ok = true;
+      break;
+    }
+    crc = Crc32cUpdate(crc, data + off, 4);
+  }
+  if (!crc_ok) {
+    error = "incorrect checksum in " + path;
+    return false;
+  }
+
+  out.SystemId = Get<uint64_t>(data, CTL_SYSTEM_IDENTIFIER);
+  out.ControlVersion = Get<uint32_t>(data, CTL_CONTROL_VERSION);
+  out.CatalogVersion = Get<uint32_t>(data, CTL_CATALOG_VERSION);
+  out.State = (WalClusterState)Get<uint32_t>(data, CTL_STATE);
+  out.Time = Get<int64_t>(data, CTL_TIME);
+  out.CheckpointLSN = Get<uint64_t>(data, CTL_CHECKPOINT);
+  out.RedoLSN = Get<uint64_t>(data, CTL_CKPT_REDO);
+  out.Timeline = Get<uint32_t>(data, CTL_CKPT_TLI);
+  out.PrevTimeline = Get<uint32_t>(data, CTL_CKPT_PREV_TLI);
+  out.FullPageWrites = data[CTL_CKPT_FULL_PAGE_WRITES] != 0;
+  out.NextXid = Get<uint64_t>(data, CTL_CKPT_NEXT_XID);
+  out.NextOid = Get<uint32_t>(data, CTL_CKPT_NEXT_OID);
+  out.CheckpointTime = Get<int64_t>(data, CTL_CKPT_TIME);
+  out.MinRecoveryLSN = Get<uint64_t>(data, CTL_MIN_RECOVERY_POINT);
+  out.MinRecoveryTimeline = Get<uint32_t>(data, CTL_MIN_RECOVERY_TLI);
+  return true;
+}
+
+std::string FindWalSegmentForLSN(const std::string &wal_dir, uint32_t tli,
+                                 uint64_t lsn) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  uint64_t segment_size = 0;
+  for (const auto &entry : fs::directory_iterator(wal_dir, ec)) {
+    std::string name = entry.path().filename().string();
+    bool wal_name = name.size() == 24 &&
+                    name.find_first_not_of("0123456789ABCDEF") ==
+                        std::string::npos;
+    if (wal_name && entry.is_regular_file(ec)) {
+      segment_size = WalSegmentSizeFromFileSize(entry.file_size(ec));
+      break;
+    }
+  }
+  if (segment_size == 0)
+    segment_size = WalSegmentSizeFromFileSize(0);
+
+  std::string name = WalFileNameForLSN(tli, lsn, segment_size);
+  for (const char *suffix : {"", ".gz", ".lz4", ".zst", ".zstd"}) {
+    fs::path path = fs::path(wal_dir) / (name + suffix);
+    if (fs::is_regular_file(path, ec))
+      return path.string();
+  }
+  return std::string();
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// The cluster's control file (global/pg_control), read offline: where the
+// last checkpoint is and where recovery would start replaying from. Only
+// fields whose position is the same in PostgreSQL 15 to 17 are decoded.
+
+enum class WalClusterState : uint32_t {
+  Startup,
+  Shutdowned,
+  ShutdownedInRecovery,
+  Shutdowning,
+  InCrashRecovery,
+  InArchiveRecovery,
+  InProduction,
+};
+// "shut down", "in production", ... as pg_controldata prints them.
+const char *WalClusterStateName(WalClusterState state);
+
+struct WalControlFile {
+  uint64_t SystemId;
+  uint32_t ControlVersion;
+  uint32_t CatalogVersion;
+  WalClusterState State;
+  int64_t Time;             /* Last update, Unix time */
+  uint64_t CheckpointLSN;   /* Latest checkpoint record */
+  uint64_t RedoLSN;         /* Where replay of that checkpoint starts */
+  uint32_t Timeline;        /* Of the checkpoint */
+  uint32_t PrevTimeline;
+  bool FullPageWrites;
+  uint64_t NextXid;         /* Full (epoch << 32 | xid) */
+  uint32_t NextOid;
+  int64_t CheckpointTime;
+  uint64_t MinRecoveryLSN;  /* Replay must reach this before it's consistent */
+  uint32_t MinRecoveryTimeline;
+};
+
+// Reads data_dir/global/pg_control and checks its CRC. False with error
+// set if it is missing, too short or corrupt.
+bool ReadWalControlFile(const std::string &data_dir, WalControlFile &out,
+                        std::string &error);
+
+// The segment of wal_dir holding lsn on timeline tli, as is or archived
+// (.gz, .lz4, .zst); empty if there is none. The segment size is taken from
+// the size of the uncompressed segments there, 16MB if there are none.
+std::string FindWalSegmentForLSN(const std::string &wal_dir, uint32_t tli,
+                                 uint64_t lsn);
@@ -0,0 +1,155 @@
+#include "wal_dir_scan.h"
+#include "wal_io.h"
+#include "wal_parser.h"
+#include "wal_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#define WAL_SCAN_SAMPLES 16
+
+const char *WalSegmentStatusName(WalSegmentStatus status) {
+  switch (status) {
+  case WalSegmentStatus::Valid:
+    return "valid";
+  case WalSegmentStatus::Recycled:
+    return "recycled";
+  case WalSegmentStatus::Empty:
+    return "empty";
+  case WalSegmentStatus::Invalid:
+    return "invalid";
+  case WalSegmentStatus::Unreadable:
+    return "unreadable";
+  }
+  return "?";
+}
+
+namespace {
+
+// A page belongs to the segment's current contents if it carries the address
+// its position implies. Pages past the end of WAL are either zeroes or left
+// over from the segment's previous life, with an older address.
+bool PageIsCurrent(const uint8_t *buf, uint32_t page, uint64_t base_lsn) {
+  WalPageHeaderInfo header;
+  return ReadWalPageHeader(buf, WAL_SHORT_PAGE_HEADER_SIZE, header) &&
+         header.PageAddr == base_lsn + (uint64_t)page * WAL_PAGE_SIZE;
+}
+
+} // namespace
+
+bool SummarizeWalSegment(const std::string &path, WalSegmentSummary &out) {
+  WalTraceScope trace("scan", "summarize");
+  trace.SetSegment(path);
+  out = WalSegmentSummary();
+  out.Path = path;
+  out.FileName = std::filesystem::path(path).filename().string();
+
+  WalPositionalFile file;
+  uint8_t first[WAL_LONG_PAGE_HEADER_SIZE];
+  if (!file.Open(path, out.FileSize) || out.FileSize < sizeof(first) ||
+      !file.ReadAt(0, first, sizeof(first))) {
+    out.Status = WalSegmentStatus::Unreadable;
+    return false;
+  }
+  out.TotalPages = (uint32_t)(out.FileSize / WAL_PAGE_SIZE);
+
+  bool all_zero = true;
+  for (uint8_t b : first)
+    all_zero &= b == 0;
+  if (all_zero) {
+    out.Status = WalSegmentStatus::Empty;
+    return true;
+  }
+
+  WalPageHeaderInfo header;
+  if (!ReadWalPageHeader(first, sizeof(first), header)) {
+    out.Status = WalSegmentStatus::Invalid;
+    return true;
+  }
+  out.StartLSN = header.PageAddr;
+  out.Timeline = header.Timeline;
+  out.SystemId = header.SystemId;
+  out.SegmentSize = header.SegmentSize;
+
+  uint64_t segment_size = header.SegmentSize
+                              ? header.SegmentSize
+                              : WalSegmentSizeFromFileSize(out.FileSize);
+  out.NameLSN = WalFileNameToLSN(out.FileName, segment_size);
+  if (out.NameLSN != 0 && out.NameLSN != header.PageAddr) {
+    out.Status = WalSegmentStatus::Recycled;
+    return true;
+  }
+  out.Status = WalSegmentStatus::Valid;
+  if (out.TotalPages == 0)
+    return true;
+
+  // Current pages form a prefix of the file. Each round reads the headers
+  // of pages spread evenly inside the bracket as one batch and narrows the
+  // bracket to where they stop being current: three rounds for 16 MB.
+  uint32_t lo = 0;              // Known current
+  uint32_t hi = out.TotalPages; // Known not current (or past the end)
+  while (hi - lo > 1) {
+    uint32_t pages[WAL_SCAN_SAMPLES];
+    uint64_t offsets[WAL_SCAN_SAMPLES];
+    uint8_t headers[WAL_SCAN_SAMPLES][WAL_SHORT_PAGE_HEADER_SIZE];
+    uint32_t span = hi - lo;
+    size_t n = 0;
+    for (uint32_t i = 1; i <= WAL_SCAN_SAMPLES && i < span; i++) {
+      pages[n] = span <= WAL_SCAN_SAMPLES
+                     ? lo + i
+                     : lo + (uint32_t)((uint64_t)span * i /
+                                       (WAL_SCAN_SAMPLES + 1));
+      offsets[n] = (uint64_t)pages[n] * WAL_PAGE_SIZE;
+      n++;
+    }
+    size_t read = file.ReadManyAt(offsets, n, headers, sizeof(headers[0]));
+    uint32_t next_hi = hi;
+    for (size_t i = 0; i < n; i++) {
+      if (i >= read || !PageIsCurrent(headers[i], pages[i], header.PageAddr)) {
+        next_hi = pages[i];
+        break;
+      }
+      lo = pages[i];
+    }
+    hi = next_hi;
+  }
+  out.ValidPages = lo + 1;
+  out.Fill = out.TotalPages ? (float)out.ValidPages / out.TotalPages : 0.0f;
+  return true;
+}
+
+void ScanWalFiles(const std::vector<std::string> &paths,
+                  std::vector<WalSegmentSummary> &out, unsigned threads) {
+  out.clear();
+  out.resize(paths.size());
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = (unsigned)std::min<size_t>(threads, paths.size());
+
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < paths.size(); i = next++)
+      SummarizeWalSegment(paths[i], out[i]);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread &t : pool)
+    t.join();
+}
+
+void ScanWalDirectory(const std::string &dir,
+                      std::vector<WalSegmentSummary> &out, unsigned threads) {
+  std::vector<std::string> paths;
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    if (entry.is_regular_file(ec))
+      paths.push_back(entry.path().string());
+  }
+  std::sort(paths.begin(), paths.end());
+  ScanWalFiles(paths, out, threads);
+}
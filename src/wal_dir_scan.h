@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class WalSegmentStatus : uint8_t {
+  Valid,      // First page carries the address its file name implies
+  Recycled,   // Old segment renamed for reuse, not written since
+  Empty,      // First page is zeroes (preallocated)
+  Invalid,    // Not a WAL page
+  Unreadable, // Could not open or read the file
+};
+const char *WalSegmentStatusName(WalSegmentStatus status);
+
+struct WalSegmentSummary {
+  std::string Path;
+  std::string FileName;
+  uint64_t FileSize = 0;
+  uint64_t NameLSN = 0;     /* Start LSN implied by the file name */
+  uint64_t StartLSN = 0;    /* xlp_pageaddr of the first page */
+  uint32_t Timeline = 0;    /* xlp_tli */
+  uint64_t SystemId = 0;    /* xlp_sysid */
+  uint32_t SegmentSize = 0; /* xlp_seg_size */
+  WalSegmentStatus Status = WalSegmentStatus::Unreadable;
+  uint32_t ValidPages = 0; /* Leading pages carrying the expected address */
+  uint32_t TotalPages = 0;
+  float Fill = 0.0f; /* ValidPages / TotalPages */
+};
+
+// Summarizes a segment file from its page headers alone: the long header of
+// the first page, then rounds of evenly sampled pages, each narrowing the
+// search to where pages stop carrying the expected address. A round's page
+// headers are read as one batch, so a 16 MB segment costs three rounds of
+// small reads, however cold the cache.
+bool SummarizeWalSegment(const std::string &path, WalSegmentSummary &out);
+
+// Summarizes every regular file in dir (sorted by name), spreading the files
+// over `threads` workers (0 = all cores).
+void ScanWalDirectory(const std::string &dir,
+                      std::vector<WalSegmentSummary> &out,
+                      unsigned threads = 0);
+void ScanWalFiles(const std::vector<std::string> &paths,
+                  std::vector<WalSegmentSummary> &out, unsigned threads = 0);
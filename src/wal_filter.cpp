@@ -0,0 +1,625 @@
+#include "wal_filter.h"
+#include "wal_rel_names.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// --- Tokenizer ---
+
+enum class TokType { End, Word, String, LParen, RParen, Comma, Op };
+
+struct FilterToken {
+  TokType type;
+  std::string text;
+  size_t pos;
+};
+
+static bool IsWordChar(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '/' ||
+         c == '$';
+}
+
+static bool Tokenize(const std::string &s, std::vector<FilterToken> &out,
+                     std::string &error) {
+  size_t i = 0;
+  while (i < s.size()) {
+    char c = s[i];
+    if (isspace((unsigned char)c)) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    if (c == '(') {
+      out.push_back({TokType::LParen, "(", start});
+      i++;
+    } else if (c == ')') {
+      out.push_back({TokType::RParen, ")", start});
+      i++;
+    } else if (c == ',') {
+      out.push_back({TokType::Comma, ",", start});
+      i++;
+    } else if (c == '\'' || c == '"') {
+      size_t end = s.find(c, i + 1);
+      if (end == std::string::npos) {
+        error = "unterminated string at " + std::to_string(start);
+        return false;
+      }
+      out.push_back({TokType::String, s.substr(i + 1, end - i - 1), start});
+      i = end + 1;
+    } else if (strchr("=!<>&|", c)) {
+      std::string op(1, c);
+      if (i + 1 < s.size()) {
+        std::string two = s.substr(i, 2);
+        if (two == "==" || two == "!=" || two == "<>" || two == "<=" ||
+            two == ">=" || two == "&&" || two == "||")
+          op = two;
+      }
+      if (op == "&" || op == "|") {
+        error = "unexpected '" + op + "' at " + std::to_string(start);
+        return false;
+      }
+      out.push_back({TokType::Op, op, start});
+      i += op.size();
+    } else if (IsWordChar(c)) {
+      while (i < s.size() && IsWordChar(s[i]))
+        i++;
+      out.push_back({TokType::Word, s.substr(start, i - start), start});
+    } else {
+      error = std::string("unexpected character '") + c + "' at " +
+              std::to_string(start);
+      return false;
+    }
+  }
+  out.push_back({TokType::End, "", s.size()});
+  return true;
+}
+
+static std::string Lower(std::string s) {
+  for (auto &c : s)
+    c = (char)tolower((unsigned char)c);
+  return s;
+}
+
+static bool ParseNumber(const std::string &s, uint64_t &out) {
+  if (s.empty())
+    return false;
+  char *end = nullptr;
+  if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    out = strtoull(s.c_str() + 2, &end, 16);
+  else
+    out = strtoull(s.c_str(), &end, 10);
+  return end && *end == 0;
+}
+
+// --- Compiler (recursive descent, emits postfix ops) ---
+
+namespace {
+class FilterCompiler {
+public:
+  FilterCompiler(const std::vector<FilterToken> &toks,
+                 const WalFilterResolver &resolver,
+                 std::vector<WalFilter::Op> &program,
+                 std::vector<uint64_t> &sets, std::string &error)
+      : toks_(toks), resolver_(resolver), program_(program), sets_(sets),
+        error_(error) {}
+
+  bool Run(size_t &max_depth) {
+    if (!ParseOr())
+      return false;
+    if (Peek().type != TokType::End)
+      return Fail("unexpected '" + Peek().text + "'");
+    max_depth = max_depth_;
+    return true;
+  }
+
+private:
+  typedef WalFilter::Op Op;
+  typedef WalFilter::Field Field;
+  typedef WalFilter::OpCode OpCode;
+  typedef WalFilter::Cmp Cmp;
+
+  const FilterToken &Peek() const { return toks_[pos_]; }
+  const FilterToken &Next() { return toks_[pos_++]; }
+
+  bool Fail(const std::string &msg) {
+    error_ = msg + " at " + std::to_string(Peek().pos);
+    return false;
+  }
+
+  bool IsKeyword(const char *kw) const {
+    return Peek().type == TokType::Word && Lower(Peek().text) == kw;
+  }
+  bool IsOp(const char *op) const {
+    return Peek().type == TokType::Op && Peek().text == op;
+  }
+
+  void Emit(const Op &op) {
+    program_.push_back(op);
+    if (op.code == OpCode::Cmp || op.code == OpCode::In ||
+        op.code == OpCode::Flag) {
+      depth_++;
+      max_depth_ = std::max(max_depth_, depth_);
+    } else if (op.code == OpCode::And || op.code == OpCode::Or) {
+      depth_--;
+    }
+  }
+  void EmitLogic(OpCode code) { Emit({code, Field::LSN, Cmp::EQ, 0, 0, 0}); }
+
+  bool ParseOr() {
+    if (!ParseAnd())
+      return false;
+    while (IsKeyword("or") || IsOp("||")) {
+      Next();
+      if (!ParseAnd())
+        return false;
+      EmitLogic(OpCode::Or);
+    }
+    return true;
+  }
+
+  bool ParseAnd() {
+    if (!ParseNot())
+      return false;
+    while (IsKeyword("and") || IsOp("&&")) {
+      Next();
+      if (!ParseNot())
+        return false;
+      EmitLogic(OpCode::And);
+    }
+    return true;
+  }
+
+  bool ParseNot() {
+    if (IsKeyword("not") || IsOp("!")) {
+      Next();
+      if (!ParseNot())
+        return false;
+      EmitLogic(OpCode::Not);
+      return true;
+    }
+    return ParsePrimary();
+  }
+
+  bool ParsePrimary() {
+    if (Peek().type == TokType::LParen) {
+      Next();
+      if (!ParseOr())
+        return false;
+      if (Peek().type != TokType::RParen)
+        return Fail("expected ')'");
+      Next();
+      return true;
+    }
+    if (Peek().type != TokType::Word)
+      return Fail("expected a field name");
+
+    std::string name = Lower(Peek().text);
+    if (name == "has_fpi") {
+      Next();
+      Emit({OpCode::Flag, Field::FPI, Cmp::EQ, 0, 0, 0});
+      return true;
+    }
+
+    Field field;
+    std::string resolve_as;
+    if (name == "lsn")
+      field = Field::LSN;
+    else if (name == "rmid" || name == "rmgr")
+      field = Field::RMID;
+    else if (name == "info")
+      field = Field::INFO;
+    else if (name == "len" || name == "length")
+      field = Field::LEN;
+    else if (name == "xid")
+      field = Field::XID;
+    else if (name == "rel" || name == "table") {
+      field = Field::REL;
+      resolve_as = "rel";
+    } else if (name == "nsp" || name == "namespace" || name == "schema") {
+      field = Field::REL;
+      resolve_as = "nsp";
+    } else if (name == "db") {
+      field = Field::DB;
+      resolve_as = "db";
+    } else if (name == "spc")
+      field = Field::SPC;
+    else
+      return Fail("unknown field '" + Peek().text + "'");
+    Next();
+
+    // Numbers go to values, resolved rel/nsp names to keys
+    std::vector<uint64_t> values, keys;
+    if (IsKeyword("in")) {
+      Next();
+      if (Peek().type != TokType::LParen)
+        return Fail("expected '(' after 'in'");
+      Next();
+      while (Peek().type != TokType::RParen) {
+        if (!ParseValue(field, resolve_as, values, keys))
+          return false;
+        if (Peek().type == TokType::Comma) {
+          Next();
+          continue;
+        }
+        if (Peek().type != TokType::RParen)
+          return Fail("expected ',' or ')'");
+      }
+      Next();
+      EmitSets(field, values, keys);
+      return true;
+    }
+
+    if (Peek().type != TokType::Op)
+      return Fail("expected a comparison after '" + name + "'");
+    std::string op = Next().text;
+    bool resolved_name = false;
+    if (!ParseValue(field, resolve_as, values, keys, &resolved_name))
+      return false;
+
+    if (op == "=" || op == "==" || op == "!=" || op == "<>") {
+      if (values.size() == 1 && !resolved_name)
+        Emit({OpCode::Cmp, field, Cmp::EQ, values[0], 0, 0});
+      else
+        EmitSets(field, values, keys);
+      if (op == "!=" || op == "<>")
+        EmitLogic(OpCode::Not);
+      return true;
+    }
+
+    if (resolved_name)
+      return Fail("'" + op + "' needs a numeric value");
+    Cmp cmp;
+    if (op == "<")
+      cmp = Cmp::LT;
+    else if (op == "<=")
+      cmp = Cmp::LE;
+    else if (op == ">")
+      cmp = Cmp::GT;
+    else if (op == ">=")
+      cmp = Cmp::GE;
+    else
+      return Fail("unknown operator '" + op + "'");
+    Emit({OpCode::Cmp, field, cmp, values[0], 0, 0});
+    return true;
+  }
+
+  void EmitSet(Field field, std::vector<uint64_t> &values) {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    Op op = {OpCode::In, field, Cmp::EQ, 0, (uint32_t)sets_.size(),
+             (uint32_t)values.size()};
+    sets_.insert(sets_.end(), values.begin(), values.end());
+    Emit(op);
+  }
+
+  // "in (orders, 16384)" matches relation orders of any database it is in,
+  // or relfilenode 16384 of any database.
+  void EmitSets(Field field, std::vector<uint64_t> &values,
+                std::vector<uint64_t> &keys) {
+    if (keys.empty()) {
+      EmitSet(field, values);
+      return;
+    }
+    EmitSet(Field::DBREL, keys);
+    if (!values.empty()) {
+      EmitSet(field, values);
+      EmitLogic(OpCode::Or);
+    }
+  }
+
+  bool ParseValue(Field field, const std::string &resolve_as,
+                  std::vector<uint64_t> &values, std::vector<uint64_t> &keys,
+                  bool *resolved_name = nullptr) {
+    const FilterToken &tok = Peek();
+    if (tok.type != TokType::Word && tok.type != TokType::String)
+      return Fail("expected a value");
+    std::string text = tok.text;
+    uint64_t v;
+
+    if (field == Field::LSN) {
+      uint32_t hi, lo;
+      char tail;
+      char *end = nullptr;
+      if (sscanf(text.c_str(), "%X/%X%c", &hi, &lo, &tail) == 2)
+        v = ((uint64_t)hi << 32) | lo;
+      else if ((v = strtoull(text.c_str(), &end, 16)), !end || *end != 0)
+        return Fail("invalid LSN '" + text + "'"); // Plain LSNs are hex
+      values.push_back(v);
+      Next();
+      return true;
+    }
+
+    if (field == Field::RMID && !ParseNumber(text, v)) {
+      WalParser parser;
+      for (int i = 0; i <= RM_LOGICALMSG_ID; i++) {
+        if (Lower(parser.GetRmidName((uint8_t)i)) == Lower(text)) {
+          values.push_back((uint64_t)i);
+          Next();
+          return true;
+        }
+      }
+      return Fail("unknown resource manager '" + text + "'");
+    }
+
+    // Numbers are taken literally except for namespaces, which always
+    // resolve to the relations they contain.
+    if (resolve_as != "nsp" && tok.type == TokType::Word &&
+        ParseNumber(text, v)) {
+      values.push_back(v);
+      Next();
+      return true;
+    }
+
+    if (resolve_as.empty())
+      return Fail("invalid number '" + text + "'");
+
+    std::vector<uint64_t> ids;
+    if (!resolver_ || !resolver_(resolve_as, text, ids))
+      return Fail("unknown " + resolve_as + " '" + text + "'");
+    std::vector<uint64_t> &out = resolve_as == "db" ? values : keys;
+    out.insert(out.end(), ids.begin(), ids.end());
+    if (resolved_name)
+      *resolved_name = true;
+    Next();
+    return true;
+  }
+
+  const std::vector<FilterToken> &toks_;
+  const WalFilterResolver &resolver_;
+  std::vector<Op> &program_;
+  std::vector<uint64_t> &sets_;
+  std::string &error_;
+  size_t pos_ = 0;
+  size_t depth_ = 0;
+  size_t max_depth_ = 0;
+};
+} // namespace
+
+bool WalFilter::Compile(const std::string &expr, std::string &error,
+                        const WalFilterResolver &resolver) {
+  program_.clear();
+  sets_.clear();
+  max_depth_ = 0;
+  error.clear();
+
+  std::vector<FilterToken> toks;
+  if (!Tokenize(expr, toks, error))
+    return false;
+  if (toks.size() == 1)
+    return true; // Empty expression: match all
+
+  FilterCompiler compiler(toks, resolver, program_, sets_, error);
+  if (!compiler.Run(max_depth_)) {
+    program_.clear();
+    sets_.clear();
+    return false;
+  }
+  return true;
+}
+
+// --- Evaluation ---
+
+static int CountTrailingZeros(uint64_t v) {
+#ifdef _MSC_VER
+  unsigned long idx;
+  _BitScanForward64(&idx, v);
+  return (int)idx;
+#else
+  return __builtin_ctzll(v);
+#endif
+}
+
+template <typename Get>
+static uint64_t CmpMask(const WalRecordInfo *recs, size_t n, Get get,
+                        WalFilter::Cmp cmp, uint64_t value) {
+  uint64_t mask = 0;
+  switch (cmp) {
+  case WalFilter::Cmp::EQ:
+    for (size_t i = 0; i < n; i++)
+      mask |= (uint64_t)(get(recs[i]) == value) << i;
+    break;
+  case WalFilter::Cmp::LT:
+    for (size_t i = 0; i < n; i++)
+      mask |= (uint64_t)(get(recs[i]) < value) << i;
+    break;
+  case WalFilter::Cmp::LE:
+    for (size_t i = 0; i < n; i++)
+      mask |= (uint64_t)(get(recs[i]) <= value) << i;
+    break;
+  case WalFilter::Cmp::GT:
+    for (size_t i = 0; i < n; i++)
+      mask |= (uint64_t)(get(recs[i]) > value) << i;
+    break;
+  case WalFilter::Cmp::GE:
+    for (size_t i = 0; i < n; i++)
+      mask |= (uint64_t)(get(recs[i]) >= value) << i;
+    break;
+  }
+  return mask;
+}
+
+static bool CmpValue(uint64_t a, WalFilter::Cmp cmp, uint64_t b) {
+  switch (cmp) {
+  case WalFilter::Cmp::EQ:
+    return a == b;
+  case WalFilter::Cmp::LT:
+    return a < b;
+  case WalFilter::Cmp::LE:
+    return a <= b;
+  case WalFilter::Cmp::GT:
+    return a > b;
+  case WalFilter::Cmp::GE:
+    return a >= b;
+  }
+  return false;
+}
+
+static bool InSet(const uint64_t *set, uint32_t count, uint64_t v) {
+  if (count <= 8) {
+    for (uint32_t i = 0; i < count; i++)
+      if (set[i] == v)
+        return true;
+    return false;
+  }
+  return std::binary_search(set, set + count, v);
+}
+
+static uint64_t NodeField(const WalRelFileNode &node, WalFilter::Field field) {
+  if (field == WalFilter::Field::DBREL)
+    return WalRelKey(node.dbNode, node.relNode);
+  if (field == WalFilter::Field::REL)
+    return node.relNode;
+  if (field == WalFilter::Field::DB)
+    return node.dbNode;
+  return node.spcNode;
+}
+
+static uint64_t ScalarField(const WalRecordInfo &rec, WalFilter::Field field) {
+  switch (field) {
+  case WalFilter::Field::LSN:
+    return rec.LSN;
+  case WalFilter::Field::RMID:
+    return rec.RMID;
+  case WalFilter::Field::INFO:
+    return rec.Info;
+  case WalFilter::Field::LEN:
+    return rec.Length;
+  case WalFilter::Field::XID:
+    return rec.XID;
+  default:
+    return 0;
+  }
+}
+
+static bool IsNodeField(WalFilter::Field field) {
+  return field == WalFilter::Field::REL || field == WalFilter::Field::DB ||
+         field == WalFilter::Field::SPC || field == WalFilter::Field::DBREL;
+}
+
+uint64_t WalFilter::EvalBatch(const WalRecordInfo *recs, size_t n,
+                              uint64_t *stack) const {
+  size_t sp = 0;
+  for (const Op &op : program_) {
+    uint64_t mask = 0;
+    switch (op.code) {
+    case OpCode::And:
+      sp--;
+      stack[sp - 1] &= stack[sp];
+      continue;
+    case OpCode::Or:
+      sp--;
+      stack[sp - 1] |= stack[sp];
+      continue;
+    case OpCode::Not:
+      stack[sp - 1] = ~stack[sp - 1];
+      continue;
+    case OpCode::Flag:
+      for (size_t i = 0; i < n; i++)
+        mask |= (uint64_t)recs[i].HasFPI << i;
+      break;
+    case OpCode::Cmp:
+      if (IsNodeField(op.field)) {
+        for (size_t i = 0; i < n; i++) {
+          for (const auto &node : recs[i].RelFileNodes) {
+            if (CmpValue(NodeField(node, op.field), op.cmp, op.value)) {
+              mask |= 1ull << i;
+              break;
+            }
+          }
+        }
+        break;
+      }
+      switch (op.field) {
+      case Field::LSN:
+        mask = CmpMask(
+            recs, n, [](const WalRecordInfo &r) { return r.LSN; }, op.cmp,
+            op.value);
+        break;
+      case Field::RMID:
+        mask = CmpMask(
+            recs, n, [](const WalRecordInfo &r) { return (uint64_t)r.RMID; },
+            op.cmp, op.value);
+        break;
+      case Field::INFO:
+        mask = CmpMask(
+            recs, n, [](const WalRecordInfo &r) { return (uint64_t)r.Info; },
+            op.cmp, op.value);
+        break;
+      case Field::LEN:
+        mask = CmpMask(
+            recs, n,
+            [](const WalRecordInfo &r) { return (uint64_t)r.Length; }, op.cmp,
+            op.value);
+        break;
+      case Field::XID:
+        mask = CmpMask(
+            recs, n, [](const WalRecordInfo &r) { return (uint64_t)r.XID; },
+            op.cmp, op.value);
+        break;
+      default:
+        break;
+      }
+      break;
+    case OpCode::In: {
+      const uint64_t *set = sets_.data() + op.set_begin;
+      if (IsNodeField(op.field)) {
+        for (size_t i = 0; i < n; i++) {
+          for (const auto &node : recs[i].RelFileNodes) {
+            if (InSet(set, op.set_count, NodeField(node, op.field))) {
+              mask |= 1ull << i;
+              break;
+            }
+          }
+        }
+      } else {
+        for (size_t i = 0; i < n; i++)
+          mask |= (uint64_t)InSet(set, op.set_count,
+                                  ScalarField(recs[i], op.field))
+                  << i;
+      }
+      break;
+    }
+    }
+    stack[sp++] = mask;
+  }
+  return sp ? stack[0] : ~0ull;
+}
+
+bool WalFilter::Matches(const WalRecordInfo &rec) const {
+  if (program_.empty())
+    return true;
+  uint64_t small_stack[32];
+  std::vector<uint64_t> big_stack;
+  uint64_t *stack = small_stack;
+  if (max_depth_ > 32) {
+    big_stack.resize(max_depth_);
+    stack = big_stack.data();
+  }
+  return EvalBatch(&rec, 1, stack) & 1;
+}
+
+void WalFilter::Evaluate(const WalRecordInfo *records, size_t count,
+                         std::vector<uint32_t> &out_indices) const {
+  if (program_.empty()) {
+    for (size_t i = 0; i < count; i++)
+      out_indices.push_back((uint32_t)i);
+    return;
+  }
+  std::vector<uint64_t> stack(max_depth_ > 0 ? max_depth_ : 1);
+  for (size_t base = 0; base < count; base += 64) {
+    size_t n = std::min<size_t>(64, count - base);
+    uint64_t mask = EvalBatch(records + base, n, stack.data());
+    if (n < 64)
+      mask &= (1ull << n) - 1;
+    while (mask) {
+      int bit = CountTrailingZeros(mask);
+      out_indices.push_back((uint32_t)(base + bit));
+      mask &= mask - 1;
+    }
+  }
+}
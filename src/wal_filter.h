@@ -0,0 +1,72 @@
+#pragma once
+#include "wal_parser.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Resolves a name used in a filter expression into ids. For "rel" and "nsp"
+// the ids are WalRelKey(database OID, relfilenode), so a name only matches
+// in the databases where it exists; for "db" they are database OIDs.
+// Returns false if the name is unknown.
+typedef std::function<bool(const std::string &field, const std::string &name,
+                           std::vector<uint64_t> &out_ids)>
+    WalFilterResolver;
+
+// Record filter shared by the GUI filter bar and the CLI. An expression like
+//
+//   rmid in (Heap,Btree) and rel = orders and len > 4096 and not has_fpi
+//
+// is parsed once by Compile() into a flat postfix program which is then
+// evaluated over records in batches of 64, one bit per record.
+//
+// Fields: lsn, rmid, info, len, xid, rel, db, spc, nsp, has_fpi.
+// Operators: = == != <> < <= > >= in, combined with and/or/not (&& || !)
+// and parentheses. rel/db/spc match if any block reference matches. An
+// empty list, "rmid in ()", matches nothing.
+class WalFilter {
+public:
+  // An empty expression compiles to a filter that matches everything.
+  bool Compile(const std::string &expr, std::string &error,
+               const WalFilterResolver &resolver = nullptr);
+  bool Empty() const { return program_.empty(); }
+
+  bool Matches(const WalRecordInfo &rec) const;
+  // Appends the indices of the matching records to out_indices.
+  void Evaluate(const WalRecordInfo *records, size_t count,
+                std::vector<uint32_t> &out_indices) const;
+
+  // DBREL is the database and relfilenode of a block reference as one
+  // key, what rel and nsp names resolve to.
+  enum class Field : uint8_t {
+    LSN,
+    RMID,
+    INFO,
+    LEN,
+    XID,
+    REL,
+    DB,
+    SPC,
+    DBREL,
+    FPI
+  };
+  enum class OpCode : uint8_t { Cmp, In, Flag, And, Or, Not };
+  enum class Cmp : uint8_t { EQ, LT, LE, GT, GE };
+
+  struct Op {
+    OpCode code;
+    Field field;
+    Cmp cmp;
+    uint64_t value;     // Cmp operand
+    uint32_t set_begin; // In: sorted values in sets_
+    uint32_t set_count;
+  };
+
+private:
+  uint64_t EvalBatch(const WalRecordInfo *records, size_t n,
+                     uint64_t *stack) const;
+
+  std::vector<Op> program_;
+  std::vector<uint64_t> sets_;
+  size_t max_depth_ = 0;
+};
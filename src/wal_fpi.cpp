@@ -0,0 +1,326 @@
+#include "wal_fpi.h"
+#include <cstring>
+
+#ifdef WAL_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef WAL_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// bimg_info compression flags (PostgreSQL 15+)
+#define BKPIMAGE_COMPRESS_PGLZ 0x04
+#define BKPIMAGE_COMPRESS_LZ4 0x08
+#define BKPIMAGE_COMPRESS_ZSTD 0x10
+#define SizeOfXLogRecordBlockCompressHeader 2
+
+const char *WalFpiCompressionName(WalFpiCompression compression) {
+  switch (compression) {
+  case WalFpiCompression::None:
+    return "off";
+  case WalFpiCompression::Pglz:
+    return "pglz";
+  case WalFpiCompression::Lz4:
+    return "lz4";
+  case WalFpiCompression::Zstd:
+    return "zstd";
+  }
+  return "?";
+}
+
+bool WalFpiCompressionAvailable(WalFpiCompression compression) {
+  switch (compression) {
+  case WalFpiCompression::None:
+  case WalFpiCompression::Pglz:
+    return true;
+  case WalFpiCompression::Lz4:
+#ifdef WAL_HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+  case WalFpiCompression::Zstd:
+#ifdef WAL_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+uint8_t WalFpiCompressionFlag(WalFpiCompression compression) {
+  switch (compression) {
+  case WalFpiCompression::Pglz:
+    return BKPIMAGE_COMPRESS_PGLZ;
+  case WalFpiCompression::Lz4:
+    return BKPIMAGE_COMPRESS_LZ4;
+  case WalFpiCompression::Zstd:
+    return BKPIMAGE_COMPRESS_ZSTD;
+  default:
+    return 0;
+  }
+}
+
+int32_t WalCompressPageImage(WalFpiCompression compression,
+                             const uint8_t *src, int32_t len, bool has_hole,
+                             uint8_t *dst) {
+  int32_t out = -1;
+  switch (compression) {
+  case WalFpiCompression::None:
+    return -1;
+  case WalFpiCompression::Pglz:
+    out = WalPglzCompress(src, len, dst);
+    break;
+  case WalFpiCompression::Lz4:
+#ifdef WAL_HAVE_LZ4
+    out = LZ4_compress_default((const char *)src, (char *)dst, len,
+                               WAL_FPI_COMPRESS_BOUND(len));
+    if (out <= 0)
+      out = -1;
+#endif
+    break;
+  case WalFpiCompression::Zstd:
+#ifdef WAL_HAVE_ZSTD
+  {
+    size_t n = ZSTD_compress(dst, WAL_FPI_COMPRESS_BOUND(len), src, len,
+                             ZSTD_CLEVEL_DEFAULT);
+    out = ZSTD_isError(n) ? -1 : (int32_t)n;
+  }
+#endif
+    break;
+  }
+  int32_t extra = has_hole ? SizeOfXLogRecordBlockCompressHeader : 0;
+  if (out < 0 || out + extra >= len)
+    return -1;
+  return out;
+}
+
+WalFpiCompression WalFpiCompressionFromFlags(uint8_t bimg_info) {
+  if (bimg_info & BKPIMAGE_COMPRESS_PGLZ)
+    return WalFpiCompression::Pglz;
+  if (bimg_info & BKPIMAGE_COMPRESS_LZ4)
+    return WalFpiCompression::Lz4;
+  if (bimg_info & BKPIMAGE_COMPRESS_ZSTD)
+    return WalFpiCompression::Zstd;
+  return WalFpiCompression::None;
+}
+
+int32_t WalDecompressPageImage(WalFpiCompression compression,
+                               const uint8_t *src, int32_t len, uint8_t *dst,
+                               int32_t raw_len) {
+  switch (compression) {
+  case WalFpiCompression::None:
+    if (len != raw_len)
+      return -1;
+    memcpy(dst, src, len);
+    return raw_len;
+  case WalFpiCompression::Pglz:
+    return WalPglzDecompress(src, len, dst, raw_len);
+  case WalFpiCompression::Lz4:
+#ifdef WAL_HAVE_LZ4
+    return LZ4_decompress_safe((const char *)src, (char *)dst, len,
+                               raw_len) == raw_len
+               ? raw_len
+               : -1;
+#else
+    return -1;
+#endif
+  case WalFpiCompression::Zstd:
+#ifdef WAL_HAVE_ZSTD
+  {
+    size_t n = ZSTD_decompress(dst, raw_len, src, len);
+    return !ZSTD_isError(n) && n == (size_t)raw_len ? raw_len : -1;
+  }
+#else
+    return -1;
+#endif
+  }
+  return -1;
+}
+
+// --- pglz ---
+//
+// Output is a sequence of control bytes, each followed by up to 8 items:
+// a literal byte (control bit 0) or a 2-3 byte back reference (bit 1)
+// holding a 12 bit offset and a length of 3..273.
+
+#define PGLZ_MAX_HISTORY_LISTS 8192
+#define PGLZ_HISTORY_SIZE 4096
+#define PGLZ_MAX_MATCH 273
+#define PGLZ_MIN_INPUT 32
+#define PGLZ_MIN_COMP_RATE 25
+#define PGLZ_FIRST_SUCCESS_BY 1024
+#define PGLZ_MATCH_SIZE_GOOD 128
+#define PGLZ_MATCH_SIZE_DROP 10
+
+namespace {
+
+// History entries are linked per hash bucket, newest first. Entry 0 is the
+// list terminator; entries are recycled round robin like the original.
+struct PglzHistory {
+  int16_t start[PGLZ_MAX_HISTORY_LISTS];
+  struct Entry {
+    int16_t next, prev;
+    int32_t hindex;
+    const uint8_t *pos;
+  } entries[PGLZ_HISTORY_SIZE + 1];
+};
+
+int PglzHash(const uint8_t *s, const uint8_t *end, int mask) {
+  if (end - s < 4)
+    return s[0] & mask;
+  return ((s[0] << 6) ^ (s[1] << 4) ^ (s[2] << 2) ^ s[3]) & mask;
+}
+
+} // namespace
+
+int32_t WalPglzCompress(const uint8_t *src, int32_t len, uint8_t *dst) {
+  if (len < PGLZ_MIN_INPUT)
+    return -1;
+
+  // Smaller inputs get fewer hash lists, so they are cheaper to clear
+  int hashsz = len < 128    ? 512
+               : len < 256  ? 1024
+               : len < 512  ? 2048
+               : len < 1024 ? 4096
+                            : 8192;
+  int mask = hashsz - 1;
+  static thread_local PglzHistory hist;
+  memset(hist.start, 0, hashsz * sizeof(int16_t));
+  int hist_next = 1;
+  bool hist_recycle = false;
+
+  int32_t result_max = (len / 100) * (100 - PGLZ_MIN_COMP_RATE);
+  const uint8_t *dp = src, *dend = src + len;
+  uint8_t *bp = dst;
+  uint8_t ctrl_dummy = 0, *ctrlp = &ctrl_dummy;
+  uint8_t ctrl = 0, ctrlb = 0;
+  bool found_match = false;
+
+  auto hist_add = [&](const uint8_t *s) {
+    int hindex = PglzHash(s, dend, mask);
+    PglzHistory::Entry &e = hist.entries[hist_next];
+    if (hist_recycle) {
+      // Unlink the entry from the list it was on
+      if (e.prev == 0)
+        hist.start[e.hindex] = e.next;
+      else
+        hist.entries[e.prev].next = e.next;
+      if (e.next != 0)
+        hist.entries[e.next].prev = e.prev;
+    }
+    e.next = hist.start[hindex];
+    e.prev = 0;
+    e.hindex = hindex;
+    e.pos = s;
+    if (e.next != 0)
+      hist.entries[e.next].prev = (int16_t)hist_next;
+    hist.start[hindex] = (int16_t)hist_next;
+    if (++hist_next > PGLZ_HISTORY_SIZE) {
+      hist_next = 1;
+      hist_recycle = true;
+    }
+  };
+  auto out_ctrl = [&]() {
+    ctrlb <<= 1;
+    if (ctrlb == 0) {
+      *ctrlp = ctrl;
+      ctrlp = bp++;
+      ctrl = 0;
+      ctrlb = 1;
+    }
+  };
+
+  while (dp < dend) {
+    if (bp - dst >= result_max)
+      return -1;
+    if (!found_match && bp - dst >= PGLZ_FIRST_SUCCESS_BY)
+      return -1;
+
+    // Longest match in the history, giving up sooner the longer the chain
+    int match_len = 0, match_off = 0;
+    int good_match = PGLZ_MATCH_SIZE_GOOD;
+    int16_t hent = hist.start[PglzHash(dp, dend, mask)];
+    while (hent != 0) {
+      const uint8_t *ip = dp, *hp = hist.entries[hent].pos;
+      int off = (int)(ip - hp);
+      if (off >= 0x0fff)
+        break;
+      int n = 0;
+      while (ip < dend && *ip == *hp && n < PGLZ_MAX_MATCH) {
+        n++;
+        ip++;
+        hp++;
+      }
+      if (n > match_len) {
+        match_len = n;
+        match_off = off;
+      }
+      hent = hist.entries[hent].next;
+      if (hent != 0) {
+        if (match_len >= good_match)
+          break;
+        good_match -= good_match * PGLZ_MATCH_SIZE_DROP / 100;
+      }
+    }
+
+    out_ctrl();
+    if (match_len > 2) {
+      ctrl |= ctrlb;
+      if (match_len > 17) {
+        bp[0] = (uint8_t)(((match_off & 0xf00) >> 4) | 0x0f);
+        bp[1] = (uint8_t)(match_off & 0xff);
+        bp[2] = (uint8_t)(match_len - 18);
+        bp += 3;
+      } else {
+        bp[0] = (uint8_t)(((match_off & 0xf00) >> 4) | (match_len - 3));
+        bp[1] = (uint8_t)(match_off & 0xff);
+        bp += 2;
+      }
+      while (match_len--)
+        hist_add(dp++);
+      found_match = true;
+    } else {
+      *bp++ = *dp;
+      hist_add(dp++);
+    }
+  }
+  *ctrlp = ctrl;
+
+  int32_t result = (int32_t)(bp - dst);
+  return result >= result_max ? -1 : result;
+}
+
+int32_t WalPglzDecompress(const uint8_t *src, int32_t len, uint8_t *dst,
+                          int32_t raw_len) {
+  const uint8_t *sp = src, *send = src + len;
+  uint8_t *dp = dst, *dend = dst + raw_len;
+  while (sp < send && dp < dend) {
+    uint8_t ctrl = *sp++;
+    for (int i = 0; i < 8 && sp < send && dp < dend; i++, ctrl >>= 1) {
+      if (!(ctrl & 1)) {
+        *dp++ = *sp++;
+        continue;
+      }
+      if (send - sp < 2)
+        return -1;
+      int32_t n = (sp[0] & 0x0f) + 3;
+      int32_t off = ((sp[0] & 0xf0) << 4) | sp[1];
+      sp += 2;
+      if (n == 18) {
+        if (sp >= send)
+          return -1;
+        n += *sp++;
+      }
+      if (off == 0 || off > dp - dst)
+        return -1;
+      if (n > dend - dp)
+        n = (int32_t)(dend - dp);
+      // Byte by byte: the reference may overlap what it produces
+      for (; n > 0; n--, dp++)
+        *dp = dp[-off];
+    }
+  }
+  return dp == dend && sp == send ? raw_len : -1;
+}
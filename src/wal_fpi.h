@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Compression of full-page images the way the server does it for
+// wal_compression: the page with its hole removed is compressed on its own,
+// and the result is only used if it is smaller, counting the 2 byte hole
+// length it then needs. pglz is built in; lz4 and zstd depend on the
+// libraries found at build time.
+enum class WalFpiCompression : uint8_t { None, Pglz, Lz4, Zstd };
+const char *WalFpiCompressionName(WalFpiCompression compression);
+bool WalFpiCompressionAvailable(WalFpiCompression compression);
+
+// bimg_info flag the server sets for an image compressed this way.
+uint8_t WalFpiCompressionFlag(WalFpiCompression compression);
+
+// Worst case output size of WalCompressPageImage() for len bytes.
+#define WAL_FPI_COMPRESS_BOUND(len) ((len) + (len) / 8 + 64)
+
+// Compresses len bytes (a page image without its hole) into dst, which
+// must hold WAL_FPI_COMPRESS_BOUND(len) bytes. has_hole adds the compress
+// header the server writes in that case. Returns the compressed size, or -1
+// when the server would store the image uncompressed.
+int32_t WalCompressPageImage(WalFpiCompression compression,
+                             const uint8_t *src, int32_t len, bool has_hole,
+                             uint8_t *dst);
+
+// The compression a bimg_info says an image is stored with.
+WalFpiCompression WalFpiCompressionFromFlags(uint8_t bimg_info);
+
+// Restores raw_len bytes (the page without its hole) from an image stored
+// with compression. Returns raw_len, or -1 if the data is corrupt or the
+// method wasn't built in.
+int32_t WalDecompressPageImage(WalFpiCompression compression,
+                               const uint8_t *src, int32_t len, uint8_t *dst,
+                               int32_t raw_len);
+
+// pglz as in PostgreSQL's common/pg_lzcompress.c with the default strategy.
+// Compress returns -1 if the data didn't shrink by at least 25%.
+int32_t WalPglzCompress(const uint8_t *src, int32_t len, uint8_t *dst);
+// Returns raw_len, or -1 if src is corrupt or doesn't fill raw_len bytes.
+int32_t WalPglzDecompress(const uint8_t *src, int32_t len, uint8_t *dst,
+                          int32_t raw_len);
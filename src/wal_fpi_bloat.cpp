@@ -0,0 +1,99 @@
+#include "wal_fpi_bloat.h"
+#include <algorithm>
+
+// Compress header the server adds to a compressed image with a hole
+#define SizeOfXLogRecordBlockCompressHeader 2
+
+void WalFpiRelStats::Add(const WalFpiRelStats &other) {
+  Images += other.Images;
+  HoleBytes += other.HoleBytes;
+  StoredBytes += other.StoredBytes;
+  for (int m = 0; m < 4; m++) {
+    Compressed[m] += other.Compressed[m];
+    WhatIf[m] += other.WhatIf[m];
+  }
+  Unreadable += other.Unreadable;
+}
+
+void WalFpiAnalyzer::AddRecord(const uint8_t *record, uint32_t length) {
+  if (!WalDecodeRecord(record, length, decoded_))
+    return;
+  bool any = false;
+  for (const WalDecodedBlock &b : decoded_.Blocks) {
+    if (b.Node.hasImage) {
+      AddImage(b);
+      any = true;
+    }
+  }
+  records_ += any;
+}
+
+void WalFpiAnalyzer::AddImage(const WalDecodedBlock &block) {
+  WalFpiRelStats &s = rels_[std::make_tuple(
+      block.Node.spcNode, block.Node.dbNode, block.Node.relNode)];
+  s.Spc = block.Node.spcNode;
+  s.Db = block.Node.dbNode;
+  s.Rel = block.Node.relNode;
+
+  bool has_hole = block.HoleLength > 0;
+  int32_t raw_len = WAL_PAGE_SIZE - block.HoleLength;
+  WalFpiCompression current = WalFpiCompressionFromFlags(block.ImageInfo);
+  uint32_t header = current != WalFpiCompression::None && has_hole
+                        ? SizeOfXLogRecordBlockCompressHeader
+                        : 0;
+  uint32_t stored = block.ImageLength + header;
+  s.Images++;
+  s.HoleBytes += block.HoleLength;
+  s.StoredBytes += stored;
+  s.Compressed[(int)current]++;
+  s.WhatIf[(int)WalFpiCompression::None] += raw_len;
+
+  page_.resize(WAL_PAGE_SIZE);
+  if (WalDecompressPageImage(current, block.Image, block.ImageLength,
+                             page_.data(), raw_len) != raw_len) {
+    s.Unreadable++;
+    for (int m = 1; m < 4; m++)
+      s.WhatIf[m] += stored;
+    return;
+  }
+  packed_.resize(WAL_FPI_COMPRESS_BOUND(WAL_PAGE_SIZE));
+  for (int m = 1; m < 4; m++) {
+    WalFpiCompression method = (WalFpiCompression)m;
+    if (!WalFpiCompressionAvailable(method))
+      continue;
+    int32_t n = WalCompressPageImage(method, page_.data(), raw_len, has_hole,
+                                     packed_.data());
+    s.WhatIf[m] += n < 0 ? raw_len
+                         : n + (has_hole ? SizeOfXLogRecordBlockCompressHeader
+                                         : 0);
+  }
+}
+
+void WalFpiAnalyzer::Merge(const WalFpiAnalyzer &other) {
+  for (const auto &kv : other.rels_) {
+    WalFpiRelStats &s = rels_[kv.first];
+    s.Spc = kv.second.Spc;
+    s.Db = kv.second.Db;
+    s.Rel = kv.second.Rel;
+    s.Add(kv.second);
+  }
+  records_ += other.records_;
+}
+
+std::vector<WalFpiRelStats> WalFpiAnalyzer::Relations() const {
+  std::vector<WalFpiRelStats> rels;
+  for (const auto &kv : rels_)
+    rels.push_back(kv.second);
+  std::stable_sort(rels.begin(), rels.end(),
+                   [](const WalFpiRelStats &a, const WalFpiRelStats &b) {
+                     return a.StoredBytes > b.StoredBytes;
+                   });
+  return rels;
+}
+
+WalFpiRelStats WalFpiAnalyzer::Total() const {
+  WalFpiRelStats total;
+  for (const auto &kv : rels_)
+    total.Add(kv.second);
+  return total;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "wal_fpi.h"
+#include "wal_record_decode.h"
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// What full-page images cost per relation, and what they would cost with
+// each wal_compression setting. Every image is brought back to the page
+// without its hole (decompressed if it was stored compressed) and
+// compressed again with pglz, lz4 and zstd the way the server would, so
+// the settings are compared on the actual pages rather than guessed.
+//
+// Analyzers merge, so records can be spread over threads.
+
+struct WalFpiRelStats {
+  uint32_t Spc = 0;
+  uint32_t Db = 0;
+  uint32_t Rel = 0;
+  uint64_t Images = 0;
+  uint64_t HoleBytes = 0;   /* Free space left out of the images */
+  uint64_t StoredBytes = 0; /* Image bytes in the WAL as written */
+  // Images by the compression they were written with
+  uint64_t Compressed[4] = {};
+  // Image bytes with wal_compression set to each WalFpiCompression. Not
+  // filled for methods that weren't built in.
+  uint64_t WhatIf[4] = {};
+  // Stored with a method that isn't built in (or corrupt): they count at
+  // their stored size for every method.
+  uint64_t Unreadable = 0;
+
+  void Add(const WalFpiRelStats &other);
+};
+
+class WalFpiAnalyzer {
+public:
+  // record holds length bytes from the XLogRecord header on.
+  void AddRecord(const uint8_t *record, uint32_t length);
+  void AddImage(const WalDecodedBlock &block);
+  void Merge(const WalFpiAnalyzer &other);
+
+  // Relations with the most image bytes first.
+  std::vector<WalFpiRelStats> Relations() const;
+  WalFpiRelStats Total() const;
+  uint64_t Records() const { return records_; }
+
+private:
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t>, WalFpiRelStats> rels_;
+  uint64_t records_ = 0;
+  WalDecodedRecord decoded_;
+  std::vector<uint8_t> page_;
+  std::vector<uint8_t> packed_;
+};
@@ -0,0 +1,206 @@
+#include "wal_hotspot.h"
+#include <algorithm>
+#include <numeric>
+
+// Rows of the count-min sketch; each page is counted once per row
+#define CMS_DEPTH 4
+
+static uint64_t Mix(uint64_t x) {
+  // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+static uint64_t HashKey(const WalBlockKey &k) {
+  uint64_t a = ((uint64_t)k.Rel << 32) | k.Block;
+  uint64_t b = ((uint64_t)k.Db << 32) | k.Spc;
+  return Mix(a ^ Mix(b + k.Fork));
+}
+
+size_t WalHotspotSketch::KeyHash::operator()(const WalBlockKey &k) const {
+  return (size_t)HashKey(k);
+}
+
+WalHotspotSketch::WalHotspotSketch(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 16)) {
+  width_ = 1024;
+  while (width_ < capacity_)
+    width_ *= 2;
+  fpi_counts_.assign(CMS_DEPTH * width_, 0);
+}
+
+// Each row rehashes the page's hash with its own row number.
+uint32_t WalHotspotSketch::FpiEstimate(const WalBlockKey &key) const {
+  uint64_t h = HashKey(key);
+  uint32_t estimate = UINT32_MAX;
+  for (size_t row = 0; row < CMS_DEPTH; row++) {
+    size_t col = (size_t)Mix(h + row) & (width_ - 1);
+    estimate = std::min(estimate, fpi_counts_[row * width_ + col]);
+  }
+  return estimate;
+}
+
+void WalHotspotSketch::Add(const WalRecordInfo &rec) {
+  for (const WalRelFileNode &node : rec.RelFileNodes)
+    Add({node.spcNode, node.dbNode, node.relNode, node.blockNum,
+         node.forkNum},
+        node.hasImage);
+}
+
+void WalHotspotSketch::Add(const WalBlockKey &key, bool fpi) {
+  total_refs_++;
+  if (fpi) {
+    total_fpis_++;
+    uint64_t h = HashKey(key);
+    for (size_t row = 0; row < CMS_DEPTH; row++)
+      fpi_counts_[row * width_ + ((size_t)Mix(h + row) & (width_ - 1))]++;
+  }
+
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    WalHotspot &e = entries_[it->second];
+    e.Refs++;
+    e.Fpis += fpi;
+    if (!exact_)
+      SiftDown(heap_pos_[it->second]);
+    return;
+  }
+  if (entries_.size() < capacity_) {
+    index_.emplace(key, (uint32_t)entries_.size());
+    entries_.push_back({key, 1, fpi ? 1u : 0u, 0});
+    return;
+  }
+
+  // Full: take over the least referenced page
+  if (exact_)
+    StartEvicting();
+  uint32_t idx = heap_[0];
+  WalHotspot &e = entries_[idx];
+  index_.erase(e.Key);
+  uint64_t min = e.Refs;
+  e = {key, min + 1, std::min<uint64_t>(FpiEstimate(key), min + 1), min};
+  index_.emplace(key, idx);
+  SiftDown(0);
+}
+
+void WalHotspotSketch::StartEvicting() {
+  exact_ = false;
+  heap_.resize(entries_.size());
+  std::iota(heap_.begin(), heap_.end(), 0);
+  heap_pos_ = heap_;
+  for (size_t i = heap_.size() / 2; i-- > 0;)
+    SiftDown(i);
+}
+
+void WalHotspotSketch::SiftDown(size_t pos) {
+  size_t n = heap_.size();
+  uint32_t idx = heap_[pos];
+  uint64_t refs = entries_[idx].Refs;
+  for (;;) {
+    size_t child = pos * 2 + 1;
+    if (child >= n)
+      break;
+    if (child + 1 < n &&
+        entries_[heap_[child + 1]].Refs < entries_[heap_[child]].Refs)
+      child++;
+    if (entries_[heap_[child]].Refs >= refs)
+      break;
+    heap_[pos] = heap_[child];
+    heap_pos_[heap_[pos]] = (uint32_t)pos;
+    pos = child;
+  }
+  heap_[pos] = idx;
+  heap_pos_[idx] = (uint32_t)pos;
+}
+
+void WalHotspotSketch::Rebuild() {
+  index_.clear();
+  for (uint32_t i = 0; i < entries_.size(); i++)
+    index_.emplace(entries_[i].Key, i);
+  heap_.clear();
+  heap_pos_.clear();
+  if (!exact_)
+    StartEvicting();
+}
+
+// Mergeable summaries (Agarwal et al.): a page missing from a summary that
+// has dropped pages may have been counted there up to its smallest count,
+// so that much is added to its count and error. The largest `capacity`
+// counts are kept.
+void WalHotspotSketch::Merge(const WalHotspotSketch &other) {
+  uint64_t min = exact_ ? 0 : entries_[heap_[0]].Refs;
+  uint64_t other_min = other.exact_ ? 0 : other.entries_[other.heap_[0]].Refs;
+
+  std::vector<WalHotspot> merged = entries_;
+  for (WalHotspot &e : merged) {
+    auto it = other.index_.find(e.Key);
+    if (it != other.index_.end()) {
+      const WalHotspot &o = other.entries_[it->second];
+      e.Refs += o.Refs;
+      e.Fpis += o.Fpis;
+      e.Error += o.Error;
+    } else if (!other.exact_) {
+      e.Refs += other_min;
+      e.Error += other_min;
+      e.Fpis += std::min<uint64_t>(other.FpiEstimate(e.Key), other_min);
+    }
+  }
+  for (const WalHotspot &o : other.entries_) {
+    if (index_.count(o.Key))
+      continue;
+    WalHotspot e = o;
+    if (!exact_) {
+      e.Refs += min;
+      e.Error += min;
+      e.Fpis += std::min<uint64_t>(FpiEstimate(e.Key), min);
+    }
+    merged.push_back(e);
+  }
+
+  for (size_t i = 0; i < fpi_counts_.size(); i++)
+    fpi_counts_[i] += other.fpi_counts_[i];
+  total_refs_ += other.total_refs_;
+  total_fpis_ += other.total_fpis_;
+  exact_ = exact_ && other.exact_ && merged.size() <= capacity_;
+  if (merged.size() > capacity_) {
+    std::nth_element(merged.begin(), merged.begin() + capacity_, merged.end(),
+                     [](const WalHotspot &a, const WalHotspot &b) {
+                       return a.Refs > b.Refs;
+                     });
+    merged.resize(capacity_);
+  }
+  entries_ = std::move(merged);
+  Rebuild();
+}
+
+std::vector<WalHotspot> WalHotspotSketch::Top(size_t n, bool by_fpi) const {
+  std::vector<WalHotspot> top;
+  for (const WalHotspot &e : entries_) {
+    if (!by_fpi || e.Fpis > 0)
+      top.push_back(e);
+  }
+  auto count = [by_fpi](const WalHotspot &e) {
+    return by_fpi ? e.Fpis : e.Refs;
+  };
+  n = std::min(n, top.size());
+  std::partial_sort(top.begin(), top.begin() + n, top.end(),
+                    [&](const WalHotspot &a, const WalHotspot &b) {
+                      if (count(a) != count(b))
+                        return count(a) > count(b);
+                      return a.Refs > b.Refs;
+                    });
+  top.resize(n);
+  return top;
+}
+
+size_t WalHotspotSketch::MemoryUsage() const {
+  // Rough for the hash map: a node per page plus the bucket array
+  return entries_.capacity() * sizeof(WalHotspot) +
+         index_.size() * (sizeof(WalBlockKey) + 4 + 2 * sizeof(void *)) +
+         index_.bucket_count() * sizeof(void *) +
+         (heap_.capacity() + heap_pos_.capacity()) * sizeof(uint32_t) +
+         fpi_counts_.size() * sizeof(uint32_t);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "wal_parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Which pages (relation, fork, block) the block references of a stretch
+// of WAL modify most, and which get the most full-page images: what a
+// checkpoint's FPI storm or a contended page looks like in WAL.
+//
+// Pages are counted exactly until `capacity` distinct ones have been seen.
+// Past that the counter becomes a Space-Saving summary of that many pages:
+// a new page takes over the least referenced one, inheriting its count as
+// possible overcount (Error), so every page referenced more than
+// total / capacity times is still listed. FPIs of a page that takes over
+// come from a count-min sketch of all FPIs, an upper bound as well.
+//
+// Sketches of the same capacity merge, so segments can be counted on
+// separate threads and combined.
+
+struct WalBlockKey {
+  uint32_t Spc;
+  uint32_t Db;
+  uint32_t Rel;
+  uint32_t Block;
+  uint8_t Fork;
+
+  bool operator==(const WalBlockKey &o) const {
+    return Spc == o.Spc && Db == o.Db && Rel == o.Rel && Block == o.Block &&
+           Fork == o.Fork;
+  }
+};
+
+struct WalHotspot {
+  WalBlockKey Key;
+  uint64_t Refs;  /* Block references (modifications) */
+  uint64_t Fpis;  /* Of them with a full-page image */
+  uint64_t Error; /* Refs and Fpis are at most this much too high */
+};
+
+class WalHotspotSketch {
+public:
+  explicit WalHotspotSketch(size_t capacity = 1 << 16);
+
+  void Add(const WalRecordInfo &rec);
+  void Add(const WalBlockKey &key, bool fpi);
+  // other must have the same capacity.
+  void Merge(const WalHotspotSketch &other);
+
+  // The n pages with the most references, or with by_fpi the most images,
+  // highest first.
+  std::vector<WalHotspot> Top(size_t n, bool by_fpi) const;
+
+  // No page was ever dropped, so the counts are exact.
+  bool Exact() const { return exact_; }
+  size_t Capacity() const { return capacity_; }
+  size_t Tracked() const { return entries_.size(); }
+  uint64_t TotalRefs() const { return total_refs_; }
+  uint64_t TotalFpis() const { return total_fpis_; }
+  size_t MemoryUsage() const;
+
+private:
+  struct KeyHash {
+    size_t operator()(const WalBlockKey &k) const;
+  };
+
+  void StartEvicting();
+  void SiftDown(size_t pos);
+  void Rebuild();
+  uint32_t FpiEstimate(const WalBlockKey &key) const;
+
+  size_t capacity_;
+  bool exact_ = true;
+  uint64_t total_refs_ = 0;
+  uint64_t total_fpis_ = 0;
+  std::vector<WalHotspot> entries_;
+  std::unordered_map<WalBlockKey, uint32_t, KeyHash> index_;
+  // Once evicting: a min-heap of entry indices by Refs, and each entry's
+  // position in it.
+  std::vector<uint32_t> heap_;
+  std::vector<uint32_t> heap_pos_;
+  // Count-min sketch of FPIs: depth rows of width counters.
+  std::vector<uint32_t> fpi_counts_;
+  size_t width_;
+};
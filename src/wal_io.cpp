@@ -0,0 +1,539 @@
+#include "wal_io.h"
+#include "wal_trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef WAL_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// Reads are issued in chunks of this size so one large file keeps several
+// requests in flight.
+#define WAL_IO_CHUNK_SIZE (1 << 20)
+#define WAL_IO_URING_ENTRIES 64
+#define WAL_IO_MAX_PREAD_THREADS 16
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// --- WalPositionalFile ---
+
+WalPositionalFile::~WalPositionalFile() {
+#ifdef _WIN32
+  if (file_)
+    fclose(file_);
+#else
+  if (fd_ >= 0)
+    close(fd_);
+#endif
+}
+
+bool WalPositionalFile::Open(const std::string &path, uint64_t &size) {
+#ifdef _WIN32
+  file_ = fopen(path.c_str(), "rb");
+  if (!file_)
+    return false;
+  if (_fseeki64(file_, 0, SEEK_END) != 0)
+    return false;
+  size = (uint64_t)_ftelli64(file_);
+  return true;
+#else
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd_, &st) != 0)
+    return false;
+  size = (uint64_t)st.st_size;
+  return true;
+#endif
+}
+
+bool WalPositionalFile::ReadAt(uint64_t offset, void *buf, size_t len) {
+#ifdef _WIN32
+  if (_fseeki64(file_, (long long)offset, SEEK_SET) != 0)
+    return false;
+  return fread(buf, 1, len, file_) == len;
+#else
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n =
+        pread(fd_, (char *)buf + done, len - done, (off_t)(offset + done));
+    if (n <= 0)
+      return false;
+    done += (size_t)n;
+  }
+  return true;
+#endif
+}
+
+size_t WalPositionalFile::ReadManyAt(const uint64_t *offsets, size_t count,
+                                     void *bufs, size_t len) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+  // pread/preadv can't scatter over separate file ranges; starting readahead
+  // of each one queues them on the device at once.
+  if (count > 1) {
+    for (size_t i = 0; i < count; i++)
+      posix_fadvise(fd_, (off_t)offsets[i], (off_t)len, POSIX_FADV_WILLNEED);
+  }
+#endif
+  for (size_t i = 0; i < count; i++) {
+    if (!ReadAt(offsets[i], (uint8_t *)bufs + i * len, len))
+      return i;
+  }
+  return count;
+}
+
+const char *WalIoBackendName(WalIoBackend backend) {
+  switch (backend) {
+  case WalIoBackend::Auto:
+    return "auto";
+  case WalIoBackend::IoUring:
+    return "io_uring";
+  case WalIoBackend::Pread:
+    return "pread";
+  }
+  return "?";
+}
+
+WalFileReader::WalFileReader(const std::vector<std::string> &paths,
+                             size_t max_ahead, WalIoBackend backend)
+    : paths_(paths), max_ahead_(max_ahead ? max_ahead : paths.size()),
+      backend_(backend) {
+  start_ns_ = NowNs();
+  if (paths_.empty()) {
+    end_ns_ = start_ns_.load();
+    return;
+  }
+
+#ifdef WAL_HAVE_IO_URING
+  if (backend_ != WalIoBackend::Pread && SetupUring()) {
+    backend_ = WalIoBackend::IoUring;
+    threads_.emplace_back(&WalFileReader::UringLoop, this);
+    return;
+  }
+#endif
+  backend_ = WalIoBackend::Pread;
+  size_t n = std::min<size_t>(std::min(max_ahead_, paths_.size()),
+                              WAL_IO_MAX_PREAD_THREADS);
+  for (size_t i = 0; i < n; i++)
+    threads_.emplace_back(&WalFileReader::PreadWorker, this);
+}
+
+WalFileReader::~WalFileReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  claim_cv_.notify_all();
+  for (auto &t : threads_)
+    t.join();
+}
+
+bool WalFileReader::Next(WalFileBuffer &out) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_cv_.wait(lock, [&] {
+    return !ready_.empty() || handed_out_ >= paths_.size();
+  });
+  if (ready_.empty())
+    return false;
+  out = std::move(ready_.front());
+  ready_.pop_front();
+  if (++handed_out_ == paths_.size())
+    ready_cv_.notify_all(); // Wake the other consumers so they can exit
+  return true;
+}
+
+void WalFileReader::Retire(size_t count) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count <= retired_)
+      return;
+    retired_ = count;
+  }
+  claim_cv_.notify_all();
+}
+
+void WalFileReader::Recycle(std::vector<uint8_t> &&data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (spares_.size() < max_ahead_)
+    spares_.push_back(std::move(data));
+}
+
+double WalFileReader::GetReadSeconds() const {
+  int64_t end = end_ns_ ? end_ns_.load() : NowNs();
+  return (end - start_ns_) / 1e9;
+}
+
+bool WalFileReader::ClaimNext(size_t &index, bool wait) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    if (stop_ || next_claim_ >= paths_.size())
+      return false;
+    if (next_claim_ < retired_ + max_ahead_) {
+      index = next_claim_++;
+      return true;
+    }
+    if (!wait)
+      return false;
+    claim_cv_.wait(lock);
+  }
+}
+
+void WalFileReader::Complete(WalFileBuffer &&buf) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_.push_back(std::move(buf));
+    if (handed_out_ + ready_.size() == paths_.size())
+      end_ns_ = NowNs();
+  }
+  ready_cv_.notify_one();
+}
+
+std::vector<uint8_t> WalFileReader::TakeSpare() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (spares_.empty())
+    return {};
+  std::vector<uint8_t> data = std::move(spares_.back());
+  spares_.pop_back();
+  return data;
+}
+
+// --- Blocking fallback ---
+
+void WalFileReader::PreadWorker() {
+  WalTraceSetThreadName("pread");
+  size_t index;
+  while (ClaimNext(index, true)) {
+    WalFileBuffer buf;
+    buf.Index = index;
+    buf.Data = TakeSpare();
+    const std::string &path = paths_[index];
+    WalTraceScope trace("io", "pread");
+    trace.SetSegment(path);
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+      buf.Error = "failed to open file";
+    } else {
+      std::streamsize size = file.tellg();
+      file.seekg(0, std::ios::beg);
+      buf.Data.resize((size_t)size);
+      if (!file.read((char *)buf.Data.data(), size))
+        buf.Error = "failed to read file data";
+      else
+        bytes_read_ += (uint64_t)size;
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      buf.Error = strerror(errno);
+    } else {
+#ifdef POSIX_FADV_SEQUENTIAL
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+      buf.Data.resize((size_t)st.st_size);
+      size_t done = 0;
+      while (done < buf.Data.size()) {
+        size_t len = std::min<size_t>(buf.Data.size() - done,
+                                      WAL_IO_CHUNK_SIZE);
+        ssize_t n = pread(fd, buf.Data.data() + done, len, (off_t)done);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0) {
+          buf.Error = n < 0 ? strerror(errno) : "unexpected end of file";
+          break;
+        }
+        done += (size_t)n;
+        bytes_read_ += (uint64_t)n;
+      }
+    }
+    if (fd >= 0)
+      close(fd);
+#endif
+    trace.SetBytes(buf.Data.size());
+    Complete(std::move(buf));
+  }
+}
+
+// --- io_uring ---
+//
+// Talks to the kernel through the raw syscalls so there is no liburing
+// dependency. A single thread opens files as the window allows, splits
+// each into chunk reads, and keeps the submission ring full.
+
+#ifdef WAL_HAVE_IO_URING
+
+struct WalFileReader::Uring {
+  int fd = -1;
+  void *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED, *sqes_ptr = MAP_FAILED;
+  size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  unsigned entries = 0;
+  io_uring_sqe *sqes;
+  io_uring_cqe *cqes;
+
+  ~Uring() {
+    if (sqes_ptr != MAP_FAILED)
+      munmap(sqes_ptr, sqes_size);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED)
+      munmap(sq_ptr, sq_size);
+    if (fd >= 0)
+      close(fd);
+  }
+};
+
+namespace {
+
+struct UringFile {
+  WalFileBuffer buf;
+  int fd = -1;
+  size_t pending = 0; // Chunks not yet completed
+};
+
+struct UringChunk {
+  UringFile *file;
+  uint64_t offset;
+  iovec iov;
+};
+
+} // namespace
+
+bool WalFileReader::SetupUring() {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = (int)syscall(__NR_io_uring_setup, WAL_IO_URING_ENTRIES, &params);
+  if (fd < 0)
+    return false; // Old kernel, or disabled by seccomp/sysctl
+
+  Uring *ring = new Uring();
+  ring->fd = fd;
+  ring->entries = params.sq_entries;
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap)
+    ring->sq_size = ring->cq_size = std::max(ring->sq_size, ring->cq_size);
+
+  ring->sq_ptr = mmap(nullptr, ring->sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ptr == MAP_FAILED) {
+    delete ring;
+    return false;
+  }
+  ring->cq_ptr = single_mmap
+                     ? ring->sq_ptr
+                     : mmap(nullptr, ring->cq_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  ring->sqes_ptr = mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->cq_ptr == MAP_FAILED || ring->sqes_ptr == MAP_FAILED) {
+    delete ring;
+    return false;
+  }
+
+  char *sq = (char *)ring->sq_ptr;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  char *cq = (char *)ring->cq_ptr;
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+  ring->sqes = (io_uring_sqe *)ring->sqes_ptr;
+  uring_ = ring;
+  return true;
+}
+
+void WalFileReader::UringLoop() {
+  WalTraceSetThreadName("io_uring");
+  Uring &ring = *uring_;
+  std::deque<UringChunk *> queued; // Waiting for a free ring slot
+  std::vector<UringFile *> open_files;
+  size_t in_flight = 0; // Submitted, not yet completed
+  unsigned unsubmitted = 0; // In the ring, not yet taken by the kernel
+
+  auto finish_file = [&](UringFile *file) {
+    close(file->fd);
+    open_files.erase(
+        std::find(open_files.begin(), open_files.end(), file));
+    Complete(std::move(file->buf));
+    delete file;
+  };
+
+  for (;;) {
+    // Open new files while the window allows. Only block for the window
+    // when there is nothing else to wait for.
+    size_t index;
+    bool idle = in_flight == 0 && queued.empty() && unsubmitted == 0;
+    while (ClaimNext(index, idle)) {
+      idle = false;
+      UringFile *file = new UringFile();
+      file->buf.Index = index;
+      file->buf.Data = TakeSpare();
+      file->fd = open(paths_[index].c_str(), O_RDONLY);
+      struct stat st;
+      if (file->fd < 0 || fstat(file->fd, &st) != 0) {
+        file->buf.Error = strerror(errno);
+        if (file->fd >= 0)
+          close(file->fd);
+        Complete(std::move(file->buf));
+        delete file;
+        continue;
+      }
+      file->buf.Data.resize((size_t)st.st_size);
+      open_files.push_back(file);
+      for (size_t off = 0; off < file->buf.Data.size();
+           off += WAL_IO_CHUNK_SIZE) {
+        UringChunk *chunk = new UringChunk();
+        chunk->file = file;
+        chunk->offset = off;
+        chunk->iov.iov_base = file->buf.Data.data() + off;
+        chunk->iov.iov_len =
+            std::min<size_t>(file->buf.Data.size() - off, WAL_IO_CHUNK_SIZE);
+        queued.push_back(chunk);
+        file->pending++;
+      }
+      if (file->pending == 0)
+        finish_file(file); // Empty file
+    }
+    if (idle)
+      break; // Everything claimed (or stopping) and nothing in flight
+
+    // Fill free ring slots. READV is the oldest read opcode, so this works
+    // on any kernel that has io_uring at all.
+    unsigned tail = *ring.sq_tail;
+    while (!queued.empty() &&
+           in_flight + unsubmitted < ring.entries) {
+      UringChunk *chunk = queued.front();
+      queued.pop_front();
+      unsigned slot = tail & *ring.sq_mask;
+      io_uring_sqe &sqe = ring.sqes[slot];
+      memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_READV;
+      sqe.fd = chunk->file->fd;
+      sqe.off = chunk->offset;
+      sqe.addr = (uint64_t)(uintptr_t)&chunk->iov;
+      sqe.len = 1;
+      sqe.user_data = (uint64_t)(uintptr_t)chunk;
+      ring.sq_array[slot] = slot;
+      tail++;
+      unsubmitted++;
+    }
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    if (in_flight + unsubmitted == 0)
+      continue;
+    // One event per submit-and-wait, with the bytes it completed
+    WalTraceScope trace("io", "io_uring_enter");
+    uint64_t completed = 0;
+    int ret = (int)syscall(__NR_io_uring_enter, ring.fd, unsubmitted, 1,
+                           IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        continue;
+      // Should not happen with a valid ring. Fail what is in flight, close
+      // the ring (which cancels it) and read the rest with blocking reads.
+      // The buffers and chunks are leaked on purpose: the kernel may still
+      // be writing into them until the cancellation completes.
+      std::string error = std::string("io_uring_enter: ") + strerror(errno);
+      for (UringFile *file : open_files) {
+        WalFileBuffer failed;
+        failed.Index = file->buf.Index;
+        failed.Error = error;
+        Complete(std::move(failed));
+        close(file->fd);
+      }
+      delete uring_;
+      uring_ = nullptr;
+      PreadWorker();
+      return;
+    }
+    unsubmitted -= (unsigned)ret;
+    in_flight += (unsigned)ret;
+
+    // Reap completions.
+    unsigned head = *ring.cq_head;
+    unsigned cq_tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != cq_tail; head++) {
+      const io_uring_cqe &cqe = ring.cqes[head & *ring.cq_mask];
+      UringChunk *chunk = (UringChunk *)(uintptr_t)cqe.user_data;
+      UringFile *file = chunk->file;
+      int res = cqe.res;
+      in_flight--;
+
+      if (res == -EINTR || res == -EAGAIN) {
+        queued.push_back(chunk);
+        continue;
+      }
+      if (res > 0 && (size_t)res < chunk->iov.iov_len) {
+        // Short read: ask for the rest
+        bytes_read_ += (uint64_t)res;
+        completed += (uint64_t)res;
+        chunk->offset += (uint64_t)res;
+        chunk->iov.iov_base = (char *)chunk->iov.iov_base + res;
+        chunk->iov.iov_len -= (size_t)res;
+        queued.push_back(chunk);
+        continue;
+      }
+      if (res < 0 && file->buf.Error.empty())
+        file->buf.Error = strerror(-res);
+      else if (res == 0 && file->buf.Error.empty())
+        file->buf.Error = "unexpected end of file";
+      else if (res > 0) {
+        bytes_read_ += (uint64_t)res;
+        completed += (uint64_t)res;
+      }
+      delete chunk;
+      if (--file->pending == 0)
+        finish_file(file);
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    trace.SetBytes(completed);
+
+    // When stopping, drop what has not been submitted yet.
+    bool stopping;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping = stop_;
+    }
+    if (stopping) {
+      for (UringChunk *chunk : queued) {
+        UringFile *file = chunk->file;
+        delete chunk;
+        if (--file->pending == 0)
+          finish_file(file);
+      }
+      queued.clear();
+    }
+  }
+
+  delete uring_;
+  uring_ = nullptr;
+}
+
+#endif // WAL_HAVE_IO_URING
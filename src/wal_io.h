@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define WAL_HAVE_IO_URING 1
+#endif
+#endif
+
+enum class WalIoBackend : uint8_t {
+  Auto,    // io_uring if the kernel allows it, otherwise Pread
+  IoUring, // One thread keeping many chunk reads in flight
+  Pread,   // Pool of threads doing blocking reads
+};
+const char *WalIoBackendName(WalIoBackend backend);
+
+// Positional reads of a few pages without touching the rest of the file.
+class WalPositionalFile {
+public:
+  WalPositionalFile() = default;
+  ~WalPositionalFile();
+  WalPositionalFile(const WalPositionalFile &) = delete;
+  WalPositionalFile &operator=(const WalPositionalFile &) = delete;
+
+  bool Open(const std::string &path, uint64_t &size);
+  bool ReadAt(uint64_t offset, void *buf, size_t len);
+  // Reads len bytes at each of offsets[0, count) into bufs, one after the
+  // other. The ranges are handed to the kernel together first, so a cold
+  // file costs one round of device reads rather than one per range.
+  // Returns how many leading ranges were read.
+  size_t ReadManyAt(const uint64_t *offsets, size_t count, void *bufs,
+                    size_t len);
+
+private:
+#ifdef _WIN32
+  FILE *file_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+};
+
+// A file read completely into memory.
+struct WalFileBuffer {
+  size_t Index = 0; /* Position in the path list */
+  std::vector<uint8_t> Data;
+  std::string Error; /* Non-empty if the read failed */
+};
+
+// Reads a list of files in the background and hands them out as they
+// complete, which need not be in order. At most `max_ahead` files past the
+// last one Retire()d are read or held at any time, which bounds memory and
+// keeps the readers from running away from an in-order consumer.
+//
+//   WalFileReader reader(paths, 8);
+//   WalFileBuffer buf;
+//   while (reader.Next(buf)) {
+//     ... use buf.Data ...
+//     reader.Recycle(std::move(buf.Data));
+//   }
+//
+// and, from whoever consumes the files in order, reader.Retire(n) once the
+// first n files are finished with.
+class WalFileReader {
+public:
+  WalFileReader(const std::vector<std::string> &paths, size_t max_ahead,
+                WalIoBackend backend = WalIoBackend::Auto);
+  ~WalFileReader();
+
+  WalFileReader(const WalFileReader &) = delete;
+  WalFileReader &operator=(const WalFileReader &) = delete;
+
+  // Blocks until a file has been read. Returns false once every file has
+  // been handed out.
+  bool Next(WalFileBuffer &out);
+  // Files [0, count) are finished with; lets the readers move on. Not
+  // needed if max_ahead is 0 (no limit).
+  void Retire(size_t count);
+  // Returns a buffer's storage so the next read can reuse it instead of
+  // faulting in fresh pages.
+  void Recycle(std::vector<uint8_t> &&data);
+
+  WalIoBackend GetBackend() const { return backend_; }
+  uint64_t GetBytesRead() const { return bytes_read_; }
+  // Time from construction until the last read completed (or until now).
+  double GetReadSeconds() const;
+
+private:
+  // Reader side: claims the next file index once the window allows it.
+  // Returns false when there is nothing left to read.
+  bool ClaimNext(size_t &index, bool wait);
+  void Complete(WalFileBuffer &&buf);
+  std::vector<uint8_t> TakeSpare();
+
+  void PreadWorker();
+#ifdef WAL_HAVE_IO_URING
+  bool SetupUring();
+  void UringLoop();
+#endif
+
+  std::vector<std::string> paths_;
+  size_t max_ahead_;
+  WalIoBackend backend_;
+
+  std::mutex mutex_;
+  std::condition_variable claim_cv_; // Readers wait for the window
+  std::condition_variable ready_cv_; // Consumers wait for completed files
+  size_t next_claim_ = 0;
+  size_t retired_ = 0;
+  size_t handed_out_ = 0;
+  bool stop_ = false;
+  std::deque<WalFileBuffer> ready_;
+  std::vector<std::vector<uint8_t>> spares_;
+
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<int64_t> start_ns_{0};
+  std::atomic<int64_t> end_ns_{0};
+  std::vector<std::thread> threads_;
+
+  struct Uring;
+  Uring *uring_ = nullptr;
+};
@@ -1,6 +1,14 @@
 #include "wal_parser.h"
+#include "crc32c.h"
+#include "wal_perf.h"
+#include "wal_sparse.h"
+#include "wal_trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 
@@ -15,10 +23,12 @@ typedef uint32_t TransactionId;
 typedef uint32_t TimeLineID;
 typedef uint64_t XLogRecPtr;
 
-#define XLOG_PAGE_MAGIC 0xD113
+#define XLP_FIRST_IS_CONTRECORD 0x0001
 #define XLP_LONG_HEADER 0x0002
-#define XLOG_BLCKSZ 8192
+#define XLP_ALL_FLAGS 0x0007
+#define XLOG_BLCKSZ WAL_PAGE_SIZE
 #define MAXALIGN(LEN) (((uint64_t)(LEN) + 7) & ~7)
+#define XLogRecordMaxSize (1020 * 1024 * 1024)
 
 // Resource Manager IDs defined in wal_parser.h
 
@@ -48,6 +58,8 @@ typedef struct XLogRecord {
 } XLogRecord; // Size = 24
 
 #define SizeOfXLogRecord sizeof(XLogRecord)
+#define SizeOfXLogShortPHD sizeof(XLogPageHeaderData)
+#define SizeOfXLogLongPHD sizeof(XLogLongPageHeaderData)
 
 typedef struct RelFileLocator {
   Oid spcOid;
@@ -62,6 +74,7 @@ typedef struct RelFileLocator {
 #define XLR_BLOCK_ID_ORIGIN 253
 #define XLR_BLOCK_ID_TOPLEVEL_XID 252
 
+#define BKPBLOCK_FORK_MASK 0x0F
 #define BKPBLOCK_HAS_IMAGE 0x10
 #define BKPBLOCK_SAME_REL 0x80
 #define BKPIMAGE_HAS_HOLE 0x01
@@ -85,6 +98,11 @@ static const char *const rmid_names[] = {
     "Generic",    "LogicalMsg",  "Unknown(22)" // Placeholder for 22, if needed
 };
 
+const char *WalForkName(uint8_t fork) {
+  static const char *const names[] = {"main", "fsm", "vm", "init"};
+  return fork < 4 ? names[fork] : "?";
+}
+
 std::string WalParser::GetRmidName(uint8_t rmid) {
   if (rmid < sizeof(rmid_names) / sizeof(rmid_names[0])) {
     return rmid_names[rmid];
@@ -93,45 +111,43 @@ std::string WalParser::GetRmidName(uint8_t rmid) {
 }
 
 std::string WalParser::GetOpDescription(uint8_t rmid, uint8_t info) {
+  std::string op;
   if (rmid == RM_HEAP_ID) {
-    uint8_t op = info & XLOG_HEAP_OPMASK;
-    switch (op) {
-    case XLOG_HEAP_INSERT:
-      return "INSERT";
-    case XLOG_HEAP_DELETE:
-      return "DELETE";
-    case XLOG_HEAP_UPDATE:
-      return "UPDATE";
-    case XLOG_HEAP_HOT_UPDATE:
-      return "HOT_UPDATE";
-    default:
-      return "";
-    }
+    static const char *const ops[] = {"INSERT",     "DELETE",  "UPDATE",
+                                      "TRUNCATE",   "HOT_UPDATE", "CONFIRM",
+                                      "LOCK",       "INPLACE"};
+    op = ops[(info & XLOG_HEAP_OPMASK) >> 4];
+    if (info & XLOG_HEAP_INIT_PAGE)
+      op += "+INIT";
   } else if (rmid == RM_HEAP2_ID) {
-    uint8_t op = info & 0x70; // Using same mask?
-    // Heap2 ops are slightly different bits sometimes, but let's check basic
-    // For now using literal values from manual checking if needed, or macro
-    if ((info & 0x70) == XLOG_HEAP2_CLEAN)
-      return "CLEAN";
-    if ((info & 0x70) == XLOG_HEAP2_FREEZE_PAGE)
-      return "FREEZE_PAGE";
-    if ((info & 0x70) == XLOG_HEAP2_MULTI_INSERT)
-      return "MULTI_INSERT";
-    return "";
+    static const char *const ops[] = {
+        "REWRITE", "PRUNE",       "VACUUM",       "FREEZE_PAGE",
+        "VISIBLE", "MULTI_INSERT", "LOCK_UPDATED", "NEW_CID"};
+    static const char *const prune_ops[] = {
+        "PRUNE_ON_ACCESS", "PRUNE_VACUUM_SCAN", "PRUNE_VACUUM_CLEANUP"};
+    uint8_t i = (info & XLOG_HEAP_OPMASK) >> 4;
+    op = i >= 1 && i <= 3 && WalVersionForPageMagic(page_magic_) >= 17
+             ? prune_ops[i - 1]
+             : ops[i];
+    if (info & XLOG_HEAP_INIT_PAGE)
+      op += "+INIT";
+  } else if (rmid == RM_BTREE_ID) {
+    static const char *const ops[] = {
+        "INSERT_LEAF",    "INSERT_UPPER", "INSERT_META",
+        "SPLIT_L",        "SPLIT_R",      "INSERT_POST",
+        "DEDUP",          "DELETE",       "UNLINK_PAGE",
+        "UNLINK_PAGE_META", "NEWROOT",    "MARK_PAGE_HALFDEAD",
+        "VACUUM",         "REUSE_PAGE",   "META_CLEANUP", ""};
+    op = ops[info >> 4];
   } else if (rmid == RM_XACT_ID) {
-    // Transaction info bits are top 4 bits for some, but low bits for others?
-    // Let's check typical values.
-    // XLOG_XACT_COMMIT is 0x00
-    // But need to be careful masking.
-    if ((info & 0xF0) == 0x00)
-      return "COMMIT"; // Simplified check
-    if ((info & 0xF0) == 0x10)
-      return "ABORT";
-    if ((info & 0xF0) == 0x20)
-      return "PREPARE";
-    return "XACT";
+    // The op is in bits 4-6; bit 7 (XLOG_XACT_HAS_INFO) says an xinfo
+    // word follows in the body
+    static const char *const ops[] = {
+        "COMMIT",         "PREPARE",    "ABORT",         "COMMIT_PREPARED",
+        "ABORT_PREPARED", "ASSIGNMENT", "INVALIDATIONS", "XACT"};
+    op = ops[(info >> 4) & 0x07];
   }
-  return "";
+  return op;
 }
 
 // Helper to parse the payload headers for RelFileLocator
@@ -166,6 +182,7 @@ static void ParseXLogRecordPayload(const uint8_t *payload, uint32_t len,
           break;
 
         uint8_t bimg_info = *(const uint8_t *)(payload + offset + 4);
+        info.HasFPI = true;
         offset += SizeOfXLogRecordBlockImageHeader;
 
         // If HAS_HOLE and COMPRESSED, XLogRecordBlockCompressHeader follows
@@ -190,10 +207,15 @@ static void ParseXLogRecordPayload(const uint8_t *payload, uint32_t len,
       node.spcNode = lastLocator.spcOid;
       node.dbNode = lastLocator.dbOid;
       node.relNode = lastLocator.relNumber;
-      info.RelFileNodes.push_back(node);
+      node.forkNum = fork_flags & BKPBLOCK_FORK_MASK;
+      node.hasImage = (fork_flags & BKPBLOCK_HAS_IMAGE) != 0;
 
       // BlockNumber follows
-      if (offset + sizeof(BlockNumber) > len)
+      bool has_block = offset + sizeof(BlockNumber) <= len;
+      if (has_block)
+        memcpy(&node.blockNum, payload + offset, sizeof(BlockNumber));
+      info.RelFileNodes.push_back(node);
+      if (!has_block)
         break;
       offset += sizeof(BlockNumber);
 
@@ -220,96 +242,492 @@ static void ParseXLogRecordPayload(const uint8_t *payload, uint32_t len,
   }
 }
 
-bool WalParser::Parse(const uint8_t *data, size_t size,
-                      std::vector<WalRecordInfo> &out_records) {
-  out_records.clear();
+const char *WalEndReasonName(WalEndReason reason) {
+  switch (reason) {
+  case WalEndReason::None:
+    return "not parsed";
+  case WalEndReason::EndOfData:
+    return "end of data";
+  case WalEndReason::ZeroedTail:
+    return "zeroed (unwritten) space";
+  case WalEndReason::BadPageHeader:
+    return "invalid page header";
+  case WalEndReason::PageAddrMismatch:
+    return "page address mismatch (recycled segment)";
+  case WalEndReason::BadRecordLength:
+    return "invalid record length";
+  case WalEndReason::PrevLinkMismatch:
+    return "xl_prev mismatch";
+  case WalEndReason::CrcMismatch:
+    return "record CRC mismatch";
+  }
+  return "unknown";
+}
 
-  if (size < sizeof(XLogPageHeaderData)) {
+uint16_t WalPageMagicForVersion(int major_version) {
+  switch (major_version) {
+  case 15:
+    return 0xD110;
+  case 16:
+    return 0xD113;
+  case 17:
+    return 0xD116;
+  default:
+    return 0;
+  }
+}
+
+bool IsWalPageMagic(uint16_t magic) {
+  return magic == 0xD110 || magic == 0xD113 || magic == 0xD116;
+}
+
+int WalVersionForPageMagic(uint16_t magic) {
+  for (int version = 15; version <= 17; version++) {
+    if (WalPageMagicForVersion(version) == magic)
+      return version;
+  }
+  return 0;
+}
+
+bool ReadWalPageHeader(const uint8_t *data, size_t size,
+                       WalPageHeaderInfo &out) {
+  if (size < SizeOfXLogShortPHD)
     return false;
+  XLogPageHeaderData header;
+  memcpy(&header, data, sizeof(header));
+  if (!IsWalPageMagic(header.xlp_magic))
+    return false;
+  out.Magic = header.xlp_magic;
+  out.Info = header.xlp_info;
+  out.Timeline = header.xlp_tli;
+  out.PageAddr = header.xlp_pageaddr;
+  out.RemLen = header.xlp_rem_len;
+  out.IsLong = (header.xlp_info & XLP_LONG_HEADER) != 0;
+  out.SystemId = 0;
+  out.SegmentSize = 0;
+  if (out.IsLong && size >= SizeOfXLogLongPHD) {
+    XLogLongPageHeaderData long_header;
+    memcpy(&long_header, data, sizeof(long_header));
+    out.SystemId = long_header.xlp_sysid;
+    out.SegmentSize = long_header.xlp_seg_size;
   }
+  return true;
+}
 
-  size_t offset = 0;
-  while (offset < size) {
-    // Ensure we have enough data for a page header
-    if (offset + sizeof(XLogPageHeaderData) > size)
-      break;
+uint64_t WalSegmentSizeFromFileSize(uint64_t file_size) {
+  if (file_size >= (1u << 20) && file_size <= (1u << 30) &&
+      (file_size & (file_size - 1)) == 0)
+    return file_size;
+  return 16 * 1024 * 1024;
+}
 
-    const XLogPageHeaderData *header =
-        (const XLogPageHeaderData *)(data + offset);
+uint64_t WalFileNameToLSN(const std::string &filename,
+                          uint64_t segment_size) {
+  if (filename.length() != 24 ||
+      filename.find_first_not_of("0123456789ABCDEFabcdef") != std::string::npos)
+    return 0;
+  // Format: TLI(8) Log(8) Seg(8)
+  uint32_t logId =
+      (uint32_t)strtoul(filename.substr(8, 8).c_str(), nullptr, 16);
+  uint32_t segId =
+      (uint32_t)strtoul(filename.substr(16, 8).c_str(), nullptr, 16);
+  return ((uint64_t)logId << 32) | ((uint64_t)segId * segment_size);
+}
 
-    // Basic verification
-    if (header->xlp_magic != XLOG_PAGE_MAGIC) {
-      break;
-    }
+std::string WalFileNameForLSN(uint32_t tli, uint64_t lsn,
+                              uint64_t segment_size) {
+  char name[32];
+  snprintf(name, sizeof(name), "%08X%08X%08X", tli, (uint32_t)(lsn >> 32),
+           (uint32_t)((lsn & 0xFFFFFFFFu) / segment_size));
+  return name;
+}
+
+// Validates the header of the page at page_off, which must carry
+// expected_addr. cont_len is the number of bytes of a record expected to
+// continue on this page (0 when a new record starts here).
+static WalEndReason CheckPageHeader(const uint8_t *data, size_t page_off,
+                                    uint64_t expected_addr, uint32_t cont_len,
+                                    size_t &header_size) {
+  const XLogPageHeaderData *header =
+      (const XLogPageHeaderData *)(data + page_off);
+
+  if (!IsWalPageMagic(header->xlp_magic)) {
+    static const uint8_t zeroes[SizeOfXLogShortPHD] = {};
+    return memcmp(header, zeroes, SizeOfXLogShortPHD) == 0
+               ? WalEndReason::ZeroedTail
+               : WalEndReason::BadPageHeader;
+  }
+  if (header->xlp_info & ~XLP_ALL_FLAGS)
+    return WalEndReason::BadPageHeader;
+  if (header->xlp_pageaddr != expected_addr)
+    return WalEndReason::PageAddrMismatch;
+  if (cont_len > 0) {
+    if (!(header->xlp_info & XLP_FIRST_IS_CONTRECORD) ||
+        header->xlp_rem_len != cont_len)
+      return WalEndReason::BadPageHeader;
+  } else if (header->xlp_info & XLP_FIRST_IS_CONTRECORD) {
+    return WalEndReason::BadPageHeader;
+  }
 
-    size_t pageHeaderSize = sizeof(XLogPageHeaderData);
-    if (header->xlp_info & XLP_LONG_HEADER) {
-      pageHeaderSize = sizeof(XLogLongPageHeaderData);
+  header_size = (header->xlp_info & XLP_LONG_HEADER) ? SizeOfXLogLongPHD
+                                                     : SizeOfXLogShortPHD;
+  return WalEndReason::None;
+}
+
+// Copies len bytes of a record starting at file offset pos into dest,
+// skipping the headers of the pages it crosses. remaining is the number of
+// bytes of the record not consumed yet, checked against each continuation
+// page's xlp_rem_len. pos, dest, remaining and copied advance as data is
+// consumed, so on EndOfData they describe the partial record.
+static WalEndReason GatherRecordBytes(const uint8_t *data, size_t size,
+                                      uint64_t base_lsn, size_t &pos,
+                                      uint8_t *dest, size_t len,
+                                      uint32_t &remaining, size_t &copied) {
+  while (len > 0) {
+    if (pos % XLOG_BLCKSZ == 0) {
+      if (pos + SizeOfXLogShortPHD > size)
+        return WalEndReason::EndOfData;
+      size_t header_size;
+      WalEndReason r =
+          CheckPageHeader(data, pos, base_lsn + pos, remaining, header_size);
+      if (r != WalEndReason::None)
+        return r;
+      pos += header_size;
     }
+    size_t chunk = std::min(len, (size_t)(XLOG_BLCKSZ - pos % XLOG_BLCKSZ));
+    if (pos + chunk > size)
+      chunk = size - pos;
+    memcpy(dest + copied, data + pos, chunk);
+    pos += chunk;
+    len -= chunk;
+    remaining -= (uint32_t)chunk;
+    copied += chunk;
+    if (len > 0 && pos >= size)
+      return WalEndReason::EndOfData;
+  }
+  return WalEndReason::None;
+}
+
+bool WalParser::Parse(const uint8_t *data, size_t size,
+                      std::vector<WalRecordInfo> &out_records) {
+  return ParseFrom(data, size, 0, out_records);
+}
+
+bool WalParser::ParseFrom(const uint8_t *data, size_t size,
+                          size_t start_offset,
+                          std::vector<WalRecordInfo> &out_records) {
+  WalPerfScope perf(WalPerfSection::Parse);
+  WalTraceScope trace("parse", "parse");
+  out_records.clear();
+  size_t pos;
+  WalEndReason r = StartAt(data, size, start_offset, pos);
+  if (r != WalEndReason::None) {
+    end_reason_ = r;
+    return false;
+  }
+  size_t end = ParseRecords(data, size, pos, true, out_records);
+  perf.SetWork(end - pos, out_records.size());
+  trace.SetBytes(end - pos);
+  trace.SetItems(out_records.size());
+  trace.SetCrcNs(crc_ns_);
+  return !out_records.empty();
+}
+
+bool WalParser::ParseFrom(const WalSparseSegment &segment, size_t start_offset,
+                          std::vector<WalRecordInfo> &out_records) {
+  logical_size_ = segment.Size();
+  bool ok = ParseFrom(segment.DenseData(), segment.DenseSize(), start_offset,
+                      out_records);
+  logical_size_ = 0;
+  return ok;
+}
 
-    // Pointer to the first record on the page
-    size_t currentPos = offset + pageHeaderSize;
+bool WalParser::ParseRecordAt(const uint8_t *data, size_t size,
+                              size_t start_offset, WalRecordInfo &out) {
+  std::vector<WalRecordInfo> records;
+  size_t pos;
+  WalEndReason r = StartAt(data, size, start_offset, pos);
+  if (r != WalEndReason::None) {
+    end_reason_ = r;
+    return false;
+  }
+  // At the top of a page StartAt() skips to the first record starting
+  // there, which is only the one asked for if nothing continues onto it.
+  if (pos != start_offset) {
+    end_reason_ = WalEndReason::BadRecordLength;
+    return false;
+  }
+  ParseRecords(data, size, pos, true, records, 1);
+  if (records.empty())
+    return false;
+  out = std::move(records[0]);
+  return true;
+}
 
-    if (header->xlp_rem_len > 0) {
-      // The data for the previous record continues here.
-      currentPos += header->xlp_rem_len;
+WalEndReason WalParser::OutOfData(size_t pos) const {
+  return pos < logical_size_ ? WalEndReason::ZeroedTail
+                             : WalEndReason::EndOfData;
+}
+
+void WalParser::BeginIncremental() {
+  stream_started_ = false;
+  stream_done_ = false;
+  stream_pos_ = 0;
+  end_reason_ = WalEndReason::None;
+  end_lsn_ = 0;
+  segment_size_ = 0;
+}
+
+bool WalParser::ParseMore(const uint8_t *data, size_t size, bool at_end,
+                          std::vector<WalRecordInfo> &out_records) {
+  if (stream_done_)
+    return false;
+  WalPerfScope perf(WalPerfSection::Parse);
+  WalTraceScope trace("parse", "parse");
+  size_t first_record = out_records.size();
+  if (!stream_started_) {
+    WalEndReason r = StartAt(data, size, 0, stream_pos_);
+    if (r == WalEndReason::EndOfData && !at_end)
+      return true; // First page(s) not complete yet
+    if (r != WalEndReason::None) {
+      end_reason_ = r;
+      stream_done_ = true;
+      return false;
     }
+    stream_started_ = true;
+  }
+  size_t pos = stream_pos_;
+  stream_pos_ = ParseRecords(data, size, stream_pos_, at_end, out_records);
+  perf.SetWork(stream_pos_ - pos, out_records.size() - first_record);
+  trace.SetBytes(stream_pos_ - pos);
+  trace.SetItems(out_records.size() - first_record);
+  trace.SetCrcNs(crc_ns_);
+  if (end_reason_ != WalEndReason::EndOfData || at_end)
+    stream_done_ = true;
+  return !stream_done_;
+}
+
+WalEndReason WalParser::StartAt(const uint8_t *data, size_t size,
+                                size_t start_offset, size_t &out_pos) {
+  end_reason_ = WalEndReason::EndOfData;
+  end_lsn_ = 0;
+  segment_size_ = 0;
+  prev_lsn_ = 0;
+
+  size_t page_off = start_offset - start_offset % XLOG_BLCKSZ;
+  if (page_off + SizeOfXLogShortPHD > size) {
+    end_lsn_ = expected_base_lsn_ ? expected_base_lsn_ + page_off : 0;
+    return OutOfData(page_off);
+  }
 
-    // Alignment using PostgreSQL's MAXALIGN
-    currentPos = MAXALIGN(currentPos);
+  // Everything is checked against the address the first page claims (or
+  // the caller's expectation, e.g. from the file name): later pages must
+  // follow on from it, which is what catches stale pages of recycled
+  // segments.
+  const XLogPageHeaderData *first_page =
+      (const XLogPageHeaderData *)(data + page_off);
+  if (!IsWalPageMagic(first_page->xlp_magic)) {
+    size_t unused;
+    end_lsn_ = expected_base_lsn_ ? expected_base_lsn_ + page_off : 0;
+    return CheckPageHeader(data, page_off, 0, 0, unused);
+  }
+  base_lsn_ = first_page->xlp_pageaddr - page_off;
+  page_magic_ = first_page->xlp_magic;
+  if (expected_base_lsn_ != 0 && base_lsn_ != expected_base_lsn_) {
+    end_lsn_ = expected_base_lsn_ + page_off;
+    return WalEndReason::PageAddrMismatch;
+  }
+  end_lsn_ = base_lsn_ + start_offset;
+
+  if (size >= SizeOfXLogLongPHD) {
+    const XLogLongPageHeaderData *long_header =
+        (const XLogLongPageHeaderData *)data;
+    if (IsWalPageMagic(long_header->std.xlp_magic) &&
+        (long_header->std.xlp_info & XLP_LONG_HEADER))
+      segment_size_ = long_header->xlp_seg_size;
+  }
 
-    while (currentPos < offset + XLOG_BLCKSZ) {
-      // Check end of data
-      if (currentPos + sizeof(XLogRecord) > size)
+  // Starting at the top of a page: skip the header and the tail of a record
+  // that began on an earlier page (which may span several pages).
+  size_t pos = start_offset;
+  size_t first_header_size = (first_page->xlp_info & XLP_LONG_HEADER)
+                                 ? SizeOfXLogLongPHD
+                                 : SizeOfXLogShortPHD;
+  if (pos - page_off < first_header_size) {
+    for (;;) {
+      if (page_off + SizeOfXLogShortPHD > size)
+        return OutOfData(page_off);
+      const XLogPageHeaderData *header =
+          (const XLogPageHeaderData *)(data + page_off);
+      uint32_t rem = (header->xlp_info & XLP_FIRST_IS_CONTRECORD)
+                         ? header->xlp_rem_len
+                         : 0;
+      size_t header_size;
+      WalEndReason r =
+          CheckPageHeader(data, page_off, base_lsn_ + page_off, rem,
+                          header_size);
+      if (r != WalEndReason::None)
+        return r;
+      size_t avail = XLOG_BLCKSZ - header_size;
+      if (rem < avail) {
+        pos = MAXALIGN(page_off + header_size + rem);
         break;
+      }
+      page_off += XLOG_BLCKSZ;
+    }
+    end_lsn_ = base_lsn_ + pos;
+  }
+  out_pos = pos;
+  return WalEndReason::None;
+}
 
-      // Check end of page
-      if (currentPos + sizeof(XLogRecord) > offset + XLOG_BLCKSZ)
+size_t WalParser::ParseRecords(const uint8_t *data, size_t size, size_t pos,
+                               bool emit_partial,
+                               std::vector<WalRecordInfo> &out_records,
+                               size_t max_records) {
+  const uint64_t base_lsn = base_lsn_;
+  // Time spent in CRCs is only measured for the trace, it costs two clock
+  // reads per record.
+  const bool time_crc = WalTraceEnabled();
+  crc_ns_ = 0;
+  for (;;) {
+    // A record starting at a page boundary comes after the page header.
+    if (pos % XLOG_BLCKSZ == 0) {
+      if (pos + SizeOfXLogShortPHD > size) {
+        end_reason_ = OutOfData(pos);
+        return pos;
+      }
+      size_t header_size;
+      WalEndReason r =
+          CheckPageHeader(data, pos, base_lsn + pos, 0, header_size);
+      if (r != WalEndReason::None) {
+        end_reason_ = r;
         break;
+      }
+      pos += header_size;
+    }
 
-      const XLogRecord *rec = (const XLogRecord *)(data + currentPos);
+    // Records are MAXALIGNed, so xl_tot_len is never split across pages.
+    if (pos + sizeof(uint32_t) > size) {
+      end_reason_ = OutOfData(pos);
+      return pos;
+    }
+    uint32_t tot_len;
+    memcpy(&tot_len, data + pos, sizeof(tot_len));
+    if (tot_len == 0) {
+      end_reason_ = WalEndReason::ZeroedTail;
+      break;
+    }
+    if (tot_len < SizeOfXLogRecord || tot_len > XLogRecordMaxSize) {
+      end_reason_ = WalEndReason::BadRecordLength;
+      break;
+    }
 
-      if (rec->xl_tot_len == 0) {
+    size_t rec_pos = pos;
+    uint64_t lsn = base_lsn + rec_pos;
+    const uint8_t *rec_bytes;
+    size_t avail_len = tot_len;
+    WalEndReason gather_result = WalEndReason::None;
+
+    if (rec_pos % XLOG_BLCKSZ + tot_len <= XLOG_BLCKSZ &&
+        rec_pos + tot_len <= size) {
+      // Common case: the whole record sits on one page.
+      rec_bytes = data + rec_pos;
+      pos += tot_len;
+    } else {
+      if (scratch_.size() < tot_len)
+        scratch_.resize(tot_len);
+      uint32_t remaining = tot_len;
+      size_t copied = 0;
+      gather_result = GatherRecordBytes(data, size, base_lsn, pos,
+                                        scratch_.data(), tot_len, remaining,
+                                        copied);
+      if (gather_result == WalEndReason::EndOfData)
+        gather_result = OutOfData(pos);
+      if (gather_result != WalEndReason::None &&
+          gather_result != WalEndReason::EndOfData) {
+        end_reason_ = gather_result;
         break;
       }
-
-      WalRecordInfo info;
-      info.Offset = currentPos;
-      info.Length = rec->xl_tot_len;
-      info.XID = rec->xl_xid;
-      info.RMID = rec->xl_rmid;
-      info.Info = rec->xl_info;
-      info.Description = GetRmidName(rec->xl_rmid);
-
-      // Append Info details
-      std::string opDesc = GetOpDescription(rec->xl_rmid, rec->xl_info);
-      if (!opDesc.empty()) {
-        info.Description += ": " + opDesc;
+      rec_bytes = scratch_.data();
+      avail_len = copied;
+      // Without emit_partial, a record cut off by the end of the buffer is
+      // left for the next call, which will have more data.
+      if (avail_len < SizeOfXLogRecord ||
+          (avail_len < tot_len && !emit_partial)) {
+        end_reason_ = WalEndReason::EndOfData;
+        return rec_pos;
       }
-      // approximate LSN
-      info.LSN = header->xlp_pageaddr + (currentPos - offset);
-
-      // Parse Payload for RelFileNodes
-      uint32_t recordHeaderLen = SizeOfXLogRecord;
-      if (rec->xl_tot_len > recordHeaderLen) {
-        // Ensure we don't go out of bounds of the file
-        size_t payloadMax = rec->xl_tot_len - recordHeaderLen;
-        if (currentPos + rec->xl_tot_len <= size) {
-          ParseXLogRecordPayload(data + currentPos + recordHeaderLen,
-                                 payloadMax, info);
-        }
+    }
+
+    XLogRecord rec;
+    memcpy(&rec, rec_bytes, SizeOfXLogRecord);
+
+    // The chain must link back to the record we accepted last. For the
+    // first record we can only check that it points backwards.
+    if ((prev_lsn_ != 0 && rec.xl_prev != prev_lsn_) ||
+        (prev_lsn_ == 0 && rec.xl_prev >= lsn)) {
+      end_reason_ = WalEndReason::PrevLinkMismatch;
+      break;
+    }
+
+    bool complete = avail_len == tot_len;
+    if (complete && verify_crc_) {
+      std::chrono::steady_clock::time_point crc_start;
+      if (time_crc)
+        crc_start = std::chrono::steady_clock::now();
+      uint32_t crc = CRC32C_INIT;
+      crc = Crc32cUpdate(crc, rec_bytes + SizeOfXLogRecord,
+                         tot_len - SizeOfXLogRecord);
+      crc = Crc32cUpdate(crc, rec_bytes, offsetof(XLogRecord, xl_crc));
+      if (time_crc)
+        crc_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - crc_start)
+                       .count();
+      if (Crc32cFinish(crc) != rec.xl_crc) {
+        end_reason_ = WalEndReason::CrcMismatch;
+        break;
       }
+    }
 
-      out_records.push_back(info);
+    WalRecordInfo info;
+    info.Offset = rec_pos;
+    info.LSN = lsn;
+    info.PrevLSN = rec.xl_prev;
+    info.Length = tot_len;
+    info.XID = rec.xl_xid;
+    info.RMID = rec.xl_rmid;
+    info.Info = rec.xl_info;
+    info.HasFPI = false;
+    info.Description = GetRmidName(rec.xl_rmid);
+
+    // Append Info details
+    std::string opDesc = GetOpDescription(rec.xl_rmid, rec.xl_info);
+    if (!opDesc.empty()) {
+      info.Description += ": " + opDesc;
+    }
 
-      // Move to next record
-      currentPos += rec->xl_tot_len;
-      currentPos = MAXALIGN(currentPos);
+    // Parse Payload for RelFileNodes. A record cut off by the end of the
+    // buffer (it continues in the next segment) still has its block headers.
+    ParseXLogRecordPayload(rec_bytes + SizeOfXLogRecord,
+                           (uint32_t)(avail_len - SizeOfXLogRecord), info);
+    if (visitor_ && complete)
+      visitor_(info, rec_bytes, tot_len);
+
+    out_records.push_back(std::move(info));
+    prev_lsn_ = lsn;
+    // Where the next record would start
+    end_lsn_ = base_lsn + MAXALIGN(pos);
+
+    if (!complete) {
+      end_reason_ = WalEndReason::EndOfData;
+      return pos;
     }
 
-    // Move to next page
-    offset += XLOG_BLCKSZ;
+    // Move to next record
+    pos = MAXALIGN(pos);
+    if (--max_records == 0)
+      break;
   }
-
-  return !out_records.empty();
+  return pos;
 }
@@ -1,19 +1,29 @@
 #pragma once
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
 // Define a standalone RelFileNode struct to avoid exposing PostgreSQL headers
-// to the UI
+// to the UI. Also holds the rest of the block reference it came from.
 struct WalRelFileNode {
-  uint32_t spcNode;
-  uint32_t dbNode;
-  uint32_t relNode;
+  uint32_t spcNode = 0;
+  uint32_t dbNode = 0;
+  uint32_t relNode = 0;
+  uint32_t blockNum = 0;
+  uint8_t forkNum = 0;   /* MAIN_FORKNUM, FSM, VISIBILITYMAP, INIT */
+  bool hasImage = false; /* Carries a full-page image */
 };
 
+// "main", "fsm", "vm" or "init".
+const char *WalForkName(uint8_t fork);
+
 // Structures derived from PostgreSQL headers are handled in the implementation
 // (cpp) file. We use standard types here for the interface.
 
+// XLOG_BLCKSZ: WAL page size
+#define WAL_PAGE_SIZE 8192
+
 // RMIDs from xlog_internal.h
 #define RM_XLOG_ID 0
 #define RM_XACT_ID 1
@@ -32,15 +42,27 @@ struct WalRelFileNode {
 #define XLOG_HEAP_INSERT 0x00
 #define XLOG_HEAP_DELETE 0x10
 #define XLOG_HEAP_UPDATE 0x20
+#define XLOG_HEAP_TRUNCATE 0x30
 #define XLOG_HEAP_HOT_UPDATE 0x40
+#define XLOG_HEAP_CONFIRM 0x50
+#define XLOG_HEAP_LOCK 0x60
+#define XLOG_HEAP_INPLACE 0x70
+#define XLOG_HEAP_INIT_PAGE 0x80
 
-#define XLOG_HEAP2_CLEAN 0x00
-#define XLOG_HEAP2_FREEZE_PAGE 0x10
-#define XLOG_HEAP2_MULTI_INSERT 0x40
+// 0x10-0x30 are PRUNE_ON_ACCESS, PRUNE_VACUUM_SCAN and PRUNE_VACUUM_CLEANUP
+// from PostgreSQL 17 on, with another body
+#define XLOG_HEAP2_REWRITE 0x00
+#define XLOG_HEAP2_PRUNE 0x10
+#define XLOG_HEAP2_VACUUM 0x20
+#define XLOG_HEAP2_FREEZE_PAGE 0x30
+#define XLOG_HEAP2_VISIBLE 0x40
+#define XLOG_HEAP2_MULTI_INSERT 0x50
+#define XLOG_HEAP2_LOCK_UPDATED 0x60
+#define XLOG_HEAP2_NEW_CID 0x70
 
 #define XLOG_XACT_COMMIT 0x00
-#define XLOG_XACT_ABORT 0x10
-#define XLOG_XACT_PREPARE 0x20
+#define XLOG_XACT_PREPARE 0x10
+#define XLOG_XACT_ABORT 0x20
 
 #define RM_BTREE_ID 11
 #define RM_HASH_ID 12
@@ -54,22 +76,163 @@ struct WalRelFileNode {
 #define RM_GENERIC_ID 20
 #define RM_LOGICALMSG_ID 21
 
+// Why the last parse stopped. Anything other than EndOfData means the bytes
+// at WalParser::GetEndLSN() are not valid WAL.
+enum class WalEndReason : uint8_t {
+  None,             // Nothing parsed yet
+  EndOfData,        // Ran out of buffer
+  ZeroedTail,       // Zero page or record length: WAL not written yet
+  BadPageHeader,    // Wrong magic, flags or continuation length
+  PageAddrMismatch, // xlp_pageaddr doesn't follow on: recycled segment
+  BadRecordLength,
+  PrevLinkMismatch, // xl_prev doesn't point at the previous record
+  CrcMismatch,
+};
+const char *WalEndReasonName(WalEndReason reason);
+
+// xlp_magic of the WAL format written by a PostgreSQL major version, 0 for
+// versions the parser doesn't read. 15 to 17 share the record layout and
+// differ only in this value.
+uint16_t WalPageMagicForVersion(int major_version);
+bool IsWalPageMagic(uint16_t magic);
+// The other way round, 0 if unknown.
+int WalVersionForPageMagic(uint16_t magic);
+
+// Decoded WAL page header, for callers that only look at headers.
+struct WalPageHeaderInfo {
+  uint16_t Magic;
+  uint16_t Info;
+  uint32_t Timeline;
+  uint64_t PageAddr;
+  uint32_t RemLen;
+  bool IsLong;
+  uint64_t SystemId;    /* Long header only */
+  uint32_t SegmentSize; /* Long header only */
+};
+#define WAL_SHORT_PAGE_HEADER_SIZE 24
+#define WAL_LONG_PAGE_HEADER_SIZE 40
+// Decodes the page header at data. Needs WAL_LONG_PAGE_HEADER_SIZE bytes to
+// fill in the long header fields. Returns false if the magic is wrong.
+bool ReadWalPageHeader(const uint8_t *data, size_t size,
+                       WalPageHeaderInfo &out);
+
+// A segment file is exactly one segment long, so its size tells the
+// --wal-segsize the cluster was created with. Falls back to 16MB.
+uint64_t WalSegmentSizeFromFileSize(uint64_t file_size);
+
+// Start LSN of the segment named by a WAL file name (TLI, log and segment
+// as 24 hex digits), 0 if the name isn't one.
+uint64_t WalFileNameToLSN(const std::string &filename, uint64_t segment_size);
+// The other way round: name of the segment holding lsn on timeline tli.
+std::string WalFileNameForLSN(uint32_t tli, uint64_t lsn,
+                              uint64_t segment_size);
+
 struct WalRecordInfo {
 
   size_t Offset;           /* Global offset in the loaded buffer */
-  uint64_t LSN;            /* Log Sequence Number (approximate/derived) */
+  uint64_t LSN;            /* Log Sequence Number (from xlp_pageaddr) */
+  uint64_t PrevLSN;        /* xl_prev: LSN of the previous record */
   uint32_t Length;         /* Total length */
   uint32_t XID;            /* Transaction ID */
   uint8_t RMID;            /* Resource Manager ID */
   uint8_t Info;            /* Info flags */
+  bool HasFPI;             /* Some block reference carries a full-page image */
   std::string Description; /* Generated description */
   std::vector<WalRelFileNode> RelFileNodes; /* Affected relations */
 };
 
+class WalSparseSegment;
+
+// Sees each complete record as it is parsed, with its bytes from the
+// XLogRecord header on (reassembled if the record crosses pages). The
+// bytes are only valid during the call.
+using WalRecordVisitor = std::function<void(
+    const WalRecordInfo &info, const uint8_t *record, uint32_t length)>;
+
+// Parses the records of a WAL segment (or part of one) held in memory.
+// Every page header must carry the address that follows on from the first
+// page, every record's xl_prev must point at the record before it and its
+// CRC must match; parsing stops at the first break, so the zeroed or stale
+// tail of a segment never turns into records.
 class WalParser {
 public:
   bool Parse(const uint8_t *data, size_t size,
              std::vector<WalRecordInfo> &out_records);
+  // Like Parse() but starts at start_offset, which must be a record
+  // boundary or the start of a page. Offsets stay relative to data.
+  bool ParseFrom(const uint8_t *data, size_t size, size_t start_offset,
+                 std::vector<WalRecordInfo> &out_records);
+  // Same over a segment held without its zero pages. Only the leading run
+  // of stored pages is parsed; the zero page after it ends valid WAL as it
+  // would in the full file (ZeroedTail).
+  bool ParseFrom(const WalSparseSegment &segment, size_t start_offset,
+                 std::vector<WalRecordInfo> &out_records);
+  // Decodes only the record at start_offset, which must be a record
+  // boundary, e.g. one found by following xl_prev backwards. data may be
+  // just the pages the record sits on, with SetExpectedBaseLSN() set to
+  // the LSN of its first byte. False if there is no valid record there.
+  bool ParseRecordAt(const uint8_t *data, size_t size, size_t start_offset,
+                     WalRecordInfo &out);
+
+  // Incremental parsing of a segment that arrives a few pages at a time,
+  // e.g. from a decompressor. data always holds the segment from its first
+  // byte (it may move between calls as the buffer grows); each call appends
+  // the records that are complete within size bytes. Pass at_end with the
+  // last piece. Returns false once parsing has stopped, at the end of the
+  // data or of valid WAL.
+  void BeginIncremental();
+  bool ParseMore(const uint8_t *data, size_t size, bool at_end,
+                 std::vector<WalRecordInfo> &out_records);
+
+  // LSN of byte 0 of the buffer, usually derived from the file name, so a
+  // recycled segment is rejected even if its first page is stale. 0 trusts
+  // the first page header.
+  void SetExpectedBaseLSN(uint64_t lsn) { expected_base_lsn_ = lsn; }
+  void SetVerifyCRC(bool verify) { verify_crc_ = verify; }
+  void SetRecordVisitor(WalRecordVisitor visitor) {
+    visitor_ = std::move(visitor);
+  }
+
+  // Results of the last parse: where valid WAL ends and why. The end is
+  // MAXALIGNed, where a record after the last valid one would start (or the
+  // end of the buffer if that record is cut off by it).
+  uint64_t GetEndLSN() const { return end_lsn_; }
+  WalEndReason GetEndReason() const { return end_reason_; }
+  // xlp_seg_size from the segment's long page header, 0 if not seen.
+  uint32_t GetSegmentSize() const { return segment_size_; }
+
   std::string GetRmidName(uint8_t rmid);
   std::string GetOpDescription(uint8_t rmid, uint8_t info);
+
+private:
+  // Validates the first page and finds the first record at or after
+  // start_offset. Returns None when ready, otherwise why it can't start.
+  WalEndReason StartAt(const uint8_t *data, size_t size, size_t start_offset,
+                       size_t &out_pos);
+  // Parses records from pos until the end of valid WAL or of the buffer.
+  // Returns where it stopped.
+  size_t ParseRecords(const uint8_t *data, size_t size, size_t pos,
+                      bool emit_partial,
+                      std::vector<WalRecordInfo> &out_records,
+                      size_t max_records = SIZE_MAX);
+  // Why parsing stops when the buffer runs out at pos: the end of the data,
+  // or the zero pages of a sparse segment.
+  WalEndReason OutOfData(size_t pos) const;
+
+  uint64_t expected_base_lsn_ = 0;
+  bool verify_crc_ = true;
+  uint64_t end_lsn_ = 0;
+  WalEndReason end_reason_ = WalEndReason::None;
+  uint32_t segment_size_ = 0;
+  uint16_t page_magic_ = 0; // Of the first page, for version-specific names
+  std::vector<uint8_t> scratch_; // Reassembly of records crossing pages
+
+  uint64_t base_lsn_ = 0; // LSN of byte 0 of the current buffer
+  uint64_t prev_lsn_ = 0; // Last record accepted, for the xl_prev check
+  size_t stream_pos_ = 0; // ParseMore(): where the next call resumes
+  bool stream_started_ = false;
+  bool stream_done_ = false;
+  size_t logical_size_ = 0; // Sparse segment: zero pages up to here
+  int64_t crc_ns_ = 0;      // CRC time of the last ParseRecords(), traced
+  WalRecordVisitor visitor_;
 };
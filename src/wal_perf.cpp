@@ -0,0 +1,166 @@
+#include "wal_perf.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct Section {
+  float ring[WAL_PERF_SAMPLES];
+  int next = 0;
+  int count = 0;
+  double bytes_per_sec = 0;
+  double items_per_sec = 0;
+  double frame_seconds = 0; // Per-frame sections: sum so far
+  bool frame_touched = false;
+};
+
+std::atomic<bool> enabled{false};
+std::mutex mutex;
+Section sections[(int)WalPerfSection::Count];
+
+bool PerFrame(WalPerfSection section) {
+  return section == WalPerfSection::Frame ||
+         section == WalPerfSection::RelNames ||
+         section == WalPerfSection::HexRender;
+}
+
+void PushLocked(Section &s, double seconds) {
+  s.ring[s.next] = (float)(seconds * 1000.0);
+  s.next = (s.next + 1) % WAL_PERF_SAMPLES;
+  s.count = std::min(s.count + 1, WAL_PERF_SAMPLES);
+}
+
+} // namespace
+
+const char *WalPerfSectionName(WalPerfSection section) {
+  switch (section) {
+  case WalPerfSection::Frame:
+    return "Frame";
+  case WalPerfSection::Load:
+    return "Load";
+  case WalPerfSection::Parse:
+    return "Parse";
+  case WalPerfSection::Filter:
+    return "Filter";
+  case WalPerfSection::RelNames:
+    return "RelNode names";
+  case WalPerfSection::HexRender:
+    return "Hex editor";
+  case WalPerfSection::Count:
+    break;
+  }
+  return "?";
+}
+
+void WalPerfSetEnabled(bool on) {
+  enabled.store(on, std::memory_order_relaxed);
+}
+
+bool WalPerfEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+void WalPerfRecord(WalPerfSection section, double seconds, uint64_t bytes,
+                   uint64_t items) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Section &s = sections[(int)section];
+  if (PerFrame(section)) {
+    s.frame_seconds += seconds;
+    s.frame_touched = true;
+  } else {
+    PushLocked(s, seconds);
+  }
+  if ((bytes || items) && seconds > 0) {
+    s.bytes_per_sec = bytes / seconds;
+    s.items_per_sec = items / seconds;
+  }
+}
+
+void WalPerfEndFrame() {
+  if (!WalPerfEnabled())
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  for (int i = 0; i < (int)WalPerfSection::Count; i++) {
+    Section &s = sections[i];
+    if (!PerFrame((WalPerfSection)i))
+      continue;
+    // A frame that didn't draw the hex editor still counts, as 0 ms
+    if (s.frame_touched || s.count > 0)
+      PushLocked(s, s.frame_seconds);
+    s.frame_seconds = 0;
+    s.frame_touched = false;
+  }
+}
+
+WalPerfScope::WalPerfScope(WalPerfSection section)
+    : section_(section), active_(WalPerfEnabled()) {
+  if (active_)
+    start_ = std::chrono::steady_clock::now();
+}
+
+WalPerfScope::~WalPerfScope() {
+  if (!active_)
+    return;
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_)
+                       .count();
+  WalPerfRecord(section_, seconds, bytes_, items_);
+}
+
+void WalPerfGetStats(WalPerfSection section, WalPerfStats &out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const Section &s = sections[(int)section];
+  out.Count = s.count;
+  int first = (s.next - s.count + WAL_PERF_SAMPLES) % WAL_PERF_SAMPLES;
+  for (int i = 0; i < s.count; i++)
+    out.Samples[i] = s.ring[(first + i) % WAL_PERF_SAMPLES];
+  out.BytesPerSec = s.bytes_per_sec;
+  out.ItemsPerSec = s.items_per_sec;
+  out.Last = out.Mean = out.P50 = out.P95 = out.Max = 0;
+  if (s.count == 0)
+    return;
+
+  float sorted[WAL_PERF_SAMPLES];
+  std::copy(out.Samples, out.Samples + s.count, sorted);
+  std::sort(sorted, sorted + s.count);
+  double sum = 0;
+  for (int i = 0; i < s.count; i++)
+    sum += sorted[i];
+  out.Last = out.Samples[s.count - 1];
+  out.Mean = (float)(sum / s.count);
+  out.P50 = sorted[s.count / 2];
+  out.P95 = sorted[std::min(s.count - 1, s.count * 95 / 100)];
+  out.Max = sorted[s.count - 1];
+}
+
+void WalPerfReset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (Section &s : sections)
+    s = Section();
+}
+
+size_t WalPerfResidentBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (K32GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.WorkingSetSize;
+  return 0;
+#elif defined(__linux__)
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0;
+  unsigned long size = 0, resident = 0;
+  int n = fscanf(f, "%lu %lu", &size, &resident);
+  fclose(f);
+  return n == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Timings of the hot paths, for the GUI's performance overlay. Recording is
+// off until WalPerfSetEnabled(true); a disabled WalPerfScope costs one
+// relaxed atomic load.
+enum class WalPerfSection : uint8_t {
+  Frame,     // CPU time of a GUI frame, swap excluded
+  Load,      // Reading and parsing a segment for display
+  Parse,     // WalParser over a buffer
+  Filter,    // Compiling and evaluating the record filter
+  RelNames,  // Formatting the RelNode column
+  HexRender, // Drawing the hex editor
+  Count
+};
+const char *WalPerfSectionName(WalPerfSection section);
+
+void WalPerfSetEnabled(bool enabled);
+bool WalPerfEnabled();
+
+// Adds a sample. bytes and items are the work done, for throughput. Frame,
+// RelNames and HexRender run several times per frame; their samples are
+// summed until WalPerfEndFrame().
+void WalPerfRecord(WalPerfSection section, double seconds, uint64_t bytes = 0,
+                   uint64_t items = 0);
+void WalPerfEndFrame();
+
+class WalPerfScope {
+public:
+  explicit WalPerfScope(WalPerfSection section);
+  ~WalPerfScope();
+  WalPerfScope(const WalPerfScope &) = delete;
+  WalPerfScope &operator=(const WalPerfScope &) = delete;
+
+  void SetWork(uint64_t bytes, uint64_t items) {
+    bytes_ = bytes;
+    items_ = items;
+  }
+
+private:
+  WalPerfSection section_;
+  bool active_;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t bytes_ = 0;
+  uint64_t items_ = 0;
+};
+
+#define WAL_PERF_SAMPLES 240
+
+// The last WAL_PERF_SAMPLES samples of a section and their distribution.
+struct WalPerfStats {
+  float Samples[WAL_PERF_SAMPLES]; // Milliseconds, oldest first
+  int Count = 0;
+  float Last = 0, Mean = 0, P50 = 0, P95 = 0, Max = 0; // Milliseconds
+  double BytesPerSec = 0; // Of the last sample that did work
+  double ItemsPerSec = 0;
+};
+void WalPerfGetStats(WalPerfSection section, WalPerfStats &out);
+void WalPerfReset();
+
+// Resident set size of the process, 0 where unknown.
+size_t WalPerfResidentBytes();
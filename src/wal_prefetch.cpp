@@ -0,0 +1,146 @@
+#include "wal_prefetch.h"
+#include "wal_trace.h"
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+WalPrefetcher::WalPrefetcher(WalSegmentCache *cache, size_t capacity)
+    : cache_(cache), capacity_(capacity) {
+  thread_ = std::thread(&WalPrefetcher::Worker, this);
+}
+
+WalPrefetcher::~WalPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+}
+
+bool WalPrefetcher::PlannedLocked(const std::string &path) const {
+  return std::find(plan_.begin(), plan_.end(), path) != plan_.end();
+}
+
+void WalPrefetcher::Navigate(const std::vector<std::string> &paths,
+                             int index) {
+  if (index < 0 || index >= (int)paths.size())
+    return;
+  int dir = (last_index_ >= 0 && index < last_index_) ? -1 : 1;
+  last_index_ = index;
+
+  std::vector<std::string> plan;
+  for (int step : {dir, -dir, 2 * dir}) {
+    int i = index + step;
+    if (i >= 0 && i < (int)paths.size() && plan.size() < capacity_)
+      plan.push_back(paths[i]);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    plan_ = std::move(plan);
+    ready_.erase(std::remove_if(ready_.begin(), ready_.end(),
+                                [&](const WalLoadedSegment &seg) {
+                                  return !PlannedLocked(seg.Path);
+                                }),
+                 ready_.end());
+  }
+  cv_.notify_all();
+}
+
+bool WalPrefetcher::Take(const std::string &path, WalLoadedSegment &out) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return loading_ != path; });
+    auto it = std::find_if(
+        ready_.begin(), ready_.end(),
+        [&](const WalLoadedSegment &seg) { return seg.Path == path; });
+    if (it == ready_.end())
+      return false;
+    out = std::move(*it);
+    ready_.erase(it);
+  }
+  // Now viewed: cached as recent, like a segment loaded inline
+  if (cache_ && out.Error.empty() && !cache_->Touch(path))
+    cache_->Insert(out);
+  return true;
+}
+
+void WalPrefetcher::Clear() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    plan_.clear();
+    ready_.clear();
+    last_index_ = -1;
+  }
+  cv_.notify_all();
+}
+
+size_t WalPrefetcher::GetMemoryUsage() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t bytes = 0;
+  for (const WalLoadedSegment &seg : ready_)
+    bytes += WalSegmentMemoryUsage(seg);
+  return bytes;
+}
+
+void WalPrefetcher::Worker() {
+#ifdef __linux__
+  // Linux nice values are per thread: stay out of the UI thread's way.
+  setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+#endif
+  WalTraceSetThreadName("prefetch");
+  WalParser parser;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    std::string path;
+    std::vector<std::string> hints;
+    cv_.wait(lock, [&] {
+      if (stop_)
+        return true;
+      for (const std::string &p : plan_) {
+        bool have = std::any_of(
+            ready_.begin(), ready_.end(),
+            [&](const WalLoadedSegment &seg) { return seg.Path == p; });
+        if (!have) {
+          path = p;
+          return true;
+        }
+      }
+      return false;
+    });
+    if (stop_)
+      return;
+    loading_ = path;
+    hints = plan_;
+    lock.unlock();
+
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    // Start readahead for the whole plan, the kernel reads the later files
+    // while we parse this one.
+    for (const std::string &p : hints) {
+      int fd = open(p.c_str(), O_RDONLY);
+      if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+      }
+    }
+#endif
+
+    WalLoadedSegment seg;
+    LoadWalSegment(path, parser, cache_, seg, /*speculative=*/true);
+
+    lock.lock();
+    loading_.clear();
+    if (PlannedLocked(path))
+      ready_.push_back(std::move(seg));
+    cv_.notify_all(); // Take() may be waiting for this one
+  }
+}
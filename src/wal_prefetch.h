@@ -0,0 +1,55 @@
+#pragma once
+#include "wal_archive.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads and parses the segments next to the one being viewed on a
+// low-priority background thread, so stepping to a neighbour is instant.
+// The direction of the last step decides which side goes first: after
+// moving forward the plan is next, previous, next-but-one.
+//
+//   WalLoadedSegment seg;
+//   if (!prefetcher.Take(path, seg))
+//     LoadWalSegment(path, parser, cache, seg); // Not ready, load inline
+//   prefetcher.Navigate(paths, index);
+class WalPrefetcher {
+public:
+  // Compressed segments go through cache when given. capacity is the number
+  // of segments kept ready.
+  explicit WalPrefetcher(WalSegmentCache *cache = nullptr,
+                         size_t capacity = 3);
+  ~WalPrefetcher();
+
+  WalPrefetcher(const WalPrefetcher &) = delete;
+  WalPrefetcher &operator=(const WalPrefetcher &) = delete;
+
+  // paths are the folder's files in combo order, index the one now shown.
+  void Navigate(const std::vector<std::string> &paths, int index);
+  // Moves a prefetched segment into out. If the segment is being loaded
+  // right now this waits for it, which is never slower than loading it
+  // again. False if it isn't planned.
+  bool Take(const std::string &path, WalLoadedSegment &out);
+  // Drops everything, e.g. after the folder was rescanned.
+  void Clear();
+  // Bytes held by segments waiting in the ready list.
+  size_t GetMemoryUsage();
+
+private:
+  void Worker();
+  bool PlannedLocked(const std::string &path) const;
+
+  WalSegmentCache *cache_;
+  size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::string> plan_; // Wanted ready, most wanted first
+  std::deque<WalLoadedSegment> ready_;
+  std::string loading_; // Being loaded by the worker
+  int last_index_ = -1;
+  bool stop_ = false;
+  std::thread thread_;
+};
@@ -0,0 +1,183 @@
+#include "wal_record_decode.h"
+#include "wal_sparse.h"
+#include <algorithm>
+#include <cstring>
+
+#define SizeOfXLogRecord 24
+#define XLR_MAX_BLOCK_ID 32
+#define XLR_BLOCK_ID_DATA_SHORT 255
+#define XLR_BLOCK_ID_DATA_LONG 254
+#define XLR_BLOCK_ID_ORIGIN 253
+#define XLR_BLOCK_ID_TOPLEVEL_XID 252
+
+#define BKPBLOCK_FORK_MASK 0x0F
+#define BKPBLOCK_HAS_IMAGE 0x10
+#define BKPBLOCK_HAS_DATA 0x20
+#define BKPBLOCK_WILL_INIT 0x40
+#define BKPBLOCK_SAME_REL 0x80
+#define BKPIMAGE_COMPRESSED_MASK 0x1C
+
+#define XLP_LONG_HEADER 0x0002
+
+namespace {
+
+// Bounds-checked reads from the record
+struct Reader {
+  const uint8_t *Data;
+  uint32_t Length;
+  uint32_t Pos;
+
+  bool Get(void *dst, uint32_t n) {
+    if (Length - Pos < n)
+      return false;
+    memcpy(dst, Data + Pos, n);
+    Pos += n;
+    return true;
+  }
+};
+
+} // namespace
+
+bool WalDecodeRecord(const uint8_t *record, uint32_t length,
+                     WalDecodedRecord &out) {
+  out.Blocks.clear();
+  out.ToplevelXID = 0;
+  out.MainData = nullptr;
+  out.MainDataLength = 0;
+  if (length < SizeOfXLogRecord)
+    return false;
+  uint32_t tot_len;
+  memcpy(&tot_len, record, 4);
+  memcpy(&out.XID, record + 4, 4);
+  out.Info = record[16];
+  out.RMID = record[17];
+  if (tot_len != length)
+    return false;
+
+  // Headers first, then the images and data in the same order, then the
+  // main data
+  Reader r = {record, length, SizeOfXLogRecord};
+  uint32_t data_total = 0;
+  WalRelFileNode last_rel;
+  for (;;) {
+    if (r.Pos == length)
+      break;
+    uint8_t id;
+    r.Get(&id, 1);
+    if (id == XLR_BLOCK_ID_DATA_SHORT) {
+      uint8_t len;
+      if (!r.Get(&len, 1))
+        return false;
+      out.MainDataLength = len;
+      data_total += len;
+      break;
+    }
+    if (id == XLR_BLOCK_ID_DATA_LONG) {
+      if (!r.Get(&out.MainDataLength, 4))
+        return false;
+      data_total += out.MainDataLength;
+      break;
+    }
+    if (id == XLR_BLOCK_ID_ORIGIN) {
+      uint16_t origin;
+      if (!r.Get(&origin, 2))
+        return false;
+      continue;
+    }
+    if (id == XLR_BLOCK_ID_TOPLEVEL_XID) {
+      if (!r.Get(&out.ToplevelXID, 4))
+        return false;
+      continue;
+    }
+    if (id > XLR_MAX_BLOCK_ID)
+      return false;
+
+    WalDecodedBlock b = {};
+    b.Id = id;
+    uint8_t fork_flags;
+    if (!r.Get(&fork_flags, 1) || !r.Get(&b.DataLength, 2))
+      return false;
+    b.HasData = (fork_flags & BKPBLOCK_HAS_DATA) != 0;
+    b.WillInit = (fork_flags & BKPBLOCK_WILL_INIT) != 0;
+    if (b.HasData != (b.DataLength > 0))
+      return false;
+    data_total += b.DataLength;
+
+    if (fork_flags & BKPBLOCK_HAS_IMAGE) {
+      if (!r.Get(&b.ImageLength, 2) || !r.Get(&b.HoleOffset, 2) ||
+          !r.Get(&b.ImageInfo, 1))
+        return false;
+      bool compressed = (b.ImageInfo & BKPIMAGE_COMPRESSED_MASK) != 0;
+      if ((b.ImageInfo & WAL_BKPIMAGE_HAS_HOLE) && compressed) {
+        if (!r.Get(&b.HoleLength, 2))
+          return false;
+      } else if (b.ImageInfo & WAL_BKPIMAGE_HAS_HOLE) {
+        b.HoleLength = (uint16_t)(WAL_PAGE_SIZE - b.ImageLength);
+      }
+      // The same consistency checks as the server
+      if (b.HoleOffset + b.HoleLength > WAL_PAGE_SIZE ||
+          ((b.ImageInfo & WAL_BKPIMAGE_HAS_HOLE) &&
+           (b.HoleLength == 0 || b.ImageLength == WAL_PAGE_SIZE)) ||
+          (!(b.ImageInfo & WAL_BKPIMAGE_HAS_HOLE) &&
+           (b.HoleOffset != 0 || b.HoleLength != 0)) ||
+          (!compressed && !(b.ImageInfo & WAL_BKPIMAGE_HAS_HOLE) &&
+           b.ImageLength != WAL_PAGE_SIZE))
+        return false;
+      data_total += b.ImageLength;
+    }
+
+    if (!(fork_flags & BKPBLOCK_SAME_REL)) {
+      if (!r.Get(&last_rel.spcNode, 4) || !r.Get(&last_rel.dbNode, 4) ||
+          !r.Get(&last_rel.relNode, 4))
+        return false;
+    } else if (out.Blocks.empty()) {
+      return false;
+    }
+    b.Node.spcNode = last_rel.spcNode;
+    b.Node.dbNode = last_rel.dbNode;
+    b.Node.relNode = last_rel.relNode;
+    b.Node.forkNum = fork_flags & BKPBLOCK_FORK_MASK;
+    b.Node.hasImage = (fork_flags & BKPBLOCK_HAS_IMAGE) != 0;
+    if (!r.Get(&b.Node.blockNum, 4))
+      return false;
+    out.Blocks.push_back(b);
+  }
+
+  if (length - r.Pos != data_total)
+    return false;
+  for (WalDecodedBlock &b : out.Blocks) {
+    if (b.Node.hasImage) {
+      b.Image = record + r.Pos;
+      r.Pos += b.ImageLength;
+    }
+    if (b.HasData) {
+      b.Data = record + r.Pos;
+      r.Pos += b.DataLength;
+    }
+  }
+  if (out.MainDataLength > 0)
+    out.MainData = record + r.Pos;
+  return true;
+}
+
+bool WalReadRecordBytes(const WalSparseSegment &segment, size_t offset,
+                        uint32_t length, std::vector<uint8_t> &out) {
+  out.resize(length);
+  size_t pos = offset, copied = 0;
+  while (copied < length) {
+    if (pos % WAL_PAGE_SIZE == 0) {
+      uint16_t xlp_info = 0;
+      if (segment.Read(pos + 2, &xlp_info, 2) != 2)
+        return false;
+      pos += (xlp_info & XLP_LONG_HEADER) ? WAL_LONG_PAGE_HEADER_SIZE
+                                          : WAL_SHORT_PAGE_HEADER_SIZE;
+    }
+    size_t chunk = std::min((size_t)(length - copied),
+                            (size_t)(WAL_PAGE_SIZE - pos % WAL_PAGE_SIZE));
+    if (segment.Read(pos, out.data() + copied, chunk) != chunk)
+      return false;
+    pos += chunk;
+    copied += chunk;
+  }
+  return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "wal_parser.h"
+#include <cstdint>
+#include <vector>
+
+class WalSparseSegment;
+
+// A record split into its parts the way PostgreSQL's DecodeXLogRecord()
+// does: the block references with their image and data, then the main
+// data. The parser only keeps what the record list shows; this is for
+// looking inside the records that need it. Pointers point into the record
+// bytes passed in.
+
+// bimg_info flags
+#define WAL_BKPIMAGE_HAS_HOLE 0x01
+#define WAL_BKPIMAGE_APPLY 0x02
+
+struct WalDecodedBlock {
+  uint8_t Id;
+  WalRelFileNode Node;  /* Relation, fork, block, hasImage */
+  bool HasData;
+  bool WillInit;        /* Redo starts from an empty page */
+  uint8_t ImageInfo;    /* bimg_info */
+  uint16_t HoleOffset;  /* Where the hole was cut out of the page */
+  uint16_t HoleLength;
+  const uint8_t *Image; /* As stored, possibly compressed */
+  uint16_t ImageLength;
+  const uint8_t *Data;
+  uint16_t DataLength;
+};
+
+struct WalDecodedRecord {
+  uint32_t XID;
+  uint8_t RMID;
+  uint8_t Info;
+  uint32_t ToplevelXID; /* Of a subtransaction's first record, else 0 */
+  std::vector<WalDecodedBlock> Blocks;
+  const uint8_t *MainData;
+  uint32_t MainDataLength;
+};
+
+// record holds length bytes from the XLogRecord header on. False if the
+// headers don't add up to the record's length.
+bool WalDecodeRecord(const uint8_t *record, uint32_t length,
+                     WalDecodedRecord &out);
+
+// Copies the length bytes of the record at offset of a segment, as the
+// parser found it there, leaving out the page headers it crosses. False if
+// the segment ends first.
+bool WalReadRecordBytes(const WalSparseSegment &segment, size_t offset,
+                        uint32_t length, std::vector<uint8_t> &out);
@@ -0,0 +1,475 @@
+#include "wal_record_desc.h"
+#include "wal_sparse.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#define RM_MAX_ID 255
+
+// xl_heap_update flags
+#define XLH_UPDATE_CONTAINS_OLD_TUPLE 0x04
+#define XLH_UPDATE_CONTAINS_OLD_KEY 0x08
+#define XLH_UPDATE_PREFIX_FROM_OLD 0x20
+#define XLH_UPDATE_SUFFIX_FROM_OLD 0x40
+
+// xl_heap_truncate flags
+#define XLH_TRUNCATE_CASCADE 0x01
+#define XLH_TRUNCATE_RESTART_SEQS 0x02
+
+// xl_heap_prune flags, PostgreSQL 17 on
+#define XLHP_IS_CATALOG_REL 0x02
+#define XLHP_CLEANUP_LOCK 0x04
+#define XLHP_HAS_CONFLICT_HORIZON 0x08
+#define XLHP_HAS_FREEZE_PLANS 0x10
+#define XLHP_HAS_REDIRECTIONS 0x20
+#define XLHP_HAS_DEAD_ITEMS 0x40
+#define XLHP_HAS_NOW_UNUSED_ITEMS 0x80
+#define SizeOfHeapPrune 2
+#define SizeOfFreezePlan 12
+
+#define XLOG_BTREE_INSERT_LEAF 0x00
+#define XLOG_BTREE_INSERT_UPPER 0x10
+#define XLOG_BTREE_INSERT_META 0x20
+#define XLOG_BTREE_SPLIT_L 0x30
+#define XLOG_BTREE_SPLIT_R 0x40
+#define XLOG_BTREE_INSERT_POST 0x50
+#define XLOG_BTREE_DEDUP 0x60
+#define XLOG_BTREE_DELETE 0x70
+#define XLOG_BTREE_UNLINK_PAGE 0x80
+#define XLOG_BTREE_UNLINK_PAGE_META 0x90
+#define XLOG_BTREE_NEWROOT 0xA0
+#define XLOG_BTREE_MARK_PAGE_HALFDEAD 0xB0
+#define XLOG_BTREE_VACUUM 0xC0
+#define XLOG_BTREE_REUSE_PAGE 0xD0
+#define XLOG_BTREE_META_CLEANUP 0xE0
+
+#define HEAP_NATTS_MASK 0x07FF
+
+namespace {
+
+// Bounds-checked reads at an offset of a body that may be missing
+struct Body {
+  const uint8_t *Data;
+  uint32_t Length;
+
+  template <typename T> bool Get(uint32_t off, T &v) const {
+    if (!Data || off > Length || Length - off < sizeof(T))
+      return false;
+    memcpy(&v, Data + off, sizeof(T));
+    return true;
+  }
+};
+
+Body MainData(const WalDecodedRecord &rec) {
+  return {rec.MainData, rec.MainDataLength};
+}
+
+const WalDecodedBlock *FindBlock(const WalDecodedRecord &rec, uint8_t id) {
+  for (const WalDecodedBlock &b : rec.Blocks) {
+    if (b.Id == id)
+      return &b;
+  }
+  return nullptr;
+}
+
+Body BlockData(const WalDecodedRecord &rec, uint8_t id) {
+  const WalDecodedBlock *b = FindBlock(rec, id);
+  return b && b->HasData ? Body{b->Data, b->DataLength} : Body{nullptr, 0};
+}
+
+void Appendf(std::string &out, const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n > 0)
+    out.append(buf, std::min((size_t)n, sizeof(buf) - 1));
+}
+
+void AppendInfobits(std::string &out, uint8_t bits) {
+  static const char *const names[] = {"IS_MULTI", "LOCK_ONLY", "EXCL_LOCK",
+                                      "KEYSHR_LOCK", "KEYS_UPDATED"};
+  out += "[";
+  bool first = true;
+  for (int i = 0; i < 5; i++) {
+    if (bits & (1 << i)) {
+      out += first ? "" : ", ";
+      out += names[i];
+      first = false;
+    }
+  }
+  out += "]";
+}
+
+// The xl_heap_header in front of a tuple's data
+void AppendTupleHeader(std::string &out, Body body, uint32_t off) {
+  uint16_t infomask2, infomask;
+  uint8_t hoff;
+  if (body.Get(off, infomask2) && body.Get(off + 2, infomask) &&
+      body.Get(off + 4, hoff))
+    Appendf(out, ", natts: %u, infomask: 0x%04X, infomask2: 0x%04X, "
+                 "hoff: %u",
+            infomask2 & HEAP_NATTS_MASK, infomask, infomask2, hoff);
+}
+
+// "blkref #0: blk 12 FPW, #1: vm blk 0"
+void AppendBlocks(std::string &out, const WalDecodedRecord &rec) {
+  for (size_t i = 0; i < rec.Blocks.size(); i++) {
+    const WalDecodedBlock &b = rec.Blocks[i];
+    out += i == 0 ? (out.empty() ? "blkref #" : "; blkref #") : ", #";
+    Appendf(out, "%u: ", b.Id);
+    if (b.Node.forkNum != 0)
+      Appendf(out, "%s ", WalForkName(b.Node.forkNum));
+    Appendf(out, "blk %u", b.Node.blockNum);
+    if (b.Node.hasImage)
+      out += " FPW";
+    if (b.WillInit)
+      out += " (init)";
+  }
+}
+
+void DescribeHeap(const WalDecodedRecord &rec, int /*version*/,
+                  std::string &out) {
+  Body d = MainData(rec);
+  uint32_t xmax, new_xmax;
+  uint16_t off, new_off;
+  uint8_t infobits, flags;
+  switch (rec.Info & XLOG_HEAP_OPMASK) {
+  case XLOG_HEAP_INSERT:
+    if (d.Get(0, off) && d.Get(2, flags))
+      Appendf(out, "off: %u, flags: 0x%02X", off, flags);
+    AppendTupleHeader(out, BlockData(rec, 0), 0);
+    break;
+  case XLOG_HEAP_DELETE:
+    if (d.Get(0, xmax) && d.Get(4, off) && d.Get(6, infobits) &&
+        d.Get(7, flags)) {
+      Appendf(out, "xmax: %u, off: %u, infobits: ", xmax, off);
+      AppendInfobits(out, infobits);
+      Appendf(out, ", flags: 0x%02X", flags);
+    }
+    break;
+  case XLOG_HEAP_UPDATE:
+  case XLOG_HEAP_HOT_UPDATE: {
+    if (!d.Get(0, xmax) || !d.Get(4, off) || !d.Get(6, infobits) ||
+        !d.Get(7, flags) || !d.Get(8, new_xmax) || !d.Get(12, new_off))
+      break;
+    Appendf(out, "old_xmax: %u, old_off: %u, old_infobits: ", xmax, off);
+    AppendInfobits(out, infobits);
+    Appendf(out, ", flags: 0x%02X, new_xmax: %u, new_off: %u", flags,
+            new_xmax, new_off);
+    // The new tuple's data may reuse a prefix and suffix of the old one
+    Body data = BlockData(rec, 0);
+    uint32_t pos = 0;
+    uint16_t len;
+    if ((flags & XLH_UPDATE_PREFIX_FROM_OLD) && data.Get(pos, len)) {
+      Appendf(out, ", prefix: %u", len);
+      pos += 2;
+    }
+    if ((flags & XLH_UPDATE_SUFFIX_FROM_OLD) && data.Get(pos, len)) {
+      Appendf(out, ", suffix: %u", len);
+      pos += 2;
+    }
+    AppendTupleHeader(out, data, pos);
+    if (flags & XLH_UPDATE_CONTAINS_OLD_TUPLE)
+      out += ", old tuple";
+    else if (flags & XLH_UPDATE_CONTAINS_OLD_KEY)
+      out += ", old key";
+    // Block 0 is the new tuple's page, block 1 the old one's if another
+    const WalDecodedBlock *new_blk = FindBlock(rec, 0);
+    const WalDecodedBlock *old_blk = FindBlock(rec, 1);
+    if (new_blk && old_blk)
+      Appendf(out, ", blk: %u -> %u", old_blk->Node.blockNum,
+              new_blk->Node.blockNum);
+    else if (new_blk)
+      Appendf(out, ", blk: %u (same page)", new_blk->Node.blockNum);
+    return; // Blocks done
+  }
+  case XLOG_HEAP_TRUNCATE: {
+    uint32_t db, nrelids;
+    if (!d.Get(0, db) || !d.Get(4, nrelids) || !d.Get(8, flags))
+      break;
+    Appendf(out, "%s%snrelids: %u, relids:",
+            flags & XLH_TRUNCATE_CASCADE ? "cascade, " : "",
+            flags & XLH_TRUNCATE_RESTART_SEQS ? "restart_seqs, " : "",
+            nrelids);
+    for (uint32_t i = 0; i < nrelids && i < 16; i++) {
+      uint32_t relid;
+      if (d.Get(12 + i * 4, relid))
+        Appendf(out, " %u", relid);
+    }
+    if (nrelids > 16)
+      out += " ...";
+    break;
+  }
+  case XLOG_HEAP_CONFIRM:
+  case XLOG_HEAP_INPLACE:
+    if (d.Get(0, off))
+      Appendf(out, "off: %u", off);
+    break;
+  case XLOG_HEAP_LOCK:
+    if (d.Get(0, xmax) && d.Get(4, off) && d.Get(6, infobits) &&
+        d.Get(7, flags)) {
+      Appendf(out, "xmax: %u, off: %u, infobits: ", xmax, off);
+      AppendInfobits(out, infobits);
+      Appendf(out, ", flags: 0x%02X", flags);
+    }
+    break;
+  }
+  AppendBlocks(out, rec);
+}
+
+// PostgreSQL 17 merged pruning, vacuuming and freezing into one record:
+// xl_heap_prune in the main data, the arrays in block 0's data.
+void DescribePrune17(const WalDecodedRecord &rec, std::string &out) {
+  Body d = MainData(rec);
+  uint8_t flags;
+  if (!d.Get(1, flags))
+    return;
+  uint32_t horizon;
+  if ((flags & XLHP_HAS_CONFLICT_HORIZON) && d.Get(SizeOfHeapPrune, horizon))
+    Appendf(out, "snapshotConflictHorizon: %u, ", horizon);
+  Appendf(out, "isCatalogRel: %c, cleanupLock: %c",
+          flags & XLHP_IS_CATALOG_REL ? 'T' : 'F',
+          flags & XLHP_CLEANUP_LOCK ? 'T' : 'F');
+
+  Body data = BlockData(rec, 0);
+  uint32_t pos = 0;
+  uint16_t nplans = 0, nredirected = 0, ndead = 0, nunused = 0;
+  if ((flags & XLHP_HAS_FREEZE_PLANS) && data.Get(pos, nplans))
+    pos += 4 + nplans * SizeOfFreezePlan; // Plans are 4-byte aligned
+  if ((flags & XLHP_HAS_REDIRECTIONS) && data.Get(pos, nredirected))
+    pos += 2 + nredirected * 4; // Pairs of offsets
+  if ((flags & XLHP_HAS_DEAD_ITEMS) && data.Get(pos, ndead))
+    pos += 2 + ndead * 2;
+  if (flags & XLHP_HAS_NOW_UNUSED_ITEMS)
+    data.Get(pos, nunused);
+  Appendf(out, ", nplans: %u, nredirected: %u, ndead: %u, nunused: %u",
+          nplans, nredirected, ndead, nunused);
+}
+
+void DescribeHeap2(const WalDecodedRecord &rec, int version,
+                   std::string &out) {
+  Body d = MainData(rec);
+  uint32_t xid, a, b, c;
+  uint16_t n, m;
+  uint8_t flags, infobits;
+  uint8_t op = rec.Info & XLOG_HEAP_OPMASK;
+  if (version >= 17 && op >= XLOG_HEAP2_PRUNE &&
+      op <= XLOG_HEAP2_FREEZE_PAGE) {
+    DescribePrune17(rec, out);
+    AppendBlocks(out, rec);
+    return;
+  }
+  switch (op) {
+  case XLOG_HEAP2_REWRITE:
+    // xl_heap_rewrite_mapping: mapped_xid, mapped_db, mapped_rel, offset,
+    // num_mappings
+    if (d.Get(0, xid) && d.Get(4, a) && d.Get(8, b) && d.Get(24, c))
+      Appendf(out, "mapped_xid: %u, mapped_db: %u, mapped_rel: %u, "
+                   "num_mappings: %u",
+              xid, a, b, c);
+    break;
+  case XLOG_HEAP2_PRUNE:
+    if (d.Get(0, xid) && d.Get(4, n) && d.Get(6, m))
+      Appendf(out, "snapshotConflictHorizon: %u, nredirected: %u, "
+                   "ndead: %u",
+              xid, n, m);
+    break;
+  case XLOG_HEAP2_VACUUM:
+    if (d.Get(0, n))
+      Appendf(out, "nunused: %u", n);
+    break;
+  case XLOG_HEAP2_FREEZE_PAGE:
+    // PostgreSQL 16 went from freezing tuple by tuple to freeze plans
+    if (d.Get(0, xid) && d.Get(4, n))
+      Appendf(out, "snapshotConflictHorizon: %u, %s: %u", xid,
+              version >= 16 ? "nplans" : "ntuples", n);
+    break;
+  case XLOG_HEAP2_VISIBLE:
+    if (d.Get(0, xid) && d.Get(4, flags))
+      Appendf(out, "snapshotConflictHorizon: %u, flags: 0x%02X", xid, flags);
+    break;
+  case XLOG_HEAP2_MULTI_INSERT:
+    if (d.Get(0, flags) && d.Get(2, n))
+      Appendf(out, "ntuples: %u, flags: 0x%02X", n, flags);
+    break;
+  case XLOG_HEAP2_LOCK_UPDATED:
+    if (d.Get(0, xid) && d.Get(4, n) && d.Get(6, infobits) &&
+        d.Get(7, flags)) {
+      Appendf(out, "xmax: %u, off: %u, infobits: ", xid, n);
+      AppendInfobits(out, infobits);
+      Appendf(out, ", flags: 0x%02X", flags);
+    }
+    break;
+  case XLOG_HEAP2_NEW_CID: {
+    // xl_heap_new_cid: top_xid, cmin, cmax, combocid, target locator,
+    // target tid
+    uint32_t cmin, cmax, combo, spc, db, rel;
+    uint16_t blk_hi, blk_lo, tid_off;
+    if (d.Get(4, cmin) && d.Get(8, cmax) && d.Get(12, combo) &&
+        d.Get(16, spc) && d.Get(20, db) && d.Get(24, rel) &&
+        d.Get(28, blk_hi) && d.Get(30, blk_lo) && d.Get(32, tid_off))
+      Appendf(out, "rel: %u/%u/%u, tid: %u/%u, cmin: %u, cmax: %u, "
+                   "combo: %u",
+              spc, db, rel, ((uint32_t)blk_hi << 16) | blk_lo, tid_off,
+              cmin, cmax, combo);
+    break;
+  }
+  }
+  AppendBlocks(out, rec);
+}
+
+void DescribeBtree(const WalDecodedRecord &rec, int version,
+                   std::string &out) {
+  Body d = MainData(rec);
+  uint32_t a, b, c, e, level;
+  uint16_t n, m, k;
+  uint8_t catalog;
+  switch (rec.Info & 0xF0) {
+  case XLOG_BTREE_INSERT_LEAF:
+  case XLOG_BTREE_INSERT_UPPER:
+  case XLOG_BTREE_INSERT_META:
+  case XLOG_BTREE_INSERT_POST:
+    if (d.Get(0, n))
+      Appendf(out, "off: %u", n);
+    break;
+  case XLOG_BTREE_SPLIT_L:
+  case XLOG_BTREE_SPLIT_R:
+    if (d.Get(0, level) && d.Get(4, n) && d.Get(6, m) && d.Get(8, k))
+      Appendf(out, "level: %u, firstrightoff: %u, newitemoff: %u, "
+                   "postingoff: %u",
+              level, n, m, k);
+    break;
+  case XLOG_BTREE_DEDUP:
+    if (d.Get(0, n))
+      Appendf(out, "nintervals: %u", n);
+    break;
+  case XLOG_BTREE_DELETE:
+    if (d.Get(0, a) && d.Get(4, n) && d.Get(6, m)) {
+      Appendf(out, "snapshotConflictHorizon: %u, ndeleted: %u, nupdated: %u",
+              a, n, m);
+      if (version >= 16 && d.Get(8, catalog))
+        Appendf(out, ", isCatalogRel: %c", catalog ? 'T' : 'F');
+    }
+    break;
+  case XLOG_BTREE_VACUUM:
+    if (d.Get(0, n) && d.Get(2, m))
+      Appendf(out, "ndeleted: %u, nupdated: %u", n, m);
+    break;
+  case XLOG_BTREE_MARK_PAGE_HALFDEAD:
+    // poffset, then the blocks 4-byte aligned
+    if (d.Get(4, a) && d.Get(8, b) && d.Get(12, c) && d.Get(16, e))
+      Appendf(out, "topparent: %u, leaf: %u, left: %u, right: %u", e, a, b,
+              c);
+    break;
+  case XLOG_BTREE_UNLINK_PAGE:
+  case XLOG_BTREE_UNLINK_PAGE_META: {
+    uint32_t xid, epoch, leafleft, leafright, leaftop;
+    if (d.Get(0, a) && d.Get(4, b) && d.Get(8, level) && d.Get(16, xid) &&
+        d.Get(20, epoch) && d.Get(24, leafleft) && d.Get(28, leafright) &&
+        d.Get(32, leaftop))
+      Appendf(out, "left: %u, right: %u, level: %u, safexid: %u:%u, "
+                   "leafleft: %u, leafright: %u, leaftopparent: %u",
+              a, b, level, epoch, xid, leafleft, leafright, leaftop);
+    break;
+  }
+  case XLOG_BTREE_NEWROOT:
+    if (d.Get(0, a) && d.Get(4, level))
+      Appendf(out, "root: %u, level: %u", a, level);
+    break;
+  case XLOG_BTREE_REUSE_PAGE: {
+    uint32_t xid, epoch;
+    if (d.Get(0, a) && d.Get(4, b) && d.Get(8, c) && d.Get(16, xid) &&
+        d.Get(20, epoch)) {
+      Appendf(out, "rel: %u/%u/%u, snapshotConflictHorizon: %u:%u", a, b, c,
+              epoch, xid);
+      if (version >= 16 && d.Get(24, catalog))
+        Appendf(out, ", isCatalogRel: %c", catalog ? 'T' : 'F');
+    }
+    break;
+  }
+  case XLOG_BTREE_META_CLEANUP: {
+    // xl_btree_metadata in block 0's data
+    Body meta = BlockData(rec, 0);
+    if (meta.Get(20, a))
+      Appendf(out, "last_cleanup_num_delpages: %u", a);
+    break;
+  }
+  }
+  AppendBlocks(out, rec);
+}
+
+WalRecordDescriber *Describers() {
+  static WalRecordDescriber describers[RM_MAX_ID + 1] = {};
+  static bool registered = false;
+  if (!registered) {
+    registered = true;
+    describers[RM_HEAP_ID] = DescribeHeap;
+    describers[RM_HEAP2_ID] = DescribeHeap2;
+    describers[RM_BTREE_ID] = DescribeBtree;
+  }
+  return describers;
+}
+
+} // namespace
+
+void WalRegisterRecordDescriber(uint8_t rmid, WalRecordDescriber describer) {
+  Describers()[rmid] = describer;
+}
+
+bool WalDescribeRecord(const WalDecodedRecord &rec, int version,
+                       std::string &out) {
+  WalRecordDescriber describer = Describers()[rec.RMID];
+  if (!describer)
+    return false;
+  describer(rec, version, out);
+  return true;
+}
+
+// --- WalRecordDescCache ---
+
+void WalRecordDescCache::SetSource(const WalSparseSegment *segment,
+                                   uint64_t base_lsn) {
+  segment_ = segment;
+  base_lsn_ = base_lsn;
+  lru_.clear();
+  index_.clear();
+}
+
+const std::string &WalRecordDescCache::Get(const WalRecordInfo &rec) {
+  auto it = index_.find(rec.LSN);
+  if (it != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->Text;
+  }
+
+  // Misses are kept too, so a row without a describer is looked at once
+  lru_.push_front({rec.LSN, std::string()});
+  index_[rec.LSN] = lru_.begin();
+  std::string &text = lru_.front().Text;
+  uint16_t magic = 0;
+  if (segment_ && rec.LSN >= base_lsn_ &&
+      rec.LSN - base_lsn_ < segment_->Size() &&
+      segment_->Read(rec.Offset - rec.Offset % WAL_PAGE_SIZE, &magic, 2) ==
+          2 &&
+      WalReadRecordBytes(*segment_, rec.Offset, rec.Length, bytes_) &&
+      WalDecodeRecord(bytes_.data(), rec.Length, decoded_))
+    WalDescribeRecord(decoded_, WalVersionForPageMagic(magic), text);
+
+  while (lru_.size() > capacity_) {
+    index_.erase(lru_.back().LSN);
+    lru_.pop_back();
+  }
+  return text;
+}
+
+size_t WalRecordDescCache::MemoryUsage() const {
+  // A list node and a hash node per entry, plus the text
+  size_t bytes = index_.bucket_count() * sizeof(void *) + bytes_.capacity();
+  for (const Entry &e : lru_)
+    bytes += sizeof(Entry) + 6 * sizeof(void *) +
+             (e.Text.capacity() > 15 ? e.Text.capacity() + 1 : 0);
+  return bytes;
+}
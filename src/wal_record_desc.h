@@ -0,0 +1,60 @@
+#pragma once
+#include "wal_parser.h"
+#include "wal_record_decode.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What a record's body says beyond its op name, as pg_waldump shows it:
+// offsets, flags, xmax and infomask bits, split points, block numbers.
+// Describers are registered per resource manager; Heap, Heap2 and Btree
+// come built in. Decoding a body costs a few microseconds, so the record
+// list only asks for the rows on screen, through a bounded cache.
+
+// Appends to out. version is the PostgreSQL major version that wrote the
+// WAL (from the page magic), for bodies that changed between versions.
+using WalRecordDescriber = void (*)(const WalDecodedRecord &rec, int version,
+                                    std::string &out);
+
+// Replaces the describer of rmid; nullptr removes it.
+void WalRegisterRecordDescriber(uint8_t rmid, WalRecordDescriber describer);
+// False if no describer is registered for the record's resource manager.
+bool WalDescribeRecord(const WalDecodedRecord &rec, int version,
+                       std::string &out);
+
+class WalSparseSegment;
+
+// Descriptions of the records of one segment, decoded on first ask and
+// kept for the `capacity` most recently asked, by LSN.
+class WalRecordDescCache {
+public:
+  explicit WalRecordDescCache(size_t capacity = 4096)
+      : capacity_(capacity) {}
+
+  // Where the bytes of the records come from: a segment starting at
+  // base_lsn. Records outside it (e.g. those a tail took from earlier
+  // segments) get no description. Empties the cache.
+  void SetSource(const WalSparseSegment *segment, uint64_t base_lsn);
+  // "" if the record has no describer or its bytes aren't held.
+  const std::string &Get(const WalRecordInfo &rec);
+
+  size_t Size() const { return lru_.size(); }
+  size_t MemoryUsage() const;
+
+private:
+  struct Entry {
+    uint64_t LSN;
+    std::string Text;
+  };
+
+  const WalSparseSegment *segment_ = nullptr;
+  uint64_t base_lsn_ = 0;
+  size_t capacity_;
+  std::list<Entry> lru_; // Most recently asked first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  std::vector<uint8_t> bytes_;
+  WalDecodedRecord decoded_;
+};
@@ -0,0 +1,177 @@
+#include "wal_record_table.h"
+#include "wal_perf.h"
+#include <cstdio>
+
+static WalParser rmid_names; // Only for GetRmidName()
+
+static const std::string *FindName(const std::map<uint32_t, std::string> *m,
+                                   uint32_t id) {
+  if (!m)
+    return nullptr;
+  auto it = m->find(id);
+  return it == m->end() ? nullptr : &it->second;
+}
+
+void DrawWalRecordTable(const std::vector<WalRecordInfo> &records,
+                        const std::vector<uint32_t> &indices,
+                        const WalRecordTableNames &names,
+                        const WalXactIndex *xacts, uint32_t highlighted_xid,
+                        WalRecordDescCache *details, bool &scroll_to_bottom,
+                        const ImVec2 &size, WalRecordTableAction &action) {
+  if (!ImGui::BeginTable("WalRecords", 6,
+                         ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                             ImGuiTableFlags_ScrollY |
+                             ImGuiTableFlags_Resizable,
+                         size))
+    return;
+
+  ImGui::TableSetupScrollFreeze(0, 1); // Make top row always visible
+  // Increased widths by ~50-80%
+  ImGui::TableSetupColumn("LSN", ImGuiTableColumnFlags_WidthFixed, 150.0f);
+  ImGui::TableSetupColumn("RMID", ImGuiTableColumnFlags_WidthFixed, 160.0f);
+  ImGui::TableSetupColumn("Info", ImGuiTableColumnFlags_WidthFixed, 80.0f);
+  ImGui::TableSetupColumn("Length", ImGuiTableColumnFlags_WidthFixed, 80.0f);
+  ImGui::TableSetupColumn("RelNode", ImGuiTableColumnFlags_WidthFixed,
+                          350.0f);
+  ImGui::TableSetupColumn("Description", ImGuiTableColumnFlags_WidthStretch);
+  ImGui::TableHeadersRow();
+
+  // Only the visible rows of the filtered set are submitted.
+  ImGuiListClipper clipper;
+  clipper.Begin((int)indices.size());
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+      const WalRecordInfo &rec = records[indices[row]];
+
+      ImGui::TableNextRow();
+
+      // Highlight XID logic
+      const WalXactStatus *xact =
+          xacts && rec.XID != 0 ? xacts->Find(rec.XID) : nullptr;
+      if (highlighted_xid != 0 && rec.XID == highlighted_xid) {
+        ImGui::TableSetBgColor(
+            ImGuiTableBgTarget_RowBg0,
+            ImGui::GetColorU32(
+                ImVec4(0.3f, 0.3f, 0.2f, 0.6f))); // Yellow-ish tint
+      } else if (xact && xact->Outcome != WalXactOutcome::Committed) {
+        // Committed is the usual case and stays plain
+        ImVec4 tint = xact->Outcome == WalXactOutcome::Aborted
+                          ? ImVec4(0.45f, 0.15f, 0.15f, 0.5f)
+                      : xact->Outcome == WalXactOutcome::Prepared
+                          ? ImVec4(0.15f, 0.25f, 0.45f, 0.5f)
+                          : ImVec4(0.35f, 0.3f, 0.1f, 0.35f);
+        ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg0,
+                               ImGui::GetColorU32(tint));
+      }
+
+      // Make row selectable
+      ImGui::TableNextColumn();
+      char lsnBuf[32];
+      snprintf(lsnBuf, 32, "%lX", rec.LSN);
+
+      // We use a unique ID for selectable to allow multiple items with same
+      // XID to be handled separately if needed, but here we just need to
+      // detect click. Note: Selectable returns true on click.
+      bool is_selected = (rec.XID != 0 && rec.XID == highlighted_xid);
+      if (ImGui::Selectable(lsnBuf, is_selected,
+                            ImGuiSelectableFlags_SpanAllColumns))
+        action.Selected = &rec;
+
+      // Context Menu
+      if (ImGui::BeginPopupContextItem()) {
+        if (ImGui::MenuItem("Show Hexdump")) {
+          action.Selected = &rec;
+          action.ShowHexdump = true;
+        }
+        if (rec.RMID == RM_HEAP_ID && ImGui::MenuItem("Show Columns")) {
+          action.Selected = &rec;
+          action.ShowColumns = true;
+        }
+        ImGui::EndPopup();
+      }
+
+      ImGui::TableNextColumn();
+      // Show Name only
+      ImGui::Text("%s", rmid_names.GetRmidName(rec.RMID).c_str());
+
+      ImGui::TableNextColumn();
+      ImGui::Text("%02X", rec.Info);
+
+      ImGui::TableNextColumn();
+      ImGui::Text("%u", rec.Length);
+
+      ImGui::TableNextColumn();
+      if (rec.RelFileNodes.empty()) {
+        ImGui::Text("-");
+      } else {
+        WalPerfScope perf(WalPerfSection::RelNames);
+        std::string s;
+        for (size_t i = 0; i < rec.RelFileNodes.size(); ++i) {
+          const WalRelFileNode &node = rec.RelFileNodes[i];
+          if (i > 0)
+            s += ", "; // Keep rows single-line for the clipper
+
+          const std::string *db = FindName(names.DbNames, node.dbNode);
+          const std::string *rel = nullptr;
+          const std::string *rel_oid = nullptr;
+          if (names.Rels) {
+            if (const WalRelName *r = names.Rels->Find(node.dbNode,
+                                                       node.relNode))
+              rel = &r->Name;
+            else if ((r = names.Rels->FindOid(node.dbNode, node.relNode)))
+              rel_oid = &r->Name;
+          }
+          if (names.ShowRawIds) {
+            // spc/db(Name)/rel(Name)
+            s += std::to_string(node.spcNode) + "/";
+            s += std::to_string(node.dbNode);
+            if (db)
+              s += "(" + *db + ")";
+            s += "/";
+            s += std::to_string(node.relNode);
+            if (rel)
+              s += "(" + *rel + ")";
+            else if (rel_oid)
+              s += "(" + *rel_oid + "*)"; // * indicates OID match
+          } else {
+            // Simplified view: db_name:rel_name
+            s += db ? *db : std::to_string(node.dbNode);
+            s += ":";
+            if (rel)
+              s += *rel;
+            else if (rel_oid)
+              s += *rel_oid + "*";
+            else
+              s += std::to_string(node.relNode);
+          }
+        }
+        ImGui::Text("%s", s.c_str());
+      }
+
+      ImGui::TableNextColumn();
+      ImGui::Text("%s", rec.Description.c_str());
+      if (details) {
+        const std::string &detail = details->Get(rec);
+        if (!detail.empty()) {
+          ImGui::SameLine();
+          ImGui::TextUnformatted(detail.c_str());
+        }
+      }
+      // Maybe append XID here?
+      if (rec.XID != 0)
+        ImGui::SameLine();
+      ImGui::TextColored(ImVec4(0.7f, 0.7f, 1, 1), "XID: %u", rec.XID);
+      if (xact) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(%s)", WalXactOutcomeName(xact->Outcome));
+      }
+    }
+  }
+
+  if (scroll_to_bottom) {
+    ImGui::SetScrollHereY(1.0f);
+    scroll_to_bottom = false;
+  }
+
+  ImGui::EndTable();
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "wal_parser.h"
+#include "wal_record_desc.h"
+#include "wal_rel_names.h"
+#include "wal_xact.h"
+#include <imgui.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// The record list of the main window, shared with the UI benchmark so both
+// draw the same rows.
+
+// Catalog names shown in the RelNode column.
+struct WalRecordTableNames {
+  const std::map<uint32_t, std::string> *DbNames;
+  // By relfilenode, else by OID (marked *), within the record's database
+  const WalRelNameMap *Rels;
+  bool ShowRawIds;
+};
+
+// What the user did in the table this frame.
+struct WalRecordTableAction {
+  const WalRecordInfo *Selected = nullptr; // Clicked row
+  bool ShowHexdump = false; // Picked "Show Hexdump" on the selected row
+  bool ShowColumns = false; // Picked "Show Columns" on a Heap row
+};
+
+// Draws the rows of records listed in indices; only the visible ones are
+// submitted. Rows of highlighted_xid are tinted, the others by the outcome
+// of their transaction in xacts (may be null). The visible rows' bodies
+// are described through details (may be null). scroll_to_bottom is
+// cleared once the table has scrolled to its last row.
+void DrawWalRecordTable(const std::vector<WalRecordInfo> &records,
+                        const std::vector<uint32_t> &indices,
+                        const WalRecordTableNames &names,
+                        const WalXactIndex *xacts, uint32_t highlighted_xid,
+                        WalRecordDescCache *details, bool &scroll_to_bottom,
+                        const ImVec2 &size, WalRecordTableAction &action);
@@ -0,0 +1,98 @@
+#include "wal_rel_names.h"
+
+static size_t SlotFor(uint64_t key, size_t mask) {
+  // Fibonacci hashing; relfilenodes are dense, so spread them
+  return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+void WalRelNameMap::Clear() {
+  rels_.clear();
+  by_node_.clear();
+  by_oid_.clear();
+  namespaces_.clear();
+}
+
+const WalRelNameMap::Slot *
+WalRelNameMap::Probe(const std::vector<Slot> &table, uint64_t key) {
+  if (table.empty())
+    return nullptr;
+  size_t mask = table.size() - 1;
+  for (size_t i = SlotFor(key, mask);; i = (i + 1) & mask) {
+    const Slot &slot = table[i];
+    if (slot.Index == 0)
+      return nullptr;
+    if (slot.Key == key)
+      return &slot;
+  }
+}
+
+bool WalRelNameMap::Insert(std::vector<Slot> &table, uint64_t key,
+                           uint32_t index) {
+  size_t mask = table.size() - 1;
+  for (size_t i = SlotFor(key, mask);; i = (i + 1) & mask) {
+    Slot &slot = table[i];
+    if (slot.Index == 0) {
+      slot = {key, index + 1};
+      return true;
+    }
+    if (slot.Key == key)
+      return false;
+  }
+}
+
+void WalRelNameMap::Grow() {
+  // Kept at most half full, so probe runs stay short
+  size_t size = by_node_.empty() ? 1024 : by_node_.size() * 2;
+  by_node_.assign(size, Slot{0, 0});
+  by_oid_.assign(size, Slot{0, 0});
+  for (uint32_t i = 0; i < rels_.size(); i++) {
+    const WalRelName &rel = rels_[i];
+    Insert(by_node_, WalRelKey(rel.Database, rel.RelFileNode), i);
+    Insert(by_oid_, WalRelKey(rel.Database, rel.Oid), i);
+  }
+}
+
+void WalRelNameMap::Add(uint32_t db, uint32_t relfilenode, uint32_t oid,
+                        uint32_t namespace_oid, const std::string &name) {
+  if ((rels_.size() + 1) * 2 > by_node_.size())
+    Grow();
+  uint32_t index = (uint32_t)rels_.size();
+  bool new_node = Insert(by_node_, WalRelKey(db, relfilenode), index);
+  bool new_oid = Insert(by_oid_, WalRelKey(db, oid), index);
+  if (new_node || new_oid)
+    rels_.push_back({db, relfilenode, oid, namespace_oid, name});
+}
+
+void WalRelNameMap::AddNamespace(uint32_t db, uint32_t oid,
+                                 const std::string &name) {
+  namespaces_.emplace(WalRelKey(db, oid), name);
+}
+
+const WalRelName *WalRelNameMap::Find(uint32_t db,
+                                      uint32_t relfilenode) const {
+  const Slot *slot = Probe(by_node_, WalRelKey(db, relfilenode));
+  return slot ? &rels_[slot->Index - 1] : nullptr;
+}
+
+const WalRelName *WalRelNameMap::FindOid(uint32_t db, uint32_t oid) const {
+  const Slot *slot = Probe(by_oid_, WalRelKey(db, oid));
+  return slot ? &rels_[slot->Index - 1] : nullptr;
+}
+
+const std::string *WalRelNameMap::NamespaceName(uint32_t db,
+                                                uint32_t oid) const {
+  auto it = namespaces_.find(WalRelKey(db, oid));
+  return it == namespaces_.end() ? nullptr : &it->second;
+}
+
+size_t WalRelNameMap::MemoryUsage() const {
+  size_t bytes = rels_.capacity() * sizeof(WalRelName) +
+                 (by_node_.capacity() + by_oid_.capacity()) * sizeof(Slot);
+  for (const WalRelName &rel : rels_) {
+    if (rel.Name.capacity() > 15)
+      bytes += rel.Name.capacity() + 1;
+  }
+  // Rough: a red-black tree node plus the string
+  bytes += namespaces_.size() * (4 * sizeof(void *) + sizeof(std::string) + 8);
+  return bytes;
+}
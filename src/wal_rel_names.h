@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Relation names of a whole cluster, keyed the way WAL block references
+// name relations: by database OID and relfilenode. Shared catalogs live
+// under database 0, as in WAL. Relations can also be looked up by OID
+// within a database, for records that carry OIDs instead.
+//
+// Both lookups are open-addressing hash tables over the combined 64-bit
+// key, probed linearly, so a record table row costs a couple of cache
+// misses however many databases are loaded.
+
+struct WalRelName {
+  uint32_t Database;
+  uint32_t RelFileNode;
+  uint32_t Oid;
+  uint32_t Namespace;
+  std::string Name;
+};
+
+// (database OID, relfilenode or OID) as one key, also used by filters.
+inline uint64_t WalRelKey(uint32_t db, uint32_t rel) {
+  return ((uint64_t)db << 32) | rel;
+}
+
+class WalRelNameMap {
+public:
+  void Clear();
+  // Where a key is added twice the first relation wins, so callers add
+  // the most trustworthy rows first.
+  void Add(uint32_t db, uint32_t relfilenode, uint32_t oid,
+           uint32_t namespace_oid, const std::string &name);
+  void AddNamespace(uint32_t db, uint32_t oid, const std::string &name);
+
+  const WalRelName *Find(uint32_t db, uint32_t relfilenode) const;
+  const WalRelName *FindOid(uint32_t db, uint32_t oid) const;
+  const std::string *NamespaceName(uint32_t db, uint32_t oid) const;
+
+  const std::vector<WalRelName> &Relations() const { return rels_; }
+  // (database << 32 | OID) -> nspname
+  const std::map<uint64_t, std::string> &Namespaces() const {
+    return namespaces_;
+  }
+  size_t Size() const { return rels_.size(); }
+  size_t MemoryUsage() const;
+
+private:
+  // Slots hold the key and 1 + the index into rels_; 0 marks a free slot.
+  struct Slot {
+    uint64_t Key;
+    uint32_t Index;
+  };
+  static const Slot *Probe(const std::vector<Slot> &table, uint64_t key);
+  static bool Insert(std::vector<Slot> &table, uint64_t key, uint32_t index);
+  void Grow();
+
+  std::vector<WalRelName> rels_;
+  std::vector<Slot> by_node_;
+  std::vector<Slot> by_oid_;
+  std::map<uint64_t, std::string> namespaces_;
+};
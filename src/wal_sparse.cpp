@@ -0,0 +1,176 @@
+#include "wal_sparse.h"
+#include "wal_parser.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define WAL_SPARSE_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if (defined(__x86_64__) || defined(__i386__)) &&                             \
+    (defined(__GNUC__) || defined(__clang__))
+#define WAL_SPARSE_HAVE_AVX2_PATH 1
+#include <immintrin.h>
+#endif
+
+static bool IsZeroScalar(const uint8_t *p, size_t len) {
+  uint64_t acc = 0;
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    acc |= v;
+    p += 8;
+    len -= 8;
+  }
+  while (len--)
+    acc |= *p++;
+  return acc == 0;
+}
+
+#ifdef WAL_SPARSE_HAVE_SSE2
+static bool IsZeroSse2(const uint8_t *p, size_t len) {
+  // OR 64 bytes together per check; WAL pages are either zero from the
+  // start or not zero early on, so the early exit rarely matters.
+  while (len >= 64) {
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(p + 32));
+    __m128i d = _mm_loadu_si128((const __m128i *)(p + 48));
+    __m128i v = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF)
+      return false;
+    p += 64;
+    len -= 64;
+  }
+  return IsZeroScalar(p, len);
+}
+#endif
+
+#ifdef WAL_SPARSE_HAVE_AVX2_PATH
+__attribute__((target("avx2"))) static bool IsZeroAvx2(const uint8_t *p,
+                                                       size_t len) {
+  while (len >= 128) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i *)(p + 64));
+    __m256i d = _mm256_loadu_si256((const __m256i *)(p + 96));
+    __m256i v = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+    if (!_mm256_testz_si256(v, v))
+      return false;
+    p += 128;
+    len -= 128;
+  }
+  return IsZeroScalar(p, len);
+}
+#endif
+
+bool WalIsZero(const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+#ifdef WAL_SPARSE_HAVE_AVX2_PATH
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  if (have_avx2)
+    return IsZeroAvx2(p, len);
+#endif
+#ifdef WAL_SPARSE_HAVE_SSE2
+  return IsZeroSse2(p, len);
+#else
+  return IsZeroScalar(p, len);
+#endif
+}
+
+void WalSparseSegment::Assign(std::vector<uint8_t> &&data) {
+  size_ = data.size();
+  size_t page_count = (size_ + WAL_PAGE_SIZE - 1) / WAL_PAGE_SIZE;
+  slots_.assign(page_count, -1);
+  // A short last page is padded so every slot is a whole page
+  data.resize(page_count * WAL_PAGE_SIZE);
+
+  size_t stored = 0;
+  zero_pages_ = 0;
+  for (size_t page = 0; page < page_count; page++) {
+    const uint8_t *src = data.data() + page * WAL_PAGE_SIZE;
+    if (WalIsZero(src, WAL_PAGE_SIZE)) {
+      zero_pages_++;
+      continue;
+    }
+    if (stored != page)
+      memmove(data.data() + stored * WAL_PAGE_SIZE, src, WAL_PAGE_SIZE);
+    slots_[page] = (int32_t)stored++;
+  }
+  data.resize(stored * WAL_PAGE_SIZE);
+  data.shrink_to_fit();
+  pages_ = std::move(data);
+
+  dense_pages_ = 0;
+  while (dense_pages_ < page_count &&
+         slots_[dense_pages_] == (int32_t)dense_pages_)
+    dense_pages_++;
+}
+
+void WalSparseSegment::Reset(size_t size) {
+  Clear();
+  size_ = size;
+  slots_.assign((size + WAL_PAGE_SIZE - 1) / WAL_PAGE_SIZE, -1);
+  zero_pages_ = slots_.size();
+}
+
+void WalSparseSegment::Clear() {
+  std::vector<uint8_t>().swap(pages_);
+  std::vector<int32_t>().swap(slots_);
+  size_ = 0;
+  dense_pages_ = 0;
+  zero_pages_ = 0;
+}
+
+size_t WalSparseSegment::DenseSize() const {
+  return std::min(dense_pages_ * WAL_PAGE_SIZE, size_);
+}
+
+size_t WalSparseSegment::Read(size_t offset, void *out, size_t len) const {
+  if (offset >= size_)
+    return 0;
+  len = std::min(len, size_ - offset);
+  uint8_t *dst = (uint8_t *)out;
+  size_t done = 0;
+  while (done < len) {
+    size_t pos = offset + done;
+    size_t page = pos / WAL_PAGE_SIZE;
+    size_t in_page = pos % WAL_PAGE_SIZE;
+    size_t n = std::min(len - done, (size_t)WAL_PAGE_SIZE - in_page);
+    int32_t slot = slots_[page];
+    if (slot < 0)
+      memset(dst + done, 0, n);
+    else
+      memcpy(dst + done, pages_.data() + (size_t)slot * WAL_PAGE_SIZE + in_page,
+             n);
+    done += n;
+  }
+  return len;
+}
+
+void WalSparseSegment::Write(size_t offset, const void *in, size_t len) {
+  if (offset >= size_)
+    return;
+  len = std::min(len, size_ - offset);
+  const uint8_t *src = (const uint8_t *)in;
+  size_t done = 0;
+  while (done < len) {
+    size_t pos = offset + done;
+    size_t page = pos / WAL_PAGE_SIZE;
+    size_t in_page = pos % WAL_PAGE_SIZE;
+    size_t n = std::min(len - done, (size_t)WAL_PAGE_SIZE - in_page);
+    if (slots_[page] < 0) {
+      // Materialize the page. It goes at the end of pages_, so it only
+      // joins the dense run if every page before it is stored.
+      slots_[page] = (int32_t)(pages_.size() / WAL_PAGE_SIZE);
+      pages_.resize(pages_.size() + WAL_PAGE_SIZE);
+      zero_pages_--;
+      while (dense_pages_ < slots_.size() &&
+             slots_[dense_pages_] == (int32_t)dense_pages_)
+        dense_pages_++;
+    }
+    memcpy(pages_.data() + (size_t)slots_[page] * WAL_PAGE_SIZE + in_page,
+           src + done, n);
+    done += n;
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// True if len bytes at data are all zero. Vectorized (SSE2, or AVX2 when
+// the CPU has it).
+bool WalIsZero(const void *data, size_t len);
+
+// A segment held page by page, without its all-zero pages. A freshly
+// switched or preallocated segment is mostly zeroes, so this usually keeps
+// a small fraction of the file resident. Dropped pages read back as zeroes.
+//
+// Stored pages stay in page order, so the leading run of non-zero pages is
+// one contiguous buffer (DenseData(), DenseSize()). That is all the parser
+// needs: valid WAL ends at the first zero page anyway.
+class WalSparseSegment {
+public:
+  // Takes the bytes of a segment and drops its zero pages, compacting in
+  // place.
+  void Assign(std::vector<uint8_t> &&data);
+  // An all-zero segment of size bytes, to be filled in by Write() with the
+  // pages that were actually read.
+  void Reset(size_t size);
+  void Clear();
+
+  bool Empty() const { return size_ == 0; }
+  // Logical size, zero pages included.
+  size_t Size() const { return size_; }
+  size_t ResidentBytes() const { return pages_.capacity(); }
+  size_t ZeroPages() const { return zero_pages_; }
+  bool HasPage(size_t page) const {
+    return page < slots_.size() && slots_[page] >= 0;
+  }
+
+  const uint8_t *DenseData() const { return pages_.data(); }
+  // Bytes of the leading non-zero pages, never more than Size().
+  size_t DenseSize() const;
+
+  // Copies [offset, offset + len) into out, clamped to Size(). Returns the
+  // number of bytes copied.
+  size_t Read(size_t offset, void *out, size_t len) const;
+  // Overwrites bytes, storing a zero page once something is written to it.
+  void Write(size_t offset, const void *in, size_t len);
+
+private:
+  std::vector<uint8_t> pages_; // Stored pages, in page order
+  std::vector<int32_t> slots_; // Page -> index into pages_, -1 if zero
+  size_t size_ = 0;
+  size_t dense_pages_ = 0; // Leading pages with slot == page
+  size_t zero_pages_ = 0;
+};
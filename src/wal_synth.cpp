@@ -0,0 +1,324 @@
+#include "wal_synth.h"
+#include "crc32c.h"
+#include "wal_parser.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// On-disk layout, as in wal_parser.cpp
+#define XLP_FIRST_IS_CONTRECORD 0x0001
+#define XLP_LONG_HEADER 0x0002
+#define SizeOfXLogRecord 24
+#define XLR_BLOCK_ID_DATA_SHORT 255
+#define XLR_BLOCK_ID_DATA_LONG 254
+#define BKPBLOCK_HAS_IMAGE 0x10
+#define BKPBLOCK_HAS_DATA 0x20
+#define BKPIMAGE_HAS_HOLE 0x01
+#define BKPIMAGE_APPLY 0x02
+#define XLOG_NOOP 0x20
+#define XLOG_SWITCH 0x40
+#define MAXALIGN(LEN) (((uint64_t)(LEN) + 7) & ~(uint64_t)7)
+
+namespace {
+
+void Put16(std::vector<uint8_t> &v, uint16_t x) {
+  v.insert(v.end(), (const uint8_t *)&x, (const uint8_t *)&x + 2);
+}
+void Put32(std::vector<uint8_t> &v, uint32_t x) {
+  v.insert(v.end(), (const uint8_t *)&x, (const uint8_t *)&x + 4);
+}
+
+void WritePageHeader(uint8_t *page, uint16_t magic, bool long_header,
+                     uint16_t info, uint32_t tli, uint64_t pageaddr,
+                     uint32_t rem_len, uint64_t sysid, uint32_t seg_size) {
+  memcpy(page + 0, &magic, 2);
+  memcpy(page + 2, &info, 2);
+  memcpy(page + 4, &tli, 4);
+  memcpy(page + 8, &pageaddr, 8);
+  memcpy(page + 16, &rem_len, 4);
+  if (long_header) {
+    uint32_t blcksz = WAL_PAGE_SIZE;
+    memcpy(page + 24, &sysid, 8);
+    memcpy(page + 32, &seg_size, 4);
+    memcpy(page + 36, &blcksz, 4);
+  }
+}
+
+} // namespace
+
+WalSynthGenerator::WalSynthGenerator(const WalSynthOptions &options)
+    : options_(options), rng_(options.Seed) {
+  mix_ = options_.RmidMix;
+  if (mix_.empty())
+    mix_ = {{RM_HEAP_ID, 45},       {RM_BTREE_ID, 30}, {RM_HEAP2_ID, 10},
+            {RM_XACT_ID, 10},       {RM_STANDBY_ID, 3}, {RM_XLOG_ID, 2}};
+  for (const WalSynthRmidWeight &w : mix_)
+    mix_total_ += w.Weight;
+  segment_lsn_ = options_.StartLSN - options_.StartLSN % options_.SegmentSize;
+  page_.resize(WAL_PAGE_SIZE);
+  compressed_.resize(WAL_FPI_COMPRESS_BOUND(WAL_PAGE_SIZE));
+}
+
+uint64_t WalSynthGenerator::Random() {
+  // splitmix64: fast, and the same sequence everywhere, unlike <random>'s
+  // distributions
+  uint64_t z = (rng_ += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+double WalSynthGenerator::Uniform() {
+  return (Random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint32_t WalSynthGenerator::DataLen() {
+  // Box-Muller for the normal deviate
+  double u1 = Uniform(), u2 = Uniform();
+  double n = std::sqrt(-2.0 * std::log(1.0 - u1)) *
+             std::cos(6.283185307179586 * u2);
+  double len = options_.DataLenMedian * std::exp(options_.DataLenSigma * n);
+  if (len < 1)
+    return 1;
+  return len > options_.DataLenMax ? options_.DataLenMax : (uint32_t)len;
+}
+
+std::string WalSynthGenerator::NextSegmentName() const {
+  return WalFileNameForLSN(options_.Timeline, segment_lsn_,
+                           options_.SegmentSize);
+}
+
+// A heap page: header, line pointers, then tuples at the end that share
+// most of their bytes, so images compress about as well as real ones. The
+// free space between pd_lower and pd_upper is the hole.
+void WalSynthGenerator::BuildPageImage(uint64_t lsn) {
+  memset(page_.data(), 0, WAL_PAGE_SIZE);
+  uint16_t tuple_len = (uint16_t)(32 + Random() % 96);
+  uint16_t ntuples = (uint16_t)(1 + Random() % ((WAL_PAGE_SIZE - 24) /
+                                                 (MAXALIGN(tuple_len) + 4)));
+  uint16_t pd_lower = 24 + 4 * ntuples;
+  uint16_t pd_upper =
+      (uint16_t)(WAL_PAGE_SIZE - ntuples * MAXALIGN(tuple_len));
+  uint16_t pd_special = WAL_PAGE_SIZE;
+  uint16_t version = WAL_PAGE_SIZE | 4;
+  memcpy(&page_[0], &lsn, 8);
+  memcpy(&page_[12], &pd_lower, 2);
+  memcpy(&page_[14], &pd_upper, 2);
+  memcpy(&page_[16], &pd_special, 2);
+  memcpy(&page_[18], &version, 2);
+
+  uint8_t row[128];
+  for (size_t i = 0; i < sizeof(row); i++)
+    row[i] = (uint8_t)(Random() % 26 + 'a');
+  uint16_t off = pd_upper;
+  for (uint16_t t = 0; t < ntuples; t++) {
+    uint32_t lp = off | (1u << 15) | ((uint32_t)tuple_len << 17);
+    memcpy(&page_[24 + 4 * t], &lp, 4);
+    uint8_t *tup = &page_[off];
+    memcpy(tup, &xid_, 4); // t_xmin
+    memcpy(tup + 23, row, tuple_len - 23);
+    uint32_t key = (uint32_t)(Random() & 0xFFFF) + t;
+    memcpy(tup + 24, &key, 4); // A column that differs per row
+    off += (uint16_t)MAXALIGN(tuple_len);
+  }
+
+  // Image without the hole, and the header fields describing it. A full
+  // page has no hole, and then no hole offset either.
+  uint16_t hole_length = pd_upper - pd_lower;
+  uint16_t hole_offset = hole_length ? pd_lower : 0;
+  image_.assign(page_.begin(), page_.begin() + pd_lower);
+  image_.insert(image_.end(), page_.begin() + pd_upper, page_.end());
+
+  uint8_t bimg_info = BKPIMAGE_APPLY;
+  if (hole_length > 0)
+    bimg_info |= BKPIMAGE_HAS_HOLE;
+  int32_t clen = WalCompressPageImage(options_.FpiCompression, image_.data(),
+                                      (int32_t)image_.size(),
+                                      hole_length > 0, compressed_.data());
+  // XLogRecordBlockImageHeader, then the compress header if needed
+  std::vector<uint8_t> &r = record_;
+  if (clen >= 0) {
+    bimg_info |= WalFpiCompressionFlag(options_.FpiCompression);
+    Put16(r, (uint16_t)clen);
+    Put16(r, hole_offset);
+    r.push_back(bimg_info);
+    if (hole_length > 0)
+      Put16(r, hole_length);
+    image_.assign(compressed_.begin(), compressed_.begin() + clen);
+    fpis_compressed_++;
+  } else {
+    Put16(r, (uint16_t)image_.size());
+    Put16(r, hole_offset);
+    r.push_back(bimg_info);
+  }
+  fpis_++;
+}
+
+void WalSynthGenerator::BuildRecord(uint64_t lsn, bool switch_record) {
+  uint8_t rmid = RM_XLOG_ID, info = XLOG_NOOP;
+  uint32_t xid = 0;
+  bool has_block = false;
+  // Decoders read counts out of the main data of transaction and standby
+  // records (pg_waldump does too), so theirs stays zero
+  bool zero_main = true;
+  if (switch_record) {
+    info = XLOG_SWITCH;
+  } else {
+    double pick = Uniform() * mix_total_;
+    rmid = mix_.back().Rmid;
+    for (const WalSynthRmidWeight &w : mix_) {
+      if (pick < w.Weight) {
+        rmid = w.Rmid;
+        break;
+      }
+      pick -= w.Weight;
+    }
+    static const uint8_t heap_ops[] = {XLOG_HEAP_INSERT, XLOG_HEAP_INSERT,
+                                       XLOG_HEAP_UPDATE, XLOG_HEAP_HOT_UPDATE,
+                                       XLOG_HEAP_DELETE};
+    static const uint8_t heap2_ops[] = {XLOG_HEAP2_PRUNE,
+                                        XLOG_HEAP2_FREEZE_PAGE,
+                                        XLOG_HEAP2_MULTI_INSERT};
+    switch (rmid) {
+    case RM_HEAP_ID:
+      info = heap_ops[Random() % 5];
+      xid = xid_;
+      has_block = true;
+      zero_main = false;
+      break;
+    case RM_HEAP2_ID:
+      info = heap2_ops[Random() % 3];
+      xid = info == XLOG_HEAP2_MULTI_INSERT ? xid_ : 0;
+      has_block = true;
+      zero_main = false;
+      break;
+    case RM_BTREE_ID:
+      info = (uint8_t)((Random() % 3) << 4); // Leaf, upper, meta insert
+      xid = xid_;
+      has_block = true;
+      zero_main = false;
+      break;
+    case RM_XACT_ID:
+      info = Random() % 20 == 0 ? XLOG_XACT_ABORT : XLOG_XACT_COMMIT;
+      xid = xid_++;
+      break;
+    case RM_XLOG_ID:
+      info = XLOG_NOOP;
+      break;
+    default:
+      info = 0;
+      break;
+    }
+  }
+
+  record_.clear();
+  record_.resize(SizeOfXLogRecord); // Header filled in last
+  uint32_t block_data_len = 0;
+  bool fpi = false;
+  if (has_block) {
+    fpi = Uniform() < options_.FpiRatio;
+    block_data_len = fpi ? 0 : DataLen();
+    uint8_t fork_flags = 0; // Main fork, own RelFileLocator
+    if (fpi)
+      fork_flags |= BKPBLOCK_HAS_IMAGE;
+    if (block_data_len)
+      fork_flags |= BKPBLOCK_HAS_DATA;
+    record_.push_back(0); // Block id
+    record_.push_back(fork_flags);
+    Put16(record_, (uint16_t)block_data_len);
+    if (fpi)
+      BuildPageImage(lsn);
+    uint32_t rel = (uint32_t)(Random() % options_.Relations);
+    Put32(record_, 1663);                                // spcOid
+    Put32(record_, 5 + rel % options_.Databases);        // dbOid
+    Put32(record_, 16384 + rel);                         // relNumber
+    Put32(record_, (uint32_t)(Random() % 100000));       // BlockNumber
+  }
+  uint32_t main_len = switch_record ? 0 : DataLen() % 256 + 2;
+  if (rmid == RM_XACT_ID)
+    main_len = std::max(main_len, 8u); // xact_time
+  if (main_len) {
+    if (main_len < 256) {
+      record_.push_back(XLR_BLOCK_ID_DATA_SHORT);
+      record_.push_back((uint8_t)main_len);
+    } else {
+      record_.push_back(XLR_BLOCK_ID_DATA_LONG);
+      Put32(record_, main_len);
+    }
+  }
+  if (fpi)
+    record_.insert(record_.end(), image_.begin(), image_.end());
+  for (uint32_t i = 0; i < block_data_len; i++)
+    record_.push_back((uint8_t)(Random() % 7 == 0 ? Random() : i));
+  size_t main_start = record_.size();
+  for (uint32_t i = 0; i < main_len; i++)
+    record_.push_back(
+        zero_main ? 0 : (uint8_t)(Random() % 7 == 0 ? Random() : i));
+  if (rmid == RM_XACT_ID) {
+    int64_t xact_time =
+        options_.StartTime +
+        (int64_t)((lsn - options_.StartLSN) * 1e6 / options_.BytesPerSecond);
+    memcpy(&record_[main_start], &xact_time, 8);
+  }
+
+  uint32_t tot_len = (uint32_t)record_.size();
+  uint8_t *hdr = record_.data();
+  memcpy(hdr + 0, &tot_len, 4);
+  memcpy(hdr + 4, &xid, 4);
+  memcpy(hdr + 8, &prev_lsn_, 8);
+  hdr[16] = info;
+  hdr[17] = rmid;
+  hdr[18] = hdr[19] = 0;
+  uint32_t crc = CRC32C_INIT;
+  crc = Crc32cUpdate(crc, hdr + SizeOfXLogRecord, tot_len - SizeOfXLogRecord);
+  crc = Crc32cUpdate(crc, hdr, 20);
+  crc = Crc32cFinish(crc);
+  memcpy(hdr + 20, &crc, 4);
+
+  prev_lsn_ = lsn;
+  record_done_ = 0;
+  records_++;
+}
+
+void WalSynthGenerator::NextSegment(std::vector<uint8_t> &out, double fill) {
+  const size_t seg_size = options_.SegmentSize;
+  out.assign(seg_size, 0);
+  size_t fill_end = fill >= 1.0 ? seg_size : (size_t)(fill * seg_size);
+  bool switched = false;
+  size_t pos = 0;
+  while (pos < seg_size) {
+    if (switched && record_done_ == record_.size())
+      break; // Rest of the segment stays zero
+    if (pos % WAL_PAGE_SIZE == 0) {
+      uint32_t rem = (uint32_t)(record_.size() - record_done_);
+      bool long_header = pos == 0;
+      WritePageHeader(out.data() + pos, options_.PageMagic, long_header,
+                      (uint16_t)((long_header ? XLP_LONG_HEADER : 0) |
+                                 (rem ? XLP_FIRST_IS_CONTRECORD : 0)),
+                      options_.Timeline, segment_lsn_ + pos, rem,
+                      options_.SystemId, options_.SegmentSize);
+      pos += long_header ? WAL_LONG_PAGE_HEADER_SIZE
+                         : WAL_SHORT_PAGE_HEADER_SIZE;
+    }
+    if (record_done_ == record_.size()) {
+      // Between records: the next one starts MAXALIGNed
+      pos = MAXALIGN(pos);
+      if (pos >= seg_size || pos % WAL_PAGE_SIZE == 0)
+        continue;
+      bool do_switch = pos >= fill_end;
+      BuildRecord(segment_lsn_ + pos, do_switch);
+      switched = do_switch;
+    }
+    size_t n = std::min(record_.size() - record_done_,
+                        WAL_PAGE_SIZE - pos % WAL_PAGE_SIZE);
+    memcpy(out.data() + pos, record_.data() + record_done_, n);
+    record_done_ += n;
+    pos += n;
+  }
+  if (switched) {
+    record_.clear();
+    record_done_ = 0;
+  }
+  segment_lsn_ += seg_size;
+}
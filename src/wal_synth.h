@@ -0,0 +1,84 @@
+#pragma once
+#include "wal_fpi.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Generates valid WAL without a server, for benchmarks and for trying the
+// tools on a known workload. Output depends only on the options, so a seed
+// gives the same bytes on every run and platform.
+//
+// Segments have proper long and short page headers, records that cross
+// pages and segments with matching xlp_rem_len, an unbroken xl_prev chain
+// and correct CRCs. Heap, Heap2 and Btree records reference one block,
+// some of them with a full-page image of a heap-like page, compressed as
+// wal_compression would.
+
+struct WalSynthRmidWeight {
+  uint8_t Rmid;
+  double Weight;
+};
+
+struct WalSynthOptions {
+  uint64_t Seed = 1;
+  uint32_t SegmentSize = 16 * 1024 * 1024;
+  uint32_t Timeline = 1;
+  uint64_t SystemId = 7300000000000000001ULL;
+  uint64_t StartLSN = 0x1000000; // Start of the first segment
+  uint16_t PageMagic = 0xD113;    // Server version, see WalPageMagicForVersion
+  // Relative frequency of each resource manager; empty means an OLTP-like
+  // mix of Heap, Btree, Heap2, Transaction, Standby and XLOG records.
+  std::vector<WalSynthRmidWeight> RmidMix;
+  double FpiRatio = 0.05; // Share of block references with a page image
+  WalFpiCompression FpiCompression = WalFpiCompression::None;
+  // Block and main data lengths are log-normal around the median, which
+  // gives the long tail of real WAL.
+  uint32_t DataLenMedian = 48;
+  double DataLenSigma = 1.0;
+  uint32_t DataLenMax = 32 * 1024;
+  uint32_t Relations = 200;
+  uint32_t Databases = 3;
+  // Commit and abort times: StartTime (microseconds since 2000-01-01 UTC,
+  // here 2024-01-01) at StartLSN, then advancing with the WAL written.
+  int64_t StartTime = 757382400000000;
+  double BytesPerSecond = 4 * 1024 * 1024;
+};
+
+class WalSynthGenerator {
+public:
+  explicit WalSynthGenerator(const WalSynthOptions &options);
+
+  // Writes the next segment into out. With fill < 1 the segment is
+  // switched (XLOG_SWITCH) once about that fraction is used, leaving a
+  // zeroed tail, and the next segment starts with a new record.
+  void NextSegment(std::vector<uint8_t> &out, double fill = 1.0);
+  // File name of the segment NextSegment() writes next.
+  std::string NextSegmentName() const;
+
+  uint64_t GetRecordCount() const { return records_; }
+  uint64_t GetFpiCount() const { return fpis_; }
+  uint64_t GetFpiCompressedCount() const { return fpis_compressed_; }
+
+private:
+  uint64_t Random();
+  double Uniform(); // [0, 1)
+  uint32_t DataLen();
+  void BuildRecord(uint64_t lsn, bool switch_record);
+  void BuildPageImage(uint64_t lsn);
+
+  WalSynthOptions options_;
+  std::vector<WalSynthRmidWeight> mix_;
+  double mix_total_ = 0;
+  uint64_t rng_;
+
+  uint64_t segment_lsn_;  // Start of the segment written next
+  uint64_t prev_lsn_ = 0; // Last record, for xl_prev
+  uint32_t xid_ = 1000;
+  std::vector<uint8_t> record_; // Record being written
+  size_t record_done_ = 0;      // Bytes of it already written
+  std::vector<uint8_t> page_, image_, compressed_;
+
+  uint64_t records_ = 0;
+  uint64_t fpis_ = 0;
+  uint64_t fpis_compressed_ = 0;
+};
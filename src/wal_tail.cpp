@@ -0,0 +1,331 @@
+#include "wal_tail.h"
+#include "wal_archive.h"
+#include "wal_io.h"
+#include "wal_trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+
+// xlp_info flag of a page that starts with the tail of an earlier record
+#define WAL_TAIL_FIRST_IS_CONTRECORD 0x0001
+#define WAL_TAIL_MAXALIGN(len) (((uint64_t)(len) + 7) & ~(uint64_t)7)
+
+namespace {
+
+// One segment file, read page by page as the walk needs it. Compressed
+// segments can only be read from the start, so they are inflated whole.
+struct TailSegment {
+  size_t Index = 0; // In the caller's paths
+  uint64_t BaseLSN = 0;
+  uint64_t SegmentSize = 0;
+  size_t PageCount = 0;
+  WalSparseSegment Pages;
+  WalPositionalFile File;
+  bool Raw = true;
+  uint64_t PagesRead = 0;
+
+  bool Open(const std::vector<std::string> &paths, size_t index,
+            std::string &error) {
+    Index = index;
+    const std::string &path = paths[index];
+    std::string name = WalStripCompressionSuffix(
+        std::filesystem::path(path).filename().string());
+    uint64_t size = 0;
+    Raw = WalCompressionFromName(path) == WalCompression::None;
+    if (Raw) {
+      if (!File.Open(path, size)) {
+        error = "failed to open file";
+        return false;
+      }
+      Pages.Reset((size_t)size);
+    } else {
+      std::vector<uint8_t> data;
+      if (!ReadWalSegmentFile(path, data, error))
+        return false;
+      size = data.size();
+      PagesRead = size / WAL_PAGE_SIZE;
+      Pages.Assign(std::move(data));
+    }
+    PageCount = Pages.Size() / WAL_PAGE_SIZE;
+    if (PageCount == 0 || !Load(0, 1)) {
+      error = "segment is empty";
+      return false;
+    }
+
+    uint8_t first[WAL_LONG_PAGE_HEADER_SIZE];
+    Pages.Read(0, first, sizeof(first));
+    WalPageHeaderInfo header;
+    bool valid = ReadWalPageHeader(first, sizeof(first), header);
+    SegmentSize = valid && header.SegmentSize
+                      ? header.SegmentSize
+                      : WalSegmentSizeFromFileSize(size);
+    BaseLSN = WalFileNameToLSN(name, SegmentSize);
+    if (BaseLSN == 0 && valid)
+      BaseLSN = header.PageAddr;
+    return true;
+  }
+
+  // Makes pages [first, first + count) resident, clamped to the segment.
+  // Runs of missing pages are read with one pread each.
+  bool Load(size_t first, size_t count) {
+    size_t end = std::min(first + count, PageCount);
+    std::vector<uint8_t> buf;
+    for (size_t page = first; page < end;) {
+      if (!Raw || Pages.HasPage(page)) {
+        page++;
+        continue;
+      }
+      size_t run = page + 1;
+      while (run < end && !Pages.HasPage(run))
+        run++;
+      buf.resize((run - page) * WAL_PAGE_SIZE);
+      if (!File.ReadAt((uint64_t)page * WAL_PAGE_SIZE, buf.data(),
+                       buf.size()))
+        return false;
+      PagesRead += run - page;
+      for (size_t i = 0; i < run - page; i++) {
+        const uint8_t *src = buf.data() + i * WAL_PAGE_SIZE;
+        if (!WalIsZero(src, WAL_PAGE_SIZE)) // Zero pages stay implicit
+          Pages.Write((page + i) * WAL_PAGE_SIZE, src, WAL_PAGE_SIZE);
+      }
+      page = run;
+    }
+    return true;
+  }
+
+  bool ReadHeader(size_t page, WalPageHeaderInfo &header) {
+    uint8_t buf[WAL_LONG_PAGE_HEADER_SIZE];
+    if (!Load(page, 1))
+      return false;
+    Pages.Read(page * WAL_PAGE_SIZE, buf, sizeof(buf));
+    return ReadWalPageHeader(buf, sizeof(buf), header);
+  }
+
+  // Pages written since the segment was last recycled carry the address
+  // their position implies; they form a prefix of the file.
+  bool PageIsCurrent(size_t page) {
+    WalPageHeaderInfo header;
+    return ReadHeader(page, header) &&
+           header.PageAddr == BaseLSN + (uint64_t)page * WAL_PAGE_SIZE;
+  }
+
+  // Copies pages [first, first + count) into slice.
+  void Slice(size_t first, size_t count, std::vector<uint8_t> &slice) {
+    count = std::min(count, PageCount - first);
+    Load(first, count);
+    slice.resize(count * WAL_PAGE_SIZE);
+    Pages.Read(first * WAL_PAGE_SIZE, slice.data(), slice.size());
+  }
+};
+
+// Offset just past a record of tot_len bytes starting at offset, counting
+// the short headers of the pages it continues onto.
+size_t RecordEnd(size_t offset, uint32_t tot_len) {
+  size_t pos = offset;
+  while (tot_len > 0) {
+    if (pos % WAL_PAGE_SIZE == 0)
+      pos += WAL_SHORT_PAGE_HEADER_SIZE;
+    size_t chunk = std::min((size_t)tot_len,
+                            (size_t)WAL_PAGE_SIZE - pos % WAL_PAGE_SIZE);
+    pos += chunk;
+    tot_len -= (uint32_t)chunk;
+  }
+  return pos;
+}
+
+std::string FormatLSN(uint64_t lsn) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%X/%X", (uint32_t)(lsn >> 32), (uint32_t)lsn);
+  return buf;
+}
+
+// Timeline of a WAL file name, 0 if it isn't one.
+uint32_t NameTimeline(const std::string &name) {
+  if (name.size() != 24 ||
+      name.find_first_not_of("0123456789ABCDEF") != std::string::npos)
+    return 0;
+  return (uint32_t)strtoul(name.substr(0, 8).c_str(), nullptr, 16);
+}
+
+} // namespace
+
+bool ReadWalTail(const std::vector<std::string> &paths, size_t index,
+                 uint64_t end_lsn, size_t count, WalParser &parser,
+                 WalTailResult &out) {
+  WalTraceScope trace("load", "tail");
+  out = WalTailResult();
+  if (index >= paths.size()) {
+    out.Error = "no such segment";
+    return false;
+  }
+  trace.SetSegment(paths[index]);
+
+  auto start = std::make_unique<TailSegment>();
+  TailSegment &seg = *start;
+  if (!seg.Open(paths, index, out.Error))
+    return false;
+  out.BaseLSN = seg.BaseLSN;
+  out.SegmentSize = (uint32_t)seg.SegmentSize;
+  if (!seg.PageIsCurrent(0)) {
+    out.Error = "no valid WAL in segment";
+    out.Data = std::move(seg.Pages);
+    return false;
+  }
+
+  // --- The pages before the end ---
+  size_t last_page;
+  if (end_lsn > seg.BaseLSN && end_lsn - seg.BaseLSN <= seg.Pages.Size()) {
+    last_page = (size_t)((end_lsn - seg.BaseLSN - 1) / WAL_PAGE_SIZE);
+  } else {
+    end_lsn = 0;
+    size_t lo = 0, hi = seg.PageCount; // lo current, hi not (or past end)
+    while (hi - lo > 1) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (seg.PageIsCurrent(mid))
+        lo = mid;
+      else
+        hi = mid;
+    }
+    last_page = lo;
+  }
+
+  // Step back to a page on which a record starts: one that isn't wholly
+  // the continuation of an earlier record. If it begins with the tail of
+  // one, step back to where that one starts too, so it is checked like a
+  // full parse checks it: when it is broken, valid WAL ends before it.
+  size_t first_page = last_page;
+  for (bool checked = false;; first_page--) {
+    WalPageHeaderInfo header;
+    if (!seg.ReadHeader(first_page, header))
+      break;
+    size_t header_size = header.IsLong ? WAL_LONG_PAGE_HEADER_SIZE
+                                       : WAL_SHORT_PAGE_HEADER_SIZE;
+    uint32_t rem = (header.Info & WAL_TAIL_FIRST_IS_CONTRECORD)
+                       ? header.RemLen
+                       : 0;
+    if (first_page == 0)
+      break;
+    if (WAL_TAIL_MAXALIGN(header_size + rem) < WAL_PAGE_SIZE) {
+      if (rem == 0 || checked)
+        break;
+      checked = true;
+    }
+  }
+
+  // Parse forward from there. The page after the end is included in case
+  // the last record continues onto it; a record cut off by the slice is
+  // not emitted unless the slice reaches the end of the segment.
+  std::vector<uint8_t> slice;
+  std::vector<WalRecordInfo> tail;
+  size_t slice_pages = last_page - first_page + 2;
+  seg.Slice(first_page, slice_pages, slice);
+  parser.SetExpectedBaseLSN(seg.BaseLSN + first_page * WAL_PAGE_SIZE);
+  parser.BeginIncremental();
+  parser.ParseMore(slice.data(), slice.size(),
+                   first_page + slice_pages >= seg.PageCount, tail);
+  out.EndLSN = parser.GetEndLSN();
+  out.EndReason = parser.GetEndReason();
+  if (end_lsn) {
+    while (!tail.empty() && tail.back().LSN >= end_lsn)
+      tail.pop_back();
+    if (!tail.empty())
+      out.EndLSN = std::min(out.EndLSN, end_lsn);
+  }
+  for (WalRecordInfo &rec : tail)
+    rec.Offset += first_page * WAL_PAGE_SIZE;
+  if (tail.empty())
+    out.Stop = "no record starts on the last pages of the segment";
+
+  // --- Backwards along xl_prev ---
+  std::vector<WalRecordInfo> newest_first;
+  std::vector<size_t> newest_first_paths;
+  size_t keep = std::min(count, tail.size());
+  for (size_t i = 0; i < keep; i++) {
+    newest_first.push_back(std::move(tail[tail.size() - 1 - i]));
+    newest_first_paths.push_back(index);
+  }
+  uint64_t lsn = newest_first.empty() ? 0 : newest_first.back().PrevLSN;
+
+  // Other segments by start LSN, on the same timeline as the starting one
+  // or else the latest one before it.
+  std::map<uint64_t, std::pair<uint32_t, size_t>> by_lsn;
+  uint32_t start_tli = NameTimeline(WalStripCompressionSuffix(
+      std::filesystem::path(paths[index]).filename().string()));
+  for (size_t i = 0; i < paths.size(); i++) {
+    std::string name = WalStripCompressionSuffix(
+        std::filesystem::path(paths[i]).filename().string());
+    uint32_t tli = NameTimeline(name);
+    if (tli == 0 || (start_tli && tli > start_tli))
+      continue;
+    auto &slot = by_lsn[WalFileNameToLSN(name, seg.SegmentSize)];
+    if (slot.first <= tli)
+      slot = {tli, i};
+  }
+  std::map<uint64_t, std::unique_ptr<TailSegment>> opened;
+  opened[seg.BaseLSN] = std::move(start);
+
+  while (newest_first.size() < count && !tail.empty()) {
+    if (lsn == 0) {
+      out.Stop = "reached the first record";
+      break;
+    }
+    uint64_t base = lsn - lsn % seg.SegmentSize;
+    auto it = opened.find(base);
+    if (it == opened.end()) {
+      auto found = by_lsn.find(base);
+      if (found == by_lsn.end()) {
+        out.Stop = "no segment for " + FormatLSN(lsn);
+        break;
+      }
+      auto other = std::make_unique<TailSegment>();
+      std::string error;
+      if (!other->Open(paths, found->second.second, error)) {
+        out.Stop = paths[found->second.second] + ": " + error;
+        break;
+      }
+      it = opened.emplace(base, std::move(other)).first;
+    }
+    TailSegment &cur = *it->second;
+
+    // xl_tot_len is never split across pages; it tells how many pages the
+    // record needs.
+    size_t offset = (size_t)(lsn - cur.BaseLSN);
+    size_t page = offset / WAL_PAGE_SIZE;
+    uint32_t tot_len = 0;
+    if (page < cur.PageCount && cur.Load(page, 1))
+      cur.Pages.Read(offset, &tot_len, sizeof(tot_len));
+    if (tot_len == 0) {
+      out.Stop = "no record at " + FormatLSN(lsn);
+      break;
+    }
+    size_t pages = (RecordEnd(offset, tot_len) - 1) / WAL_PAGE_SIZE - page + 1;
+    cur.Slice(page, pages, slice);
+    parser.SetExpectedBaseLSN(cur.BaseLSN + page * WAL_PAGE_SIZE);
+    WalRecordInfo rec;
+    if (!parser.ParseRecordAt(slice.data(), slice.size(),
+                              offset - page * WAL_PAGE_SIZE, rec)) {
+      out.Stop = std::string("broken xl_prev chain at ") + FormatLSN(lsn) +
+                 " (" + WalEndReasonName(parser.GetEndReason()) + ")";
+      break;
+    }
+    rec.Offset += page * WAL_PAGE_SIZE;
+    lsn = rec.PrevLSN;
+    newest_first.push_back(std::move(rec));
+    newest_first_paths.push_back(cur.Index);
+  }
+
+  out.Records.assign(std::make_move_iterator(newest_first.rbegin()),
+                     std::make_move_iterator(newest_first.rend()));
+  out.PathIndex.assign(newest_first_paths.rbegin(),
+                       newest_first_paths.rend());
+  for (auto &entry : opened)
+    out.PagesRead += entry.second->PagesRead;
+  out.SegmentsRead = (uint32_t)opened.size();
+  out.Data = std::move(opened[out.BaseLSN]->Pages);
+  trace.SetBytes(out.PagesRead * WAL_PAGE_SIZE);
+  trace.SetItems(out.Records.size());
+  return true;
+}
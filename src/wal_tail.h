@@ -0,0 +1,35 @@
+#pragma once
+#include "wal_parser.h"
+#include "wal_sparse.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The most recent records of the WAL, read backwards. The end of valid WAL
+// is found from page headers alone (or given, e.g. the server's
+// pg_current_wal_lsn()), the last record on the pages before it, and the
+// records before that by following xl_prev, across segment files when the
+// chain leaves the first one. Only the pages those records sit on are read,
+// so the tail of a 1GB segment costs about what the records shown do.
+struct WalTailResult {
+  std::vector<WalRecordInfo> Records; /* Oldest first */
+  std::vector<size_t> PathIndex;      /* paths[] each record came from */
+  WalSparseSegment Data;    /* The starting segment, pages read so far */
+  uint64_t BaseLSN = 0;     /* LSN of Data's first byte */
+  uint32_t SegmentSize = 0;
+  uint64_t EndLSN = 0;      /* As WalParser::GetEndLSN() */
+  WalEndReason EndReason = WalEndReason::None;
+  uint64_t PagesRead = 0;   /* Over all segments visited */
+  uint32_t SegmentsRead = 0;
+  std::string Stop;  /* Why fewer records than asked for, else empty */
+  std::string Error; /* Non-empty if the starting segment is unusable */
+};
+
+// Reads the last `count` records of paths[index], ending before end_lsn if
+// that falls inside it, else at the end of valid WAL. The other paths (raw
+// or compressed, in any order) are where the chain may lead, e.g. the rest
+// of pg_wal. Records from earlier segments keep their offset within their
+// own file. False, with out.Error set, if paths[index] can't be used.
+bool ReadWalTail(const std::vector<std::string> &paths, size_t index,
+                 uint64_t end_lsn, size_t count, WalParser &parser,
+                 WalTailResult &out);
@@ -0,0 +1,558 @@
+#include "wal_time_index.h"
+#include "crc32c.h"
+#include "wal_archive.h"
+#include "wal_dir_scan.h"
+#include "wal_xact.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <thread>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// RM_XLOG_ID records with a time
+#define XLOG_CHECKPOINT_SHUTDOWN 0x00
+#define XLOG_CHECKPOINT_ONLINE 0x10
+#define XLOG_RESTORE_POINT 0x70
+#define XLOG_END_OF_RECOVERY 0x90
+#define XLOG_OPMASK 0xF0
+// CheckPoint.time, a pg_time_t (Unix seconds); see CTL_CKPT_TIME
+#define CHECKPOINT_TIME_OFFSET 64
+
+#define TIMES_MAGIC "WALTIMES"
+#define TIMES_VERSION 1
+
+namespace {
+
+bool CarriesTime(uint8_t rmid, uint8_t info) {
+  if (rmid == RM_XACT_ID) {
+    switch (info & XLOG_XACT_OPMASK) {
+    case XLOG_XACT_COMMIT:
+    case XLOG_XACT_PREPARE:
+    case XLOG_XACT_ABORT:
+    case XLOG_XACT_COMMIT_PREPARED:
+    case XLOG_XACT_ABORT_PREPARED:
+      return true;
+    }
+    return false;
+  }
+  if (rmid == RM_XLOG_ID) {
+    switch (info & XLOG_OPMASK) {
+    case XLOG_CHECKPOINT_SHUTDOWN:
+    case XLOG_CHECKPOINT_ONLINE:
+    case XLOG_RESTORE_POINT:
+    case XLOG_END_OF_RECOVERY:
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsSegmentName(const std::string &name) {
+  return name.size() == 24 &&
+         name.find_first_not_of("0123456789ABCDEFabcdef") == std::string::npos;
+}
+
+bool FileStamp(const std::string &path, uint64_t &size, int64_t &mtime) {
+  std::error_code ec;
+  size = fs::file_size(path, ec);
+  if (ec)
+    return false;
+  mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+  return !ec;
+}
+
+time_t UnixSeconds(int64_t timestamp) {
+  int64_t us = WalTimestampToUnixMicros(timestamp);
+  return (time_t)(us >= 0 ? us / 1000000 : (us - 999999) / 1000000);
+}
+
+void LocalTime(time_t secs, struct tm &tm) {
+#ifdef _WIN32
+  localtime_s(&tm, &secs);
+#else
+  localtime_r(&secs, &tm);
+#endif
+}
+
+// File layout: header, segment entries, points, then the file names, each
+// NUL-terminated. All little-endian, as written.
+struct TimesHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t HeaderSize;
+  uint64_t SystemId;
+  uint32_t SegmentCount;
+  uint32_t PointCount;
+  uint32_t NameBytes;
+  uint32_t BodyCrc; /* CRC-32C of everything after the header */
+};
+
+struct TimesSegment {
+  uint64_t FileSize;
+  int64_t ModTime;
+  uint64_t StartLSN;
+  uint64_t EndLSN;
+  uint32_t Name;
+  uint32_t Points;
+};
+
+} // namespace
+
+bool WalRecordTime(const WalDecodedRecord &rec, int64_t &time) {
+  if (!CarriesTime(rec.RMID, rec.Info))
+    return false;
+  const uint8_t *data = rec.MainData;
+  uint32_t len = rec.MainDataLength;
+  if (rec.RMID == RM_XACT_ID) {
+    // xact_time leads every commit and abort; a PREPARE's body is the
+    // TwoPhaseFileHeader, prepared_at after magic, length, xid and database
+    uint32_t off = (rec.Info & XLOG_XACT_OPMASK) == XLOG_XACT_PREPARE ? 16 : 0;
+    if (len < off + 8)
+      return false;
+    memcpy(&time, data + off, 8);
+  } else if ((rec.Info & XLOG_OPMASK) <= XLOG_CHECKPOINT_ONLINE) {
+    int64_t secs;
+    if (len < CHECKPOINT_TIME_OFFSET + 8)
+      return false;
+    memcpy(&secs, data + CHECKPOINT_TIME_OFFSET, 8);
+    time = WalTimestampFromUnixMicros(secs * 1000000);
+  } else {
+    // rp_time and end_time come first
+    if (len < 8)
+      return false;
+    memcpy(&time, data, 8);
+  }
+  return time != 0;
+}
+
+bool WalParseTime(const std::string &text, int64_t reference,
+                  int64_t &time) {
+  const char *s = text.c_str();
+  while (*s == ' ')
+    s++;
+  int year = 0, month = 0, day = 0, n = 0;
+  bool has_date = sscanf(s, "%4d-%2d-%2d%n", &year, &month, &day, &n) == 3;
+  if (has_date) {
+    s += n;
+    if (*s == 'T' || *s == ' ')
+      s++;
+  }
+  int hour = 0, minute = 0, second = 0, micros = 0;
+  if (sscanf(s, "%2d:%2d%n", &hour, &minute, &n) == 2) {
+    s += n;
+    if (sscanf(s, ":%2d%n", &second, &n) == 1) {
+      s += n;
+      if (*s == '.') {
+        int digits = 0;
+        for (s++; *s >= '0' && *s <= '9'; s++) {
+          if (digits++ < 6)
+            micros = micros * 10 + (*s - '0');
+        }
+        for (; digits < 6; digits++)
+          micros *= 10;
+      }
+    }
+  } else if (!has_date) {
+    return false;
+  }
+  while (*s == ' ')
+    s++;
+  if (*s || hour > 23 || minute > 59 || second > 60 ||
+      (has_date && (month < 1 || month > 12 || day < 1 || day > 31)))
+    return false;
+
+  struct tm tm = {};
+  if (!has_date) {
+    time_t now = ::time(nullptr);
+    LocalTime(reference ? UnixSeconds(reference) : now, tm);
+  } else {
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+  }
+  tm.tm_hour = hour;
+  tm.tm_min = minute;
+  tm.tm_sec = second;
+  tm.tm_isdst = -1;
+  time_t secs = mktime(&tm);
+  if (secs == (time_t)-1)
+    return false;
+  time = WalTimestampFromUnixMicros((int64_t)secs * 1000000 + micros);
+  if (!has_date && reference && time > reference) {
+    // That time of day hasn't come yet on the reference day
+    tm.tm_mday -= 1;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    tm.tm_isdst = -1;
+    secs = mktime(&tm);
+    time = WalTimestampFromUnixMicros((int64_t)secs * 1000000 + micros);
+  }
+  return true;
+}
+
+// --- WalTimeSampler ---
+
+void WalTimeSampler::Add(const WalRecordInfo &info, const uint8_t *record,
+                         uint32_t length) {
+  // Most records can't carry a time; don't decode those
+  if (!record || !CarriesTime(info.RMID, info.Info) ||
+      !WalDecodeRecord(record, length, decoded_))
+    return;
+  int64_t time;
+  if (!WalRecordTime(decoded_, time))
+    return;
+  last_ = {time, info.LSN};
+  if (info.LSN >= next_) {
+    points_.push_back(last_);
+    next_ = info.LSN - info.LSN % WAL_TIME_SAMPLE_BYTES + WAL_TIME_SAMPLE_BYTES;
+  }
+}
+
+void WalTimeSampler::Finish(std::vector<WalTimePoint> &out) {
+  if (last_.LSN && (points_.empty() || points_.back().LSN != last_.LSN))
+    points_.push_back(last_);
+  out = std::move(points_);
+  points_.clear();
+  last_ = {0, 0};
+  next_ = 0;
+}
+
+// --- WalTimeIndex ---
+
+void WalTimeIndex::Update(const std::vector<std::string> &paths,
+                          unsigned threads, std::atomic<size_t> *done) {
+  std::unordered_map<std::string, size_t> known;
+  for (size_t i = 0; i < segments_.size(); i++)
+    known[segments_[i].FileName] = i;
+
+  std::vector<WalSegmentTimes> next;
+  std::vector<std::string> todo_paths;
+  std::vector<size_t> todo;
+  for (const std::string &path : paths) {
+    WalSegmentTimes seg;
+    seg.FileName = fs::path(path).filename().string();
+    if (!IsSegmentName(WalStripCompressionSuffix(seg.FileName)) ||
+        !FileStamp(path, seg.FileSize, seg.ModTime)) {
+      if (done)
+        ++*done;
+      continue;
+    }
+    auto it = known.find(seg.FileName);
+    if (it != known.end() && segments_[it->second].FileSize == seg.FileSize &&
+        segments_[it->second].ModTime == seg.ModTime) {
+      next.push_back(std::move(segments_[it->second]));
+      if (done)
+        ++*done;
+      continue;
+    }
+    todo.push_back(next.size());
+    todo_paths.push_back(path);
+    next.push_back(std::move(seg));
+  }
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = (unsigned)std::min<size_t>(threads, todo.size());
+  std::atomic<size_t> next_job{0};
+  std::atomic<uint64_t> system_id{0};
+  auto worker = [&]() {
+    WalParser parser;
+    WalTimeSampler sampler;
+    parser.SetRecordVisitor([&](const WalRecordInfo &info,
+                                const uint8_t *record, uint32_t length) {
+      sampler.Add(info, record, length);
+    });
+    for (size_t j = next_job++; j < todo.size(); j = next_job++) {
+      WalSegmentTimes &seg = next[todo[j]];
+      WalLoadedSegment loaded;
+      if (LoadWalSegment(todo_paths[j], parser, nullptr, loaded)) {
+        uint64_t segment_size = loaded.SegmentSize
+                                    ? loaded.SegmentSize
+                                    : WalSegmentSizeFromFileSize(seg.FileSize);
+        seg.StartLSN = WalFileNameToLSN(
+            WalStripCompressionSuffix(seg.FileName), segment_size);
+        seg.EndLSN = loaded.EndLSN;
+        uint8_t first[WAL_LONG_PAGE_HEADER_SIZE];
+        WalPageHeaderInfo header;
+        if (loaded.Data.Read(0, first, sizeof(first)) == sizeof(first) &&
+            ReadWalPageHeader(first, sizeof(first), header) &&
+            header.SystemId)
+          system_id = header.SystemId;
+      }
+      sampler.Finish(seg.Points);
+      if (done)
+        ++*done;
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; t++)
+    pool.emplace_back(worker);
+  if (threads)
+    worker();
+  for (std::thread &t : pool)
+    t.join();
+
+  if (system_id)
+    system_id_ = system_id;
+  segments_ = std::move(next);
+  Rebuild();
+}
+
+void WalTimeIndex::Rebuild() {
+  points_.clear();
+  max_time_.clear();
+  point_segment_.clear();
+  int64_t max_time = INT64_MIN;
+  for (size_t i = 0; i < segments_.size(); i++) {
+    WalSegmentTimes &seg = segments_[i];
+    seg.FirstTime = seg.LastTime = 0;
+    for (const WalTimePoint &p : seg.Points) {
+      if (!seg.FirstTime || p.Time < seg.FirstTime)
+        seg.FirstTime = p.Time;
+      if (!seg.LastTime || p.Time > seg.LastTime)
+        seg.LastTime = p.Time;
+      max_time = std::max(max_time, p.Time);
+      points_.push_back(p);
+      max_time_.push_back(max_time);
+      point_segment_.push_back((uint32_t)i);
+    }
+  }
+}
+
+bool WalTimeIndex::Find(int64_t time, WalTimePoint &out,
+                        size_t *segment) const {
+  if (points_.empty() || time < points_[0].Time || time > max_time_.back())
+    return false;
+  size_t i = std::lower_bound(max_time_.begin(), max_time_.end(), time) -
+             max_time_.begin();
+  if (i > 0)
+    i--;
+  out = points_[i];
+  if (segment)
+    *segment = point_segment_[i];
+  return true;
+}
+
+bool WalTimeIndex::FindEnd(int64_t time, WalTimePoint &out) const {
+  size_t i = std::lower_bound(max_time_.begin(), max_time_.end(), time) -
+             max_time_.begin();
+  if (i == points_.size())
+    return false;
+  out = points_[i];
+  return true;
+}
+
+void WalTimeIndex::Rate(int64_t from, int64_t to, size_t buckets,
+                        std::vector<float> &bytes_per_sec) const {
+  bytes_per_sec.assign(buckets, 0.0f);
+  if (buckets == 0 || to <= from)
+    return;
+  double width = (double)(to - from) / buckets;
+  // The WAL between two samples was written by the time of the second
+  for (size_t i = 1; i < points_.size(); i++) {
+    int64_t t = max_time_[i];
+    if (t < from || t >= to || points_[i].LSN <= points_[i - 1].LSN)
+      continue;
+    size_t b = std::min(buckets - 1, (size_t)((t - from) / width));
+    bytes_per_sec[b] += (float)(points_[i].LSN - points_[i - 1].LSN);
+  }
+  for (float &v : bytes_per_sec)
+    v = (float)(v / (width / 1e6));
+}
+
+const WalSegmentTimes *
+WalTimeIndex::FindSegment(const std::string &file_name) const {
+  // In the order of the paths, which are sorted by name
+  auto it = std::lower_bound(segments_.begin(), segments_.end(), file_name,
+                             [](const WalSegmentTimes &seg,
+                                const std::string &name) {
+                               return seg.FileName < name;
+                             });
+  return it != segments_.end() && it->FileName == file_name ? &*it : nullptr;
+}
+
+int64_t WalTimeIndex::FirstTime() const {
+  return points_.empty() ? 0 : points_[0].Time;
+}
+
+int64_t WalTimeIndex::LastTime() const {
+  return max_time_.empty() ? 0 : max_time_.back();
+}
+
+size_t WalTimeIndex::MemoryUsage() const {
+  size_t bytes = points_.capacity() * sizeof(WalTimePoint) +
+                 max_time_.capacity() * sizeof(int64_t) +
+                 point_segment_.capacity() * sizeof(uint32_t);
+  for (const WalSegmentTimes &seg : segments_)
+    bytes += sizeof(seg) + seg.FileName.capacity() +
+             seg.Points.capacity() * sizeof(WalTimePoint);
+  return bytes;
+}
+
+bool WalTimeIndex::Save(const std::string &path, std::string &error) const {
+  std::vector<char> names;
+  std::vector<uint8_t> body;
+  auto append = [&](const void *p, size_t len) {
+    body.insert(body.end(), (const uint8_t *)p, (const uint8_t *)p + len);
+  };
+  for (const WalSegmentTimes &seg : segments_) {
+    TimesSegment entry = {seg.FileSize, seg.ModTime,
+                          seg.StartLSN, seg.EndLSN,
+                          (uint32_t)names.size(), (uint32_t)seg.Points.size()};
+    names.insert(names.end(), seg.FileName.begin(), seg.FileName.end());
+    names.push_back(0);
+    append(&entry, sizeof(entry));
+  }
+  for (const WalSegmentTimes &seg : segments_)
+    append(seg.Points.data(), seg.Points.size() * sizeof(WalTimePoint));
+  append(names.data(), names.size());
+
+  TimesHeader header = {};
+  memcpy(header.Magic, TIMES_MAGIC, sizeof(header.Magic));
+  header.Version = TIMES_VERSION;
+  header.HeaderSize = sizeof(header);
+  header.SystemId = system_id_;
+  header.SegmentCount = (uint32_t)segments_.size();
+  header.PointCount = (uint32_t)points_.size();
+  header.NameBytes = (uint32_t)names.size();
+  header.BodyCrc =
+      Crc32cFinish(Crc32cUpdate(CRC32C_INIT, body.data(), body.size()));
+
+  std::error_code ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+  std::string tmp = path + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f) {
+    error = "cannot create " + tmp;
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(body.data(), 1, body.size(), f) == body.size();
+  ok = fclose(f) == 0 && ok;
+  if (ok) {
+    fs::rename(tmp, path, ec);
+    ok = !ec;
+  }
+  if (!ok) {
+    fs::remove(tmp, ec);
+    error = "cannot write " + path;
+  }
+  return ok;
+}
+
+bool WalTimeIndex::Load(const std::string &path, std::string &error) {
+  std::vector<uint8_t> file;
+  std::string read_error;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f) {
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+      file.insert(file.end(), buf, buf + n);
+    fclose(f);
+  }
+  if (!f || file.empty()) {
+    error = "cannot read " + path;
+    return false;
+  }
+  TimesHeader header;
+  if (file.size() < sizeof(header)) {
+    error = path + " is too short";
+    return false;
+  }
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.Magic, TIMES_MAGIC, sizeof(header.Magic)) != 0 ||
+      header.Version != TIMES_VERSION || header.HeaderSize != sizeof(header)) {
+    error = path + " is not a time index of this version";
+    return false;
+  }
+  uint64_t body_size =
+      (uint64_t)header.SegmentCount * sizeof(TimesSegment) +
+      (uint64_t)header.PointCount * sizeof(WalTimePoint) + header.NameBytes;
+  const uint8_t *body = file.data() + sizeof(header);
+  if (body_size != file.size() - sizeof(header) ||
+      Crc32cFinish(Crc32cUpdate(CRC32C_INIT, body, body_size)) !=
+          header.BodyCrc ||
+      (header.NameBytes && body[body_size - 1] != 0)) {
+    error = path + " is corrupt";
+    return false;
+  }
+
+  const uint8_t *entries = body;
+  const uint8_t *points =
+      entries + (size_t)header.SegmentCount * sizeof(TimesSegment);
+  const char *names =
+      (const char *)points + (size_t)header.PointCount * sizeof(WalTimePoint);
+  std::vector<WalSegmentTimes> segments(header.SegmentCount);
+  uint64_t points_left = header.PointCount;
+  for (uint32_t i = 0; i < header.SegmentCount; i++) {
+    TimesSegment entry;
+    memcpy(&entry, entries + i * sizeof(TimesSegment), sizeof(entry));
+    if (entry.Points > points_left || entry.Name >= header.NameBytes) {
+      error = path + " is corrupt";
+      return false;
+    }
+    WalSegmentTimes &seg = segments[i];
+    seg.FileName = names + entry.Name;
+    seg.FileSize = entry.FileSize;
+    seg.ModTime = entry.ModTime;
+    seg.StartLSN = entry.StartLSN;
+    seg.EndLSN = entry.EndLSN;
+    seg.Points.resize(entry.Points);
+    memcpy(seg.Points.data(), points, entry.Points * sizeof(WalTimePoint));
+    points += entry.Points * sizeof(WalTimePoint);
+    points_left -= entry.Points;
+  }
+  system_id_ = header.SystemId;
+  segments_ = std::move(segments);
+  Rebuild();
+  return true;
+}
+
+std::string WalTimeIndexPath(const std::string &dir, uint64_t system_id) {
+  return (fs::path(dir) / ("times-" + std::to_string(system_id) + ".bin"))
+      .string();
+}
+
+bool WalRefreshTimeIndex(const std::vector<std::string> &paths,
+                         const std::string &cache_dir, WalTimeIndex &index,
+                         std::string &error, unsigned threads,
+                         std::atomic<size_t> *done) {
+  // The cluster's identifier is in the first page of any of its segments;
+  // archived ones have to be decompressed for it
+  uint64_t system_id = 0;
+  for (const std::string &path : paths) {
+    WalSegmentSummary summary;
+    if (SummarizeWalSegment(path, summary) && summary.SystemId) {
+      system_id = summary.SystemId;
+      break;
+    }
+  }
+  for (size_t i = 0; !system_id && i < paths.size(); i++) {
+    std::vector<uint8_t> data;
+    std::string read_error;
+    WalPageHeaderInfo header;
+    if (IsSegmentName(WalStripCompressionSuffix(
+            fs::path(paths[i]).filename().string())) &&
+        ReadWalSegmentFile(paths[i], data, read_error) &&
+        ReadWalPageHeader(data.data(), data.size(), header))
+      system_id = header.SystemId;
+  }
+  if (cache_dir.empty()) {
+    index.Update(paths, threads, done);
+    return true;
+  }
+  std::string path = WalTimeIndexPath(cache_dir, system_id);
+  if (index.SystemId() != system_id || index.Segments().empty()) {
+    std::string load_error; // Missing the first time
+    index = WalTimeIndex();
+    index.Load(path, load_error);
+  }
+  index.Update(paths, threads, done);
+  return index.Save(path, error);
+}
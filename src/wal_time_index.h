@@ -0,0 +1,118 @@
+#pragma once
+#include "wal_parser.h"
+#include "wal_record_decode.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wall-clock time -> LSN. Commit, abort and prepare records carry the time
+// they were written, and so do checkpoints; one of them per
+// WAL_TIME_SAMPLE_BYTES of WAL is kept as a sample. That is a few hundred
+// per 16 MB segment, little enough to keep for a whole directory and on
+// disk between runs, and enough to binary search for where a time falls.
+
+#define WAL_TIME_SAMPLE_BYTES (64 * 1024)
+
+struct WalTimePoint {
+  int64_t Time; /* PostgreSQL timestamp */
+  uint64_t LSN; /* Of the record carrying it */
+};
+
+// The time a record carries: xact_time of commits and aborts, prepared_at,
+// the checkpoint's time, end of recovery and restore point times. False
+// for other records.
+bool WalRecordTime(const WalDecodedRecord &rec, int64_t &time);
+
+// "2024-01-31 14:03:27[.123456]" or "2024-01-31T14:03", in local time. A
+// bare "14:03:27" is the last time of day at or before reference.
+bool WalParseTime(const std::string &text, int64_t reference,
+                  int64_t &time);
+
+// Picks the samples out of one segment's records, fed in LSN order from
+// the parser's record visitor.
+class WalTimeSampler {
+public:
+  void Add(const WalRecordInfo &info, const uint8_t *record,
+           uint32_t length);
+  // Moves the samples to out, the last timed record always among them,
+  // and starts over.
+  void Finish(std::vector<WalTimePoint> &out);
+
+private:
+  WalDecodedRecord decoded_;
+  std::vector<WalTimePoint> points_;
+  WalTimePoint last_ = {0, 0}; /* LSN 0 if none yet */
+  uint64_t next_ = 0;          /* Samples are due again from here */
+};
+
+struct WalSegmentTimes {
+  std::string FileName;
+  uint64_t FileSize = 0;
+  int64_t ModTime = 0;  /* When indexed; a newer file is indexed again */
+  uint64_t StartLSN = 0;
+  uint64_t EndLSN = 0;  /* End of valid WAL, 0 if none */
+  int64_t FirstTime = 0; /* Earliest and latest sample, 0 if none */
+  int64_t LastTime = 0;
+  std::vector<WalTimePoint> Points; /* By LSN */
+};
+
+class WalTimeIndex {
+public:
+  // Brings the index up to date with paths, sorted by name: segments
+  // indexed before and unchanged since are kept, the rest are parsed on
+  // `threads` workers (0 = all cores) and files not in paths dropped.
+  // done counts the files finished, for progress.
+  void Update(const std::vector<std::string> &paths, unsigned threads = 0,
+              std::atomic<size_t> *done = nullptr);
+
+  // The last sample before time, so the records from time on follow it.
+  // False if time is before the first sample or after the last.
+  bool Find(int64_t time, WalTimePoint &out, size_t *segment = nullptr) const;
+  // The first sample at or after time: the WAL before it was written
+  // before then. False if time is after the last sample.
+  bool FindEnd(int64_t time, WalTimePoint &out) const;
+
+  // WAL written per second in `buckets` equal slices of [from, to), by
+  // the samples either side of each stretch of WAL.
+  void Rate(int64_t from, int64_t to, size_t buckets,
+            std::vector<float> &bytes_per_sec) const;
+
+  const std::vector<WalSegmentTimes> &Segments() const { return segments_; }
+  // Nullptr if the file isn't indexed.
+  const WalSegmentTimes *FindSegment(const std::string &file_name) const;
+  uint64_t SystemId() const { return system_id_; }
+  int64_t FirstTime() const; /* 0 if empty */
+  int64_t LastTime() const;
+  size_t PointCount() const { return points_.size(); }
+  size_t MemoryUsage() const;
+
+  // Written to a temporary file and renamed over path, like the catalog
+  // snapshots. Load fails on a file of another version or a corrupt one.
+  bool Save(const std::string &path, std::string &error) const;
+  bool Load(const std::string &path, std::string &error);
+
+private:
+  void Rebuild();
+
+  uint64_t system_id_ = 0;
+  std::vector<WalSegmentTimes> segments_;
+  // Every sample by LSN, with the running maximum of the times: commit
+  // times may run a little backwards, their maximum never does.
+  std::vector<WalTimePoint> points_;
+  std::vector<int64_t> max_time_;
+  std::vector<uint32_t> point_segment_;
+};
+
+// dir/times-<system id>.bin, next to the catalog snapshots.
+std::string WalTimeIndexPath(const std::string &dir, uint64_t system_id);
+
+// Load, Update and Save in one: the index saved in cache_dir for the
+// cluster of paths, brought up to date with them; nothing is kept with an
+// empty cache_dir. Only a failure to save is an error; the index is usable
+// either way.
+bool WalRefreshTimeIndex(const std::vector<std::string> &paths,
+                         const std::string &cache_dir, WalTimeIndex &index,
+                         std::string &error, unsigned threads = 0,
+                         std::atomic<size_t> *done = nullptr);
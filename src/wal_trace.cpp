@@ -0,0 +1,232 @@
+#include "wal_trace.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A thread's events live in chunks that are allocated as needed and never
+// freed or moved, so the writer can append while another thread reads up to
+// the published count.
+#define WAL_TRACE_CHUNK_EVENTS 4096
+#define WAL_TRACE_MAX_CHUNKS 64 // 256K events per thread
+
+namespace {
+
+struct Event {
+  const char *category;
+  const char *name;
+  int64_t begin_ns;
+  int64_t dur_ns;
+  uint64_t bytes;
+  uint64_t items;
+  int64_t crc_ns;
+  char segment[40];
+};
+
+struct ThreadBuffer {
+  int tid = 0;
+  char name[32] = "";
+  // Of the recording count belongs to; stored after count and dropped are
+  // reset, so a reader that sees it sees them reset
+  std::atomic<uint32_t> generation{0};
+  std::atomic<size_t> count{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<Event *> chunks[WAL_TRACE_MAX_CHUNKS] = {};
+
+  ~ThreadBuffer() {
+    for (auto &chunk : chunks)
+      delete[] chunk.load();
+  }
+};
+
+std::atomic<bool> enabled{false};
+std::atomic<uint32_t> generation{0};
+// Stored before generation is bumped; read after loading generation
+std::atomic<int64_t> start_ns{0};
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+thread_local ThreadBuffer *local_buffer = nullptr;
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+ThreadBuffer *LocalBuffer() {
+  if (!local_buffer) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(std::make_unique<ThreadBuffer>());
+    local_buffer = registry.back().get();
+    local_buffer->tid = (int)registry.size();
+  }
+  return local_buffer;
+}
+
+void Append(const Event &event) {
+  ThreadBuffer *buf = LocalBuffer();
+  uint32_t gen = generation.load(std::memory_order_acquire);
+  if (buf->generation.load(std::memory_order_relaxed) != gen) {
+    // First event since WalTraceStart(): reuse the chunks from the start
+    buf->count.store(0, std::memory_order_relaxed);
+    buf->dropped.store(0, std::memory_order_relaxed);
+    buf->generation.store(gen, std::memory_order_release);
+  }
+  size_t n = buf->count.load(std::memory_order_relaxed);
+  size_t chunk_index = n / WAL_TRACE_CHUNK_EVENTS;
+  if (chunk_index >= WAL_TRACE_MAX_CHUNKS) {
+    buf->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Event *chunk = buf->chunks[chunk_index].load(std::memory_order_relaxed);
+  if (!chunk) {
+    chunk = new Event[WAL_TRACE_CHUNK_EVENTS];
+    buf->chunks[chunk_index].store(chunk, std::memory_order_release);
+  }
+  chunk[n % WAL_TRACE_CHUNK_EVENTS] = event;
+  buf->count.store(n + 1, std::memory_order_release);
+}
+
+} // namespace
+
+void WalTraceStart() {
+  start_ns.store(NowNs(), std::memory_order_relaxed);
+  generation.fetch_add(1, std::memory_order_acq_rel);
+  enabled.store(true, std::memory_order_release);
+}
+
+void WalTraceStop() { enabled.store(false, std::memory_order_release); }
+
+bool WalTraceEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+void WalTraceSetThreadName(const char *name) {
+  ThreadBuffer *buf = LocalBuffer();
+  snprintf(buf->name, sizeof(buf->name), "%s", name);
+}
+
+uint64_t WalTraceEventCount() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  uint32_t gen = generation.load(std::memory_order_acquire);
+  uint64_t total = 0;
+  for (const auto &buf : registry) {
+    if (buf->generation.load(std::memory_order_acquire) == gen)
+      total += buf->count.load(std::memory_order_acquire);
+  }
+  return total;
+}
+
+uint64_t WalTraceDroppedCount() {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  uint32_t gen = generation.load(std::memory_order_acquire);
+  uint64_t total = 0;
+  for (const auto &buf : registry) {
+    if (buf->generation.load(std::memory_order_acquire) == gen)
+      total += buf->dropped.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+bool WalTraceWrite(const std::string &path, std::string &error) {
+  FILE *f = fopen(path.c_str(), "w");
+  if (!f) {
+    error = path + ": " + strerror(errno);
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  uint32_t gen = generation.load(std::memory_order_acquire);
+  int64_t start = start_ns.load(std::memory_order_relaxed);
+  uint64_t dropped = 0;
+  bool first = true;
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (const auto &buf : registry) {
+    fprintf(f,
+            "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"",
+            first ? "" : ",", buf->tid);
+    first = false;
+    if (buf->name[0])
+      fprintf(f, "%s\"}}", buf->name);
+    else
+      fprintf(f, "thread %d\"}}", buf->tid);
+
+    if (buf->generation.load(std::memory_order_acquire) != gen)
+      continue;
+    dropped += buf->dropped.load(std::memory_order_relaxed);
+    size_t n = buf->count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+      const Event *chunk = buf->chunks[i / WAL_TRACE_CHUNK_EVENTS].load(
+          std::memory_order_acquire);
+      const Event &e = chunk[i % WAL_TRACE_CHUNK_EVENTS];
+      fprintf(f,
+              ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+              "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+              e.name, e.category, buf->tid, (e.begin_ns - start) / 1e3,
+              e.dur_ns / 1e3);
+      const char *sep = "";
+      if (e.segment[0]) {
+        fprintf(f, "\"segment\":\"%s\"", e.segment);
+        sep = ",";
+      }
+      if (e.bytes) {
+        fprintf(f, "%s\"bytes\":%llu", sep, (unsigned long long)e.bytes);
+        sep = ",";
+      }
+      if (e.items) {
+        fprintf(f, "%s\"records\":%llu", sep, (unsigned long long)e.items);
+        sep = ",";
+      }
+      if (e.crc_ns)
+        fprintf(f, "%s\"crc_us\":%.3f", sep, e.crc_ns / 1e3);
+      fprintf(f, "}}");
+    }
+  }
+  fprintf(f, "\n],\"otherData\":{\"dropped_events\":%llu}}\n",
+          (unsigned long long)dropped);
+
+  bool ok = !ferror(f);
+  if (fclose(f) != 0)
+    ok = false;
+  if (!ok)
+    error = path + ": write failed";
+  return ok;
+}
+
+WalTraceScope::WalTraceScope(const char *category, const char *name)
+    : category_(category), name_(name), active_(WalTraceEnabled()) {
+  if (active_)
+    begin_ns_ = NowNs();
+}
+
+WalTraceScope::~WalTraceScope() {
+  if (!active_)
+    return;
+  Event event;
+  event.category = category_;
+  event.name = name_;
+  event.begin_ns = begin_ns_;
+  event.dur_ns = NowNs() - begin_ns_;
+  event.bytes = bytes_;
+  event.items = items_;
+  event.crc_ns = crc_ns_;
+  memcpy(event.segment, segment_, sizeof(event.segment));
+  Append(event);
+}
+
+void WalTraceScope::SetSegment(const std::string &path) {
+  if (!active_)
+    return;
+  size_t slash = path.find_last_of("/\\");
+  size_t base = slash == std::string::npos ? 0 : slash + 1;
+  snprintf(segment_, sizeof(segment_), "%s", path.c_str() + base);
+  // Kept out of the JSON string syntax
+  for (char *c = segment_; *c; c++) {
+    if (*c == '"' || *c == '\\' || (unsigned char)*c < 0x20)
+      *c = '_';
+  }
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Event recording for offline analysis of loading and parsing, written as
+// Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Each thread appends
+// to its own buffer without locking; nothing is recorded, and a
+// WalTraceScope costs one relaxed atomic load, until WalTraceStart().
+//
+//   WalTraceScope trace("io", "read");
+//   trace.SetSegment(path);
+//   ...
+//   trace.SetBytes(n);
+
+// Drops what was recorded before and starts recording.
+void WalTraceStart();
+// Stops recording. Call before WalTraceWrite(); scopes still open finish
+// their events.
+void WalTraceStop();
+bool WalTraceEnabled();
+// Shown as the thread's name in the trace. Can be called while stopped.
+void WalTraceSetThreadName(const char *name);
+// Events recorded since WalTraceStart(), and those dropped because a
+// thread's buffer was full.
+uint64_t WalTraceEventCount();
+uint64_t WalTraceDroppedCount();
+bool WalTraceWrite(const std::string &path, std::string &error);
+
+class WalTraceScope {
+public:
+  // category and name must be string literals (they are kept by pointer).
+  WalTraceScope(const char *category, const char *name);
+  ~WalTraceScope();
+  WalTraceScope(const WalTraceScope &) = delete;
+  WalTraceScope &operator=(const WalTraceScope &) = delete;
+
+  bool Active() const { return active_; }
+  // Arguments of the event; the segment is shown by file name.
+  void SetSegment(const std::string &path);
+  void SetBytes(uint64_t bytes) { bytes_ = bytes; }
+  void SetItems(uint64_t items) { items_ = items; }
+  void SetCrcNs(int64_t ns) { crc_ns_ = ns; }
+
+private:
+  const char *category_;
+  const char *name_;
+  bool active_;
+  int64_t begin_ns_ = 0;
+  uint64_t bytes_ = 0;
+  uint64_t items_ = 0;
+  int64_t crc_ns_ = 0;
+  char segment_[40] = "";
+};
@@ -0,0 +1,809 @@
+#include "wal_tuple.h"
+#include "wal_fpi.h"
+#include <algorithm>
+#include <cfloat>
+#include <cinttypes>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// xl_heap_insert, xl_heap_delete and xl_heap_update
+#define SizeOfHeapInsert 3
+#define SizeOfHeapDelete 8
+#define SizeOfHeapUpdate 14
+#define SizeOfHeapHeader 5 /* t_infomask2, t_infomask, t_hoff */
+#define XLH_DELETE_CONTAINS_OLD_TUPLE 0x02
+#define XLH_DELETE_CONTAINS_OLD_KEY 0x04
+#define XLH_UPDATE_CONTAINS_OLD_TUPLE 0x04
+#define XLH_UPDATE_CONTAINS_OLD_KEY 0x08
+#define XLH_UPDATE_PREFIX_FROM_OLD 0x20
+#define XLH_UPDATE_SUFFIX_FROM_OLD 0x40
+
+// HeapTupleHeaderData: the fields up to t_bits, then the bitmap
+#define SizeofHeapTupleHeader 23
+#define HEAP_HASNULL 0x0001
+#define HEAP_NATTS_MASK 0x07FF
+#define SizeOfPageHeader 24
+#define LP_NORMAL 1
+
+// Type OIDs from pg_type.dat
+#define BOOLOID 16
+#define BYTEAOID 17
+#define CHAROID 18
+#define NAMEOID 19
+#define INT8OID 20
+#define INT2OID 21
+#define INT4OID 23
+#define REGPROCOID 24
+#define TEXTOID 25
+#define OIDOID 26
+#define XIDOID 28
+#define CIDOID 29
+#define JSONOID 114
+#define XMLOID 142
+#define FLOAT4OID 700
+#define FLOAT8OID 701
+#define MONEYOID 790
+#define BPCHAROID 1042
+#define VARCHAROID 1043
+#define DATEOID 1082
+#define TIMEOID 1083
+#define TIMESTAMPOID 1114
+#define TIMESTAMPTZOID 1184
+#define INTERVALOID 1186
+#define NUMERICOID 1700
+#define REGCLASSOID 2205
+#define UUIDOID 2950
+#define PG_LSNOID 3220
+#define JSONBOID 3802
+
+#define VARTAG_ONDISK 18
+#define VARLENA_EXTERNAL_SIZE 16 /* varatt_external */
+#define MAX_DECOMPRESSED (64 << 20)
+
+namespace {
+
+uint16_t Read16(const uint8_t *p) {
+  uint16_t v;
+  memcpy(&v, p, 2);
+  return v;
+}
+
+uint32_t Read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+int64_t Read64(const uint8_t *p) {
+  int64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+// The tuple at offset off (1-based) of a full-page image.
+bool TupleFromImage(const WalDecodedBlock &block, uint16_t off,
+                    WalHeapTuple &tuple) {
+  if (!block.Node.hasImage || off == 0)
+    return false;
+  int32_t raw_len = WAL_PAGE_SIZE - block.HoleLength;
+  if (block.HoleOffset > raw_len)
+    return false;
+  std::vector<uint8_t> raw(raw_len);
+  WalFpiCompression compression =
+      WalFpiCompressionFromFlags(block.ImageInfo);
+  if (compression == WalFpiCompression::None) {
+    if (block.ImageLength != raw_len)
+      return false;
+    memcpy(raw.data(), block.Image, raw_len);
+  } else if (WalDecompressPageImage(compression, block.Image,
+                                    block.ImageLength, raw.data(),
+                                    raw_len) != raw_len) {
+    return false;
+  }
+  std::vector<uint8_t> page(WAL_PAGE_SIZE, 0);
+  memcpy(page.data(), raw.data(), block.HoleOffset);
+  memcpy(page.data() + block.HoleOffset + block.HoleLength,
+         raw.data() + block.HoleOffset, raw_len - block.HoleOffset);
+
+  size_t item = SizeOfPageHeader + (size_t)(off - 1) * 4;
+  if (item + 4 > WAL_PAGE_SIZE)
+    return false;
+  uint32_t lp = Read32(page.data() + item);
+  // ItemIdData: lp_off:15, lp_flags:2, lp_len:15
+  uint32_t lp_off = lp & 0x7FFF, lp_flags = (lp >> 15) & 3;
+  uint32_t lp_len = lp >> 17;
+  if (lp_flags != LP_NORMAL || lp_len < SizeofHeapTupleHeader ||
+      lp_off + lp_len > WAL_PAGE_SIZE)
+    return false;
+  const uint8_t *t = page.data() + lp_off;
+  tuple.Infomask2 = Read16(t + 18);
+  tuple.Infomask = Read16(t + 20);
+  tuple.Hoff = t[22];
+  tuple.FromImage = true;
+  tuple.Bytes.assign(t + SizeofHeapTupleHeader, t + lp_len);
+  return true;
+}
+
+// xl_heap_header followed by the tuple from t_bits on
+bool TupleFromHeader(const uint8_t *p, size_t len, WalHeapTuple &tuple) {
+  if (!p || len < SizeOfHeapHeader)
+    return false;
+  tuple.Infomask2 = Read16(p);
+  tuple.Infomask = Read16(p + 2);
+  tuple.Hoff = p[4];
+  tuple.Bytes.assign(p + SizeOfHeapHeader, p + len);
+  return true;
+}
+
+const WalDecodedBlock *FindBlock(const WalDecodedRecord &rec, uint8_t id) {
+  for (const WalDecodedBlock &b : rec.Blocks) {
+    if (b.Id == id)
+      return &b;
+  }
+  return nullptr;
+}
+
+// The new tuple of an insert or update, in block 0's data after skip
+// bytes, or else in its image.
+bool NewTuple(const WalDecodedRecord &rec, size_t skip, uint16_t off,
+              WalHeapTuple &tuple) {
+  const WalDecodedBlock *block = FindBlock(rec, 0);
+  if (!block)
+    return false;
+  if (block->HasData && block->DataLength >= skip)
+    return TupleFromHeader(block->Data + skip, block->DataLength - skip,
+                           tuple);
+  return TupleFromImage(*block, off, tuple);
+}
+
+WalHeapTuple EmptyTuple(const char *role) {
+  WalHeapTuple t;
+  t.Role = role;
+  t.Infomask2 = t.Infomask = 0;
+  t.Hoff = SizeofHeapTupleHeader;
+  t.Prefix = t.Suffix = 0;
+  t.FromImage = false;
+  return t;
+}
+
+void Appendf(std::string &out, const char *fmt, ...) {
+  char buf[128];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n > 0)
+    out.append(buf, std::min((size_t)n, sizeof(buf) - 1));
+}
+
+void AppendHex(std::string &out, const uint8_t *p, size_t len,
+               size_t max_text) {
+  static const char digits[] = "0123456789abcdef";
+  out += "\\x";
+  for (size_t i = 0; i < len && i * 2 < max_text; i++) {
+    out += digits[p[i] >> 4];
+    out += digits[p[i] & 15];
+  }
+  if (len * 2 > max_text)
+    out += "...";
+}
+
+// As an SQL literal, control characters escaped.
+void AppendQuoted(std::string &out, const uint8_t *p, size_t len,
+                  size_t max_text) {
+  out += '\'';
+  for (size_t i = 0; i < len && i < max_text; i++) {
+    char c = (char)p[i];
+    if (c == '\'')
+      out += "''";
+    else if (c == '\n')
+      out += "\\n";
+    else if ((uint8_t)c < 0x20)
+      Appendf(out, "\\x%02X", (uint8_t)c);
+    else
+      out += c;
+  }
+  out += '\'';
+  if (len > max_text)
+    out += "...";
+}
+
+// Days since 2000-01-01 -> "2024-01-31", by Howard Hinnant's
+// civil_from_days.
+void AppendDate(std::string &out, int32_t days) {
+  int64_t z = (int64_t)days + 10957 + 719468; // From 0000-03-01
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  int64_t doe = z - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  int64_t d = doy - (153 * mp + 2) / 5 + 1;
+  int64_t m = mp < 10 ? mp + 3 : mp - 9;
+  int64_t y = yoe + era * 400 + (m <= 2);
+  Appendf(out, "%04" PRId64 "-%02" PRId64 "-%02" PRId64, y, m, d);
+}
+
+// Microseconds into the day -> "14:03:27[.123]"
+void AppendTime(std::string &out, int64_t us) {
+  Appendf(out, "%02" PRId64 ":%02" PRId64 ":%02" PRId64, us / 3600000000,
+          us / 60000000 % 60, us / 1000000 % 60);
+  int64_t frac = us % 1000000;
+  if (frac) {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "%06" PRId64, frac);
+    size_t n = 6;
+    while (buf[n - 1] == '0')
+      n--;
+    out += '.';
+    out.append(buf, n);
+  }
+}
+
+void AppendTimestamp(std::string &out, int64_t ts) {
+  if (ts == INT64_MAX || ts == INT64_MIN) {
+    out += ts > 0 ? "infinity" : "-infinity";
+    return;
+  }
+  const int64_t day = 86400000000LL;
+  int64_t days = ts / day, us = ts % day;
+  if (us < 0) {
+    us += day;
+    days--;
+  }
+  AppendDate(out, (int32_t)days);
+  out += ' ';
+  AppendTime(out, us);
+}
+
+// numeric's on-disk form: a header word (short or long format, or a
+// special value) and base-10000 digits.
+void AppendNumeric(std::string &out, const uint8_t *p, size_t len) {
+  if (len < 2)
+    return;
+  uint16_t header = Read16(p);
+  if ((header & 0xC000) == 0xC000) {
+    out += header == 0xC000 ? "NaN"
+           : header == 0xD000 ? "Infinity"
+                              : "-Infinity";
+    return;
+  }
+  bool negative;
+  int dscale, weight;
+  size_t digits_at;
+  if (header & 0x8000) { // Short format
+    negative = header & 0x2000;
+    dscale = (header & 0x1F80) >> 7;
+    weight = (header & 0x0040 ? ~0x003F : 0) | (header & 0x003F);
+    digits_at = 2;
+  } else {
+    if (len < 4)
+      return;
+    negative = (header & 0xC000) == 0x4000;
+    dscale = header & 0x3FFF;
+    weight = (int16_t)Read16(p + 2);
+    digits_at = 4;
+  }
+  int ndigits = (int)((len - digits_at) / 2);
+  auto digit = [&](int i) -> int {
+    return i >= 0 && i < ndigits ? Read16(p + digits_at + i * 2) : 0;
+  };
+  if (negative)
+    out += '-';
+  if (weight < 0) {
+    out += '0';
+  } else {
+    Appendf(out, "%d", digit(0));
+    for (int i = 1; i <= weight; i++)
+      Appendf(out, "%04d", digit(i));
+  }
+  if (dscale > 0) {
+    std::string frac;
+    for (int i = weight + 1; (int)frac.size() < dscale; i++)
+      Appendf(frac, "%04d", digit(i));
+    out += '.';
+    out.append(frac, 0, dscale);
+  }
+}
+
+// Shortest digits that read back as the same value, in fixed notation
+// unless the exponent is below -4 or at least max_fixed: float4out and
+// float8out with the default extra_float_digits.
+void AppendFloat(std::string &out, double v, int max_fixed, int max_digits) {
+  if (std::isnan(v)) {
+    out += "NaN";
+    return;
+  }
+  if (std::isinf(v)) {
+    out += v > 0 ? "Infinity" : "-Infinity";
+    return;
+  }
+  if (v == 0) {
+    out += std::signbit(v) ? "-0" : "0";
+    return;
+  }
+  char buf[64];
+  int digits = 1;
+  for (; digits < max_digits; digits++) {
+    snprintf(buf, sizeof(buf), "%.*e", digits - 1, v);
+    double back = strtod(buf, nullptr);
+    if (max_digits == FLT_DECIMAL_DIG ? (float)back == (float)v : back == v)
+      break;
+  }
+  snprintf(buf, sizeof(buf), "%.*e", digits - 1, v);
+  int exp = atoi(strchr(buf, 'e') + 1);
+  if (exp < -4 || exp >= max_fixed)
+    out += buf;
+  else
+    Appendf(out, "%.*f", std::max(0, digits - 1 - exp), v);
+}
+
+// cash_out in the C locale: "-$1,234.56"
+void AppendMoney(std::string &out, int64_t cents) {
+  uint64_t v = cents < 0 ? 0 - (uint64_t)cents : (uint64_t)cents;
+  std::string units = std::to_string(v / 100);
+  if (cents < 0)
+    out += '-';
+  out += '$';
+  for (size_t i = 0; i < units.size(); i++) {
+    if (i > 0 && (units.size() - i) % 3 == 0)
+      out += ',';
+    out += units[i];
+  }
+  Appendf(out, ".%02d", (int)(v % 100));
+}
+
+// interval_out with IntervalStyle postgres: "1 year 2 mons 3 days
+// 04:05:06", "00:00:00" when zero. After a negative field the positive
+// ones get a '+'.
+void AppendInterval(std::string &out, int64_t us, int32_t days,
+                    int32_t months) {
+  bool is_zero = true, is_before = false;
+  auto part = [&](int32_t value, const char *unit) {
+    if (value == 0)
+      return;
+    Appendf(out, "%s%s%d %s%s", is_zero ? "" : " ",
+            is_before && value > 0 ? "+" : "", value, unit,
+            value != 1 ? "s" : "");
+    is_zero = false;
+    is_before = value < 0;
+  };
+  part(months / 12, "year");
+  part(months % 12, "mon");
+  part(days, "day");
+  if (is_zero || us != 0) {
+    if (!is_zero)
+      out += ' ';
+    if (us < 0)
+      out += '-';
+    else if (is_before)
+      out += '+';
+    AppendTime(out, us < 0 ? -us : us);
+  }
+}
+
+void AppendUuid(std::string &out, const uint8_t *p) {
+  for (int i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      out += '-';
+    Appendf(out, "%02x", p[i]);
+  }
+}
+
+// A value of type type_oid held in len bytes (a varlena's without its
+// header).
+void AppendValue(std::string &out, uint32_t type_oid, const uint8_t *p,
+                 size_t len, size_t max_text) {
+  switch (type_oid) {
+  case BOOLOID:
+    if (len >= 1)
+      out += p[0] ? "t" : "f";
+    return;
+  case INT2OID:
+    if (len >= 2)
+      Appendf(out, "%d", (int16_t)Read16(p));
+    return;
+  case INT4OID:
+    if (len >= 4)
+      Appendf(out, "%d", (int32_t)Read32(p));
+    return;
+  case INT8OID:
+    if (len >= 8)
+      Appendf(out, "%" PRId64, Read64(p));
+    return;
+  case OIDOID:
+  case REGPROCOID:
+  case REGCLASSOID:
+  case XIDOID:
+  case CIDOID:
+    if (len >= 4)
+      Appendf(out, "%u", Read32(p));
+    return;
+  case FLOAT4OID:
+    if (len >= 4) {
+      float f;
+      memcpy(&f, p, 4);
+      AppendFloat(out, f, FLT_DIG, FLT_DECIMAL_DIG);
+    }
+    return;
+  case FLOAT8OID:
+    if (len >= 8) {
+      double d;
+      memcpy(&d, p, 8);
+      AppendFloat(out, d, DBL_DIG, DBL_DECIMAL_DIG);
+    }
+    return;
+  case MONEYOID:
+    if (len >= 8)
+      AppendMoney(out, Read64(p));
+    return;
+  case DATEOID:
+    if (len >= 4) {
+      int32_t days = (int32_t)Read32(p);
+      if (days == INT32_MAX || days == INT32_MIN)
+        out += days > 0 ? "infinity" : "-infinity";
+      else
+        AppendDate(out, days);
+    }
+    return;
+  case TIMEOID:
+    if (len >= 8)
+      AppendTime(out, Read64(p));
+    return;
+  case TIMESTAMPOID:
+  case TIMESTAMPTZOID:
+    if (len >= 8) {
+      AppendTimestamp(out, Read64(p));
+      if (type_oid == TIMESTAMPTZOID)
+        out += "+00";
+    }
+    return;
+  case INTERVALOID:
+    if (len >= 16)
+      AppendInterval(out, Read64(p), (int32_t)Read32(p + 8),
+                     (int32_t)Read32(p + 12));
+    return;
+  case UUIDOID:
+    if (len >= 16)
+      AppendUuid(out, p);
+    return;
+  case PG_LSNOID:
+    if (len >= 8) {
+      uint64_t lsn = (uint64_t)Read64(p);
+      Appendf(out, "%X/%X", (uint32_t)(lsn >> 32), (uint32_t)lsn);
+    }
+    return;
+  case NUMERICOID:
+    AppendNumeric(out, p, len);
+    return;
+  case NAMEOID:
+    AppendQuoted(out, p, strnlen((const char *)p, len), max_text);
+    return;
+  case CHAROID:
+  case TEXTOID:
+  case VARCHAROID:
+  case BPCHAROID:
+  case JSONOID:
+  case XMLOID:
+    AppendQuoted(out, p, len, max_text);
+    return;
+  case JSONBOID:
+    Appendf(out, "(jsonb, %zu bytes)", len);
+    return;
+  default:
+    AppendHex(out, p, len, max_text);
+    return;
+  }
+}
+
+size_t AlignUp(size_t off, uint8_t align) {
+  return (off + align - 1) & ~(size_t)(align - 1);
+}
+
+} // namespace
+
+bool WalExtractHeapTuples(const WalDecodedRecord &rec,
+                          std::vector<WalHeapTuple> &out, std::string &why) {
+  out.clear();
+  if (rec.RMID != RM_HEAP_ID) {
+    why = "not a Heap record";
+    return false;
+  }
+  const uint8_t *d = rec.MainData;
+  uint32_t len = rec.MainDataLength;
+  uint8_t op = rec.Info & XLOG_HEAP_OPMASK;
+  switch (op) {
+  case XLOG_HEAP_INSERT: {
+    if (len < SizeOfHeapInsert)
+      break;
+    WalHeapTuple tuple = EmptyTuple("new");
+    if (NewTuple(rec, 0, Read16(d), tuple))
+      out.push_back(std::move(tuple));
+    break;
+  }
+  case XLOG_HEAP_UPDATE:
+  case XLOG_HEAP_HOT_UPDATE: {
+    if (len < SizeOfHeapUpdate)
+      break;
+    uint8_t flags = d[7];
+    WalHeapTuple tuple = EmptyTuple("new");
+    // The lengths left out come first in block 0's data
+    size_t skip = 0;
+    const WalDecodedBlock *block = FindBlock(rec, 0);
+    if (block && block->HasData) {
+      if ((flags & XLH_UPDATE_PREFIX_FROM_OLD) &&
+          block->DataLength >= skip + 2) {
+        tuple.Prefix = Read16(block->Data + skip);
+        skip += 2;
+      }
+      if ((flags & XLH_UPDATE_SUFFIX_FROM_OLD) &&
+          block->DataLength >= skip + 2) {
+        tuple.Suffix = Read16(block->Data + skip);
+        skip += 2;
+      }
+    }
+    if (NewTuple(rec, skip, Read16(d + 12), tuple))
+      out.push_back(std::move(tuple));
+    WalHeapTuple old = EmptyTuple("old");
+    if ((flags &
+         (XLH_UPDATE_CONTAINS_OLD_TUPLE | XLH_UPDATE_CONTAINS_OLD_KEY)) &&
+        TupleFromHeader(d + SizeOfHeapUpdate, len - SizeOfHeapUpdate, old))
+      out.push_back(std::move(old));
+    break;
+  }
+  case XLOG_HEAP_DELETE: {
+    if (len < SizeOfHeapDelete)
+      break;
+    uint8_t flags = d[7];
+    WalHeapTuple old = EmptyTuple("old");
+    const WalDecodedBlock *block = FindBlock(rec, 0);
+    if ((flags &
+         (XLH_DELETE_CONTAINS_OLD_TUPLE | XLH_DELETE_CONTAINS_OLD_KEY)) &&
+        TupleFromHeader(d + SizeOfHeapDelete, len - SizeOfHeapDelete, old))
+      out.push_back(std::move(old));
+    else if (block && TupleFromImage(*block, Read16(d + 4), old))
+      out.push_back(std::move(old));
+    if (out.empty())
+      why = "the deleted tuple isn't logged (REPLICA IDENTITY DEFAULT "
+            "logs only key columns that changed, and no full-page image)";
+    return !out.empty();
+  }
+  default:
+    why = "only inserts, updates and deletes carry tuples";
+    return false;
+  }
+  if (out.empty())
+    why = "no tuple data in the record";
+  return !out.empty();
+}
+
+void WalTupleLayout::Add(const std::string &name, uint32_t type_oid,
+                         int16_t length, char align, bool by_val,
+                         bool dropped) {
+  WalAttribute a;
+  a.TypeOid = dropped ? 0 : type_oid;
+  a.Length = length;
+  a.Align = align == 'd' ? 8 : align == 'i' ? 4 : align == 's' ? 2 : 1;
+  a.ByVal = by_val;
+  a.Name = (uint32_t)Names.size();
+  Attributes.push_back(a);
+  Names += name;
+  Names += '\0';
+}
+
+std::string WalTypeName(uint32_t type_oid) {
+  switch (type_oid) {
+  case 0:
+    return "(dropped)";
+  case BOOLOID:
+    return "bool";
+  case BYTEAOID:
+    return "bytea";
+  case CHAROID:
+    return "char";
+  case NAMEOID:
+    return "name";
+  case INT8OID:
+    return "int8";
+  case INT2OID:
+    return "int2";
+  case INT4OID:
+    return "int4";
+  case REGPROCOID:
+    return "regproc";
+  case TEXTOID:
+    return "text";
+  case OIDOID:
+    return "oid";
+  case XIDOID:
+    return "xid";
+  case CIDOID:
+    return "cid";
+  case JSONOID:
+    return "json";
+  case XMLOID:
+    return "xml";
+  case FLOAT4OID:
+    return "float4";
+  case FLOAT8OID:
+    return "float8";
+  case MONEYOID:
+    return "money";
+  case BPCHAROID:
+    return "bpchar";
+  case VARCHAROID:
+    return "varchar";
+  case DATEOID:
+    return "date";
+  case TIMEOID:
+    return "time";
+  case TIMESTAMPOID:
+    return "timestamp";
+  case TIMESTAMPTZOID:
+    return "timestamptz";
+  case INTERVALOID:
+    return "interval";
+  case NUMERICOID:
+    return "numeric";
+  case REGCLASSOID:
+    return "regclass";
+  case UUIDOID:
+    return "uuid";
+  case PG_LSNOID:
+    return "pg_lsn";
+  case JSONBOID:
+    return "jsonb";
+  }
+  return std::to_string(type_oid);
+}
+
+void WalDecodeTuple(const WalTupleLayout &layout, const WalHeapTuple &tuple,
+                    std::vector<WalColumnValue> &out, size_t max_text) {
+  out.clear();
+  // The column data starts at t_hoff, which is MAXALIGNed, so alignment
+  // can be counted from there. An update may leave out a prefix and a
+  // suffix of it; those bytes are the old version's.
+  size_t data_at = tuple.Hoff > SizeofHeapTupleHeader
+                       ? tuple.Hoff - SizeofHeapTupleHeader
+                       : 0;
+  size_t given =
+      tuple.Bytes.size() > data_at ? tuple.Bytes.size() - data_at : 0;
+  size_t known_end = tuple.Prefix + given;
+  auto known = [&](size_t off, size_t len) {
+    return off >= tuple.Prefix && off + len <= known_end;
+  };
+  // Only for known bytes
+  auto at = [&](size_t off) {
+    return tuple.Bytes.data() + data_at + (off - tuple.Prefix);
+  };
+  size_t natts = tuple.Infomask2 & HEAP_NATTS_MASK;
+  bool has_nulls = tuple.Infomask & HEAP_HASNULL;
+
+  std::vector<uint8_t> raw; // A value decompressed
+  size_t off = 0;
+  bool lost = false; // Past a column of unknown length
+  for (size_t i = 0; i < layout.Attributes.size(); i++) {
+    const WalAttribute &a = layout.Attributes[i];
+    WalColumnValue v;
+    v.Attnum = (uint16_t)(i + 1);
+    out.push_back(v);
+    std::string &value = out.back().Value;
+    if (i >= natts) {
+      value = "(not in tuple: column added later)";
+      continue;
+    }
+    if (has_nulls && (i >> 3 >= data_at ||
+                      !(tuple.Bytes[i >> 3] & (1 << (i & 7))))) {
+      value = "NULL";
+      continue;
+    }
+    if (lost) {
+      value = "(unknown: follows an unlogged column)";
+      continue;
+    }
+    if (off >= known_end && tuple.Suffix) {
+      value = "(unchanged)";
+      continue;
+    }
+
+    // Where the value starts and how long it is. A varlena with a 1-byte
+    // header isn't aligned; alignment padding is zeroes.
+    const uint8_t *payload = nullptr;
+    size_t length = 0, payload_length = 0;
+    std::string note;
+    if (a.Length > 0) {
+      off = AlignUp(off, a.Align);
+      length = payload_length = a.Length;
+      if (known(off, length))
+        payload = at(off);
+    } else if (a.Length == -1) {
+      if (!known(off, 1)) {
+        value = "(unchanged)";
+        lost = true;
+        continue;
+      }
+      if (*at(off) == 0)
+        off = AlignUp(off, a.Align);
+      // A short varlena may be a single byte, an empty string
+      uint8_t b = known(off, 1) ? *at(off) : 0;
+      if (!known(off, b == 0x01 ? 2 : 1)) {
+        value = "(truncated)";
+        lost = true;
+        continue;
+      }
+      if (b == 0x01) { // TOAST pointer, then its tag
+        bool on_disk = at(off)[1] == VARTAG_ONDISK;
+        length = 2 + (on_disk ? VARLENA_EXTERNAL_SIZE : 8);
+        if (known(off, length) && on_disk) {
+          const uint8_t *ext = at(off) + 2;
+          Appendf(note, "(TOASTed: %u bytes, value %u in toast relation %u)",
+                  Read32(ext) - 4, Read32(ext + 8), Read32(ext + 12));
+        } else {
+          note = "(TOASTed)";
+        }
+      } else if (b & 0x01) {
+        length = b >> 1;
+        payload = at(off) + 1;
+        payload_length = length - 1;
+      } else if (known(off, 4)) {
+        uint32_t header = Read32(at(off));
+        length = header >> 2;
+        if ((header & 0x03) == 0x02 && known(off, 8) && length >= 8) {
+          // Compressed in line: decompressed if it is all here
+          uint32_t info = Read32(at(off) + 4);
+          int32_t raw_len = (int32_t)(info & 0x3FFFFFFF);
+          WalFpiCompression method = info >> 30 == 0
+                                         ? WalFpiCompression::Pglz
+                                         : WalFpiCompression::Lz4;
+          if (known(off, length) && raw_len <= MAX_DECOMPRESSED) {
+            raw.resize(raw_len);
+            if (WalDecompressPageImage(method, at(off) + 8,
+                                       (int32_t)(length - 8), raw.data(),
+                                       raw_len) == raw_len) {
+              payload = raw.data();
+              payload_length = raw_len;
+            }
+          }
+          if (!payload)
+            Appendf(note, "(compressed: %d bytes)", raw_len);
+        } else {
+          payload = at(off) + 4;
+          payload_length = length >= 4 ? length - 4 : 0;
+        }
+      }
+      if (length == 0) {
+        value = "(truncated)";
+        lost = true;
+        continue;
+      }
+    } else { // C string
+      if (!known(off, 1)) {
+        value = "(unchanged)";
+        lost = true;
+        continue;
+      }
+      size_t n = strnlen((const char *)at(off), known_end - off);
+      length = n + 1;
+      payload = at(off);
+      payload_length = n;
+    }
+
+    if (!known(off, length)) {
+      bool inside = off + length <= tuple.Prefix || off >= known_end;
+      value = inside ? "(unchanged)" : "(changed, partly logged)";
+      if (off + length > tuple.Prefix + given + tuple.Suffix) {
+        value = "(truncated)";
+        lost = true;
+      }
+    } else if (!note.empty()) {
+      value = note;
+    } else if (a.TypeOid == 0) {
+      value = "(dropped)";
+    } else {
+      AppendValue(value, a.TypeOid, payload, payload_length, max_text);
+    }
+    off += length;
+  }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "wal_record_decode.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Column values of the heap tuples a record carries, decoded with the
+// relation's pg_attribute rows. A tuple is stored as PostgreSQL keeps it
+// on the page: a null bitmap, then each non-null column at its alignment,
+// fixed-width ones by length, variable-width ones behind a varlena header.
+// Only the column layout is needed to walk it; the type OID picks how a
+// value is printed.
+
+// A heap tuple as a record carries it: the header fields xl_heap_header
+// keeps, and the tuple's bytes from t_bits on (null bitmap, padding to
+// t_hoff, column data).
+struct WalHeapTuple {
+  const char *Role;   /* "new" or "old" */
+  uint16_t Infomask2; /* Number of attributes in the low 11 bits */
+  uint16_t Infomask;
+  uint8_t Hoff;
+  // An update on the same page may leave out the leading and trailing
+  // column bytes it has in common with the old version.
+  uint16_t Prefix;
+  uint16_t Suffix;
+  bool FromImage; /* Read from the block's full-page image */
+  std::vector<uint8_t> Bytes;
+};
+
+// The tuples of a heap INSERT, UPDATE or HOT_UPDATE (the new version, and
+// the old one or its key when REPLICA IDENTITY logs it) or DELETE (the old
+// one). A tuple left out of the block data because the page was logged
+// whole is read from the image. False with why set if there are none.
+bool WalExtractHeapTuples(const WalDecodedRecord &rec,
+                          std::vector<WalHeapTuple> &out, std::string &why);
+
+struct WalAttribute {
+  uint32_t TypeOid; /* 0 for a dropped column */
+  int16_t Length;   /* attlen: > 0 fixed, -1 varlena, -2 C string */
+  uint8_t Align;    /* attalign in bytes: 1, 2, 4 or 8 */
+  bool ByVal;
+  uint32_t Name; /* Offset into WalTupleLayout::Names */
+};
+
+// The pg_attribute rows (attnum > 0, dropped ones included) of a relation.
+struct WalTupleLayout {
+  std::vector<WalAttribute> Attributes; /* By attnum */
+  std::string Names;                    /* Each followed by '\0' */
+
+  void Add(const std::string &name, uint32_t type_oid, int16_t length,
+           char align, bool by_val, bool dropped);
+  const char *Name(size_t i) const {
+    return Names.c_str() + Attributes[i].Name;
+  }
+  size_t MemoryUsage() const {
+    return sizeof(*this) + Attributes.capacity() * sizeof(WalAttribute) +
+           Names.capacity();
+  }
+};
+
+// "int4", "timestamptz", ... for the types values are printed for, else
+// the OID.
+std::string WalTypeName(uint32_t type_oid);
+
+struct WalColumnValue {
+  uint16_t Attnum;
+  // 'NULL', a value, or what is known about it in parentheses: left out
+  // of an update, TOASTed, past the end of a tuple written before the
+  // column was added, ...
+  std::string Value;
+};
+
+// Walks tuple with layout, one value per attribute. Values of common
+// types read as psql shows them with TimeZone UTC, IntervalStyle postgres
+// and lc_monetary C, except that strings are quoted as SQL literals; jsonb
+// is only sized and other types are shown as \x hex. Strings longer than
+// max_text bytes are cut.
+void WalDecodeTuple(const WalTupleLayout &layout, const WalHeapTuple &tuple,
+                    std::vector<WalColumnValue> &out, size_t max_text = 256);
@@ -0,0 +1,298 @@
+#include "imgui.h"
+#include "imgui_hex.h"
+#include "wal_parser.h"
+#include "wal_record_table.h"
+#include "wal_sparse.h"
+#include "wal_synth.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// Frame cost of the record table and the hex editor without a window or a
+// GPU: an ImGui context gets a display size, time steps and scripted mouse
+// input, and each frame is built up to ImGui::Render(). The draw data that
+// a backend would upload is measured instead of drawn.
+
+// Allocations per frame, counted like the GUI's performance overlay does.
+static std::atomic<uint64_t> alloc_count{0};
+
+void *operator new(size_t size) {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static void PrintUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "\n"
+          "Options:\n"
+          "      --seed N          Generator seed (default 42)\n"
+          "      --segments N      16 MB segments of records (default 4)\n"
+          "      --frames N        Measured frames per scenario (default "
+          "600)\n"
+          "      --size WxH        Display size (default 1920x1080)\n"
+          "      --wheel N         Mouse wheel steps per frame (default 1)\n"
+          "  -h, --help            Show this help\n",
+          prog);
+}
+
+enum class Scenario { Table, TableRawIds, Hex, Both };
+
+static const char *ScenarioName(Scenario s) {
+  switch (s) {
+  case Scenario::Table:
+    return "table";
+  case Scenario::TableRawIds:
+    return "table (raw ids)";
+  case Scenario::Hex:
+    return "hex";
+  case Scenario::Both:
+    return "table + hex";
+  }
+  return "?";
+}
+
+struct FrameSample {
+  double Ms;
+  int Vertices;
+  int DrawCmds;
+  uint64_t Allocs;
+};
+
+static std::vector<uint8_t> hex_data;
+
+static int HexRead(ImGuiHexEditorState *, int offset, void *buf, int size) {
+  if (offset >= (int)hex_data.size())
+    return 0;
+  int n = std::min(size, (int)hex_data.size() - offset);
+  memcpy(buf, hex_data.data() + offset, n);
+  return n;
+}
+
+static double Percentile(std::vector<double> v, double p) {
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int main(int argc, char **argv) {
+  WalSynthOptions options;
+  options.Seed = 42;
+  int segments = 4;
+  int frames = 600;
+  int width = 1920, height = 1080;
+  float wheel = 1.0f;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    auto next = [&](const char *opt) -> const char * {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Error: %s requires an argument\n", opt);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+      PrintUsage(argv[0]);
+      return 0;
+    } else if (!strcmp(arg, "--seed")) {
+      options.Seed = strtoull(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--segments")) {
+      segments = atoi(next(arg));
+    } else if (!strcmp(arg, "--frames")) {
+      frames = atoi(next(arg));
+    } else if (!strcmp(arg, "--size")) {
+      const char *v = next(arg);
+      if (sscanf(v, "%dx%d", &width, &height) != 2) {
+        fprintf(stderr, "Error: bad size '%s'\n", v);
+        return 1;
+      }
+    } else if (!strcmp(arg, "--wheel")) {
+      wheel = (float)atof(next(arg));
+    } else {
+      fprintf(stderr, "Error: unknown option '%s'\n", arg);
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (segments < 1 || frames < 1 || width < 320 || height < 240) {
+    fprintf(stderr, "Error: invalid options\n");
+    return 1;
+  }
+
+  // --- Records, names and bytes to show ---
+  std::vector<WalRecordInfo> records;
+  size_t first_segment_records = 0;
+  uint64_t first_segment_lsn = 0;
+  WalXactIndex xacts; // Row tints cost a lookup per row
+  {
+    WalSynthGenerator gen(options);
+    WalParser parser;
+    parser.SetRecordVisitor([&](const WalRecordInfo &info,
+                                const uint8_t *record, uint32_t length) {
+      xacts.Add(info, record, length);
+    });
+    std::vector<uint8_t> seg;
+    for (int i = 0; i < segments; i++) {
+      uint64_t base_lsn =
+          WalFileNameToLSN(gen.NextSegmentName(), options.SegmentSize);
+      parser.SetExpectedBaseLSN(base_lsn);
+      gen.NextSegment(seg);
+      parser.Parse(seg.data(), seg.size(), records);
+      if (i == 0) {
+        hex_data = seg;
+        first_segment_records = records.size();
+        first_segment_lsn = base_lsn;
+      }
+    }
+  }
+  std::vector<uint32_t> indices(records.size());
+  for (size_t i = 0; i < indices.size(); i++)
+    indices[i] = (uint32_t)i;
+
+  // Like a catalog fetched from a server: most relations have names, a few
+  // only match by OID and some are unknown.
+  std::map<uint32_t, std::string> db_names;
+  WalRelNameMap rel_names;
+  for (uint32_t db = 0; db < options.Databases; db++) {
+    db_names[5 + db] = "db_" + std::to_string(db);
+    for (uint32_t rel = 0; rel < options.Relations; rel++) {
+      // Neither number of the OID-only ones is a relfilenode in use
+      if (rel % 10 < 7)
+        rel_names.Add(5 + db, 16384 + rel, 16384 + rel, 2200,
+                      "public.table_" + std::to_string(rel));
+      else if (rel % 10 < 9)
+        rel_names.Add(5 + db, 900000 + rel, 16384 + rel, 2200,
+                      "public.by_oid_" + std::to_string(rel));
+    }
+  }
+
+  // --- Headless ImGui ---
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGuiIO &io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.DisplaySize = ImVec2((float)width, (float)height);
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::StyleColorsDark();
+  unsigned char *pixels;
+  int tex_w, tex_h;
+  io.Fonts->GetTexDataAsRGBA32(&pixels, &tex_w, &tex_h); // Builds the atlas
+
+  // Rows of the first segment get their bodies described, as in the viewer
+  WalSparseSegment segment;
+  segment.Assign(std::vector<uint8_t>(hex_data));
+  WalRecordDescCache details;
+  details.SetSource(&segment, first_segment_lsn);
+
+  ImGuiHexEditorState hex_state;
+  hex_state.MaxBytes = (int)hex_data.size();
+  hex_state.ReadCallback = HexRead;
+  hex_state.ReadOnly = true;
+
+  printf("%zu records, %dx%d, %d frames per scenario\n\n", records.size(),
+         width, height, frames);
+  printf("%-16s %8s %8s %8s %8s %9s %8s %8s\n", "scenario", "mean ms",
+         "p50 ms", "p95 ms", "max ms", "vertices", "cmds", "allocs");
+
+  const Scenario scenarios[] = {Scenario::Table, Scenario::TableRawIds,
+                                Scenario::Hex, Scenario::Both};
+  for (Scenario scenario : scenarios) {
+    const int warmup = 10;
+    std::vector<FrameSample> samples;
+    bool scroll_to_bottom = true; // As after loading a segment
+    uint32_t highlighted_xid = 0;
+    hex_state.SelectStartByte = hex_state.SelectEndByte = -1;
+    bool show_table = scenario != Scenario::Hex;
+    bool show_hex = scenario == Scenario::Hex || scenario == Scenario::Both;
+    float table_h = show_hex && show_table ? height * 0.65f : 0.0f;
+    float mouse_y = table_h ? table_h * 0.5f : height * 0.5f;
+
+    for (int frame = 0; frame < warmup + frames; frame++) {
+      // The table starts at the bottom and scrolls up for half the frames,
+      // then jumps to the top and scrolls down; the hex view the other way
+      // round. Every 30 frames a record is selected, as a click on a row
+      // does.
+      int f = frame - warmup;
+      float dir = (f < frames / 2) == show_table ? 1.0f : -1.0f;
+      io.AddMousePosEvent(width * 0.5f, mouse_y);
+      if (f == frames / 2)
+        io.AddMouseWheelEvent(0, -dir * 1e6f); // Far enough to reach the end
+      else
+        io.AddMouseWheelEvent(0, dir * wheel);
+      if (frame % 30 == 0 && first_segment_records) {
+        const WalRecordInfo &rec =
+            records[(size_t)frame * 7919 % first_segment_records];
+        hex_state.SelectStartByte = (int)rec.Offset;
+        hex_state.SelectEndByte = (int)(rec.Offset + rec.Length - 1);
+        highlighted_xid = rec.XID;
+      }
+
+      uint64_t allocs_before = alloc_count.load(std::memory_order_relaxed);
+      auto t0 = std::chrono::steady_clock::now();
+      ImGui::NewFrame();
+      ImGui::SetNextWindowPos(ImVec2(0, 0));
+      ImGui::SetNextWindowSize(io.DisplaySize);
+      ImGui::Begin("bench", nullptr,
+                   ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove |
+                       ImGuiWindowFlags_NoSavedSettings);
+      if (show_table) {
+        WalRecordTableNames names = {&db_names, &rel_names,
+                                     scenario == Scenario::TableRawIds};
+        WalRecordTableAction action;
+        DrawWalRecordTable(records, indices, names, &xacts, highlighted_xid,
+                           &details, scroll_to_bottom, ImVec2(0, table_h),
+                           action);
+      }
+      if (show_hex) {
+        ImGui::BeginHexEditor("##HexEditor", &hex_state,
+                              ImGui::GetContentRegionAvail());
+        ImGui::EndHexEditor();
+      }
+      ImGui::End();
+      ImGui::Render();
+      auto t1 = std::chrono::steady_clock::now();
+
+      if (frame < warmup)
+        continue;
+      ImDrawData *draw = ImGui::GetDrawData();
+      FrameSample s;
+      s.Ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+      s.Vertices = draw->TotalVtxCount;
+      s.DrawCmds = 0;
+      for (int i = 0; i < draw->CmdListsCount; i++)
+        s.DrawCmds += draw->CmdLists[i]->CmdBuffer.Size;
+      s.Allocs = alloc_count.load(std::memory_order_relaxed) - allocs_before;
+      samples.push_back(s);
+    }
+
+    std::vector<double> ms;
+    double vertices = 0, cmds = 0, allocs = 0;
+    for (const FrameSample &s : samples) {
+      ms.push_back(s.Ms);
+      vertices += s.Vertices;
+      cmds += s.DrawCmds;
+      allocs += (double)s.Allocs;
+    }
+    double n = (double)samples.size(), sum = 0;
+    for (double m : ms)
+      sum += m;
+    printf("%-16s %8.3f %8.3f %8.3f %8.3f %9.0f %8.1f %8.1f\n",
+           ScenarioName(scenario), sum / n, Percentile(ms, 0.5),
+           Percentile(ms, 0.95), Percentile(ms, 1.0), vertices / n, cmds / n,
+           allocs / n);
+  }
+
+  ImGui::DestroyContext();
+  return 0;
+}
@@ -1,63 +1,1092 @@
-#include <iostream>
-#include <fstream>
-#include <vector>
-#include <iomanip>
+#include "output_buffer.h"
+#include "wal_archive.h"
+#include "wal_catalog_snapshot.h"
+#include "wal_control.h"
+#include "wal_dir_scan.h"
+#include "wal_filter.h"
+#include "wal_fpi_bloat.h"
+#include "wal_hotspot.h"
+#include "wal_io.h"
 #include "wal_parser.h"
+#include "wal_tail.h"
+#include "wal_time_index.h"
+#include "wal_trace.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <glob.h>
+#endif
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <wal_file_path>" << std::endl;
-        return 1;
+namespace fs = std::filesystem;
+
+enum class OutputFormat { Text, Csv, Ndjson };
+
+// One input file. Workers fill it in, the main thread prints it in order.
+struct FileJob {
+  std::string path;
+  size_t size = 0;
+  size_t parsed_count = 0;
+  uint64_t end_lsn = 0;
+  WalEndReason end_reason = WalEndReason::None;
+  std::vector<WalRecordInfo> records;
+  std::string error;
+  bool done = false;
+};
+
+static void PrintUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options] <file|dir|glob>...\n"
+          "       %s [options] --pgdata DIR\n"
+          "\n"
+          "Options:\n"
+          "  -f, --format FMT     Output format: text (default), csv, ndjson\n"
+          "  -j, --jobs N         Parser threads (default: all cores)\n"
+          "      --start-lsn LSN  Only records at or after LSN (X/X or hex)\n"
+          "      --end-lsn LSN    Only records before LSN\n"
+          "      --start-time T   Only the WAL written from local time T "
+          "on, e.g.\n"
+          "                       \"14:03:27\" or \"2024-01-31 14:03\", "
+          "found by commit\n"
+          "                       and checkpoint times (indexed once, then "
+          "cached); the\n"
+          "                       WAL between the last of those before T "
+          "and the first\n"
+          "                       after it is included\n"
+          "      --end-time T     Only the WAL written before T\n"
+          "      --rmid LIST      Comma separated resource managers (name or "
+          "id)\n"
+          "      --rel LIST       Comma separated relfilenode numbers\n"
+          "      --xid XID        Only records of this transaction\n"
+          "  -e, --filter EXPR    Filter expression, e.g.\n"
+          "                       \"rmid in (Heap,Btree) and len > 4096\"\n"
+          "                       The options above are and-ed with it.\n"
+          "      --no-crc         Don't verify record CRCs\n"
+          "      --io BACKEND     File reads: auto (default), uring, pread\n"
+          "      --overview       Only summarize each file from its page "
+          "headers\n"
+          "      --tail N         Only the last N records of the latest file, "
+          "read\n"
+          "                       backwards along xl_prev (into the other "
+          "files\n"
+          "                       as needed) without parsing whole "
+          "segments\n"
+          "      --pgdata DIR     Read DIR/global/pg_control and show the "
+          "WAL from\n"
+          "                       the last checkpoint's redo pointer on "
+          "(offline)\n"
+          "      --hotspots N     Instead of records, list the N pages with "
+          "the most\n"
+          "                       block references and the N with the most "
+          "FPIs\n"
+          "      --hotspot-pages N  Pages counted exactly before switching "
+          "to an\n"
+          "                       approximate summary of that many "
+          "(default 65536)\n"
+          "      --fpi-bloat N    Instead of records, report full-page "
+          "image bytes\n"
+          "                       per wal_compression setting for the N "
+          "relations\n"
+          "                       with the most, recompressing every "
+          "image\n"
+          "      --trace FILE     Record a Chrome trace (chrome://tracing,\n"
+          "                       ui.perfetto.dev) of reading and parsing\n"
+          "  -q, --quiet          Don't print the summary to stderr\n"
+          "  -h, --help           Show this help\n",
+          prog, prog);
+}
+
+// Expands a command line argument into the list of files it names: a
+// directory contributes its regular files, a glob its matches.
+static void ExpandInput(const std::string &arg, std::vector<std::string> &out) {
+  std::error_code ec;
+  if (fs::is_directory(arg, ec)) {
+    std::vector<std::string> dir_files;
+    for (const auto &entry : fs::directory_iterator(arg, ec)) {
+      if (entry.is_regular_file())
+        dir_files.push_back(entry.path().string());
+    }
+    std::sort(dir_files.begin(), dir_files.end());
+    out.insert(out.end(), dir_files.begin(), dir_files.end());
+    return;
+  }
+#ifndef _WIN32
+  if (arg.find_first_of("*?[") != std::string::npos) {
+    glob_t g;
+    if (glob(arg.c_str(), 0, nullptr, &g) == 0) {
+      for (size_t i = 0; i < g.gl_pathc; i++)
+        out.push_back(g.gl_pathv[i]);
+    }
+    globfree(&g);
+    return;
+  }
+#endif
+  out.push_back(arg);
+}
+
+// Time index samples are WAL_TIME_SAMPLE_BYTES apart; the records after
+// the last one before time narrow a bound down, like jumping to a time in
+// the GUI. Reads the sample's segment, and the next one if time isn't
+// reached in it. after_before is where the WAL after the last record
+// written before time starts, first_at the first record written at or
+// after it; both stay 0 if no such record is read.
+static void NarrowTimeBound(const WalTimeIndex &index, size_t segment,
+                            uint64_t sample_lsn, int64_t time,
+                            const std::vector<std::string> &paths,
+                            uint64_t &after_before, uint64_t &first_at) {
+  WalParser parser;
+  std::vector<uint8_t> bytes;
+  WalDecodedRecord decoded;
+  bool last_was_before = false;
+  size_t end = std::min(segment + 2, index.Segments().size());
+  for (size_t s = segment; s < end; s++) {
+    const std::string &name = index.Segments()[s].FileName;
+    auto path = std::find_if(paths.begin(), paths.end(),
+                             [&](const std::string &p) {
+                               return fs::path(p).filename().string() == name;
+                             });
+    WalLoadedSegment seg;
+    if (path == paths.end() ||
+        !LoadWalSegmentAt(*path, parser, sample_lsn, seg))
+      return;
+    for (const WalRecordInfo &rec : seg.Records) {
+      if (last_was_before)
+        after_before = rec.LSN;
+      last_was_before = false;
+      int64_t t;
+      if ((rec.RMID == RM_XACT_ID || rec.RMID == RM_XLOG_ID) &&
+          WalReadRecordBytes(seg.Data, rec.Offset, rec.Length, bytes) &&
+          WalDecodeRecord(bytes.data(), rec.Length, decoded) &&
+          WalRecordTime(decoded, t)) {
+        if (t >= time) {
+          first_at = rec.LSN;
+          return;
+        }
+        after_before = rec.LSN + 1; // Until the next record is seen
+        last_was_before = true;
+      }
+    }
+  }
+}
+
+static void WriteRels(OutputBuffer &out, const WalRecordInfo &rec, char sep) {
+  for (size_t i = 0; i < rec.RelFileNodes.size(); ++i) {
+    if (i > 0)
+      out.Append(sep);
+    out.AppendDec(rec.RelFileNodes[i].spcNode);
+    out.Append('/');
+    out.AppendDec(rec.RelFileNodes[i].dbNode);
+    out.Append('/');
+    out.AppendDec(rec.RelFileNodes[i].relNode);
+  }
+}
+
+static void WriteRecord(OutputBuffer &out, OutputFormat format,
+                        const std::string &path, const WalRecordInfo &rec) {
+  switch (format) {
+  case OutputFormat::Text:
+    out.AppendHexPadded(rec.LSN, 16);
+    out.AppendHexPadded(rec.Offset, 10);
+    out.AppendPadded(rec.Description.data(), rec.Description.size(), 15);
+    out.Append(' ');
+    out.AppendDecPadded(rec.Length, 8);
+    out.AppendDecPadded(rec.XID, 8);
+    WriteRels(out, rec, ' ');
+    out.Append('\n');
+    break;
+  case OutputFormat::Csv:
+    out.AppendCsvField(path.data(), path.size());
+    out.Append(',');
+    out.AppendLSN(rec.LSN);
+    out.Append(',');
+    out.AppendDec(rec.Offset);
+    out.Append(',');
+    out.AppendDec(rec.RMID);
+    out.Append(',');
+    out.AppendDec(rec.Info);
+    out.Append(',');
+    out.AppendDec(rec.Length);
+    out.Append(',');
+    out.AppendDec(rec.XID);
+    out.Append(',');
+    out.AppendCsvField(rec.Description.data(), rec.Description.size());
+    out.Append(',');
+    WriteRels(out, rec, ' ');
+    out.Append('\n');
+    break;
+  case OutputFormat::Ndjson:
+    out.Append("{\"file\":");
+    out.AppendJsonString(path.data(), path.size());
+    out.Append(",\"lsn\":\"");
+    out.AppendLSN(rec.LSN);
+    out.Append("\",\"offset\":");
+    out.AppendDec(rec.Offset);
+    out.Append(",\"rmid\":");
+    out.AppendDec(rec.RMID);
+    out.Append(",\"info\":");
+    out.AppendDec(rec.Info);
+    out.Append(",\"length\":");
+    out.AppendDec(rec.Length);
+    out.Append(",\"xid\":");
+    out.AppendDec(rec.XID);
+    out.Append(",\"desc\":");
+    out.AppendJsonString(rec.Description.data(), rec.Description.size());
+    out.Append(",\"rels\":[");
+    for (size_t i = 0; i < rec.RelFileNodes.size(); ++i) {
+      if (i > 0)
+        out.Append(',');
+      out.Append('"');
+      out.AppendDec(rec.RelFileNodes[i].spcNode);
+      out.Append('/');
+      out.AppendDec(rec.RelFileNodes[i].dbNode);
+      out.Append('/');
+      out.AppendDec(rec.RelFileNodes[i].relNode);
+      out.Append('"');
+    }
+    out.Append("]}\n");
+    break;
+  }
+}
+
+static void WriteHotspots(OutputBuffer &out, OutputFormat format,
+                          const WalHotspotSketch &sketch, size_t count) {
+  if (format == OutputFormat::Csv)
+    out.Append("by,rank,spc,db,rel,fork,block,refs,fpis,error\n");
+  for (bool by_fpi : {false, true}) {
+    std::vector<WalHotspot> top = sketch.Top(count, by_fpi);
+    const char *by = by_fpi ? "fpis" : "refs";
+    if (format == OutputFormat::Text) {
+      out.Append(by_fpi ? "Pages with the most full-page images"
+                        : "Pages with the most block references");
+      if (sketch.Exact()) {
+        out.Append(" (exact, ");
+        out.AppendDec(sketch.Tracked());
+        out.Append(" pages):\n");
+      } else {
+        out.Append(" (approximate, counts at most Error too high):\n");
+      }
+      out.Append("Rank  Relation                  Fork  Block     Refs      "
+                 "FPIs");
+      out.Append(sketch.Exact() ? "\n" : "      Error\n");
+    }
+    for (size_t i = 0; i < top.size(); i++) {
+      const WalHotspot &h = top[i];
+      switch (format) {
+      case OutputFormat::Text: {
+        out.AppendDecPadded(i + 1, 6);
+        char rel[40];
+        int n = snprintf(rel, sizeof(rel), "%u/%u/%u", h.Key.Spc, h.Key.Db,
+                         h.Key.Rel);
+        out.AppendPadded(rel, (size_t)n, 26);
+        const char *fork = WalForkName(h.Key.Fork);
+        out.AppendPadded(fork, strlen(fork), 6);
+        out.AppendDecPadded(h.Key.Block, 10);
+        out.AppendDecPadded(h.Refs, 10);
+        if (sketch.Exact()) {
+          out.AppendDec(h.Fpis);
+        } else {
+          out.AppendDecPadded(h.Fpis, 10);
+          out.AppendDec(h.Error);
+        }
+        out.Append('\n');
+        break;
+      }
+      case OutputFormat::Csv:
+        out.Append(by);
+        out.Append(',');
+        out.AppendDec(i + 1);
+        out.Append(',');
+        out.AppendDec(h.Key.Spc);
+        out.Append(',');
+        out.AppendDec(h.Key.Db);
+        out.Append(',');
+        out.AppendDec(h.Key.Rel);
+        out.Append(',');
+        out.Append(WalForkName(h.Key.Fork));
+        out.Append(',');
+        out.AppendDec(h.Key.Block);
+        out.Append(',');
+        out.AppendDec(h.Refs);
+        out.Append(',');
+        out.AppendDec(h.Fpis);
+        out.Append(',');
+        out.AppendDec(h.Error);
+        out.Append('\n');
+        break;
+      case OutputFormat::Ndjson:
+        out.Append("{\"by\":\"");
+        out.Append(by);
+        out.Append("\",\"rank\":");
+        out.AppendDec(i + 1);
+        out.Append(",\"rel\":\"");
+        out.AppendDec(h.Key.Spc);
+        out.Append('/');
+        out.AppendDec(h.Key.Db);
+        out.Append('/');
+        out.AppendDec(h.Key.Rel);
+        out.Append("\",\"fork\":\"");
+        out.Append(WalForkName(h.Key.Fork));
+        out.Append("\",\"block\":");
+        out.AppendDec(h.Key.Block);
+        out.Append(",\"refs\":");
+        out.AppendDec(h.Refs);
+        out.Append(",\"fpis\":");
+        out.AppendDec(h.Fpis);
+        out.Append(",\"error\":");
+        out.AppendDec(h.Error);
+        out.Append("}\n");
+        break;
+      }
+    }
+    if (format == OutputFormat::Text && !by_fpi)
+      out.Append('\n');
+  }
+}
+
+static void WriteFpiBloat(OutputBuffer &out, OutputFormat format,
+                          const WalFpiAnalyzer &analyzer, size_t count) {
+  static const WalFpiCompression methods[] = {
+      WalFpiCompression::None, WalFpiCompression::Pglz,
+      WalFpiCompression::Lz4, WalFpiCompression::Zstd};
+  WalFpiRelStats total = analyzer.Total();
+  std::vector<WalFpiRelStats> rels = analyzer.Relations();
+  if (rels.size() > count)
+    rels.resize(count);
+
+  if (format == OutputFormat::Text) {
+    out.AppendDec(total.Images);
+    out.Append(" full-page images in ");
+    out.AppendDec(analyzer.Records());
+    out.Append(" records: ");
+    out.AppendDec(total.Images * WAL_PAGE_SIZE);
+    out.Append(" bytes of pages, ");
+    out.AppendDec(total.HoleBytes);
+    out.Append(" of them holes, ");
+    out.AppendDec(total.StoredBytes);
+    out.Append(" stored\nWritten with");
+    for (WalFpiCompression m : methods) {
+      out.Append(' ');
+      out.Append(WalFpiCompressionName(m));
+      out.Append(": ");
+      out.AppendDec(total.Compressed[(int)m]);
+    }
+    if (total.Unreadable) {
+      out.Append(" (");
+      out.AppendDec(total.Unreadable);
+      out.Append(" not recompressed)");
+    }
+    out.Append("\n\nwal_compression  Bytes         Saved\n");
+    for (WalFpiCompression m : methods) {
+      const char *name = WalFpiCompressionName(m);
+      out.AppendPadded(name, strlen(name), 17);
+      if (!WalFpiCompressionAvailable(m)) {
+        out.Append("not built in\n");
+        continue;
+      }
+      uint64_t bytes = total.WhatIf[(int)m];
+      out.AppendDecPadded(bytes, 14);
+      char saved[32];
+      int64_t diff = (int64_t)total.StoredBytes - (int64_t)bytes;
+      snprintf(saved, sizeof(saved), "%lld (%.1f%%)\n", (long long)diff,
+               total.StoredBytes ? 100.0 * diff / total.StoredBytes : 0.0);
+      out.Append(saved);
     }
+    out.Append("\nRelation                  Images    Hole        "
+               "Stored      off         pglz        lz4         zstd\n");
+  } else if (format == OutputFormat::Csv) {
+    out.Append("spc,db,rel,images,hole_bytes,stored_bytes,unreadable,off,"
+               "pglz,lz4,zstd\n");
+  }
+
+  for (const WalFpiRelStats &r : rels) {
+    switch (format) {
+    case OutputFormat::Text: {
+      char rel[40];
+      int n = snprintf(rel, sizeof(rel), "%u/%u/%u", r.Spc, r.Db, r.Rel);
+      out.AppendPadded(rel, (size_t)n, 26);
+      out.AppendDecPadded(r.Images, 10);
+      out.AppendDecPadded(r.HoleBytes, 12);
+      out.AppendDecPadded(r.StoredBytes, 12);
+      for (WalFpiCompression m : methods) {
+        bool last = m == WalFpiCompression::Zstd;
+        if (!WalFpiCompressionAvailable(m))
+          out.Append(last ? "-" : "-           ");
+        else if (last)
+          out.AppendDec(r.WhatIf[(int)m]);
+        else
+          out.AppendDecPadded(r.WhatIf[(int)m], 12);
+      }
+      out.Append('\n');
+      break;
+    }
+    case OutputFormat::Csv:
+      out.AppendDec(r.Spc);
+      out.Append(',');
+      out.AppendDec(r.Db);
+      out.Append(',');
+      out.AppendDec(r.Rel);
+      out.Append(',');
+      out.AppendDec(r.Images);
+      out.Append(',');
+      out.AppendDec(r.HoleBytes);
+      out.Append(',');
+      out.AppendDec(r.StoredBytes);
+      out.Append(',');
+      out.AppendDec(r.Unreadable);
+      for (WalFpiCompression m : methods) {
+        out.Append(',');
+        if (WalFpiCompressionAvailable(m))
+          out.AppendDec(r.WhatIf[(int)m]);
+      }
+      out.Append('\n');
+      break;
+    case OutputFormat::Ndjson:
+      out.Append("{\"rel\":\"");
+      out.AppendDec(r.Spc);
+      out.Append('/');
+      out.AppendDec(r.Db);
+      out.Append('/');
+      out.AppendDec(r.Rel);
+      out.Append("\",\"images\":");
+      out.AppendDec(r.Images);
+      out.Append(",\"hole_bytes\":");
+      out.AppendDec(r.HoleBytes);
+      out.Append(",\"stored_bytes\":");
+      out.AppendDec(r.StoredBytes);
+      out.Append(",\"unreadable\":");
+      out.AppendDec(r.Unreadable);
+      for (WalFpiCompression m : methods) {
+        if (!WalFpiCompressionAvailable(m))
+          continue;
+        out.Append(",\"");
+        out.Append(WalFpiCompressionName(m));
+        out.Append("\":");
+        out.AppendDec(r.WhatIf[(int)m]);
+      }
+      out.Append("}\n");
+      break;
+    }
+  }
+}
+
+static void WriteOverview(OutputBuffer &out, OutputFormat format,
+                          const std::vector<WalSegmentSummary> &summaries) {
+  if (format == OutputFormat::Text)
+    out.Append("File                      Status      Start LSN         TLI "
+               "Fill    System ID\n");
+  else if (format == OutputFormat::Csv)
+    out.Append("file,status,start_lsn,timeline,system_id,segment_size,"
+               "valid_pages,total_pages\n");
+
+  for (const WalSegmentSummary &s : summaries) {
+    const char *status = WalSegmentStatusName(s.Status);
+    switch (format) {
+    case OutputFormat::Text: {
+      out.AppendPadded(s.FileName.data(), s.FileName.size(), 25);
+      out.Append(' ');
+      out.AppendPadded(status, strlen(status), 12);
+      char lsn[32];
+      int n = snprintf(lsn, sizeof(lsn), "%X/%X", (uint32_t)(s.StartLSN >> 32),
+                       (uint32_t)s.StartLSN);
+      out.AppendPadded(lsn, (size_t)n, 18);
+      out.AppendDecPadded(s.Timeline, 4);
+      char fill[16];
+      n = snprintf(fill, sizeof(fill), "%.1f%%", s.Fill * 100.0f);
+      out.AppendPadded(fill, (size_t)n, 8);
+      out.AppendDec(s.SystemId);
+      out.Append('\n');
+      break;
+    }
+    case OutputFormat::Csv:
+      out.AppendCsvField(s.Path.data(), s.Path.size());
+      out.Append(',');
+      out.Append(status);
+      out.Append(',');
+      out.AppendLSN(s.StartLSN);
+      out.Append(',');
+      out.AppendDec(s.Timeline);
+      out.Append(',');
+      out.AppendDec(s.SystemId);
+      out.Append(',');
+      out.AppendDec(s.SegmentSize);
+      out.Append(',');
+      out.AppendDec(s.ValidPages);
+      out.Append(',');
+      out.AppendDec(s.TotalPages);
+      out.Append('\n');
+      break;
+    case OutputFormat::Ndjson:
+      out.Append("{\"file\":");
+      out.AppendJsonString(s.Path.data(), s.Path.size());
+      out.Append(",\"status\":\"");
+      out.Append(status);
+      out.Append("\",\"start_lsn\":\"");
+      out.AppendLSN(s.StartLSN);
+      out.Append("\",\"timeline\":");
+      out.AppendDec(s.Timeline);
+      out.Append(",\"system_id\":\"");
+      out.AppendDec(s.SystemId);
+      out.Append("\",\"segment_size\":");
+      out.AppendDec(s.SegmentSize);
+      out.Append(",\"valid_pages\":");
+      out.AppendDec(s.ValidPages);
+      out.Append(",\"total_pages\":");
+      out.AppendDec(s.TotalPages);
+      out.Append("}\n");
+      break;
+    }
+  }
+}
 
-    const char* file_path = argv[1];
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+int main(int argc, char **argv) {
+  OutputFormat format = OutputFormat::Text;
+  std::vector<std::string> clauses;
+  unsigned jobs = std::thread::hardware_concurrency();
+  bool quiet = false;
+  bool verify_crc = true;
+  bool overview = false;
+  WalIoBackend io_backend = WalIoBackend::Auto;
+  const char *trace_path = nullptr;
+  const char *pgdata = nullptr;
+  size_t tail_count = 0;
+  size_t hotspot_count = 0;
+  size_t hotspot_pages = 1 << 16;
+  size_t fpi_count = 0;
+  const char *start_time_arg = nullptr;
+  const char *end_time_arg = nullptr;
+  std::vector<std::string> inputs;
 
-    if (!file) {
-        std::cerr << "Error: Failed to open file: " << file_path << std::endl;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    auto next = [&](const char *opt) -> const char * {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Error: %s requires an argument\n", opt);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+      PrintUsage(argv[0]);
+      return 0;
+    } else if (!strcmp(arg, "-f") || !strcmp(arg, "--format")) {
+      const char *v = next(arg);
+      if (!strcmp(v, "text"))
+        format = OutputFormat::Text;
+      else if (!strcmp(v, "csv"))
+        format = OutputFormat::Csv;
+      else if (!strcmp(v, "ndjson") || !strcmp(v, "json"))
+        format = OutputFormat::Ndjson;
+      else {
+        fprintf(stderr, "Error: unknown format '%s'\n", v);
+        return 1;
+      }
+    } else if (!strcmp(arg, "-j") || !strcmp(arg, "--jobs")) {
+      jobs = (unsigned)strtoul(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--start-lsn")) {
+      clauses.push_back(std::string("lsn >= ") + next(arg));
+    } else if (!strcmp(arg, "--end-lsn")) {
+      clauses.push_back(std::string("lsn < ") + next(arg));
+    } else if (!strcmp(arg, "--start-time")) {
+      start_time_arg = next(arg);
+    } else if (!strcmp(arg, "--end-time")) {
+      end_time_arg = next(arg);
+    } else if (!strcmp(arg, "--rmid")) {
+      clauses.push_back(std::string("rmid in (") + next(arg) + ")");
+    } else if (!strcmp(arg, "--rel")) {
+      clauses.push_back(std::string("rel in (") + next(arg) + ")");
+    } else if (!strcmp(arg, "--xid")) {
+      clauses.push_back(std::string("xid = ") + next(arg));
+    } else if (!strcmp(arg, "-e") || !strcmp(arg, "--filter")) {
+      clauses.push_back(std::string("(") + next(arg) + ")");
+    } else if (!strcmp(arg, "--no-crc")) {
+      verify_crc = false;
+    } else if (!strcmp(arg, "--io")) {
+      const char *v = next(arg);
+      if (!strcmp(v, "auto"))
+        io_backend = WalIoBackend::Auto;
+      else if (!strcmp(v, "uring") || !strcmp(v, "io_uring"))
+        io_backend = WalIoBackend::IoUring;
+      else if (!strcmp(v, "pread"))
+        io_backend = WalIoBackend::Pread;
+      else {
+        fprintf(stderr, "Error: unknown I/O backend '%s'\n", v);
         return 1;
+      }
+    } else if (!strcmp(arg, "--overview")) {
+      overview = true;
+    } else if (!strcmp(arg, "--tail")) {
+      tail_count = strtoull(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--pgdata")) {
+      pgdata = next(arg);
+    } else if (!strcmp(arg, "--hotspots")) {
+      hotspot_count = strtoull(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--hotspot-pages")) {
+      hotspot_pages = strtoull(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--fpi-bloat")) {
+      fpi_count = strtoull(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--trace")) {
+      trace_path = next(arg);
+    } else if (!strcmp(arg, "-q") || !strcmp(arg, "--quiet")) {
+      quiet = true;
+    } else if (arg[0] == '-' && arg[1] != 0) {
+      fprintf(stderr, "Error: unknown option '%s'\n", arg);
+      PrintUsage(argv[0]);
+      return 1;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+
+  // Crash recovery starts replaying at the redo pointer of the last
+  // checkpoint, so that is where the interesting WAL starts.
+  if (pgdata) {
+    WalControlFile control;
+    std::string error;
+    if (!ReadWalControlFile(pgdata, control, error)) {
+      fprintf(stderr, "Error: %s\n", error.c_str());
+      return 1;
+    }
+    std::string wal_dir = (fs::path(pgdata) / "pg_wal").string();
+    std::string segment =
+        FindWalSegmentForLSN(wal_dir, control.Timeline, control.RedoLSN);
+    if (!quiet)
+      fprintf(stderr,
+              "Cluster state: %s, checkpoint at %X/%X, redo at %X/%X on "
+              "timeline %u\n",
+              WalClusterStateName(control.State),
+              (uint32_t)(control.CheckpointLSN >> 32),
+              (uint32_t)control.CheckpointLSN,
+              (uint32_t)(control.RedoLSN >> 32), (uint32_t)control.RedoLSN,
+              control.Timeline);
+    if (segment.empty()) {
+      fprintf(stderr, "Error: no segment for %X/%X in %s\n",
+              (uint32_t)(control.RedoLSN >> 32), (uint32_t)control.RedoLSN,
+              wal_dir.c_str());
+      return 1;
     }
+    char redo[32];
+    snprintf(redo, sizeof(redo), "%X/%X", (uint32_t)(control.RedoLSN >> 32),
+             (uint32_t)control.RedoLSN);
+    inputs.push_back(segment);
+    clauses.push_back(std::string("lsn >= ") + redo);
+  }
 
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+  if (inputs.empty()) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
 
-    std::vector<uint8_t> file_data(size);
-    if (!file.read((char*)file_data.data(), size)) {
-        std::cerr << "Error: Failed to read file data." << std::endl;
+  std::vector<std::string> input_paths;
+  for (const auto &in : inputs)
+    ExpandInput(in, input_paths);
+
+  // Times become LSN bounds by the inputs' time index, saved in the cache
+  // dir so that later runs only parse the segments written since. Files
+  // wholly outside the bounds aren't read at all.
+  if ((start_time_arg || end_time_arg) && !input_paths.empty()) {
+    WalTimeIndex index;
+    std::string error;
+    if (!WalRefreshTimeIndex(input_paths, WalDefaultCacheDir(), index, error,
+                             jobs) &&
+        !quiet)
+      fprintf(stderr, "Warning: %s\n", error.c_str());
+    uint64_t from = 0, to = UINT64_MAX;
+    for (const char *arg : {start_time_arg, end_time_arg}) {
+      int64_t time;
+      if (!arg)
+        continue;
+      if (!WalParseTime(arg, index.LastTime(), time)) {
+        fprintf(stderr, "Error: can't read '%s' as a time\n", arg);
+        return 1;
+      }
+      // Before the first sample everything is after it, past the last
+      // sample nothing is. Between samples, the records narrow it down.
+      WalTimePoint point, before;
+      size_t segment;
+      uint64_t after_before = 0, first_at = 0;
+      bool found_before = index.Find(time, before, &segment);
+      if (found_before)
+        NarrowTimeBound(index, segment, before.LSN, time, input_paths,
+                        after_before, first_at);
+      if (arg == end_time_arg) {
+        to = index.FindEnd(time, point) ? point.LSN : UINT64_MAX;
+        if (first_at)
+          to = std::min(to, first_at);
+      } else if (found_before) {
+        from = std::max(before.LSN, after_before);
+      } else if (time > index.FirstTime()) {
+        from = UINT64_MAX;
+      }
+    }
+    char lsn[32];
+    snprintf(lsn, sizeof(lsn), "%X/%X", (uint32_t)(from >> 32),
+             (uint32_t)from);
+    clauses.push_back(std::string("lsn >= ") + lsn);
+    snprintf(lsn, sizeof(lsn), "%X/%X", (uint32_t)(to >> 32), (uint32_t)to);
+    clauses.push_back(std::string("lsn < ") + lsn);
+    if (!tail_count && !overview) {
+      std::vector<std::string> kept;
+      for (const std::string &path : input_paths) {
+        const WalSegmentTimes *seg =
+            index.FindSegment(fs::path(path).filename().string());
+        if (!seg || !seg->EndLSN ||
+            (seg->EndLSN > from && seg->StartLSN < to))
+          kept.push_back(path);
+      }
+      if (kept.empty()) {
+        fprintf(stderr, "Error: no WAL written between those times\n");
         return 1;
+      }
+      input_paths = std::move(kept);
+    }
+  }
+
+  std::vector<FileJob> file_jobs(input_paths.size());
+  for (size_t i = 0; i < input_paths.size(); i++)
+    file_jobs[i].path = input_paths[i];
+  if (file_jobs.empty()) {
+    fprintf(stderr, "Error: no input files\n");
+    return 1;
+  }
+
+  // The convenience options are just clauses of the same expression
+  // language the GUI filter bar uses.
+  WalFilter filter;
+  {
+    std::string expr, error;
+    for (size_t i = 0; i < clauses.size(); i++) {
+      if (i > 0)
+        expr += " and ";
+      expr += clauses[i];
+    }
+    if (!filter.Compile(expr, error)) {
+      fprintf(stderr, "Error: invalid filter '%s': %s\n", expr.c_str(),
+              error.c_str());
+      return 1;
     }
+  }
 
-    std::vector<WalRecordInfo> wal_records;
-    WalParser wal_parser;
-    
-    std::cout << "Parsing WAL file: " << file_path << " (" << size << " bytes)" << std::endl;
+  if (jobs == 0)
+    jobs = 1;
+  if (jobs > file_jobs.size())
+    jobs = (unsigned)file_jobs.size();
 
-    wal_parser.Parse(file_data.data(), size, wal_records);
+  auto start_time = std::chrono::steady_clock::now();
 
-    if (wal_records.empty()) {
-        std::cout << "No WAL records found or file format not recognized." << std::endl;
-        return 0;
+  if (trace_path) {
+    WalTraceSetThreadName("main");
+    WalTraceStart();
+  }
+  auto write_trace = [&]() {
+    if (!trace_path)
+      return;
+    WalTraceStop();
+    std::string error;
+    if (!WalTraceWrite(trace_path, error))
+      fprintf(stderr, "Error: %s\n", error.c_str());
+    else if (!quiet)
+      fprintf(stderr, "Trace: %llu events written to %s\n",
+              (unsigned long long)WalTraceEventCount(), trace_path);
+  };
+
+  if (overview) {
+    std::vector<std::string> paths;
+    for (const FileJob &job : file_jobs)
+      paths.push_back(job.path);
+    std::vector<WalSegmentSummary> summaries;
+    ScanWalFiles(paths, summaries, jobs);
+    OutputBuffer out(stdout);
+    WriteOverview(out, format, summaries);
+    out.Flush();
+    if (!quiet) {
+      double secs = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_time)
+                        .count();
+      fprintf(stderr, "%zu files summarized in %.3f s\n", summaries.size(),
+              secs);
     }
+    write_trace();
+    return 0;
+  }
 
-    std::cout << "Found " << wal_records.size() << " records:" << std::endl;
-    std::cout << std::left 
-              << std::setw(16) << "LSN" 
-              << std::setw(10) << "Offset" 
-              << std::setw(15) << "Type" 
-              << std::setw(8) << "Length" 
-              << std::setw(8) << "XID" 
-              << std::endl;
-    std::cout << std::string(60, '-') << std::endl;
+  if (tail_count) {
+    // The latest segment by name; the chain may lead into any of the others
+    std::vector<std::string> paths;
+    size_t latest = 0;
+    for (size_t i = 0; i < file_jobs.size(); i++) {
+      paths.push_back(file_jobs[i].path);
+      if (WalStripCompressionSuffix(fs::path(paths[i]).filename().string()) >
+          WalStripCompressionSuffix(
+              fs::path(paths[latest]).filename().string()))
+        latest = i;
+    }
+    WalParser parser;
+    parser.SetVerifyCRC(verify_crc);
+    WalTailResult tail;
+    if (!ReadWalTail(paths, latest, 0, tail_count, parser, tail)) {
+      fprintf(stderr, "Error: %s: %s\n", paths[latest].c_str(),
+              tail.Error.c_str());
+      return 1;
+    }
+    std::vector<uint32_t> matches;
+    filter.Evaluate(tail.Records.data(), tail.Records.size(), matches);
 
-    for (const auto& rec : wal_records) {
-        std::cout << std::left 
-                  << std::hex << std::uppercase << std::setw(16) << rec.LSN 
-                  << std::setw(10) << rec.Offset 
-                  << std::setw(15) << rec.Description 
-                  << std::dec << std::setw(8) << rec.Length 
-                  << std::setw(8) << rec.XID 
-                  << std::endl;
+    // Only the records kept, not everything parsed on the last pages.
+    // Those from earlier segments are read again from their files.
+    WalFpiAnalyzer fpis;
+    if (fpi_count) {
+      std::map<size_t, WalSparseSegment> others;
+      std::vector<uint8_t> bytes;
+      for (uint32_t m : matches) {
+        const WalRecordInfo &rec = tail.Records[m];
+        if (!rec.HasFPI)
+          continue;
+        size_t index = tail.PathIndex[m];
+        const WalSparseSegment *seg = &tail.Data;
+        if (index != latest) {
+          auto it = others.find(index);
+          if (it == others.end()) {
+            it = others.emplace(index, WalSparseSegment()).first;
+            std::vector<uint8_t> data;
+            std::string error;
+            if (ReadWalSegmentFile(paths[index], data, error))
+              it->second.Assign(std::move(data));
+          }
+          seg = &it->second;
+        }
+        if (WalReadRecordBytes(*seg, rec.Offset, rec.Length, bytes))
+          fpis.AddRecord(bytes.data(), rec.Length);
+      }
     }
 
+    OutputBuffer out(stdout);
+    if (hotspot_count || fpi_count) {
+      if (hotspot_count) {
+        WalHotspotSketch sketch(hotspot_pages);
+        for (uint32_t m : matches)
+          sketch.Add(tail.Records[m]);
+        WriteHotspots(out, format, sketch, hotspot_count);
+      }
+      if (fpi_count)
+        WriteFpiBloat(out, format, fpis, fpi_count);
+      out.Flush();
+      write_trace();
+      return 0;
+    }
+    if (format == OutputFormat::Csv)
+      out.Append("file,lsn,offset,rmid,info,length,xid,description,rels\n");
+    if (format == OutputFormat::Text) {
+      out.Append("Last ");
+      out.AppendDec(tail.Records.size());
+      out.Append(" records of ");
+      out.Append(paths[latest].data(), paths[latest].size());
+      out.Append(", valid WAL ends at ");
+      out.AppendLSN(tail.EndLSN);
+      out.Append(" (");
+      out.Append(WalEndReasonName(tail.EndReason));
+      out.Append("):\n");
+      out.Append("LSN             Offset    Type            Length  XID     "
+                 "Rels\n");
+      for (int d = 0; d < 64; d++)
+        out.Append('-');
+      out.Append('\n');
+    }
+    for (uint32_t m : matches)
+      WriteRecord(out, format, paths[tail.PathIndex[m]], tail.Records[m]);
+    out.Flush();
+    if (!quiet) {
+      if (!tail.Stop.empty())
+        fprintf(stderr, "Stopped early: %s\n", tail.Stop.c_str());
+      double secs = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_time)
+                        .count();
+      fprintf(stderr,
+              "%zu records, %zu matched, %llu pages of %u files read in "
+              "%.3f s\n",
+              tail.Records.size(), matches.size(),
+              (unsigned long long)tail.PagesRead, tail.SegmentsRead, secs);
+    }
+    write_trace();
     return 0;
+  }
+
+  // Reads stay at most `window` files ahead of the writer so parsed records
+  // of a large directory don't pile up in memory.
+  const size_t window = (size_t)jobs * 2;
+  std::vector<std::string> paths;
+  for (const FileJob &job : file_jobs)
+    paths.push_back(job.path);
+  WalFileReader reader(paths, window, io_backend);
+  std::mutex mutex;
+  std::condition_variable cv;
+  // One per worker, merged at the end
+  std::vector<WalHotspotSketch> sketches(
+      hotspot_count ? jobs : 0, WalHotspotSketch(hotspot_pages));
+  std::vector<WalFpiAnalyzer> fpi_analyzers(fpi_count ? jobs : 0);
+  // Record lists are replaced by these reports
+  const bool report = hotspot_count || fpi_count;
+
+  auto worker = [&](unsigned index) {
+    WalTraceSetThreadName("parse");
+    WalParser parser;
+    parser.SetVerifyCRC(verify_crc);
+    // Images are only reachable while their record's bytes are
+    if (fpi_count) {
+      parser.SetRecordVisitor([&, index](const WalRecordInfo &rec,
+                                         const uint8_t *bytes, uint32_t len) {
+        if (rec.HasFPI && filter.Matches(rec))
+          fpi_analyzers[index].AddRecord(bytes, len);
+      });
+    }
+    WalFileBuffer buf;
+    std::vector<uint8_t> segment; // Decompressed archive segments
+    std::vector<uint32_t> matches;
+    while (reader.Next(buf)) {
+      FileJob &job = file_jobs[buf.Index];
+      job.error = buf.Error;
+      if (job.error.empty()) {
+        if (WalCompressionFromName(job.path) != WalCompression::None) {
+          // Only inflate as far as the parser gets
+          LoadWalSegmentFromBuffer(job.path, buf.Data.data(), buf.Data.size(),
+                                   parser, segment, job.records, job.error,
+                                   true);
+          job.size = segment.size();
+        } else {
+          ParseWalSegment(job.path, parser, buf.Data, job.records);
+          job.size = buf.Data.size();
+        }
+      }
+      if (!job.error.empty()) {
+        job.records.clear();
+      } else {
+        job.parsed_count = job.records.size();
+        job.end_lsn = parser.GetEndLSN();
+        job.end_reason = parser.GetEndReason();
+        if (!filter.Empty()) {
+          WalTraceScope trace("index", "filter");
+          trace.SetSegment(job.path);
+          trace.SetItems(job.records.size());
+          matches.clear();
+          filter.Evaluate(job.records.data(), job.records.size(), matches);
+          for (size_t m = 0; m < matches.size(); m++) {
+            if (matches[m] != m)
+              job.records[m] = std::move(job.records[matches[m]]);
+          }
+          job.records.resize(matches.size());
+        }
+        if (hotspot_count) {
+          for (const WalRecordInfo &rec : job.records)
+            sketches[index].Add(rec);
+        }
+      }
+      reader.Recycle(std::move(buf.Data));
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.done = true;
+      }
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < jobs; t++)
+    threads.emplace_back(worker, t);
+
+  OutputBuffer out(stdout);
+  if (format == OutputFormat::Csv && !report)
+    out.Append("file,lsn,offset,rmid,info,length,xid,description,rels\n");
+
+  size_t total_bytes = 0, total_parsed = 0, total_matched = 0, failed = 0;
+  for (size_t i = 0; i < file_jobs.size(); i++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return file_jobs[i].done; });
+    }
+
+    FileJob &job = file_jobs[i];
+    WalTraceScope trace("output", "write");
+    trace.SetSegment(job.path);
+    trace.SetItems(job.records.size());
+    if (!job.error.empty()) {
+      out.Flush();
+      fprintf(stderr, "Error: %s: %s\n", job.path.c_str(), job.error.c_str());
+      failed++;
+    } else if (!report) {
+      if (format == OutputFormat::Text) {
+        out.Append("Parsing WAL file: ");
+        out.Append(job.path.data(), job.path.size());
+        out.Append(" (");
+        out.AppendDec(job.size);
+        out.Append(" bytes)\n");
+        out.Append("Found ");
+        out.AppendDec(job.records.size());
+        out.Append(" records, valid WAL ends at ");
+        out.AppendLSN(job.end_lsn);
+        out.Append(" (");
+        out.Append(WalEndReasonName(job.end_reason));
+        out.Append("):\n");
+        out.Append("LSN             Offset    Type            Length  XID     "
+                   "Rels\n");
+        for (int d = 0; d < 64; d++)
+          out.Append('-');
+        out.Append('\n');
+      }
+      for (const auto &rec : job.records)
+        WriteRecord(out, format, job.path, rec);
+    }
+
+    total_bytes += job.size;
+    total_parsed += job.parsed_count;
+    total_matched += job.records.size();
+    std::vector<WalRecordInfo>().swap(job.records);
+    reader.Retire(i + 1);
+  }
+  out.Flush();
+
+  for (auto &t : threads)
+    t.join();
+
+  if (hotspot_count) {
+    for (size_t t = 1; t < sketches.size(); t++)
+      sketches[0].Merge(sketches[t]);
+    WriteHotspots(out, format, sketches[0], hotspot_count);
+    out.Flush();
+  }
+  if (fpi_count) {
+    for (size_t t = 1; t < fpi_analyzers.size(); t++)
+      fpi_analyzers[0].Merge(fpi_analyzers[t]);
+    WriteFpiBloat(out, format, fpi_analyzers[0], fpi_count);
+    out.Flush();
+  }
+
+  if (!quiet) {
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start_time)
+                      .count();
+    fprintf(stderr,
+            "%zu files (%zu failed), %zu records, %zu matched, %.1f MB in "
+            "%.3f s (%.1f MB/s)\n",
+            file_jobs.size(), failed, total_parsed, total_matched,
+            total_bytes / (1024.0 * 1024.0), secs,
+            secs > 0 ? total_bytes / (1024.0 * 1024.0) / secs : 0.0);
+    double read_secs = reader.GetReadSeconds();
+    double read_mb = reader.GetBytesRead() / (1024.0 * 1024.0);
+    fprintf(stderr, "I/O: %s, %.1f MB read in %.3f s (%.1f MB/s)\n",
+            WalIoBackendName(reader.GetBackend()), read_mb, read_secs,
+            read_secs > 0 ? read_mb / read_secs : 0.0);
+  }
+  write_trace();
+
+  return failed == file_jobs.size() ? 1 : 0;
 }
@@ -0,0 +1,530 @@
+#include "wal_parser.h"
+#include "wal_synth.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Differential check of the parser against PostgreSQL's own decoder: every
+// segment is parsed here and by pg_waldump, and the records are compared
+// by LSN (xl_prev, resource manager, length, XID, block references and
+// whether they carry a page image). Both are timed, so the report also
+// shows how far apart they are in speed.
+
+static void PrintUsage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options] [file|dir]...\n"
+          "\n"
+          "Compares our parser with pg_waldump on WAL segment files and, "
+          "with\n"
+          "--generate, on synthetic segments.\n"
+          "\n"
+          "Options:\n"
+          "      --pg-waldump PATH  pg_waldump to run (default: from "
+          "pg_config)\n"
+          "      --generate N       Also compare N generated segments\n"
+          "                         (default 4 when no files are given)\n"
+          "      --seed N           Generator seed (default 42)\n"
+          "      --fpi RATIO        Generated page image share (default "
+          "0.05)\n"
+          "      --compression C    Generated page images: off, pglz, lz4, "
+          "zstd\n"
+          "      --keep DIR         Write generated segments to DIR and keep "
+          "them\n"
+          "      --max-diffs N      Differences shown per file (default 10)\n"
+          "  -h, --help             Show this help\n",
+          prog);
+}
+
+// pg_waldump's resource manager names, by RMID
+static const char *const waldump_rmgr_names[] = {
+    "XLOG",       "Transaction", "Storage", "CLOG",     "Database",
+    "Tablespace", "MultiXact",   "RelMap",  "Standby",  "Heap2",
+    "Heap",       "Btree",       "Hash",    "Gin",      "Gist",
+    "Sequence",   "SPGist",      "BRIN",    "CommitTs", "ReplicationOrigin",
+    "Generic",    "LogicalMessage"};
+
+static int WaldumpRmid(const char *name, size_t len) {
+  for (size_t i = 0;
+       i < sizeof(waldump_rmgr_names) / sizeof(waldump_rmgr_names[0]); i++)
+    if (strlen(waldump_rmgr_names[i]) == len &&
+        !strncmp(waldump_rmgr_names[i], name, len))
+      return (int)i;
+  return -1;
+}
+
+// One record as both sides report it.
+struct DiffRecord {
+  uint64_t LSN = 0;
+  uint64_t PrevLSN = 0;
+  int RMID = -1;
+  uint32_t Length = 0;
+  uint32_t XID = 0;
+  bool HasFPI = false;
+  std::vector<WalRelFileNode> Rels;
+};
+
+static bool ParseLSNAt(const char *s, uint64_t &out) {
+  unsigned hi, lo;
+  if (!s || sscanf(s, "%X/%X", &hi, &lo) != 2)
+    return false;
+  out = (uint64_t)hi << 32 | lo;
+  return true;
+}
+
+// A record line of pg_waldump's default output:
+//
+//   rmgr: Heap len (rec/tot): 59/ 59, tx: 740, lsn: 0/01000028, prev
+//   0/00000000, desc: INSERT off 2, blkref #0: rel 1663/5/16384 blk 0 FPW
+//
+// (one line; the spacing varies). The block reference format changed a
+// little between versions, so only "rel a/b/c" and "FPW" are relied on.
+static bool ParseWaldumpLine(const char *line, DiffRecord &rec) {
+  if (strncmp(line, "rmgr: ", 6))
+    return false;
+  const char *name = line + 6;
+  size_t name_len = strcspn(name, " ");
+  rec.RMID = WaldumpRmid(name, name_len);
+
+  const char *p = strstr(line, "len (rec/tot):");
+  unsigned rec_len, tot_len;
+  if (!p || sscanf(p + 14, "%u/%u", &rec_len, &tot_len) != 2)
+    return false;
+  rec.Length = tot_len;
+  p = strstr(line, "tx:");
+  if (!p || sscanf(p + 3, "%u", &rec.XID) != 1)
+    return false;
+  p = strstr(line, "lsn: ");
+  if (!p || !ParseLSNAt(p + 5, rec.LSN))
+    return false;
+  p = strstr(line, "prev ");
+  if (!p || !ParseLSNAt(p + 5, rec.PrevLSN))
+    return false;
+
+  // Block references follow the description
+  for (p = strstr(line, "blkref #"); p; p = strstr(p + 1, "blkref #")) {
+    const char *rel = strstr(p, "rel ");
+    const char *end = strstr(p + 1, "blkref #");
+    WalRelFileNode node;
+    if (rel && sscanf(rel + 4, "%u/%u/%u", &node.spcNode, &node.dbNode,
+                      &node.relNode) == 3) {
+      // "rel 1663/5/16384 fork vm blk 0"; the main fork isn't named
+      const char *fork = strstr(rel, " fork ");
+      if (fork && (!end || fork < end)) {
+        for (uint8_t f = 0; f < 4; f++) {
+          size_t n = strlen(WalForkName(f));
+          if (!strncmp(fork + 6, WalForkName(f), n) &&
+              !isalnum((unsigned char)fork[6 + n]))
+            node.forkNum = f;
+        }
+      }
+      const char *blk = strstr(rel, " blk ");
+      if (blk && (!end || blk < end))
+        sscanf(blk + 5, "%u", &node.blockNum);
+      rec.Rels.push_back(node);
+    }
+    const char *fpw = strstr(p, "FPW");
+    if (fpw && (!end || fpw < end))
+      rec.HasFPI = true;
+  }
+  return true;
+}
+
+struct WaldumpResult {
+  std::vector<DiffRecord> Records;
+  std::string Error; // pg_waldump's last message, e.g. where WAL ended
+  double Seconds = 0;
+};
+
+static std::string Quote(const std::string &s) {
+#ifdef _WIN32
+  return "\"" + s + "\"";
+#else
+  std::string out = "'";
+  for (char c : s)
+    out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return out + "'";
+#endif
+}
+
+// Runs pg_waldump over just this segment (it is both start and end
+// segment). Returns false if it couldn't be started.
+static bool RunWaldump(const std::string &waldump, const std::string &path,
+                       WaldumpResult &out) {
+  std::string cmd =
+      Quote(waldump) + " " + Quote(path) + " " + Quote(path) + " 2>&1";
+  auto t0 = std::chrono::steady_clock::now();
+  FILE *p = popen(cmd.c_str(), "r");
+  if (!p)
+    return false;
+  std::string line;
+  char buf[4096];
+  while (fgets(buf, sizeof(buf), p)) {
+    line += buf;
+    if (line.back() != '\n' && !feof(p))
+      continue; // Long line, read the rest
+    DiffRecord rec;
+    if (ParseWaldumpLine(line.c_str(), rec))
+      out.Records.push_back(std::move(rec));
+    else if (!strncmp(line.c_str(), "pg_waldump:", 11)) {
+      out.Error = line;
+      while (!out.Error.empty() && (out.Error.back() == '\n' ||
+                                    out.Error.back() == '\r'))
+        out.Error.pop_back();
+    }
+    line.clear();
+  }
+  pclose(p);
+  out.Seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+  return true;
+}
+
+static std::string FormatLSN(uint64_t lsn) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%X/%08X", (uint32_t)(lsn >> 32),
+           (uint32_t)lsn);
+  return buf;
+}
+
+static std::string FormatRels(const std::vector<WalRelFileNode> &rels) {
+  std::string s;
+  for (const WalRelFileNode &n : rels) {
+    if (!s.empty())
+      s += ",";
+    s += std::to_string(n.spcNode) + "/" + std::to_string(n.dbNode) + "/" +
+         std::to_string(n.relNode) + ":" + WalForkName(n.forkNum) + ":" +
+         std::to_string(n.blockNum);
+  }
+  return s.empty() ? "-" : s;
+}
+
+// Field by field differences of two records at the same LSN, empty if
+// they agree.
+static std::string CompareRecords(const DiffRecord &ours,
+                                  const DiffRecord &theirs) {
+  std::string diff;
+  auto add = [&](const char *field, const std::string &a,
+                 const std::string &b) {
+    diff += std::string(" ") + field + " " + a + " vs " + b;
+  };
+  if (ours.PrevLSN != theirs.PrevLSN)
+    add("prev", FormatLSN(ours.PrevLSN), FormatLSN(theirs.PrevLSN));
+  if (ours.RMID != theirs.RMID)
+    add("rmid", std::to_string(ours.RMID), std::to_string(theirs.RMID));
+  if (ours.Length != theirs.Length)
+    add("len", std::to_string(ours.Length), std::to_string(theirs.Length));
+  if (ours.XID != theirs.XID)
+    add("xid", std::to_string(ours.XID), std::to_string(theirs.XID));
+  if (ours.HasFPI != theirs.HasFPI)
+    add("fpi", ours.HasFPI ? "yes" : "no", theirs.HasFPI ? "yes" : "no");
+  bool rels_equal = ours.Rels.size() == theirs.Rels.size();
+  for (size_t i = 0; rels_equal && i < ours.Rels.size(); i++)
+    rels_equal = ours.Rels[i].spcNode == theirs.Rels[i].spcNode &&
+                 ours.Rels[i].dbNode == theirs.Rels[i].dbNode &&
+                 ours.Rels[i].relNode == theirs.Rels[i].relNode &&
+                 ours.Rels[i].forkNum == theirs.Rels[i].forkNum &&
+                 ours.Rels[i].blockNum == theirs.Rels[i].blockNum;
+  if (!rels_equal)
+    add("rels", FormatRels(ours.Rels), FormatRels(theirs.Rels));
+  return diff;
+}
+
+struct FileReport {
+  size_t Ours = 0, Theirs = 0, Matched = 0, Diffs = 0, Skipped = 0;
+  double OurSeconds = 0, TheirSeconds = 0;
+};
+
+static bool CompareFile(const std::string &waldump, const std::string &path,
+                        int max_diffs, FileReport &report) {
+  // --- Ours: read and parse, as the CLI does ---
+  auto t0 = std::chrono::steady_clock::now();
+  std::vector<uint8_t> data;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    fprintf(stderr, "%s: cannot open\n", path.c_str());
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data.resize(size > 0 ? (size_t)size : 0);
+  size_t got = fread(data.data(), 1, data.size(), f);
+  fclose(f);
+  data.resize(got);
+  WalParser parser;
+  std::string name = fs::path(path).filename().string();
+  parser.SetExpectedBaseLSN(
+      WalFileNameToLSN(name, WalSegmentSizeFromFileSize(data.size())));
+  std::vector<WalRecordInfo> parsed;
+  parser.Parse(data.data(), data.size(), parsed);
+  report.OurSeconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - t0)
+                          .count();
+
+  std::vector<DiffRecord> ours(parsed.size());
+  for (size_t i = 0; i < parsed.size(); i++) {
+    ours[i].LSN = parsed[i].LSN;
+    ours[i].PrevLSN = parsed[i].PrevLSN;
+    ours[i].RMID = parsed[i].RMID;
+    ours[i].Length = parsed[i].Length;
+    ours[i].XID = parsed[i].XID;
+    ours[i].HasFPI = parsed[i].HasFPI;
+    ours[i].Rels = parsed[i].RelFileNodes;
+  }
+
+  // --- pg_waldump ---
+  WaldumpResult theirs;
+  if (!RunWaldump(waldump, path, theirs)) {
+    fprintf(stderr, "%s: cannot run %s\n", path.c_str(), waldump.c_str());
+    return false;
+  }
+  report.TheirSeconds = theirs.Seconds;
+  report.Ours = ours.size();
+  report.Theirs = theirs.Records.size();
+
+  // --- Merge by LSN ---
+  printf("%s\n", path.c_str());
+  int shown = 0;
+  auto show = [&](const std::string &msg) {
+    report.Diffs++;
+    if (shown++ < max_diffs)
+      printf("  %s\n", msg.c_str());
+  };
+  // We show the start of a record that continues in the next segment;
+  // pg_waldump, stopping at the end of this one, can't decode it.
+  uint64_t seg_end = parser.GetEndLSN();
+  if (parser.GetEndReason() == WalEndReason::EndOfData && !ours.empty() &&
+      ours.back().LSN + ours.back().Length > seg_end &&
+      (theirs.Records.empty() ||
+       theirs.Records.back().LSN != ours.back().LSN)) {
+    ours.pop_back();
+    report.Skipped++;
+  }
+  size_t i = 0, j = 0;
+  while (i < ours.size() || j < theirs.Records.size()) {
+    if (j == theirs.Records.size() ||
+        (i < ours.size() && ours[i].LSN < theirs.Records[j].LSN)) {
+      show(FormatLSN(ours[i].LSN) + ": only in ours");
+      i++;
+    } else if (i == ours.size() || theirs.Records[j].LSN < ours[i].LSN) {
+      show(FormatLSN(theirs.Records[j].LSN) + ": only in pg_waldump");
+      j++;
+    } else {
+      std::string diff = CompareRecords(ours[i], theirs.Records[j]);
+      if (diff.empty())
+        report.Matched++;
+      else
+        show(FormatLSN(ours[i].LSN) + ":" + diff);
+      i++;
+      j++;
+    }
+  }
+  if (shown > max_diffs)
+    printf("  ... %d more\n", shown - max_diffs);
+
+  printf("  ours: %zu records, ends at %s (%s), %.1f ms\n", report.Ours,
+         FormatLSN(parser.GetEndLSN()).c_str(),
+         WalEndReasonName(parser.GetEndReason()), report.OurSeconds * 1e3);
+  if (report.Skipped)
+    printf("    last record continues in the next segment, not compared\n");
+  printf("  pg_waldump: %zu records, %.1f ms%s%s\n", report.Theirs,
+         report.TheirSeconds * 1e3, theirs.Error.empty() ? "" : "\n    ",
+         theirs.Error.c_str());
+  return true;
+}
+
+// Runs a command and returns the first line of its output.
+static std::string CommandOutput(const std::string &cmd) {
+  std::string out;
+  FILE *p = popen(cmd.c_str(), "r");
+  if (!p)
+    return out;
+  char buf[1024];
+  if (fgets(buf, sizeof(buf), p))
+    out = buf;
+  pclose(p);
+  while (!out.empty() && (out.back() == '\n' || out.back() == '\r'))
+    out.pop_back();
+  return out;
+}
+
+int main(int argc, char **argv) {
+  std::string waldump;
+  std::vector<std::string> inputs;
+  int generate = -1;
+  int max_diffs = 10;
+  const char *keep_dir = nullptr;
+  WalSynthOptions options;
+  options.Seed = 42;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    auto next = [&](const char *opt) -> const char * {
+      if (i + 1 >= argc) {
+        fprintf(stderr, "Error: %s requires an argument\n", opt);
+        exit(1);
+      }
+      return argv[++i];
+    };
+
+    if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+      PrintUsage(argv[0]);
+      return 0;
+    } else if (!strcmp(arg, "--pg-waldump")) {
+      waldump = next(arg);
+    } else if (!strcmp(arg, "--generate")) {
+      generate = atoi(next(arg));
+    } else if (!strcmp(arg, "--seed")) {
+      options.Seed = strtoull(next(arg), nullptr, 10);
+    } else if (!strcmp(arg, "--fpi")) {
+      options.FpiRatio = atof(next(arg));
+    } else if (!strcmp(arg, "--compression")) {
+      const char *v = next(arg);
+      bool found = false;
+      for (WalFpiCompression c :
+           {WalFpiCompression::None, WalFpiCompression::Pglz,
+            WalFpiCompression::Lz4, WalFpiCompression::Zstd}) {
+        if (!strcmp(v, WalFpiCompressionName(c))) {
+          options.FpiCompression = c;
+          found = true;
+        }
+      }
+      if (!found || !WalFpiCompressionAvailable(options.FpiCompression)) {
+        fprintf(stderr, "Error: compression '%s' not available\n", v);
+        return 1;
+      }
+    } else if (!strcmp(arg, "--keep")) {
+      keep_dir = next(arg);
+    } else if (!strcmp(arg, "--max-diffs")) {
+      max_diffs = atoi(next(arg));
+    } else if (arg[0] == '-' && arg[1] != 0) {
+      fprintf(stderr, "Error: unknown option '%s'\n", arg);
+      PrintUsage(argv[0]);
+      return 1;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (generate < 0)
+    generate = inputs.empty() ? 4 : 0;
+
+  // The PostgreSQL that pg_config finds, as the build does for libpq
+  if (waldump.empty()) {
+    std::string bindir = CommandOutput("pg_config --bindir");
+    if (bindir.empty()) {
+      fprintf(stderr, "Error: pg_config not found, use --pg-waldump\n");
+      return 2;
+    }
+    waldump = (fs::path(bindir) / "pg_waldump").string();
+  }
+  std::string version = CommandOutput(Quote(waldump) + " --version");
+  if (version.empty()) {
+    fprintf(stderr, "Error: cannot run %s\n", waldump.c_str());
+    return 2;
+  }
+  printf("%s\n", version.c_str());
+
+  std::vector<std::string> files;
+  for (const std::string &in : inputs) {
+    std::error_code ec;
+    if (fs::is_directory(in, ec)) {
+      std::vector<std::string> dir_files;
+      for (const fs::directory_entry &e : fs::directory_iterator(in, ec))
+        if (e.is_regular_file() &&
+            WalFileNameToLSN(e.path().filename().string(), 16 << 20) != 0)
+          dir_files.push_back(e.path().string());
+      std::sort(dir_files.begin(), dir_files.end());
+      files.insert(files.end(), dir_files.begin(), dir_files.end());
+    } else {
+      files.push_back(in);
+    }
+  }
+
+  // Generated segments in the format of the pg_waldump being compared to
+  fs::path gen_dir;
+  if (generate > 0) {
+    int major = 0;
+    const char *v = strstr(version.c_str(), ") ");
+    if (v)
+      major = atoi(v + 2);
+    uint16_t magic = WalPageMagicForVersion(major);
+    if (!magic) {
+      fprintf(stderr, "Error: can't generate WAL for %s\n", version.c_str());
+      return 2;
+    }
+    options.PageMagic = magic;
+    gen_dir = keep_dir ? fs::path(keep_dir)
+                       : fs::temp_directory_path() /
+                             ("wal_waldump_diff_" + std::to_string(getpid()));
+    std::error_code ec;
+    fs::create_directories(gen_dir, ec);
+    WalSynthGenerator gen(options);
+    std::vector<uint8_t> seg;
+    for (int i = 0; i < generate; i++) {
+      fs::path path = gen_dir / gen.NextSegmentName();
+      gen.NextSegment(seg);
+      FILE *f = fopen(path.string().c_str(), "wb");
+      if (!f || fwrite(seg.data(), 1, seg.size(), f) != seg.size()) {
+        fprintf(stderr, "Error: cannot write %s\n", path.string().c_str());
+        if (f)
+          fclose(f);
+        return 2;
+      }
+      fclose(f);
+      files.push_back(path.string());
+    }
+  }
+
+  if (files.empty()) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  FileReport total;
+  bool ok = true;
+  for (const std::string &path : files) {
+    FileReport r;
+    if (!CompareFile(waldump, path, max_diffs, r)) {
+      ok = false;
+      continue;
+    }
+    total.Ours += r.Ours;
+    total.Theirs += r.Theirs;
+    total.Matched += r.Matched;
+    total.Diffs += r.Diffs;
+    total.Skipped += r.Skipped;
+    total.OurSeconds += r.OurSeconds;
+    total.TheirSeconds += r.TheirSeconds;
+  }
+
+  if (!gen_dir.empty() && !keep_dir) {
+    std::error_code ec;
+    fs::remove_all(gen_dir, ec);
+  }
+
+  printf("\n%zu files: %zu records matched, %zu differences "
+         "(%zu ours, %zu pg_waldump, %zu cut off)\n",
+         files.size(), total.Matched, total.Diffs, total.Ours, total.Theirs,
+         total.Skipped);
+  printf("time: ours %.1f ms, pg_waldump %.1f ms (%.1fx)\n",
+         total.OurSeconds * 1e3, total.TheirSeconds * 1e3,
+         total.OurSeconds > 0 ? total.TheirSeconds / total.OurSeconds : 0.0);
+  return ok && total.Diffs == 0 ? 0 : 1;
+}
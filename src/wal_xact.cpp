@@ -0,0 +1,272 @@
+#include "wal_xact.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// xl_xact_xinfo flags
+#define XACT_XINFO_HAS_DBINFO (1u << 0)
+#define XACT_XINFO_HAS_SUBXACTS (1u << 1)
+#define XACT_XINFO_HAS_RELFILELOCATORS (1u << 2)
+#define XACT_XINFO_HAS_INVALS (1u << 3)
+#define XACT_XINFO_HAS_TWOPHASE (1u << 4)
+#define XACT_XINFO_HAS_ORIGIN (1u << 5)
+#define XACT_XINFO_HAS_GID (1u << 7)
+#define XACT_XINFO_HAS_DROPPED_STATS (1u << 8)
+
+#define SizeOfRelFileLocator 12
+#define SizeOfSharedInvalidationMessage 16
+#define SizeOfXactOrigin 16
+// Seconds from 1970-01-01 to 2000-01-01
+#define POSTGRES_EPOCH_OFFSET 946684800ll
+
+const char *WalXactOutcomeName(WalXactOutcome outcome) {
+  switch (outcome) {
+  case WalXactOutcome::InProgress:
+    return "in progress";
+  case WalXactOutcome::Committed:
+    return "committed";
+  case WalXactOutcome::Aborted:
+    return "aborted";
+  case WalXactOutcome::Prepared:
+    return "prepared";
+  }
+  return "?";
+}
+
+int64_t WalTimestampToUnixMicros(int64_t timestamp) {
+  return timestamp + POSTGRES_EPOCH_OFFSET * 1000000;
+}
+
+int64_t WalTimestampFromUnixMicros(int64_t us) {
+  return us - POSTGRES_EPOCH_OFFSET * 1000000;
+}
+
+std::string WalFormatTimestamp(int64_t timestamp) {
+  int64_t us = WalTimestampToUnixMicros(timestamp);
+  time_t secs = (time_t)(us >= 0 ? us / 1000000 : (us - 999999) / 1000000);
+  struct tm tm;
+#ifdef _WIN32
+  localtime_s(&tm, &secs);
+#else
+  localtime_r(&secs, &tm);
+#endif
+  char buf[48];
+  size_t n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+  snprintf(buf + n, sizeof(buf) - n, ".%06lld",
+           (long long)(us - (int64_t)secs * 1000000));
+  return buf;
+}
+
+namespace {
+
+struct BodyReader {
+  const uint8_t *Data;
+  uint32_t Length;
+  uint32_t Pos = 0;
+
+  bool Get(void *dst, uint32_t n) {
+    if (Length - Pos < n)
+      return false;
+    memcpy(dst, Data + Pos, n);
+    Pos += n;
+    return true;
+  }
+  bool Skip(uint64_t n) {
+    if (Length - Pos < n)
+      return false;
+    Pos += (uint32_t)n;
+    return true;
+  }
+  // A count followed by that many items of item_size bytes
+  bool SkipArray(uint32_t item_size, uint32_t *count = nullptr) {
+    int32_t n;
+    if (!Get(&n, 4) || n < 0)
+      return false;
+    if (count)
+      *count = (uint32_t)n;
+    return Skip((uint64_t)n * item_size);
+  }
+};
+
+// Parts follow each other in the order of the xinfo flags, see
+// ParseCommitRecord() and ParseAbortRecord(). Dropped statistics items
+// grew from 12 to 16 bytes in PostgreSQL 18, so the caller tries both:
+// only the right size ends exactly at the end of the body.
+bool ParseEnd(const WalDecodedRecord &rec, uint32_t stats_item_size,
+              WalXactEnd &out) {
+  BodyReader r = {rec.MainData, rec.MainDataLength};
+  out.Xid = rec.XID;
+  out.Database = 0;
+  out.Relations = 0;
+  out.Subxacts.clear();
+  out.Gid.clear();
+  if (!r.Get(&out.Time, 8))
+    return false;
+  uint32_t xinfo = 0;
+  if ((rec.Info & XLOG_XACT_HAS_INFO) && !r.Get(&xinfo, 4))
+    return false;
+  if (xinfo & XACT_XINFO_HAS_DBINFO) {
+    if (!r.Get(&out.Database, 4) || !r.Skip(4))
+      return false;
+  }
+  if (xinfo & XACT_XINFO_HAS_SUBXACTS) {
+    int32_t n;
+    if (!r.Get(&n, 4) || n < 0 || (uint64_t)n * 4 > r.Length - r.Pos)
+      return false;
+    out.Subxacts.resize(n);
+    r.Get(out.Subxacts.data(), (uint32_t)n * 4);
+  }
+  if ((xinfo & XACT_XINFO_HAS_RELFILELOCATORS) &&
+      !r.SkipArray(SizeOfRelFileLocator, &out.Relations))
+    return false;
+  if ((xinfo & XACT_XINFO_HAS_DROPPED_STATS) && !r.SkipArray(stats_item_size))
+    return false;
+  if ((xinfo & XACT_XINFO_HAS_INVALS) &&
+      !r.SkipArray(SizeOfSharedInvalidationMessage))
+    return false;
+  if ((xinfo & XACT_XINFO_HAS_TWOPHASE) && !r.Get(&out.Xid, 4))
+    return false;
+  if (xinfo & XACT_XINFO_HAS_GID) {
+    const uint8_t *start = r.Data + r.Pos;
+    const void *nul = memchr(start, 0, r.Length - r.Pos);
+    if (!nul)
+      return false;
+    out.Gid.assign((const char *)start, (const uint8_t *)nul - start);
+    r.Skip(out.Gid.size() + 1);
+  }
+  if ((xinfo & XACT_XINFO_HAS_ORIGIN) && !r.Skip(SizeOfXactOrigin))
+    return false;
+  // Without xinfo nothing says how long the body is
+  return !xinfo || r.Pos == r.Length;
+}
+
+} // namespace
+
+bool WalDecodeXactEnd(const WalDecodedRecord &rec, WalXactEnd &out) {
+  if (rec.RMID != RM_XACT_ID)
+    return false;
+  switch (rec.Info & XLOG_XACT_OPMASK) {
+  case XLOG_XACT_COMMIT:
+  case XLOG_XACT_COMMIT_PREPARED:
+    out.Outcome = WalXactOutcome::Committed;
+    break;
+  case XLOG_XACT_ABORT:
+  case XLOG_XACT_ABORT_PREPARED:
+    out.Outcome = WalXactOutcome::Aborted;
+    break;
+  case XLOG_XACT_PREPARE: {
+    // TwoPhaseFileHeader: magic, total_len, xid, database, prepared_at, ...
+    out.Outcome = WalXactOutcome::Prepared;
+    out.Relations = 0;
+    out.Subxacts.clear();
+    out.Gid.clear();
+    if (rec.MainDataLength < 24)
+      return false;
+    memcpy(&out.Xid, rec.MainData + 8, 4);
+    memcpy(&out.Database, rec.MainData + 12, 4);
+    memcpy(&out.Time, rec.MainData + 16, 8);
+    return true;
+  }
+  default:
+    return false;
+  }
+  return ParseEnd(rec, 12, out) || ParseEnd(rec, 16, out);
+}
+
+void WalXactIndex::Clear() { xacts_.clear(); }
+
+void WalXactIndex::End(uint32_t xid, WalXactOutcome outcome, int64_t time,
+                       uint64_t lsn) {
+  WalXactStatus &s = xacts_[xid];
+  s.Outcome = outcome;
+  s.Time = time;
+  s.EndLSN = lsn;
+}
+
+void WalXactIndex::Add(const WalRecordInfo &info, const uint8_t *record,
+                       uint32_t length) {
+  if (info.XID != 0) {
+    WalXactStatus &s = xacts_[info.XID];
+    if (s.Records++ == 0)
+      s.FirstLSN = info.LSN;
+  }
+  if (info.RMID != RM_XACT_ID || !record ||
+      !WalDecodeRecord(record, length, decoded_))
+    return;
+
+  if ((info.Info & XLOG_XACT_OPMASK) == XLOG_XACT_ASSIGNMENT) {
+    // xl_xact_assignment: xtop, nsubxacts, xsub[]
+    uint32_t top;
+    int32_t n;
+    if (decoded_.MainDataLength < 8)
+      return;
+    memcpy(&top, decoded_.MainData, 4);
+    memcpy(&n, decoded_.MainData + 4, 4);
+    if (n < 0 || (uint64_t)n * 4 > decoded_.MainDataLength - 8)
+      return;
+    for (int32_t i = 0; i < n; i++) {
+      uint32_t sub;
+      memcpy(&sub, decoded_.MainData + 8 + i * 4, 4);
+      xacts_[sub].Top = top;
+    }
+    return;
+  }
+  if (!WalDecodeXactEnd(decoded_, end_))
+    return;
+  End(end_.Xid, end_.Outcome, end_.Time, info.LSN);
+  for (uint32_t sub : end_.Subxacts) {
+    End(sub, end_.Outcome, end_.Time, info.LSN);
+    xacts_[sub].Top = end_.Xid;
+  }
+}
+
+const WalXactStatus *WalXactIndex::Find(uint32_t xid) const {
+  auto it = xacts_.find(xid);
+  if (it == xacts_.end())
+    return nullptr;
+  // Assigned to a parent but not ended with it yet
+  const WalXactStatus *s = &it->second;
+  if (s->Outcome == WalXactOutcome::InProgress && s->Top != 0) {
+    auto top = xacts_.find(s->Top);
+    if (top != xacts_.end() &&
+        top->second.Outcome != WalXactOutcome::InProgress)
+      return &top->second;
+  }
+  return s;
+}
+
+WalXactOutcome WalXactIndex::Outcome(uint32_t xid) const {
+  const WalXactStatus *s = Find(xid);
+  return s ? s->Outcome : WalXactOutcome::InProgress;
+}
+
+std::vector<std::pair<uint32_t, WalXactStatus>>
+WalXactIndex::InFlight() const {
+  std::vector<std::pair<uint32_t, WalXactStatus>> open;
+  for (const auto &kv : xacts_) {
+    const WalXactStatus &s = kv.second;
+    if (s.Records == 0 || s.Top != 0)
+      continue;
+    if (s.Outcome == WalXactOutcome::InProgress ||
+        s.Outcome == WalXactOutcome::Prepared)
+      open.push_back(kv);
+  }
+  std::sort(open.begin(), open.end(), [](const auto &a, const auto &b) {
+    return a.second.FirstLSN < b.second.FirstLSN;
+  });
+  return open;
+}
+
+size_t WalXactIndex::Count(WalXactOutcome outcome) const {
+  size_t n = 0;
+  for (const auto &kv : xacts_)
+    n += kv.second.Top == 0 && kv.second.Outcome == outcome;
+  return n;
+}
+
+size_t WalXactIndex::MemoryUsage() const {
+  // Rough for the hash map: a node per transaction plus the bucket array
+  return xacts_.size() * (sizeof(WalXactStatus) + 4 + 2 * sizeof(void *)) +
+         xacts_.bucket_count() * sizeof(void *);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "wal_parser.h"
+#include "wal_record_decode.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Transaction records: what the commit, abort and prepare records say, and
+// an index of every transaction's fate built from them in one pass over
+// the records, so each row can be told whether its transaction committed.
+
+#define XLOG_XACT_COMMIT_PREPARED 0x30
+#define XLOG_XACT_ABORT_PREPARED 0x40
+#define XLOG_XACT_ASSIGNMENT 0x50
+#define XLOG_XACT_INVALIDATIONS 0x60
+#define XLOG_XACT_OPMASK 0x70
+#define XLOG_XACT_HAS_INFO 0x80
+
+enum class WalXactOutcome : uint8_t {
+  InProgress, // No commit or abort seen (yet)
+  Committed,
+  Aborted,
+  Prepared // Two-phase, waiting for COMMIT/ROLLBACK PREPARED
+};
+const char *WalXactOutcomeName(WalXactOutcome outcome);
+
+// PostgreSQL timestamps count microseconds from 2000-01-01 UTC.
+int64_t WalTimestampToUnixMicros(int64_t timestamp);
+int64_t WalTimestampFromUnixMicros(int64_t us);
+// "2024-01-31 14:03:27.123456" in local time.
+std::string WalFormatTimestamp(int64_t timestamp);
+
+// The body of a commit or abort record (xl_xact_commit, xl_xact_abort,
+// also for prepared transactions) or of a PREPARE.
+struct WalXactEnd {
+  WalXactOutcome Outcome;
+  uint32_t Xid;       /* The transaction it ends, prepared ones included */
+  int64_t Time;       /* xact_time, or prepared_at of a PREPARE */
+  uint32_t Database;  /* 0 if not recorded */
+  uint32_t Relations; /* Files dropped with it */
+  std::vector<uint32_t> Subxacts; /* Committed (or aborted) with it */
+  std::string Gid;    /* Of a prepared transaction */
+};
+
+// False for other records and bodies that don't add up.
+bool WalDecodeXactEnd(const WalDecodedRecord &rec, WalXactEnd &out);
+
+struct WalXactStatus {
+  WalXactOutcome Outcome = WalXactOutcome::InProgress;
+  uint32_t Top = 0;      /* Parent of a subtransaction, when known */
+  int64_t Time = 0;      /* Of the commit, abort or prepare */
+  uint64_t EndLSN = 0;   /* Of that record */
+  uint64_t FirstLSN = 0; /* First record of it seen, 0 if none */
+  uint32_t Records = 0;  /* Records carrying its XID */
+};
+
+class WalXactIndex {
+public:
+  void Clear();
+  // Records go in LSN order. The record's bytes (from the XLogRecord
+  // header on) are only looked at for RM_XACT_ID records; without them
+  // those count as plain records.
+  void Add(const WalRecordInfo &info, const uint8_t *record,
+           uint32_t length);
+
+  // Nullptr if xid never came up. A subtransaction shares its parent's
+  // outcome once that is known.
+  const WalXactStatus *Find(uint32_t xid) const;
+  WalXactOutcome Outcome(uint32_t xid) const;
+
+  // Transactions with records but no commit or abort, prepared ones
+  // included, by first LSN. Subtransactions known to belong to one of
+  // them are left out.
+  std::vector<std::pair<uint32_t, WalXactStatus>> InFlight() const;
+  // Transactions by outcome, subtransactions not counted.
+  size_t Count(WalXactOutcome outcome) const;
+  size_t Size() const { return xacts_.size(); }
+  size_t MemoryUsage() const;
+
+private:
+  void End(uint32_t xid, WalXactOutcome outcome, int64_t time, uint64_t lsn);
+
+  std::unordered_map<uint32_t, WalXactStatus> xacts_;
+  WalDecodedRecord decoded_;
+  WalXactEnd end_;
+};